@@ -0,0 +1,193 @@
+//
+//  DTBlob.cpp
+//  FileNVRAM
+//
+//  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+//
+// This work is licensed under the
+//  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+//  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+//
+
+#include "DTBlob.h"
+#include <libkern/c++/OSBoolean.h>
+#include <libkern/c++/OSCollectionIterator.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSString.h>
+#include <libkern/c++/OSSymbol.h>
+#include <libkern/zlib.h>
+
+/**
+ ** The stamp has to match adler32_update(ADLER32_INIT, ...) in module/adler32.h, which is zlib's Adler-32,
+ ** so use the copy of zlib the kernel already exports rather than carrying another one.
+ **/
+static inline UInt32 blobAdler32(const void* buffer, size_t length)
+{
+    return (UInt32)adler32(1, (const Bytef*)buffer, (uInt)length);
+}
+
+/**
+ ** The module doesn't decode entities, so names and strings are stored escaped exactly like OSSerialize writes them.
+ **/
+static inline size_t blobEscapedLength(const char* string)
+{
+    size_t length = 0;
+
+    for(; *string; string++)
+    {
+        switch(*string)
+        {
+            case '<':   length += 4; break;     // &lt;
+            case '>':   length += 4; break;     // &gt;
+            case '&':   length += 5; break;     // &amp;
+            default:    length += 1; break;
+        }
+    }
+
+    return length;
+}
+
+static inline bool blobAppendEscaped(OSData* blob, const char* string)
+{
+    const char* run = string;
+
+    for(; *string; string++)
+    {
+        const char* entity;
+
+        switch(*string)
+        {
+            case '<':   entity = "&lt;";    break;
+            case '>':   entity = "&gt;";    break;
+            case '&':   entity = "&amp;";   break;
+            default:    continue;
+        }
+
+        if(!blob->appendBytes(run, (unsigned int)(string - run)) ||
+           !blob->appendBytes(entity, (unsigned int)strlen(entity)))
+        {
+            return false;
+        }
+        run = string + 1;
+    }
+
+    return blob->appendBytes(run, (unsigned int)(string - run));
+}
+
+static inline bool blobPad(OSData* blob)
+{
+    static const UInt8 zero[4] = { 0 };
+    unsigned int pad = (4 - (blob->getLength() & 3)) & 3;
+
+    return !pad || blob->appendBytes(zero, pad);
+}
+
+/** Append a record header and its name, the caller appends valueLength bytes of value. **/
+static inline bool blobAppendRecord(OSData* blob, UInt8 type, const char* name, UInt32 valueLength)
+{
+    NVRAMBlobRecord record;
+    size_t nameLength = blobEscapedLength(name) + 1;
+
+    if(nameLength > 0xFFFF) return false;
+
+    record.type         = type;
+    record.reserved     = 0;
+    record.nameLength   = (UInt16)nameLength;
+    record.valueLength  = valueLength;
+
+    return blob->appendBytes(&record, sizeof(record)) &&
+           blobAppendEscaped(blob, name) &&
+           blob->appendByte(0, 1);
+}
+
+static inline bool blobAppendProperty(OSData* blob, const char* name, const void* value, UInt32 length)
+{
+    return blobAppendRecord(blob, NVRAM_DTBLOB_PROPERTY, name, length) &&
+           (!length || blob->appendBytes(value, length)) &&
+           blobPad(blob);
+}
+
+/**
+ ** Mirrors the module's processDict: data and strings are copied, integers and booleans become 32bit values,
+ ** dictionaries become child nodes and anything else is dropped.
+ **/
+static inline bool blobAppendDictionary(OSData* blob, OSDictionary* dict)
+{
+    OSCollectionIterator* iter = OSCollectionIterator::withCollection(dict);
+    const OSSymbol* key;
+    bool ok = true;
+
+    if(!iter) return false;
+
+    while(ok && (key = OSDynamicCast(OSSymbol, iter->getNextObject())))
+    {
+        const char* name = key->getCStringNoCopy();
+        OSObject* value = dict->getObject(key);
+        OSData* data;
+        OSString* string;
+        OSNumber* number;
+        OSBoolean* boolean;
+        OSDictionary* child;
+
+        if((data = OSDynamicCast(OSData, value)))
+        {
+            ok = blobAppendProperty(blob, name, data->getBytesNoCopy(), data->getLength());
+        }
+        else if((string = OSDynamicCast(OSString, value)))
+        {
+            const char* text = string->getCStringNoCopy();
+            ok = blobAppendRecord(blob, NVRAM_DTBLOB_PROPERTY, name, (UInt32)blobEscapedLength(text)) &&
+                 blobAppendEscaped(blob, text) &&
+                 blobPad(blob);
+        }
+        else if((number = OSDynamicCast(OSNumber, value)))
+        {
+            UInt32 integer = number->unsigned32BitValue();
+            ok = blobAppendProperty(blob, name, &integer, sizeof(integer));
+        }
+        else if((boolean = OSDynamicCast(OSBoolean, value)))
+        {
+            UInt32 integer = boolean->isTrue();
+            ok = blobAppendProperty(blob, name, &integer, sizeof(integer));
+        }
+        else if((child = OSDynamicCast(OSDictionary, value)))
+        {
+            ok = blobAppendRecord(blob, NVRAM_DTBLOB_NODE, name, 0) &&
+                 blobPad(blob) &&
+                 blobAppendDictionary(blob, child) &&
+                 blobAppendRecord(blob, NVRAM_DTBLOB_END, "", 0) &&
+                 blobPad(blob);
+        }
+    }
+
+    iter->release();
+    return ok;
+}
+
+/**
+ ** Flatten the dictionary written to the nvram file. stamp is the Adler-32 of the file's contents,
+ ** the module only uses the blob if it matches the file it reads.
+ **/
+static inline OSData* blobCreate(OSDictionary* dict, UInt32 stamp)
+{
+    NVRAMBlobHeader header;
+    OSData* blob = OSData::withCapacity(4096);
+
+    if(!blob) return NULL;
+
+    bzero(&header, sizeof(header));
+    header.magic    = NVRAM_DTBLOB_MAGIC;
+    header.version  = NVRAM_DTBLOB_VERSION;
+    header.stamp    = stamp;
+
+    if(!blob->appendBytes(&header, sizeof(header)) || !blobAppendDictionary(blob, dict))
+    {
+        blob->release();
+        return NULL;
+    }
+
+    // Patch in the final length.
+    ((NVRAMBlobHeader*)blob->getBytesNoCopy())->length = blob->getLength();
+
+    return blob;
+}
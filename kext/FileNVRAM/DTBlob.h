@@ -0,0 +1,52 @@
+//
+//  DTBlob.h
+//  FileNVRAM
+//
+//  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+//
+// This work is licensed under the
+//  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+//  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+//
+
+#ifndef __FileNVRAM__DTBlob__
+#define __FileNVRAM__DTBlob__
+
+#include <libkern/OSTypes.h>
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSDictionary.h>
+
+/**
+ ** Pre-flattened copy of the /chosen/nvram subtree the module builds from the nvram file, so the next boot can
+ ** inject it without parsing XML. The layout is shared with the FileNVRAM module, see module/dtblob.h
+ **/
+#define NVRAM_DTBLOB_MAGIC          0x42544446      /* 'FDTB' */
+#define NVRAM_DTBLOB_VERSION        1
+
+/* Record types */
+#define NVRAM_DTBLOB_NODE           1               /* child node, followed by its records and an END */
+#define NVRAM_DTBLOB_PROPERTY       2
+#define NVRAM_DTBLOB_END            3
+
+typedef struct
+{
+    UInt32  magic;
+    UInt16  version;
+    UInt16  reserved;
+    UInt32  length;         /* total, including this header */
+    UInt32  stamp;          /* Adler-32 of the nvram file the blob was built with */
+} __attribute__((packed)) NVRAMBlobHeader;
+
+/* Each record is followed by its nul terminated name and its value, then padded to 4 bytes. */
+typedef struct
+{
+    UInt8   type;
+    UInt8   reserved;
+    UInt16  nameLength;     /* including the nul */
+    UInt32  valueLength;
+} __attribute__((packed)) NVRAMBlobRecord;
+
+static inline UInt32 blobAdler32(const void* buffer, size_t length);
+static inline OSData* blobCreate(OSDictionary* dict, UInt32 stamp);
+
+#endif /* defined(__FileNVRAM__DTBlob__) */
@@ -18,6 +18,9 @@
 #include <libkern/c++/OSUnserialize.h>
 /** The cpp file is included here to hide symbol names. **/
 #include "Support.cpp"
+#include "Statistics.cpp"
+#include "Timeline.cpp"
+#include "DTBlob.cpp"
 
 
 /** Private Macros **/
@@ -47,10 +50,26 @@ void FileNVRAM::setPath(OSString* path)
     mFilePath = path;
 }
 
+void FileNVRAM::setVolume(OSString* volume)
+{
+    OSSafeReleaseNULL(mVolume);
+    volume->retain();
+    LOG(NOTICE, "Setting bootloader volume to %s\n", volume->getCStringNoCopy());
+    mVolume = volume;
+}
+
+void FileNVRAM::setPatchCache(OSData* cache)
+{
+    OSSafeReleaseNULL(mPatchCache);
+    mPatchCache = OSData::withData(cache);
+    LOG(NOTICE, "Bootloader built a new kernel patch cache (%d bytes)\n", cache->getLength());
+}
+
 bool FileNVRAM::start(IOService *provider)
 {
     char peBuf[256];
     mReadOnly      = false;
+    mLazyLoad      = false;
     bool earlyInit = false;
     bool debug     = false;
 
@@ -88,9 +107,15 @@ bool FileNVRAM::start(IOService *provider)
           FileNVRAM_NEWYEAR);
     
     mFilePath       = NULL;         // no know file
+    mVolume         = NULL;         // bootloader volume, passed in by the module
+    mPatchCache     = NULL;         // new kernel patch cache, passed in by the module
     mLoggingLevel   = debug ? NOTICE : DISABLED; // start with logging disabled, can be update for debug
     mInitComplete   = false;        // Don't resync anything that's already in the file system.
     mSafeToSync     = false;        // Don't sync untill later
+    statsReset(&mStatistics);
+    timelineReset(&mTimeline);
+    mTimelineBase   = statsTimestamp();
+    mTimerStart     = 0;
 
     // We should be root right now... cache this for later.
     mCtx            = vfs_context_current();
@@ -110,19 +135,31 @@ bool FileNVRAM::start(IOService *provider)
     mCommandGate = IOCommandGate::commandGate( this, dispatchCommand );
     getWorkLoop()->addEventSource( mCommandGate );
 
-    // Replace the IOService dicionary with an empty one, clean out variables we don't want.
-    OSDictionary* dict = OSDictionary::withCapacity(1);
+    // Replace the IOService dicionary with one holding only the bootloader's variables, clean out variables we don't want.
+    // The table is sized up front and filled before it is published, so restoring never grows it under the registry lock.
+    OSDictionary* dict = OSDictionary::withCapacity(bootnvram ? countEntryProperties(bootnvram) + 1 : 1);
     if(!dict) return false;
-    setPropertyTable(dict);
-
 
     if(bootnvram)
     {
-        copyEntryProperties(NULL, bootnvram);
+        char key[NVRAM_KEY_BUFFER_SIZE];
+        UInt64 restoreStart = statsTimestamp();
+
+        key[0] = 0;
+        copyEntryProperties(key, 0, bootnvram, dict);
         bootnvram->detachFromParent(root, gIODTPlane);
+
+        statsAdd(&mStatistics.restoreTime, statsElapsed(restoreStart));
+        recordPhase(TIMELINE_KEXT_DT_IMPORT, restoreStart);
     }
 
-    if(mReadOnly)
+    setPropertyTable(dict);
+    dict->release();
+
+    recordPhase(TIMELINE_KEXT_START, mTimelineBase);
+
+    // In lazy mode the bootloader only passed the early variables, so even read only we need the file.
+    if(mReadOnly && !mLazyLoad)
     {
         // we assume that the bootloader has done its job
         // i.e. populate /chosen/nvram
@@ -138,6 +175,7 @@ bool FileNVRAM::start(IOService *provider)
         if(mTimer)
         {
             getWorkLoop()->addEventSource( mTimer);
+            mTimerStart = statsTimestamp();
             mTimer->setTimeoutMS(50); // callback isn't being setup right, causes a panic
             mSafeToSync = false;
         }
@@ -162,6 +200,8 @@ bool FileNVRAM::start(IOService *provider)
 
 void FileNVRAM::registerNVRAM()
 {
+    UInt64 registerStart = statsTimestamp();
+
     // Create entry in device tree -> IODeviceTree:/options
     setName("AppleEFINVRAM");
     setName("options", gIODTPlane);
@@ -176,11 +216,16 @@ void FileNVRAM::registerNVRAM()
         callPlatformFunction(funcSym, false, this, NULL, NULL, NULL);
         funcSym->release();
     }
+
+    recordPhase(TIMELINE_KEXT_REGISTER, registerStart);
+    publishTimeline();
 }
 
 void FileNVRAM::stop(IOService *provider)
 {
     OSSafeReleaseNULL(mFilePath);
+    OSSafeReleaseNULL(mVolume);
+    OSSafeReleaseNULL(mPatchCache);
 
     if(mTimer)
     {
@@ -203,9 +248,9 @@ void FileNVRAM::stop(IOService *provider)
     LOG(NOTICE, "Stop has passed the detach point.. move along now\n");
 }
 
-void FileNVRAM::copyUnserialzedData(const char* prefix, OSDictionary* dict)
+void FileNVRAM::copyUnserialzedData(char* key, size_t keyLength, OSDictionary* dict, OSDictionary* table)
 {
-    const OSSymbol* key;
+    const OSSymbol* name;
 
     if(!dict) return;
 
@@ -213,121 +258,227 @@ void FileNVRAM::copyUnserialzedData(const char* prefix, OSDictionary* dict)
 
     if(!iter) return;
 
-    if(!prefix) LOG(INFO, "Restoring nvram data from file.\n");
-    do
+    if(!keyLength) LOG(INFO, "Restoring nvram data from file.\n");
+    while((name = OSDynamicCast(OSSymbol, iter->getNextObject())))
     {
-        key = (const OSSymbol *)iter->getNextObject();
-        if(key)
-        {
-            const char* name = key->getCStringNoCopy();
-            OSObject* object = dict->getObject(name);
-            
-            if(prefix)
-            {
-                size_t size = strlen(prefix) + strlen(NVRAM_SEPERATOR) + strlen(key->getCStringNoCopy()) +1;
-                char* newKey = (char*)IOMalloc(size);
+        OSObject* object = dict->getObject(name);
+        size_t length = appendKey(key, keyLength, name->getCStringNoCopy());
 
-                snprintf(newKey, size, "%s%s%s", prefix, NVRAM_SEPERATOR, key->getCStringNoCopy());
-
-                setProperty(OSSymbol::withCString(newKey), object);
+        if(!object) continue;
+        if(!length)
+        {
+            LOG(ERROR, "Key %s is too long, ignoring\n", name->getCStringNoCopy());
+            continue;
+        }
 
-                IOFree(newKey, size);
-            }
-            else
-            {
-                OSDictionary* subdict;
-                if((subdict = OSDynamicCast(OSDictionary, object)))
-                {
-                    // Guid
-                    copyUnserialzedData(name, subdict);
-                }
-                else
-                {
-                    setProperty(key, object);
-                }
-            }
+        OSDictionary* subdict;
+        if(!keyLength && (subdict = OSDynamicCast(OSDictionary, object)))
+        {
+            // Guid
+            copyUnserialzedData(key, length, subdict, table);
+        }
+        else
+        {
+            restoreProperty(table, key, object);
         }
-    } while(key);
-    if(!prefix) LOG(INFO, "nvram data restored.\n");
+    }
+    if(!keyLength) LOG(INFO, "nvram data restored.\n");
 
     iter->release();
 }
 
-void FileNVRAM::copyEntryProperties(const char* prefix, IORegistryEntry* entry)
+void FileNVRAM::copyEntryProperties(char* key, size_t keyLength, IORegistryEntry* entry, OSDictionary* table)
 {
     IORegistryEntry* child;
     OSDictionary* properties;
     OSCollectionIterator *iter;
-    
+    size_t length;
+
     if(entry)
     {
-        // Parse all IORegistery Children
+        // Parse all IORegistery Children, extending the key in place for each one
         OSIterator * iterator = entry->getChildIterator(gIODTPlane);
 
         if(iterator)
         {
             while((child = OSDynamicCast(IORegistryEntry, iterator->getNextObject())) != NULL)
             {
-                const char* name = child->getName();
-
-                if(prefix)
+                if((length = appendKey(key, keyLength, child->getName())))
                 {
-                    size_t size = strlen(prefix) + strlen(NVRAM_SEPERATOR) + strlen(name) +1;
-                    char* newPrefix = (char*)IOMalloc(size);
-
-                    snprintf(newPrefix, size, "%s%s%s", prefix, NVRAM_SEPERATOR, name);
-                    copyEntryProperties(newPrefix, child);
-
-                    IOFree(newPrefix, size);
-                }
-                else
-                {
-                    copyEntryProperties(name, child);
+                    copyEntryProperties(key, length, child, table);
                 }
             }
             iterator->release();
         }
 
-        // Parse entry properties and add them to our self
+        // Parse entry properties and add them to the restore table
         properties = entry->dictionaryWithProperties();
+        if(!properties) return;
 
-        bool                 result = true;
         OSObject             *object;
-        const OSSymbol       *key;
+        const OSSymbol       *name;
 
 
         iter = OSCollectionIterator::withCollection(properties);
-        if(iter == 0) return;
-
-        while (result)
+        if(iter == 0)
         {
-            key = OSDynamicCast(OSSymbol, iter->getNextObject());
-            if(key == 0) break;
+            properties->release();
+            return;
+        }
 
-            if(key->isEqualTo("name")) continue; // Special property in IORegistery, ignore
+        while((name = OSDynamicCast(OSSymbol, iter->getNextObject())))
+        {
+            if(name->isEqualTo("name")) continue; // Special property in IORegistery, ignore
 
-            object = properties->getObject(key);
+            object = properties->getObject(name);
             if(object == 0) continue;
 
-            if(prefix)
+            if((length = appendKey(key, keyLength, name->getCStringNoCopy())))
             {
-                size_t size = strlen(prefix) + strlen(NVRAM_SEPERATOR) + strlen(key->getCStringNoCopy()) +1;
-                char* newKey = (char*)IOMalloc(size);
-
-                snprintf(newKey, size, "%s%s%s", prefix, NVRAM_SEPERATOR, key->getCStringNoCopy());
-
-                setProperty(OSSymbol::withCString(newKey), object);
-
-                IOFree(newKey, size);
+                restoreProperty(table, key, object);
             }
             else
             {
-                setProperty(key, object);
+                LOG(ERROR, "Key %s is too long, ignoring\n", name->getCStringNoCopy());
             }
         }
 
         iter->release();
+        properties->release();
+    }
+}
+
+/**
+ ** Intern key and add the restored value to table. Restored values come from the kernel, so the
+ ** privilege checks, logging and syncing done by setProperty are skipped.
+ **/
+void FileNVRAM::restoreProperty(OSDictionary* table, const char* key, OSObject* object)
+{
+    const OSSymbol* symbol = OSSymbol::withCString(key);
+    if(!symbol) return;
+
+    handleSettingKey(key, object, this);
+
+    OSObject* value = cast(symbol, object);
+    table->setObject(symbol, value);
+    if(value != object) value->release();
+
+    symbol->release();
+}
+
+/**
+ ** Count the variables copyEntryProperties will restore from entry.
+ **/
+unsigned int FileNVRAM::countEntryProperties(IORegistryEntry* entry)
+{
+    unsigned int count = 0;
+
+    OSIterator * iterator = entry->getChildIterator(gIODTPlane);
+    if(iterator)
+    {
+        IORegistryEntry* child;
+        while((child = OSDynamicCast(IORegistryEntry, iterator->getNextObject())) != NULL)
+        {
+            count += countEntryProperties(child);
+        }
+        iterator->release();
+    }
+
+    OSDictionary* properties = entry->dictionaryWithProperties();
+    if(properties)
+    {
+        count += properties->getCount();
+        if(properties->getObject("name")) count--;
+        properties->release();
+    }
+
+    return count;
+}
+
+/**
+ ** Count the variables copyUnserialzedData will restore from dict.
+ **/
+unsigned int FileNVRAM::countUnserialzedData(OSDictionary* dict)
+{
+    unsigned int count = 0;
+    const OSSymbol* name;
+
+    OSCollectionIterator * iter = OSCollectionIterator::withCollection(dict);
+    if(!iter) return 0;
+
+    while((name = OSDynamicCast(OSSymbol, iter->getNextObject())))
+    {
+        OSDictionary* subdict = OSDynamicCast(OSDictionary, dict->getObject(name));
+        count += subdict ? subdict->getCount() : 1;
+    }
+
+    iter->release();
+
+    return count;
+}
+
+/**
+ ** Copy the current property table with room for count more variables, ready to be filled and published with setPropertyTable.
+ ** One more slot is kept for the timeline registerNVRAM publishes right after restoring.
+ **/
+OSDictionary* FileNVRAM::createRestoreTable(unsigned int count)
+{
+    OSDictionary* current = getPropertyTable();
+
+    if(current) return OSDictionary::withDictionary(current, current->getCount() + count + 1);
+    else        return OSDictionary::withCapacity(count + 1);
+}
+
+/**
+ ** Refresh the read only statistics property. The registry is updated directly, bypassing the
+ ** setProperty override which refuses writes to NVRAM_STATISTICS_KEY.
+ **/
+void FileNVRAM::publishStatistics() const
+{
+    const OSSymbol* key = OSSymbol::withCString(NVRAM_STATISTICS_KEY);
+    OSDictionary* stats = statsCopyDictionary(&mStatistics);
+
+    if(key && stats) const_cast<FileNVRAM*>(this)->IOService::setProperty(key, stats);
+
+    OSSafeReleaseNULL(stats);
+    OSSafeReleaseNULL(key);
+}
+
+/**
+ ** Record a boot phase that began at start (a statsTimestamp() value) and ends now.
+ **/
+void FileNVRAM::recordPhase(UInt8 phase, UInt64 start)
+{
+    UInt64 offset = (start > mTimelineBase) ? statsMicroseconds(start - mTimelineBase) : 0;
+    timelineRecord(&mTimeline, NVRAM_TIMELINE_KEXT, phase, (UInt32)offset, (UInt32)statsElapsed(start));
+}
+
+/**
+ ** Publish the boot timeline, prefixed with the phases forwarded by the bootloader module.
+ **/
+void FileNVRAM::publishTimeline()
+{
+    const OSSymbol* key = OSSymbol::withCString(NVRAM_TIMELINE_KEY);
+    if(!key) return;
+
+    OSData* data = timelineCopyData(&mTimeline, OSDynamicCast(OSData, IOService::getProperty(key)));
+    if(data)
+    {
+        const NVRAMTimeline* timeline = (const NVRAMTimeline*)data->getBytesNoCopy();
+        for(int i = 0; i < timeline->count; i++)
+        {
+            const NVRAMTimelineEntry* entry = &timeline->entries[i];
+            LOG(NOTICE, "%s %s: +%u us, %u us (%u)\n",
+                entry->source == NVRAM_TIMELINE_LOADER ? "loader" : "kext",
+                timelinePhaseName(entry->source, entry->phase),
+                (unsigned int)entry->start, (unsigned int)entry->duration, (unsigned int)entry->count);
+        }
+
+        IOService::setProperty(key, data);
+        data->release();
     }
+
+    key->release();
 }
 
 
@@ -364,7 +515,8 @@ void FileNVRAM::registerNVRAMController(IONVRAMController *nvram)
 void FileNVRAM::sync(void)
 {
     LOG(NOTICE, "sync() called\n");
-    mCommandGate->runCommand( ( void * ) kNVRAMSyncCommand, NULL, NULL, NULL );
+    UInt64 queued = statsTimestamp();
+    mCommandGate->runCommand( ( void * ) kNVRAMSyncCommand, &queued, NULL, NULL );
 }
 
 void FileNVRAM::doSync(void)
@@ -374,9 +526,12 @@ void FileNVRAM::doSync(void)
     if(!mFilePath || !mSafeToSync || mReadOnly)
     {
         LOG(NOTICE, "doSync() returning\n");
+        statsIncrement(&mStatistics.skippedSyncs);
         return;
     }
 
+    UInt64 syncStart = statsTimestamp();
+
     LOG(NOTICE, "doSync() running\n");
 
     //create the output Dictionary
@@ -400,6 +555,8 @@ void FileNVRAM::doSync(void)
         //just get the value now anyway
         value = inputDict->getObject(key);
 
+        if(isVolatileKey(key->getCStringNoCopy())) continue;
+
         //if the key contains :, look to see if it's in the map already, cause we'll add a child pair to it
         //otherwise we just slam the key/val pair in
 
@@ -451,15 +608,26 @@ void FileNVRAM::doSync(void)
     {
         LOG(ERROR, "Unable to write to %s, errno %d\n", mFilePath->getCStringNoCopy(), error);
     }
+    else
+    {
+        write_hint();
+        write_blob(outputDict, s->text());
+        write_patch_cache();
+    }
 
     //now free the dictionaries && iter
     iter->release();
     outputDict->release();
     s->release();
+
+    statsIncrement(&mStatistics.syncs);
+    statsRecord(&mStatistics.doSyncLatency, statsElapsed(syncStart));
 }
 
 bool FileNVRAM::serializeProperties(OSSerialize *s) const
 {
+    publishStatistics();
+
     bool result = IOService::serializeProperties(s);
     LOG(NOTICE, "serializeProperties(%p) = %s\n", s, s->text());
     return result;
@@ -467,6 +635,9 @@ bool FileNVRAM::serializeProperties(OSSerialize *s) const
 
 OSObject * FileNVRAM::getProperty(const OSSymbol *aKey) const
 {
+    statsIncrement((volatile SInt64*)&mStatistics.getCalls);
+    if(aKey->isEqualTo(NVRAM_STATISTICS_KEY)) publishStatistics();
+
     OSObject* value = IOService::getProperty(aKey);
     if(value)
     {
@@ -528,6 +699,16 @@ bool FileNVRAM::setProperty(const OSSymbol *aKey, OSObject *anObject)
     result = IOUserClient::clientHasPrivilege(current_task(), kIOClientPrivilegeAdministrator);
     if(result != kIOReturnSuccess) return false;
 
+    statsIncrement(&mStatistics.setCalls);
+
+    if(isVolatileKey(aKey->getCStringNoCopy())) return false;
+    if(aKey->isEqualTo(NVRAM_RESET_STATISTICS_KEY))
+    {
+        LOG(INFO, "Resetting statistics\n");
+        statsReset(&mStatistics);
+        return true;
+    }
+
     OSSerialize *s = OSSerialize::withCapacity(1000);
     if(anObject->serialize(s))
     {
@@ -540,21 +721,12 @@ bool FileNVRAM::setProperty(const OSSymbol *aKey, OSObject *anObject)
     s->release();
 
     // Check for special FileNVRAM properties:
-    if(strncmp(FILE_NVRAM_GUID ":", aKey->getCStringNoCopy(), MIN(aKey->getLength(), strlen(FILE_NVRAM_GUID ":"))) == 0)
-    {
-        unsigned long bytes = aKey->getLength() - strlen(FILE_NVRAM_GUID ":") + 1;
-        // Found GUID
-        char* newKey = (char*)IOMalloc(bytes);
-        snprintf(newKey, bytes+1, "%s", &(aKey->getCStringNoCopy()[strlen(FILE_NVRAM_GUID ":")]));
+    handleSettingKey(aKey->getCStringNoCopy(), anObject, this);
 
-        // Send d
-        OSString* str = OSString::withCString(newKey);
-        handleSetting(str, anObject, this);
-        str->release();
-        IOFree(newKey, bytes);
-    }
-
-    bool stat = IOService::setProperty(aKey, cast(aKey, anObject));
+    // Update the registry on the work loop so a concurrent restore in timeoutOccurred can't swap this write out.
+    OSObject* value = cast(aKey, anObject);
+    bool stat = mCommandGate->runCommand((void*)kNVRAMSetProperty, NULL, (void*)aKey, value) == kIOReturnSuccess;
+    if(value != anObject) value->release();
     if(mInitComplete) sync();
     return stat;
 }
@@ -568,7 +740,9 @@ void FileNVRAM::removeProperty(const OSSymbol *aKey)
 
     LOG(NOTICE, "removeProperty() called\n");
 
-    IOService::removeProperty(aKey);
+    if(isVolatileKey(aKey->getCStringNoCopy())) return;
+
+    mCommandGate->runCommand((void*)kNVRAMRemoveProperty, NULL, (void*)aKey, NULL);
     if(mInitComplete) sync();
 }
 
@@ -729,6 +903,8 @@ IOReturn FileNVRAM::dispatchCommand( OSObject* owner,
     FileNVRAM* self = OSDynamicCast(FileNVRAM, owner);
     if(!self) return kIOReturnBadArgument;
 
+    if(arg1) statsAdd(&self->mStatistics.gateWait, statsElapsed(*(UInt64*)arg1));
+
     size_t command = (size_t) arg0;
     switch (command)
     {
@@ -736,6 +912,14 @@ IOReturn FileNVRAM::dispatchCommand( OSObject* owner,
             self->doSync();
             break;
 
+        case kNVRAMSetProperty:
+            if(!self->IOService::setProperty((const OSSymbol*)arg2, (OSObject*)arg3)) return kIOReturnNoMemory;
+            break;
+
+        case kNVRAMRemoveProperty:
+            self->IOService::removeProperty((const OSSymbol*)arg2);
+            break;
+
         default:
             break;
     }
@@ -763,10 +947,12 @@ void FileNVRAM::timeoutOccurred(OSObject *target, IOTimerEventSource* timer)
                 dict = IOService::resourceMatching( "IOBSD" );
                 if(dict)
                 {
+                    UInt64 waitStart = statsTimestamp();
                     if(IOService::waitForMatchingService( dict, timeout ))
                     {
                         found = true;
                     }
+                    self->recordPhase(TIMELINE_KEXT_WAIT_BSD, waitStart);
                 }
             } while( false );
 
@@ -778,10 +964,20 @@ void FileNVRAM::timeoutOccurred(OSObject *target, IOTimerEventSource* timer)
                 UInt8 mLoggingLevel = self->mLoggingLevel;
                 LOG(NOTICE, "BSD found, syncing\n");
 
+                if(self->mTimerStart)
+                {
+                    self->recordPhase(TIMELINE_KEXT_TIMER_WAIT, self->mTimerStart);
+                    self->mTimerStart = 0;
+                }
+
                 // TODO: Read out nvram plist and populate device tree
                 char* buffer;
                 uint64_t len;
-                if(self->read_buffer(&buffer, &len))
+                UInt64 readStart = statsTimestamp();
+                IOReturn readError = self->read_buffer(&buffer, &len);
+                self->recordPhase(TIMELINE_KEXT_READ, readStart);
+
+                if(readError)
                 {
                     retryCount++;
                     LOG(ERROR, "Unable to read in nvram data at %s\n", self->mFilePath->getCStringNoCopy());
@@ -809,15 +1005,31 @@ void FileNVRAM::timeoutOccurred(OSObject *target, IOTimerEventSource* timer)
                     {
                         char* xml = buffer + strlen(NVRAM_FILE_HEADER);
                         size_t xmllen = (size_t)len - strlen(NVRAM_FILE_HEADER) - strlen(NVRAM_FILE_FOOTER);
-                        xml[xmllen-1] = 0;
+                        xml[xmllen] = 0;     // the footer starts here, the dictionary ends right before it
 			OSString *errmsg = 0;
+                        UInt64 unserializeStart = statsTimestamp();
                         OSObject* nvram = OSUnserializeXML(xml, &errmsg);
+                        self->recordPhase(TIMELINE_KEXT_UNSERIALIZE, unserializeStart);
                         
                         if(nvram)
                         {
                             OSDictionary* data = OSDynamicCast(OSDictionary, nvram);
-                            //if(data) self->setPropertyTable(data);
-                            if(data) self->copyUnserialzedData(NULL, data);
+                            OSDictionary* table = data ? self->createRestoreTable(self->countUnserialzedData(data)) : NULL;
+                            if(table)
+                            {
+                                char key[NVRAM_KEY_BUFFER_SIZE];
+                                UInt64 restoreStart = statsTimestamp();
+
+                                key[0] = 0;
+                                // timeoutOccurred runs on the work loop, so setProperty and removeProperty,
+                                // which go through mCommandGate, can't change the table between the copy and the swap.
+                                self->copyUnserialzedData(key, 0, data, table);
+                                self->setPropertyTable(table);
+                                table->release();
+
+                                statsAdd(&self->mStatistics.restoreTime, statsElapsed(restoreStart));
+                                self->recordPhase(TIMELINE_KEXT_RESTORE, restoreStart);
+                            }
                             nvram->release();
                         }
                     }
@@ -900,15 +1112,107 @@ IOReturn FileNVRAM::write_buffer(char* buffer)
     if(mReadOnly) return error;
 
     int length = (int)strlen(buffer);
+    UInt64 writeStart = statsTimestamp();
+
+    if(!(error = write_file(FILE_NVRAM_PATH, buffer, length)))
+    {
+        statsAdd(&mStatistics.bytesWritten, length);
+        statsMax(&mStatistics.fileSizeMax, length);
+    }
+
+    statsRecord(&mStatistics.writeLatency, statsElapsed(writeStart));
+
+    return error;
+}
+
+/**
+ ** Record the bootloader volume holding the nvram file next to it, so the module can skip scanning every volume next boot.
+ ** The hint carries the modification time of mFilePath, the file the module reads, and is ignored once that file changes elsewhere.
+ **/
+void FileNVRAM::write_hint()
+{
+    char hint[64];
+    struct vnode * vp;
+    struct vnode_attr va;
+    int error;
+
+    if(mReadOnly || !mVolume || !mFilePath || !mCtx) return;
+
+    if((error = vnode_lookup(mFilePath->getCStringNoCopy(), VNODE_LOOKUP_NOFOLLOW, &vp, mCtx)))
+    {
+        LOG(ERROR, "error, vnode_lookup(%s) failed with error %d!\n", mFilePath->getCStringNoCopy(), error);
+        return;
+    }
+
+    VATTR_INIT(&va);
+    VATTR_WANTED(&va, va_modify_time);
+    error = vnode_getattr(vp, &va, mCtx);
+    vnode_put(vp);
+
+    if(error || !VATTR_IS_SUPPORTED(&va, va_modify_time))
+    {
+        LOG(ERROR, "failed to determine modification time of %s, errno %d.\n", mFilePath->getCStringNoCopy(), error);
+        return;
+    }
+
+    snprintf(hint, sizeof(hint), "%s %lu\n", mVolume->getCStringNoCopy(), (unsigned long)va.va_modify_time.tv_sec);
+    write_file(FILE_NVRAM_HINT_PATH, hint, (int)strlen(hint));
+}
+
+/**
+ ** Write the pre-flattened device tree for the file just written to FILE_NVRAM_PATH, stamped with its Adler-32.
+ ** A stale blob is harmless, the module ignores any blob whose stamp doesn't match the file it read, so it is
+ ** only used when the module reads nvram.plist rather than nvram.<uuid>.plist.
+ **/
+void FileNVRAM::write_blob(OSDictionary* dict, const char* buffer)
+{
+    OSData* blob = blobCreate(dict, blobAdler32(buffer, strlen(buffer)));
+
+    if(!blob)
+    {
+        LOG(ERROR, "Unable to create device tree blob\n");
+        return;
+    }
+
+    IOReturn error = write_file(FILE_NVRAM_BLOB_PATH, (const char*)blob->getBytesNoCopy(), blob->getLength());
+    if(error)
+    {
+        LOG(ERROR, "Unable to write to %s, errno %d\n", FILE_NVRAM_BLOB_PATH, error);
+    }
+
+    blob->release();
+}
+
+/**
+ ** The module can't write files, save the kernel patch cache it built this boot so the next boot with the
+ ** same kernel can skip patching from scratch. Written once.
+ **/
+void FileNVRAM::write_patch_cache()
+{
+    if(mReadOnly || !mPatchCache) return;
+
+    IOReturn error = write_file(FILE_NVRAM_PATCH_CACHE_PATH, (const char*)mPatchCache->getBytesNoCopy(), mPatchCache->getLength());
+    if(error)
+    {
+        LOG(ERROR, "Unable to write to %s, errno %d\n", FILE_NVRAM_PATCH_CACHE_PATH, error);
+        return;
+    }
+
+    OSSafeReleaseNULL(mPatchCache);
+}
+
+IOReturn FileNVRAM::write_file(const char* path, const char* buffer, int length)
+{
+    IOReturn error = 0;
     int ares;
     struct vnode * vp;
 
     if(mCtx)
     {
         // O_WRONLY
-        if((error = vnode_open(FILE_NVRAM_PATH, (O_WRONLY | O_CREAT | O_TRUNC | FWRITE | O_NOFOLLOW), S_IRUSR | S_IWUSR, VNODE_LOOKUP_NOFOLLOW, &vp, mCtx)))
+        if((error = vnode_open(path, (O_WRONLY | O_CREAT | O_TRUNC | FWRITE | O_NOFOLLOW), S_IRUSR | S_IWUSR, VNODE_LOOKUP_NOFOLLOW, &vp, mCtx)))
         {
-            LOG(ERROR, "error, vnode_open(%s) failed with error %d!\n", FILE_NVRAM_PATH, error);
+            LOG(ERROR, "error, vnode_open(%s) failed with error %d!\n", path, error);
 
             return error;
         }
@@ -917,19 +1221,19 @@ IOReturn FileNVRAM::write_buffer(char* buffer)
             if((error = vnode_isreg(vp)) == VREG)
             {
                 // 10.6 and later
-                if((error = vn_rdwr(UIO_WRITE, vp, buffer, length, 0, UIO_SYSSPACE, IO_NOCACHE|IO_NODELOCKED|IO_UNIT, vfs_context_ucred(mCtx), &ares/*(int *) 0*/, vfs_context_proc(mCtx))))
+                if((error = vn_rdwr(UIO_WRITE, vp, (caddr_t)buffer, length, 0, UIO_SYSSPACE, IO_NOCACHE|IO_NODELOCKED|IO_UNIT, vfs_context_ucred(mCtx), &ares/*(int *) 0*/, vfs_context_proc(mCtx))))
                 {
-                    LOG(ERROR, "error, vn_rdwr(%s) failed with error %d!\n", FILE_NVRAM_PATH, error);
+                    LOG(ERROR, "error, vn_rdwr(%s) failed with error %d!\n", path, error);
                 }
 
                 if((error = vnode_close(vp, FWASWRITTEN, mCtx)))
                 {
-                    LOG(ERROR, "error, vnode_close(%s) failed with error %d!\n", FILE_NVRAM_PATH, error);
+                    LOG(ERROR, "error, vnode_close(%s) failed with error %d!\n", path, error);
                 }
             }
             else
             {
-                LOG(ERROR, "error, vnode_isreg(%s) failed with error %d!\n", FILE_NVRAM_PATH, error);
+                LOG(ERROR, "error, vnode_isreg(%s) failed with error %d!\n", path, error);
             }
         }
     }
@@ -946,7 +1250,7 @@ IOReturn FileNVRAM::read_buffer(char** buffer, uint64_t* length)
 {
     IOReturn error = 0;
 
-    if(mReadOnly) return error;
+    if(mReadOnly && !mLazyLoad) return error;
 
     struct vnode * vp;
     struct vnode_attr va;
@@ -985,6 +1289,11 @@ IOReturn FileNVRAM::read_buffer(char** buffer, uint64_t* length)
                     {
                         LOG(ERROR, "error, writing to vnode(%s) failed with error %d!\n", mFilePath->getCStringNoCopy(), error);
                     }
+                    else
+                    {
+                        statsAdd(&mStatistics.bytesRead, len);
+                        statsMax(&mStatistics.fileSizeMax, len);
+                    }
                 }
 
                 if((error = vnode_close(vp, 0, mCtx)))
@@ -61,6 +61,9 @@ do {                        \
 #include <IOKit/IOCommandGate.h>
 #include <IOKit/IOTimerEventSource.h>
 
+#include "Statistics.h"
+#include "Timeline.h"
+
 
 #define APPLE_MLB_KEY           "4D1EDE05-38C7-4A6A-9CC6-4BCCA8B38C14:MLB"
 #define APPLE_ROM_KEY           "4D1EDE05-38C7-4A6A-9CC6-4BCCA8B38C14:ROM"
@@ -71,15 +74,29 @@ do {                        \
 #define BOOT_KEY_NVRAM_DISABLED "-NoFileNVRAM"
 #define BOOT_KEY_NVRAM_RDONLY   "-FileNVRAMro"
 #define NVRAM_SET_FILE_PATH     "NVRAMFile"
+#define NVRAM_SET_VOLUME        "NVRAMVolume"
+#define NVRAM_LAZY_LOAD         "LazyLoad"
+#define NVRAM_PATCH_CACHE       "PatchCache"
 #define FILE_NVRAM_PATH			"/Extra/nvram.plist"
+#define FILE_NVRAM_HINT_PATH    "/Extra/nvram.hint"
+#define FILE_NVRAM_BLOB_PATH    "/Extra/nvram.blob"
+#define FILE_NVRAM_PATCH_CACHE_PATH "/Extra/nvram.patches"
 
 #define NVRAM_SEPERATOR         ":"
+#define NVRAM_STATISTICS_KEY        FILE_NVRAM_GUID NVRAM_SEPERATOR "Statistics"        /* read only */
+#define NVRAM_RESET_STATISTICS_KEY  FILE_NVRAM_GUID NVRAM_SEPERATOR "ResetStatistics"   /* write only */
+#define NVRAM_TIMELINE_KEY          FILE_NVRAM_GUID NVRAM_SEPERATOR "BootTimeline"      /* read only */
+#define NVRAM_LAZY_LOAD_KEY         FILE_NVRAM_GUID NVRAM_SEPERATOR NVRAM_LAZY_LOAD     /* set by the module */
+#define NVRAM_PATCH_CACHE_KEY       FILE_NVRAM_GUID NVRAM_SEPERATOR NVRAM_PATCH_CACHE   /* set by the module */
+#define NVRAM_VOLUME_KEY            FILE_NVRAM_GUID NVRAM_SEPERATOR NVRAM_SET_VOLUME    /* set by the module */
 #define NVRAM_FILE_DT_LOCATION	"/chosen/nvram"
 #define NVRAM_FILE_HEADER		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" \
                                 "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"\
                                 "\t<plist version=\"1.0\">\n<dict>\n<key>NVRAM</key>\n"
 #define NVRAM_FILE_FOOTER       "</dict></plist>\n"
 
+#define NVRAM_KEY_BUFFER_SIZE   512
+
 #define NVRAM_MISS_KEY			"NVRAM_MISS"
 #define NVRAM_MISS_HEADER       "\n<key>NVRAM_MISS</key>\n"
 
@@ -87,6 +104,7 @@ do {                        \
 #define kNVRAMSyncCommand   1
 #define kNVRAMSetProperty   2
 #define kNVRAMGetProperty   4
+#define kNVRAMRemoveProperty 8
 
 #define super IODTNVRAM
 
@@ -106,8 +124,8 @@ public:
     
     virtual bool    passiveMatch (OSDictionary *matching, bool changesOK);
     
-    virtual void    copyEntryProperties(const char* prefix, IORegistryEntry* entry);
-    virtual void    copyUnserialzedData(const char* prefix, OSDictionary* dict);
+    virtual void    copyEntryProperties(char* key, size_t keyLength, IORegistryEntry* entry, OSDictionary* table);
+    virtual void    copyUnserialzedData(char* key, size_t keyLength, OSDictionary* dict, OSDictionary* table);
     
     virtual IOReturn syncOFVariables(void) override;
     virtual bool init(IORegistryEntry *old, const IORegistryPlane *plane) override;
@@ -162,15 +180,31 @@ private:
     virtual void registerNVRAM();
     
     virtual void setPath(OSString* path);
+    virtual void setVolume(OSString* volume);
+    virtual void setPatchCache(OSData* cache);
     
     virtual OSObject* cast(const OSSymbol* key, OSObject* obj);
+
+    virtual void restoreProperty(OSDictionary* table, const char* key, OSObject* object);
+    virtual unsigned int countEntryProperties(IORegistryEntry* entry);
+    virtual unsigned int countUnserialzedData(OSDictionary* dict);
+    virtual OSDictionary* createRestoreTable(unsigned int count);
+
+    virtual void publishStatistics() const;
+    virtual void recordPhase(UInt8 phase, UInt64 start);
+    virtual void publishTimeline();
     
     static IOReturn dispatchCommand( OSObject* owner, void* arg0, void* arg1, void* arg2, void* arg3 );
     
     virtual IOReturn write_buffer(char* buffer);
+    virtual IOReturn write_file(const char* path, const char* buffer, int length);
+    virtual void write_hint();
+    virtual void write_blob(OSDictionary* dict, const char* buffer);
+    virtual void write_patch_cache();
     virtual IOReturn read_buffer(char** buffer, uint64_t* length);
     
     bool mReadOnly;
+    bool mLazyLoad;         /* module only injected early variables, read the rest from the file */
     bool mInitComplete;
     bool mSafeToSync;
     UInt8 mLoggingLevel;
@@ -180,7 +214,14 @@ private:
     OSDictionary * mNvramMissDict;
     IOCommandGate* mCommandGate;
     OSString*      mFilePath;
+    OSString*      mVolume;
+    OSData*        mPatchCache;     /* kernel patch cache built by the module, until written */
     IOTimerEventSource* mTimer;
+
+    NVRAMStatistics mStatistics;
+    NVRAMTimeline   mTimeline;
+    UInt64          mTimelineBase;
+    UInt64          mTimerStart;
 };
 
 #if __cplusplus < 201103L
@@ -0,0 +1,145 @@
+//
+//  Statistics.cpp
+//  FileNVRAM
+//
+//  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+//
+// This work is licensed under the
+//  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+//  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+//
+
+#include "Statistics.h"
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSNumber.h>
+
+/** Current uptime, in absolute time units **/
+static inline UInt64 statsTimestamp(void)
+{
+    UInt64 now;
+    clock_get_uptime(&now);
+    return now;
+}
+
+/** Convert an absolute time interval to microseconds **/
+static inline UInt64 statsMicroseconds(UInt64 interval)
+{
+    UInt64 ns;
+    absolutetime_to_nanoseconds(interval, &ns);
+    return ns / 1000;
+}
+
+/** Microseconds elapsed since a statsTimestamp() value **/
+static inline UInt64 statsElapsed(UInt64 start)
+{
+    return statsMicroseconds(statsTimestamp() - start);
+}
+
+static inline void statsIncrement(volatile SInt64* counter)
+{
+    OSIncrementAtomic64(counter);
+}
+
+static inline void statsAdd(volatile SInt64* counter, UInt64 value)
+{
+    OSAddAtomic64((SInt64)value, counter);
+}
+
+static inline void statsMax(volatile SInt64* counter, UInt64 value)
+{
+    UInt64 current;
+    do
+    {
+        current = (UInt64)*counter;
+        if(current >= value) return;
+    } while(!OSCompareAndSwap64(current, value, (volatile UInt64*)counter));
+}
+
+static inline void statsRecord(NVRAMHistogram* histogram, UInt64 value)
+{
+    int bucket = (value < 2) ? 0 : 63 - __builtin_clzll(value);
+    if(bucket >= NVRAM_HISTOGRAM_BUCKETS) bucket = NVRAM_HISTOGRAM_BUCKETS - 1;
+
+    OSIncrementAtomic64(&histogram->buckets[bucket]);
+    OSIncrementAtomic64(&histogram->count);
+    statsAdd(&histogram->total, value);
+    statsMax(&histogram->max, value);
+}
+
+static inline void statsReset(NVRAMStatistics* stats)
+{
+    bzero((void*)stats, sizeof(*stats));
+}
+
+static inline void statsSetNumber(OSDictionary* dict, const char* key, UInt64 value)
+{
+    OSNumber* number = OSNumber::withNumber(value, 64);
+    if(number)
+    {
+        dict->setObject(key, number);
+        number->release();
+    }
+}
+
+static inline OSDictionary* statsCopyHistogram(const NVRAMHistogram* histogram)
+{
+    OSDictionary* dict = OSDictionary::withCapacity(4);
+    OSArray* buckets = OSArray::withCapacity(NVRAM_HISTOGRAM_BUCKETS);
+
+    if(!dict || !buckets)
+    {
+        OSSafeReleaseNULL(dict);
+        OSSafeReleaseNULL(buckets);
+        return NULL;
+    }
+
+    for(int i = 0; i < NVRAM_HISTOGRAM_BUCKETS; i++)
+    {
+        OSNumber* number = OSNumber::withNumber((UInt64)histogram->buckets[i], 64);
+        if(number)
+        {
+            buckets->setObject(number);
+            number->release();
+        }
+    }
+
+    statsSetNumber(dict, "Count",   (UInt64)histogram->count);
+    statsSetNumber(dict, "TotalUS", (UInt64)histogram->total);
+    statsSetNumber(dict, "MaxUS",   (UInt64)histogram->max);
+    dict->setObject("Log2USBuckets", buckets);
+    buckets->release();
+
+    return dict;
+}
+
+/** Snapshot the statistics block into a dictionary suitable for the registry **/
+static inline OSDictionary* statsCopyDictionary(const NVRAMStatistics* stats)
+{
+    OSDictionary* dict = OSDictionary::withCapacity(11);
+    if(!dict) return NULL;
+
+    statsSetNumber(dict, "Syncs",           (UInt64)stats->syncs);
+    statsSetNumber(dict, "SkippedSyncs",    (UInt64)stats->skippedSyncs);
+    statsSetNumber(dict, "BytesWritten",    (UInt64)stats->bytesWritten);
+    statsSetNumber(dict, "BytesRead",       (UInt64)stats->bytesRead);
+    statsSetNumber(dict, "GetProperty",     (UInt64)stats->getCalls);
+    statsSetNumber(dict, "SetProperty",     (UInt64)stats->setCalls);
+    statsSetNumber(dict, "GateWaitUS",      (UInt64)stats->gateWait);
+    statsSetNumber(dict, "RestoreUS",       (UInt64)stats->restoreTime);
+    statsSetNumber(dict, "FileSizeMax",     (UInt64)stats->fileSizeMax);
+
+    OSDictionary* histogram;
+    if((histogram = statsCopyHistogram(&stats->doSyncLatency)))
+    {
+        dict->setObject("doSyncLatency", histogram);
+        histogram->release();
+    }
+
+    if((histogram = statsCopyHistogram(&stats->writeLatency)))
+    {
+        dict->setObject("WriteLatency", histogram);
+        histogram->release();
+    }
+
+    return dict;
+}
@@ -0,0 +1,55 @@
+//
+//  Statistics.h
+//  FileNVRAM
+//
+//  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+//
+// This work is licensed under the
+//  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+//  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+//
+
+#ifndef __FileNVRAM__Statistics__
+#define __FileNVRAM__Statistics__
+
+#include <libkern/OSAtomic.h>
+#include <libkern/c++/OSDictionary.h>
+#include <kern/clock.h>
+
+/* Histogram bucket n counts samples in [2^n, 2^(n+1)) microseconds, the last bucket catches everything above. */
+#define NVRAM_HISTOGRAM_BUCKETS     16
+
+typedef struct
+{
+    volatile SInt64 count;
+    volatile SInt64 total;      /* us */
+    volatile SInt64 max;        /* us */
+    volatile SInt64 buckets[NVRAM_HISTOGRAM_BUCKETS];
+} NVRAMHistogram;
+
+typedef struct
+{
+    volatile SInt64 syncs;
+    volatile SInt64 skippedSyncs;
+    volatile SInt64 bytesWritten;
+    volatile SInt64 bytesRead;
+    volatile SInt64 getCalls;
+    volatile SInt64 setCalls;
+    volatile SInt64 gateWait;       /* us */
+    volatile SInt64 restoreTime;    /* us */
+    volatile SInt64 fileSizeMax;    /* bytes */
+    NVRAMHistogram  doSyncLatency;
+    NVRAMHistogram  writeLatency;
+} NVRAMStatistics;
+
+static inline UInt64 statsTimestamp(void);
+static inline UInt64 statsMicroseconds(UInt64 interval);
+static inline UInt64 statsElapsed(UInt64 start);
+static inline void statsIncrement(volatile SInt64* counter);
+static inline void statsAdd(volatile SInt64* counter, UInt64 value);
+static inline void statsMax(volatile SInt64* counter, UInt64 value);
+static inline void statsRecord(NVRAMHistogram* histogram, UInt64 value);
+static inline void statsReset(NVRAMStatistics* stats);
+static inline OSDictionary* statsCopyDictionary(const NVRAMStatistics* stats);
+
+#endif /* defined(__FileNVRAM__Statistics__) */
@@ -65,6 +65,34 @@ static inline void handleSetting(const OSObject* object, const OSObject* value,
         }
         // Where to get path from?
     }
+    else if(key->isEqualTo(NVRAM_SET_VOLUME))
+    {
+        OSString* str = OSDynamicCast(OSString, value);
+        if(str)
+        {
+            entry->setVolume(str);
+        }
+        else
+        {
+            OSData* dat = OSDynamicCast(OSData, value);
+            if(dat)
+            {
+                OSString* str = OSString::withCString((const char*)dat->getBytesNoCopy());
+                entry->setVolume(str);
+                str->release();
+            }
+        }
+    }
+    else if(key->isEqualTo(NVRAM_PATCH_CACHE))
+    {
+        OSData* cache = OSDynamicCast(OSData, value);
+        if(cache) entry->setPatchCache(cache);
+    }
+    else if(key->isEqualTo(NVRAM_LAZY_LOAD))
+    {
+        LOG(NOTICE, "Bootloader deferred variables to the nvram file\n");
+        entry->mLazyLoad = true;
+    }
     else if(key->isEqualTo(NVRAM_ENABLE_LOG))
     {
         OSData* shouldlog = OSDynamicCast(OSData, value);
@@ -77,3 +105,46 @@ static inline void handleSetting(const OSObject* object, const OSObject* value,
 
     }
 }
+
+/** Forward keys in the FileNVRAM GUID namespace to handleSetting **/
+static inline void handleSettingKey(const char* key, const OSObject* value, FileNVRAM* entry)
+{
+    const size_t prefixLength = strlen(FILE_NVRAM_GUID NVRAM_SEPERATOR);
+
+    if(strncmp(key, FILE_NVRAM_GUID NVRAM_SEPERATOR, prefixLength) == 0)
+    {
+        OSString* str = OSString::withCString(&key[prefixLength]);
+        if(str)
+        {
+            handleSetting(str, value, entry);
+            str->release();
+        }
+    }
+}
+
+/**
+ ** Append [separator]name to the key of the given length held in buffer (NVRAM_KEY_BUFFER_SIZE bytes).
+ ** Returns the new key length, or 0 if it does not fit.
+ **/
+static inline size_t appendKey(char* buffer, size_t length, const char* name)
+{
+    size_t separatorLength = length ? strlen(NVRAM_SEPERATOR) : 0;
+    size_t nameLength = strlen(name);
+
+    if(length + separatorLength + nameLength + 1 > NVRAM_KEY_BUFFER_SIZE) return 0;
+
+    memcpy(&buffer[length], NVRAM_SEPERATOR, separatorLength);
+    memcpy(&buffer[length + separatorLength], name, nameLength + 1);
+
+    return length + separatorLength + nameLength;
+}
+
+/** Keys published by FileNVRAM or the module for this boot only, these are never written to the nvram file **/
+static inline bool isVolatileKey(const char* key)
+{
+    return strcmp(key, NVRAM_STATISTICS_KEY) == 0 ||
+           strcmp(key, NVRAM_TIMELINE_KEY) == 0 ||
+           strcmp(key, NVRAM_LAZY_LOAD_KEY) == 0 ||
+           strcmp(key, NVRAM_PATCH_CACHE_KEY) == 0 ||
+           strcmp(key, NVRAM_VOLUME_KEY) == 0;
+}
@@ -18,5 +18,8 @@
 static inline const char * strstr(const char *s, const char *find);
 static inline void gen_random(char *s, const int len);
 static inline void handleSetting(const OSObject* object, const OSObject* value, FileNVRAM* entry);
+static inline void handleSettingKey(const char* key, const OSObject* value, FileNVRAM* entry);
+static inline size_t appendKey(char* buffer, size_t length, const char* name);
+static inline bool isVolatileKey(const char* key);
 
 #endif /* defined(__FileNVRAM__Support__) */
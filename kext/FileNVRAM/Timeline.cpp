@@ -0,0 +1,102 @@
+//
+//  Timeline.cpp
+//  FileNVRAM
+//
+//  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+//
+// This work is licensed under the
+//  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+//  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+//
+
+#include "Timeline.h"
+
+static inline void timelineReset(NVRAMTimeline* timeline)
+{
+    bzero(timeline, sizeof(*timeline));
+    timeline->magic   = NVRAM_TIMELINE_MAGIC;
+    timeline->version = NVRAM_TIMELINE_VERSION;
+}
+
+/**
+ ** Record a phase. Repeated runs of a phase (e.g. timer retries) are folded into a single entry.
+ **/
+static inline void timelineRecord(NVRAMTimeline* timeline, UInt8 source, UInt8 phase, UInt32 start, UInt32 duration)
+{
+    NVRAMTimelineEntry* entry;
+
+    for(int i = 0; i < timeline->count; i++)
+    {
+        entry = &timeline->entries[i];
+        if(entry->source == source && entry->phase == phase)
+        {
+            entry->count++;
+            entry->duration += duration;
+            return;
+        }
+    }
+
+    if(timeline->count >= NVRAM_TIMELINE_ENTRIES) return;
+
+    entry = &timeline->entries[timeline->count++];
+    entry->source   = source;
+    entry->phase    = phase;
+    entry->count    = 1;
+    entry->start    = start;
+    entry->duration = duration;
+}
+
+static inline bool timelineValid(const void* bytes, size_t length)
+{
+    const NVRAMTimeline* timeline = (const NVRAMTimeline*)bytes;
+
+    if(!bytes || length < NVRAM_TIMELINE_HEADER_SIZE)          return false;
+    if(timeline->magic != NVRAM_TIMELINE_MAGIC)                 return false;
+    if(timeline->version != NVRAM_TIMELINE_VERSION)             return false;
+    if(timeline->count > NVRAM_TIMELINE_ENTRIES)                return false;
+
+    return length >= NVRAM_TIMELINE_HEADER_SIZE + timeline->count * sizeof(NVRAMTimelineEntry);
+}
+
+static inline const char* timelinePhaseName(UInt8 source, UInt8 phase)
+{
+    static const char* loader[] = {
+        "unknown", "readplist", "scanforNVRAM", "parse", "FileNVRAM_hook", "processDict", "addMKext",
+    };
+    static const char* kext[] = {
+        "unknown", "start", "copyEntryProperties", "timer", "waitForMatchingService",
+        "read_buffer", "OSUnserializeXML", "copyUnserialzedData", "registerNVRAM",
+    };
+
+    if(source == NVRAM_TIMELINE_LOADER && phase < sizeof(loader)/sizeof(loader[0])) return loader[phase];
+    if(source == NVRAM_TIMELINE_KEXT   && phase < sizeof(kext)/sizeof(kext[0]))     return kext[phase];
+    return "unknown";
+}
+
+/**
+ ** Build the published timeline: the loader's entries (if it forwarded a valid timeline) followed by ours.
+ **/
+static inline OSData* timelineCopyData(const NVRAMTimeline* timeline, const OSData* loader)
+{
+    NVRAMTimeline combined;
+
+    timelineReset(&combined);
+
+    if(loader && timelineValid(loader->getBytesNoCopy(), loader->getLength()))
+    {
+        const NVRAMTimeline* bootloader = (const NVRAMTimeline*)loader->getBytesNoCopy();
+        for(int i = 0; i < bootloader->count; i++)
+        {
+            const NVRAMTimelineEntry* entry = &bootloader->entries[i];
+            if(entry->source != NVRAM_TIMELINE_LOADER || combined.count >= NVRAM_TIMELINE_ENTRIES) continue;
+            combined.entries[combined.count++] = *entry;
+        }
+    }
+
+    for(int i = 0; i < timeline->count && combined.count < NVRAM_TIMELINE_ENTRIES; i++)
+    {
+        combined.entries[combined.count++] = timeline->entries[i];
+    }
+
+    return OSData::withBytes(&combined, (unsigned int)(NVRAM_TIMELINE_HEADER_SIZE + combined.count * sizeof(NVRAMTimelineEntry)));
+}
@@ -0,0 +1,70 @@
+//
+//  Timeline.h
+//  FileNVRAM
+//
+//  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+//
+// This work is licensed under the
+//  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+//  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+//
+
+#ifndef __FileNVRAM__Timeline__
+#define __FileNVRAM__Timeline__
+
+#include <libkern/OSTypes.h>
+#include <libkern/c++/OSData.h>
+
+/* The timeline layout is shared with the FileNVRAM module, see module/timeline.h */
+#define NVRAM_TIMELINE_MAGIC        0x4C544E46      /* 'FNTL' */
+#define NVRAM_TIMELINE_VERSION      1
+#define NVRAM_TIMELINE_ENTRIES      32
+
+/* Sources */
+#define NVRAM_TIMELINE_LOADER       0
+#define NVRAM_TIMELINE_KEXT         1
+
+/* Loader phases */
+#define TIMELINE_LOADER_READPLIST   1
+#define TIMELINE_LOADER_SCAN        2
+#define TIMELINE_LOADER_PARSE       3
+#define TIMELINE_LOADER_HOOK        4
+#define TIMELINE_LOADER_INJECT      5
+#define TIMELINE_LOADER_MKEXT       6
+
+/* Kext phases */
+#define TIMELINE_KEXT_START         1
+#define TIMELINE_KEXT_DT_IMPORT     2
+#define TIMELINE_KEXT_TIMER_WAIT    3
+#define TIMELINE_KEXT_WAIT_BSD      4
+#define TIMELINE_KEXT_READ          5
+#define TIMELINE_KEXT_UNSERIALIZE   6
+#define TIMELINE_KEXT_RESTORE       7
+#define TIMELINE_KEXT_REGISTER      8
+
+typedef struct
+{
+    UInt8   source;
+    UInt8   phase;
+    UInt16  count;      /* number of times the phase ran */
+    UInt32  start;      /* us since the source's first phase began */
+    UInt32  duration;   /* us, summed over all runs */
+} __attribute__((packed)) NVRAMTimelineEntry;
+
+typedef struct
+{
+    UInt32  magic;
+    UInt16  version;
+    UInt16  count;
+    NVRAMTimelineEntry entries[NVRAM_TIMELINE_ENTRIES];
+} __attribute__((packed)) NVRAMTimeline;
+
+#define NVRAM_TIMELINE_HEADER_SIZE  (sizeof(NVRAMTimeline) - sizeof(((NVRAMTimeline*)0)->entries))
+
+static inline void timelineReset(NVRAMTimeline* timeline);
+static inline void timelineRecord(NVRAMTimeline* timeline, UInt8 source, UInt8 phase, UInt32 start, UInt32 duration);
+static inline bool timelineValid(const void* bytes, size_t length);
+static inline const char* timelinePhaseName(UInt8 source, UInt8 phase);
+static inline OSData* timelineCopyData(const NVRAMTimeline* timeline, const OSData* loader);
+
+#endif /* defined(__FileNVRAM__Timeline__) */
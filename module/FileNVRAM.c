@@ -25,6 +25,16 @@
 #include <libsaio/convert.h>
 
 #include "kernel_patcher.h"
+#include "timeline.h"
+#include "nvram_index.h"
+#include "scan_hint.h"
+#include "plist_stream.h"
+#include "lz4.h"
+#include "dtblob.h"
+#include "adler32.h"
+#include "arena.h"
+#include "patch_cache.h"
+#include "smbios_index.h"
 
 #if HAS_MKEXT
 // File to be embedded
@@ -36,13 +46,24 @@ extern void addBootArg(const char * argStr);
 
 #if HAS_MKEXT
 static bool addMKext(void* binary, unsigned long len);
+static bool verifyMKext(DriversPackage* package);
+#if MKEXT_LZ4
+static bool addCompressedMKext(void* compressed, unsigned long compressedLength, unsigned long length);
+#endif
 #endif
 
 static void FileNVRAM_hook();
 
-static void processDict(TagPtr tag, Node* node);
+static bool processDict(TagPtr tag, Node* node, bool top);
+static bool injectKey(const char* key);
+static bool streamDict(plist_stream_t* stream, Node* node, char** arena, bool top);
+static bool scanplist(const char* buffer, int length);
+static bool scanNVRAM(plist_stream_t* stream);
+static TagPtr loadNVRAMData();
+static bool readblob(BVRef bvr, const char* plist, int length);
 static EFI_CHAR8* getSmbiosUUID();
 static void InternalreadSMBIOSInfo(SMBEntryPoint *eps);
+static const char* getPlatformUUIDString();
 static BVRef scanforNVRAM(BVRef chain);
 static void readplist();
 static void getcommandline(char* args, char* args_end);
@@ -51,7 +72,40 @@ static char* gCommandline;
 static void clearBootArgsHook();
 
 static TagPtr gPListData;
-static TagPtr gNVRAMData;
+static TagPtr gNVRAMData;           /** Only parsed when the public API is used, see loadNVRAMData **/
+static char* gPListBase;            /** Raw nvram plist, kept for the whole boot **/
+static int gPListSize;
+static plist_stream_t gNVRAMStream;  /** Stream positioned at the start of the NVRAM dictionary **/
+static bool gNVRAMFound;
+static bool gNVRAMStreamable;       /** Plist is well formed and has no IDREF values **/
+static void* gNVRAMBlob;            /** Device tree blob written by the kext for this exact plist **/
+static char* gBootArgs;             /** boot-args from the plist, captured while scanning **/
+static bool gBootArgsCleared;       /** FileNVRAM_hook dropped the plist's boot-args **/
+static bool gLazyLoad;              /** Only inject early variables, FileNVRAM.kext reads the rest from disk **/
+static char* gEarlyKeys;            /** EarlyKeys setting from the plist, space or comma separated **/
+static int gDeferredKeys;
+
+/** Variables read before FileNVRAM.kext has loaded the nvram file, always injected in lazy mode **/
+static const char* gEarlyAllowlist[] =
+{
+    FILE_NVRAM_GULD,                // our own settings
+    "boot-args",
+    "csr-active-config",
+    "SystemAudioVolume",
+    "SystemAudioVolumeDB",
+    "prev-lang:kbd",
+    "platform-uuid",
+    "efi-boot-device",
+    "efi-boot-device-data",
+    "bootercfg",
+    "backlight-level",
+    NULL
+};
+static nvram_index_t gNVRAMIndex;   /** Hash index over gNVRAMData, kept in sync by the public API **/
+static char gNVRAMVolume[32];       /** hd(x,y) holding the nvram file, passed on to the kext for its scan hint **/
+static smbios_index_t gSMBIOSIndex; /** First structure of each type in the original SMBIOS table **/
+static char gPlatformUUID[40];      /** getStringFromUUID of the SMBIOS UUID, empty if there is none **/
+static bool gPlatformUUIDRead;
 
 /********************************************************************/
 /**                     Public API Functions                       **/
@@ -62,6 +116,8 @@ static TagPtr gNVRAMData;
  **/
 TagPtr getNVRAMVariable(char* key)
 {
+    loadNVRAMData();
+    if(gNVRAMIndex.slots) return nvram_index_get(&gNVRAMIndex, key);
     if(gNVRAMData) return XMLGetProperty(gNVRAMData,key);
     return NULL;
 }
@@ -72,7 +128,12 @@ TagPtr getNVRAMVariable(char* key)
 
 void addNVRAMVariable(char* key, TagPtr entry)
 {
-    if(gNVRAMData)
+    loadNVRAMData();
+    if(gNVRAMIndex.slots)
+    {
+        nvram_index_add(&gNVRAMIndex, key, entry);
+    }
+    else if(gNVRAMData)
     {
         removeNVRAMVariable(key);
         XMLAddTagToDictionary(gNVRAMData, key, entry);
@@ -84,7 +145,12 @@ void addNVRAMVariable(char* key, TagPtr entry)
  **/
 void removeNVRAMVariable(char* key)
 {
-    if(gNVRAMData)
+    loadNVRAMData();
+    if(gNVRAMIndex.slots)
+    {
+        nvram_index_remove(&gNVRAMIndex, key);
+    }
+    else if(gNVRAMData)
     {
         // look through dict and find entry, then remove it
         TagPtr tagList, parentTag, tag;
@@ -144,38 +210,41 @@ void FileNVRAM_start()
 /********************************************************************/
 static void InternalreadSMBIOSInfo(SMBEntryPoint *eps)
 {
-    // Copied from readSMBIOSInfo, we need it to run early, so we duplicate + modify here
-    
-    // Locate teh SMB header in main memory
-    uint8_t *structPtr = (uint8_t *)eps->dmi.tableAddress;
-    SMBStructHeader *structHeader = (SMBStructHeader *)structPtr;
-    
-    for (;((eps->dmi.tableAddress + eps->dmi.tableLength) > ((uint32_t)(uint8_t *)structHeader + sizeof(SMBStructHeader)));)
-    {
-        switch (structHeader->type)
-        {
-            case kSMBTypeSystemInformation:
-                // Read out the platfomr UUID and save it.
-                Platform.UUID = ((SMBSystemInformation *)structHeader)->uuid;
-                return;
-                break;
-        }
-        
-        structPtr = (uint8_t *)((uint32_t)structHeader + structHeader->length);
-        for (; ((uint16_t *)structPtr)[0] != 0; structPtr++);
+    // Like readSMBIOSInfo, we need it to run early. The table is indexed in one pass, later lookups don't walk it again.
+    if(!eps) return;
+
+    uint8_t* table = (uint8_t *)eps->dmi.tableAddress;
+    smbios_index_build(&gSMBIOSIndex, table, eps->dmi.tableLength);
+
+    // Read out the platform UUID and save it, SMBIOS 2.0 system information doesn't have one.
+    const uint8_t* system = smbios_index_find(&gSMBIOSIndex, table, kSMBTypeSystemInformation,
+                                              offsetof(SMBSystemInformation, uuid) + UUID_LEN);
+    if(system) Platform.UUID = ((SMBSystemInformation *)system)->uuid;
+}
 
-        if (((uint16_t *)structPtr)[0] == 0)
-            structPtr += 2;
+/**
+ ** The platform UUID as a string, NULL if SMBIOS doesn't have one. SMBIOS is only read and the string formatted
+ ** the first time, getStringFromUUID's buffer is shared with the rest of the booter so it's copied.
+ **/
+static const char* getPlatformUUIDString()
+{
+    if(!gPlatformUUIDRead)
+    {
+        gPlatformUUIDRead = true;
 
-        structHeader = (SMBStructHeader *)structPtr;
+        InternalreadSMBIOSInfo(getSmbios(SMBIOS_ORIGINAL));
+        const char* uuid = getStringFromUUID(getSmbiosUUID());
+        if(uuid) strncpy(gPlatformUUID, uuid, sizeof(gPlatformUUID) - 1);
     }
+
+    return gPlatformUUID[0] ? gPlatformUUID : NULL;
 }
 
 static BVRef scanforNVRAM(BVRef chain)
 {
     // Locate the nvram.plist file that was modified last.
     
-    const char* uuid = getStringFromUUID(getSmbiosUUID());
+    const char* uuid = getPlatformUUIDString();
 
     // Locate file w/ newest tiemstamp
     BVRef bvr;
@@ -185,13 +254,27 @@ static BVRef scanforNVRAM(BVRef chain)
     
     long newestTime = -1;
     BVRef result;
+    scan_hint_t hint;
+
+    if(!uuid) strcpy(fileSpec, "nvram.plist");
+    else sprintf(fileSpec, "nvram.%s.plist", uuid);
+
+    // The kext leaves a hint naming the volume it last wrote to, use it if the file there is still the one it wrote.
+    if(scan_hint_read(&hint))
+    {
+        bvr = scan_hint_lookup(chain, &hint);
+        if(bvr)
+        {
+            sprintf(dirSpec, "hd(%d,%d)/Extra/", BIOS_DEV_UNIT(bvr), bvr->part_no);
+            if(!GetFileInfo(dirSpec, fileSpec, &flags, &time) && scan_hint_matches(&hint, time)) return bvr;
+        }
+        verbose("FileNVRAM: stale scan hint, scanning all volumes\n");
+    }
     
     result = NULL;
     for (bvr = chain; bvr; bvr = bvr->next)
     {
         sprintf(dirSpec, "hd(%d,%d)/Extra/", BIOS_DEV_UNIT(bvr), bvr->part_no);
-        if(!uuid) strcpy(fileSpec, "nvram.plist");
-        else sprintf(fileSpec, "nvram.%s.plist", uuid);
         ret = GetFileInfo(dirSpec, fileSpec, &flags, &time);
         if (!ret)
         {
@@ -206,18 +289,24 @@ static BVRef scanforNVRAM(BVRef chain)
     return result;
 }
 
-void processDict(TagPtr dictionary, Node * node)
+bool processDict(TagPtr dictionary, Node * node, bool top)
 {
-    // Handle all NVRAM variables in the nvrma plist.
-    int count = 0;
-    count = XMLTagCount(dictionary);
-    
-    while(count)
+    // Handle all NVRAM variables in the nvram plist.
+    // Walk the dictionary's key list once, in file order, instead of looking up each index and key again.
+    TagPtr keyTag;
+
+    if(!XMLIsDict(dictionary)) return true;
+
+    for(keyTag = dictionary->tag; keyTag; keyTag = keyTag->tagNext)
     {
         int length = 0;
-        const char* key = XMLCastString(XMLGetKey(dictionary,count));
 
-        TagPtr entry = XMLGetProperty(dictionary,key);
+        if((keyTag->type != kTagTypeKey) || (keyTag->string == 0)) continue;
+
+        const char* key = keyTag->string;
+        TagPtr entry = keyTag->tag;
+
+        if(top && !injectKey(key)) continue;
 
         if(XMLIsData(entry))
         {
@@ -231,18 +320,23 @@ void processDict(TagPtr dictionary, Node * node)
         }
         else if(XMLIsInteger(entry))
         {
-            int value = XMLCastInteger(entry);
-            DT__AddProperty(node, key, sizeof(value), &value);
+            // The device tree keeps a pointer to the value until it is flattened, so it can't live on the stack.
+            int* value = arena_alloc(&gBootArena, sizeof(int));
+            if(!value) return false;
+            *value = XMLCastInteger(entry);
+            DT__AddProperty(node, key, sizeof(*value), value);
         }
         else if(XMLIsBoolean(entry))
         {
-            int value = XMLCastBoolean(entry);
-            DT__AddProperty(node, key, sizeof(value), &value);
+            int* value = arena_alloc(&gBootArena, sizeof(int));
+            if(!value) return false;
+            *value = XMLCastBoolean(entry);
+            DT__AddProperty(node, key, sizeof(*value), value);
         }
         else if (XMLIsDict(entry))
         {
             Node * subNode = DT__AddChild(node, key);
-            processDict(entry, subNode);
+            if(!processDict(entry, subNode, false)) return false;
         }
         else
         {
@@ -250,10 +344,294 @@ void processDict(TagPtr dictionary, Node * node)
             //  failed, or does not exist in this version of chameleon
             printf("Unable to handle key %s\n", key);
         }
+    }
+
+    return true;
+}
+
+/**
+ ** Streaming counterpart of processDict, used when nothing asked for the XML tree.
+ ** Keys and decoded values are copied to the arena, which is sized to the plist so everything fits.
+ ** Strings are referenced in place, the raw plist stays allocated for the whole boot.
+ **/
+static bool streamDict(plist_stream_t* stream, Node* node, char** arena, bool top)
+{
+    plist_token_t key, value;
+
+    while(plist_stream_next(stream, &key) == kPlistTokenKey)
+    {
+        char* name = *arena;
+        memcpy(name, key.text, key.length);
+        name[key.length] = 0;
+        *arena += key.length + 1;
+
+        plist_stream_next(stream, &value);
+
+        if(top && !injectKey(name))
+        {
+            if(!plist_stream_skip(stream, &value)) return false;
+            continue;
+        }
+
+        switch(value.type)
+        {
+            case kPlistTokenData:
+            {
+                char* data = *arena;
+                int length = plist_decode_data(&value, data);
+                *arena += length;
+                DT__AddProperty(node, name, length, data);
+                break;
+            }
+
+            case kPlistTokenString:
+                DT__AddProperty(node, name, value.length, (void*)value.text);
+                break;
+
+            case kPlistTokenInteger:
+            case kPlistTokenTrue:
+            case kPlistTokenFalse:
+            {
+                // Keys and data leave the arena unaligned. The tags around a number take more room than the padding.
+                int* number = (int*)(((size_t)*arena + sizeof(int) - 1) & ~(size_t)(sizeof(int) - 1));
+                *arena = (char*)number;
+                if(value.type == kPlistTokenInteger) *number = plist_decode_integer(&value);
+                else *number = (value.type == kPlistTokenTrue);
+                *arena += sizeof(*number);
+                DT__AddProperty(node, name, sizeof(*number), number);
+                break;
+            }
+
+            case kPlistTokenDict:
+            {
+                Node * subNode = DT__AddChild(node, name);
+                if(!streamDict(stream, subNode, arena, false)) return false;
+                break;
+            }
+
+            default:
+                // Same as processDict, arrays and the like aren't supported.
+                printf("Unable to handle key %s\n", name);
+                if(!plist_stream_skip(stream, &value)) return false;
+                break;
+        }
+    }
+
+    return key.type == kPlistTokenDictEnd;
+}
+
+/** Nul terminated copy of a string or data value, NULL for other types or when out of memory **/
+static char* copyValue(const plist_token_t* value)
+{
+    char* copy = NULL;
+
+    if(value->type == kPlistTokenString)
+    {
+        copy = arena_alloc(&gBootArena, value->length + 1);
+        if(!copy) return NULL;
+        memcpy(copy, value->text, value->length);
+        copy[value->length] = 0;
+    }
+    else if(value->type == kPlistTokenData)
+    {
+        copy = arena_alloc(&gBootArena, ((value->length * 3) / 4) + 1);
+        if(!copy) return NULL;
+        copy[plist_decode_data(value, copy)] = 0;
+    }
+
+    return copy;
+}
+
+/** Nul terminated copy of length bytes, NULL when out of memory **/
+static char* copyBytes(const void* bytes, int length)
+{
+    char* copy = arena_alloc(&gBootArena, length + 1);
+    if(!copy) return NULL;
+
+    memcpy(copy, bytes, length);
+    copy[length] = 0;
+
+    return copy;
+}
+
+/**
+ ** Walk the NVRAM dictionary, capturing boot-args for clearBootArgsHook and our EarlyKeys setting.
+ **/
+static bool scanNVRAM(plist_stream_t* stream)
+{
+    plist_token_t key, value;
+
+    while(plist_stream_next(stream, &key) == kPlistTokenKey)
+    {
+        plist_stream_next(stream, &value);
+
+        if(!gBootArgs && plist_token_equals(&key, "boot-args"))
+        {
+            gBootArgs = copyValue(&value);
+        }
+        else if(plist_token_equals(&key, FILE_NVRAM_GULD) && (value.type == kPlistTokenDict))
+        {
+            while(plist_stream_next(stream, &key) == kPlistTokenKey)
+            {
+                plist_stream_next(stream, &value);
+                if(!gEarlyKeys && plist_token_equals(&key, NVRAM_EARLY_KEYS)) gEarlyKeys = copyValue(&value);
+                if(!plist_stream_skip(stream, &value)) return false;
+            }
+
+            if(key.type != kPlistTokenDictEnd) return false;
+            continue;
+        }
+
+        if(!plist_stream_skip(stream, &value)) return false;
+    }
+
+    return key.type == kPlistTokenDictEnd;
+}
+
+/** True if key is listed in the space or comma separated list **/
+static bool listContains(const char* list, const char* key)
+{
+    int length = strlen(key);
+
+    while(list && *list)
+    {
+        const char* end = list;
+        while(*end && *end != ' ' && *end != ',') end++;
+
+        if((end - list) == length && !strncmp(list, key, length)) return true;
+
+        list = *end ? end + 1 : end;
+    }
+
+    return false;
+}
+
+/**
+ ** Filter for top level variables: boot-args once FileNVRAM_hook has zero'd it out, and in lazy mode
+ ** anything that isn't needed before FileNVRAM.kext reads the file itself.
+ **/
+static bool injectKey(const char* key)
+{
+    int i;
+
+    if(gBootArgsCleared && !strcmp(key, "boot-args")) return false;
+    if(!gLazyLoad) return true;
+
+    for(i = 0; gEarlyAllowlist[i]; i++)
+    {
+        if(!strcmp(gEarlyAllowlist[i], key)) return true;
+    }
+
+    if(listContains(gEarlyKeys, key)) return true;
+
+    gDeferredKeys++;
+    return false;
+}
+
+/**
+ ** Tokenize the plist without building the XML tree: locate the NVRAM dictionary and capture what
+ ** our own hooks need. Returns false if the file needs the full parser.
+ **/
+static bool scanplist(const char* buffer, int length)
+{
+    plist_stream_t stream;
+    plist_token_t  key, value;
+
+    plist_stream_init(&stream, buffer, length);
+    if(plist_stream_next(&stream, &value) != kPlistTokenDict) return false;
+
+    while(plist_stream_next(&stream, &key) == kPlistTokenKey)
+    {
+        plist_stream_next(&stream, &value);
+
+        if(!gNVRAMFound && plist_token_equals(&key, "NVRAM") && (value.type == kPlistTokenDict))
+        {
+            gNVRAMFound = true;
+            gNVRAMStream = stream;      // FileNVRAM_hook resumes here
+            if(!scanNVRAM(&stream)) return false;
+        }
+        else if(!plist_stream_skip(&stream, &value))
+        {
+            return false;
+        }
+    }
 
-        count--;
+    // IDREF values need the full parser to resolve.
+    return (key.type == kPlistTokenDictEnd) && !stream.refs;
+}
 
+/**
+ ** Load the device tree blob the kext writes next to the nvram file, if it was built from exactly this file.
+ **/
+static bool readblob(BVRef bvr, const char* plist, int length)
+{
+    char        path[64];
+    char*       blob = NULL;
+    bool        valid = false;
+    uint32_t    argsLength;
+    const char* args;
+
+    sprintf(path, "hd(%d,%d)/Extra/nvram.blob", BIOS_DEV_UNIT(bvr), bvr->part_no);
+    int fh = open(path, 0);
+    if(fh < 0) return false;
+
+    unsigned int blobSize = file_size(fh);
+    if(blobSize > 0)
+    {
+        blob = malloc(blobSize);
+        valid = (read(fh, blob, blobSize) == blobSize) &&
+                dtblob_valid(blob, blobSize, adler32_update(ADLER32_INIT, (const uint8_t*)plist, length));
+    }
+    close(fh);
+
+    if(!valid)
+    {
+        if(blob) free(blob);
+        verbose("FileNVRAM: no matching device tree blob, parsing nvram plist\n");
+        return false;
+    }
+
+    gNVRAMBlob = blob;
+
+    if((args = dtblob_find(blob, NULL, "boot-args", &argsLength)))
+    {
+        gBootArgs = copyBytes(args, argsLength);
+    }
+
+    if((args = dtblob_find(blob, FILE_NVRAM_GULD, NVRAM_EARLY_KEYS, &argsLength)))
+    {
+        gEarlyKeys = copyBytes(args, argsLength);
+    }
+
+    return true;
+}
+
+/**
+ ** Parse the XML tree the first time the public API needs it.
+ ** XMLParseFile modifies the buffer, so from then on FileNVRAM_hook injects from the tree.
+ **/
+static TagPtr loadNVRAMData()
+{
+    static bool parsed = false;
+
+    if(!parsed && gPListBase)
+    {
+        parsed = true;
+        gNVRAMStreamable = false;
+
+        XMLParseFile( gPListBase, &gPListData );
+        if(gPListData)
+        {
+            gNVRAMData = XMLCastDict(XMLGetProperty(gPListData,"NVRAM"));
+            if(gNVRAMData)
+            {
+                nvram_index_build(&gNVRAMIndex, gNVRAMData);   // falls back to list walks on failure
+                if(gBootArgsCleared) removeNVRAMVariable("boot-args");
+            }
+        }
     }
+
+    return gNVRAMData;
 }
 
 /*
@@ -302,6 +680,10 @@ static void clearBootArgsHook()
         if(entry) addBootArg(value);
 
     }
+    else if(gBootArgs)
+    {
+        addBootArg(gBootArgs);
+    }
 
 }
 
@@ -329,6 +711,7 @@ static void getcommandline(char* args, char* args_end)
 static void readplist()
 {
     extern BVRef    bvChain;
+    uint64_t        readplistStart = timeline_now();
 
 #if HAS_MKEXT
     /* We need to patch the kernel to load up an mkext in the event that the kernel is prelinked. */
@@ -337,16 +720,30 @@ static void readplist()
 
 
     // We need the platform UUID *early*
-    InternalreadSMBIOSInfo(getSmbios(SMBIOS_ORIGINAL));
-    const char* uuid = getStringFromUUID(getSmbiosUUID());
+    const char* uuid = getPlatformUUIDString();
 
     // By the time we are here, the file system has already been probed, lets fine the nvram plist.
+    uint64_t scanStart = timeline_now();
+    arena_scope_t scope = arena_begin(&gPhaseArena, ARENA_PHASE_SCAN);
     BVRef bvr = scanforNVRAM(bvChain);
+    arena_end(&scope);
+    timeline_record(TIMELINE_LOADER_SCAN, scanStart);
 
     /** Load Dictionary if possible **/
     if(bvr)
     {
-        char* nvramPath = malloc(sizeof("hd(%d,%d)/Extra/nvram.plist") + (uuid ? strlen(uuid)  + 2 : 0));
+        uint64_t parseStart = timeline_now();
+        scope = arena_begin(&gPhaseArena, ARENA_PHASE_PARSE);
+        sprintf(gNVRAMVolume, "hd(%d,%d)", BIOS_DEV_UNIT(bvr), bvr->part_no);
+#if HAS_MKEXT
+        patch_cache_read(bvr);
+#endif
+        char* nvramPath = arena_alloc(&gPhaseArena, sizeof("hd(%d,%d)/Extra/nvram.plist") + (uuid ? strlen(uuid)  + 2 : 0));
+        if(!nvramPath)
+        {
+            arena_end(&scope);
+            return;
+        }
         if(!uuid) sprintf(nvramPath, "hd(%d,%d)/Extra/nvram.plist", BIOS_DEV_UNIT(bvr), bvr->part_no);
         else sprintf(nvramPath, "hd(%d,%d)/Extra/nvram.%s.plist", BIOS_DEV_UNIT(bvr), bvr->part_no, uuid);
         int fh = open(nvramPath, 0);
@@ -355,15 +752,25 @@ static void readplist()
             unsigned int plistSize = file_size(fh);
             if (plistSize > 0)
             {
-                char* plistBase = (char*) malloc(plistSize);
+                // Kept for the whole boot, device tree strings point into it.
+                char* plistBase = (char*) arena_alloc(&gBootArena, plistSize + 1);
                 
-                if (plistSize && read(fh, plistBase, plistSize) == plistSize)
+                if (plistBase && read(fh, plistBase, plistSize) == plistSize)
                 {
-                    XMLParseFile( plistBase, &gPListData );
-                    if(gPListData)
+                    plistBase[plistSize] = 0;
+                    gPListBase = plistBase;
+                    gPListSize = plistSize;
+
+                    // A blob the kext built from this exact file needs no parsing at all. Otherwise well formed
+                    // files are streamed into the device tree, anything else takes the full parser.
+                    if(!readblob(bvr, plistBase, plistSize))
+                    {
+                        gNVRAMStreamable = scanplist(plistBase, plistSize);
+                        if(!gNVRAMStreamable) loadNVRAMData();
+                    }
+
+                    if(gNVRAMBlob || gNVRAMStreamable || gPListData)
                     {
-                        gNVRAMData = XMLCastDict(XMLGetProperty(gPListData,"NVRAM"));
-                        
                         register_hook_callback("DriversLoaded",&FileNVRAM_hook);    // Main code, runs when kernel has begun booting.
                         register_hook_callback("BootOptions", (void (*)(void *, void *, void *, void *)) &getcommandline);     // Code executed every time the boot options / command line is used.
                         register_hook_callback("ClearArgs", &clearBootArgsHook);    // Code executed every time the boot arguments are cleared out.
@@ -372,8 +779,11 @@ static void readplist()
                 }
             }
         }
-        free(nvramPath);
+        arena_end(&scope);
+        timeline_record(TIMELINE_LOADER_PARSE, parseStart);
     }
+
+    timeline_record(TIMELINE_LOADER_READPLIST, readplistStart);
 }
 
 
@@ -383,11 +793,36 @@ void FileNVRAM_hook()
     getBoolForKey(BOOT_KEY_NVRAM_DISABLED, &disable, &bootInfo->chameleonConfig);
     if(disable) return;
 
-    const char* uuid = getStringFromUUID(getSmbiosUUID());
+    uint64_t hookStart = timeline_now();
+
+    const char* uuid = getPlatformUUIDString();
 
     Node * nvramNode = DT__FindNode("/chosen/nvram", true);
     Node * settingsNode = DT__AddChild(nvramNode, FILE_NVRAM_GULD);
 
+    if(gNVRAMVolume[0])
+    {
+        DT__AddProperty(settingsNode, NVRAM_SET_VOLUME, strlen(gNVRAMVolume)+1, gNVRAMVolume);
+    }
+
+    // Split mode: the kext is told to read everything else from the nvram file itself.
+    getBoolForKey(BOOT_KEY_NVRAM_LAZY, &gLazyLoad, &bootInfo->chameleonConfig);
+    if(gLazyLoad)
+    {
+        static int lazy = 1;
+        DT__AddProperty(settingsNode, NVRAM_LAZY_LOAD, sizeof(lazy), &lazy);
+    }
+
+    // Forward our boot phases to the kext. The device tree is flattened later, so phases recorded after this point are included.
+    DT__AddProperty(settingsNode, NVRAM_TIMELINE_KEY, sizeof(timeline_t), timeline_get());
+
+#if HAS_MKEXT
+    // patch_kernel ran on DecodeKernel, have the kext save what it found.
+    uint32_t patchCacheLength;
+    const void* patchCache = patch_cache_pending(&patchCacheLength);
+    if(patchCache) DT__AddProperty(settingsNode, NVRAM_PATCH_CACHE, patchCacheLength, (void*)patchCache);
+#endif
+
     if(gCommandline)
     {
         DT__AddProperty(nvramNode, "boot-args", strlen(gCommandline)+1, (void*)gCommandline);
@@ -397,13 +832,49 @@ void FileNVRAM_hook()
         // Ensure boot-args is zero'd out.
         char* null = "";
         DT__AddProperty(nvramNode, "boot-args", strlen(null)+1, (void*)null);
-        removeNVRAMVariable("boot-args");
+        gBootArgsCleared = true;
+        if(gNVRAMData) removeNVRAMVariable("boot-args");
     }
 
+    // Everything the device tree points to must outlive the hook, so it comes from gBootArena.
     if(gNVRAMData)
     {
-        processDict(gNVRAMData, nvramNode);
+        uint64_t injectStart = timeline_now();
+
+        // The public API may have been used, take EarlyKeys from the tree.
+        TagPtr settings = XMLGetProperty(gNVRAMData, FILE_NVRAM_GULD);
+        TagPtr early = XMLIsDict(settings) ? XMLGetProperty(settings, NVRAM_EARLY_KEYS) : NULL;
+        if(XMLIsString(early))
+        {
+            gEarlyKeys = XMLCastString(early);
+        }
+        else if(XMLIsData(early))
+        {
+            int length;
+            char* value = XMLCastData(early, &length);
+            gEarlyKeys = copyBytes(value, length);
+        }
+
+        if(!processDict(gNVRAMData, nvramNode, true)) verbose("FileNVRAM: out of memory, nvram variables not injected\n");
+        timeline_record(TIMELINE_LOADER_INJECT, injectStart);
+    }
+    else if(gNVRAMBlob)
+    {
+        uint64_t injectStart = timeline_now();
+        dtblob_inject(gNVRAMBlob, nvramNode, &injectKey);
+        timeline_record(TIMELINE_LOADER_INJECT, injectStart);
     }
+    else if(gNVRAMStreamable && gNVRAMFound)
+    {
+        uint64_t injectStart = timeline_now();
+        plist_stream_t stream = gNVRAMStream;
+        char* arena = arena_alloc(&gBootArena, gPListSize);
+        if(arena) streamDict(&stream, nvramNode, &arena, true);
+        else verbose("FileNVRAM: out of memory, nvram variables not injected\n");
+        timeline_record(TIMELINE_LOADER_INJECT, injectStart);
+    }
+
+    if(gDeferredKeys) verbose("FileNVRAM: %d variables left for FileNVRAM.kext to load\n", gDeferredKeys);
 
     char* path = NULL;
 
@@ -415,10 +886,13 @@ void FileNVRAM_hook()
         if(bvr->description)
         {
             bvr->description(bvr, label, sizeof(label)-1);
-            path = malloc(sizeof("/Volumes/%s/Extra/nvram..plist") + strlen(label));
-            if(uuid) sprintf(path, "/Volumes/%s/Extra/nvram.%s.plist", label, uuid);
-            else sprintf(path, "/Volumes/%s/Extra/nvram.plist", label, uuid);
-            DT__AddProperty(settingsNode, NVRAM_SET_FILE_PATH, strlen(path)+1, path);
+            path = arena_alloc(&gBootArena, sizeof("/Volumes/%s/Extra/nvram..plist") + strlen(label) + (uuid ? strlen(uuid) : 0));
+            if(path)
+            {
+                if(uuid) sprintf(path, "/Volumes/%s/Extra/nvram.%s.plist", label, uuid);
+                else sprintf(path, "/Volumes/%s/Extra/nvram.plist", label);
+                DT__AddProperty(settingsNode, NVRAM_SET_FILE_PATH, strlen(path)+1, path);
+            }
         }
     }
     else
@@ -426,15 +900,27 @@ void FileNVRAM_hook()
         if(!uuid) path = "/Extra/nvram.plist";
         else
         {
-            path = malloc(sizeof("/Extra/nvram..plist") + strlen(uuid));
-            sprintf(path, "/Extra/nvram.%s.plist", uuid);
+            path = arena_alloc(&gBootArena, sizeof("/Extra/nvram..plist") + strlen(uuid));
+            if(path) sprintf(path, "/Extra/nvram.%s.plist", uuid);
         }
-        DT__AddProperty(settingsNode, NVRAM_SET_FILE_PATH, strlen(path)+1, path);
+        // Without a path the kext falls back to /Extra/nvram.plist.
+        if(path) DT__AddProperty(settingsNode, NVRAM_SET_FILE_PATH, strlen(path)+1, path);
     }
     
 #if HAS_MKEXT
+    uint64_t mkextStart = timeline_now();
+#if MKEXT_LZ4
+    addCompressedMKext(FileNVRAM_mkext_lz4, FileNVRAM_mkext_lz4_len, FileNVRAM_mkext_raw_len);
+#else
     addMKext(FileNVRAM_mkext, FileNVRAM_mkext_len);
 #endif
+    timeline_record(TIMELINE_LOADER_MKEXT, mkextStart);
+#endif
+
+    timeline_record(TIMELINE_LOADER_HOOK, hookStart);
+
+    arena_report(&gBootArena);
+    arena_report(&gPhaseArena);
 }
 
 #if HAS_MKEXT
@@ -450,11 +936,7 @@ static bool addMKext(void* binary, unsigned long len)
     DriversPackage * package = binary;
 
     // Verify the MKext.
-    if (( GetPackageElement(signature1) != kDriverPackageSignature1) ||
-        ( GetPackageElement(signature2) != kDriverPackageSignature2) ||
-        ( GetPackageElement(length)      > kLoadSize )               ||
-        ( GetPackageElement(adler32)    !=
-         Adler32((unsigned char *)&package->version, GetPackageElement(length) - 0x10) ) )
+    if (!verifyMKext(package))
     {
         return false;
     }
@@ -473,4 +955,40 @@ static bool addMKext(void* binary, unsigned long len)
 
     return true;
 }
+
+static bool verifyMKext(DriversPackage* package)
+{
+    return (( GetPackageElement(signature1) == kDriverPackageSignature1) &&
+            ( GetPackageElement(signature2) == kDriverPackageSignature2) &&
+            ( GetPackageElement(length)     <= kLoadSize )               &&
+            ( GetPackageElement(adler32)    ==
+             Adler32((unsigned char *)&package->version, GetPackageElement(length) - 0x10) ) );
+}
+
+#if MKEXT_LZ4
+/**
+ ** The embedded mkext is lz4 compressed (COMPRESS_MKEXT=lz4). Decode it into a scratch buffer and hand it to
+ ** addMKext, which verifies it before reserving any kernel memory. Kernel memory can't be given back, so a
+ ** corrupt payload must not claim it.
+ **/
+static bool addCompressedMKext(void* compressed, unsigned long compressedLength, unsigned long length)
+{
+    bool             added = false;
+    uint8_t*         binary = malloc(length);
+
+    if (!binary)
+    {
+        return false;
+    }
+
+    // addMKext verifies the adler32, which also covers any damage to the compressed payload.
+    if (lz4_decode_legacy(compressed, compressedLength, binary, length) == length)
+    {
+        added = addMKext(binary, length);
+    }
+
+    free(binary);
+    return added;
+}
+#endif /* MKEXT_LZ4 */
 #endif
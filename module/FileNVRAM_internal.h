@@ -15,11 +15,18 @@
 #ifndef FILENVRAM_INTERNAL_H
 #define FILENVRAM_INTERNAL_H
 
+#include "adler32.h"
+
 #define BOOT_KEY_NVRAM_DISABLED		"NoFileNVRAM"
+#define BOOT_KEY_NVRAM_LAZY         "FileNVRAMLazy"
 
 #define FILE_NVRAM_GULD         "D8F0CCF5-580E-4334-87B6-9FBBB831271D"
 #define NVRAM_ENABLE_LOG        "EnableLogging"
 #define NVRAM_SET_FILE_PATH     "NVRAMFile"
+#define NVRAM_SET_VOLUME        "NVRAMVolume"
+#define NVRAM_LAZY_LOAD         "LazyLoad"
+#define NVRAM_EARLY_KEYS        "EarlyKeys"
+#define NVRAM_PATCH_CACHE       "PatchCache"
 
 #define GetPackageElement(e)     OSSwapBigToHostInt32(package->e)
 #define kDriverPackageSignature1 'MKXT'
@@ -42,30 +49,7 @@ typedef struct DriversPackage DriversPackage;
 static inline unsigned long
 Adler32( unsigned char * buffer, long length )
 {
-    long          cnt;
-    unsigned long result, lowHalf, highHalf;
-
-    lowHalf  = 1;
-    highHalf = 0;
-
-    for ( cnt = 0; cnt < length; cnt++ )
-    {
-        if ((cnt % 5000) == 0)
-        {
-            lowHalf  %= 65521L;
-            highHalf %= 65521L;
-        }
-        
-        lowHalf  += buffer[cnt];
-        highHalf += lowHalf;
-    }
-
-    lowHalf  %= 65521L;
-    highHalf %= 65521L;
-
-    result = (highHalf << 16) | lowHalf;
-
-    return result;
+    return adler32_update(ADLER32_INIT, buffer, length);
 }
 
 #endif /* FILENVRAM_INTERNAL_H */
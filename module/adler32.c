@@ -0,0 +1,128 @@
+/*
+ *  adler32.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "adler32.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#define ADLER32_BASE    65521U
+
+/* Largest n, multiple of 16, such that 255n(n+1)/2 + (n+1)(BASE-1) fits in 32 bits: sums only need reducing every NMAX bytes. */
+#define ADLER32_NMAX    5552
+
+#define ADLER32_DO1(i)  { a += buffer[i]; b += a; }
+#define ADLER32_DO4(i)  { ADLER32_DO1(i) ADLER32_DO1(i+1) ADLER32_DO1(i+2) ADLER32_DO1(i+3) }
+#define ADLER32_DO16    { ADLER32_DO4(0) ADLER32_DO4(4) ADLER32_DO4(8) ADLER32_DO4(12) }
+
+uint32_t adler32_scalar(uint32_t adler, const uint8_t* buffer, size_t length)
+{
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+
+    while(length)
+    {
+        size_t n = (length < ADLER32_NMAX) ? length : ADLER32_NMAX;
+        length -= n;
+
+        for(; n >= 16; n -= 16, buffer += 16) ADLER32_DO16
+        for(; n; n--, buffer++) ADLER32_DO1(0)
+
+        a %= ADLER32_BASE;
+        b %= ADLER32_BASE;
+    }
+
+    return (b << 16) | a;
+}
+
+#if defined(__SSE2__)
+static inline uint32_t hsum_epi32(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+/**
+ ** For each 16 byte chunk c, b grows by 16 * a + sum((16 - i) * c[i]) and a by sum(c[i]).
+ ** Per NMAX block we accumulate the byte sums, the weighted sums and the running a at the start of each chunk,
+ ** then fold them into a and b once.
+ **/
+static uint32_t adler32_sse2(uint32_t adler, const uint8_t* buffer, size_t length)
+{
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+
+    const __m128i zero = _mm_setzero_si128();
+#if defined(__SSSE3__)
+    const __m128i weights = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i ones    = _mm_set1_epi16(1);
+#else
+    const __m128i weightsLo = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+    const __m128i weightsHi = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+#endif
+
+    while(length)
+    {
+        size_t n = (length < ADLER32_NMAX) ? length : ADLER32_NMAX;
+        size_t chunks = n / 16;
+        length -= n;
+        n -= chunks * 16;
+
+        if(chunks)
+        {
+            __m128i vs1 = zero;     /* byte sums */
+            __m128i vps = zero;     /* byte sums preceding each chunk */
+            __m128i vs2 = zero;     /* weighted sums */
+            size_t  i;
+
+            for(i = 0; i < chunks; i++, buffer += 16)
+            {
+                __m128i bytes = _mm_loadu_si128((const __m128i*)buffer);
+
+                vps = _mm_add_epi32(vps, vs1);
+                vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(bytes, zero));
+#if defined(__SSSE3__)
+                vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_maddubs_epi16(bytes, weights), ones));
+#else
+                vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weightsLo));
+                vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weightsHi));
+#endif
+            }
+
+            b += (uint32_t)(a * chunks * 16) + (hsum_epi32(vps) << 4) + hsum_epi32(vs2);
+            a += hsum_epi32(vs1);
+        }
+
+        for(; n; n--, buffer++) ADLER32_DO1(0)
+
+        a %= ADLER32_BASE;
+        b %= ADLER32_BASE;
+    }
+
+    return (b << 16) | a;
+}
+#endif /* __SSE2__ */
+
+uint32_t adler32_update(uint32_t adler, const uint8_t* buffer, size_t length)
+{
+#if defined(__SSE2__)
+    return adler32_sse2(adler, buffer, length);
+#else
+    return adler32_scalar(adler, buffer, length);
+#endif
+}
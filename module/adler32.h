@@ -0,0 +1,29 @@
+/*
+ *  adler32.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_ADLER32_H
+#define __FILENVRAM_ADLER32_H
+
+#include "libsaio.h"
+
+#define ADLER32_INIT    1
+
+/**
+ ** Continue a running Adler-32 over length more bytes, zlib style: start from ADLER32_INIT.
+ ** Uses an SSE2 (or SSSE3) kernel when the module is built for it.
+ **/
+uint32_t    adler32_update(uint32_t adler, const uint8_t* buffer, size_t length);
+
+/** Plain C version, always available **/
+uint32_t    adler32_scalar(uint32_t adler, const uint8_t* buffer, size_t length);
+
+#endif /* !__FILENVRAM_ADLER32_H */
@@ -0,0 +1,114 @@
+/*
+ *  arena.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "arena.h"
+
+#define ARENA_ALIGN(x)      (((x) + 7) & ~(size_t)7)
+#define ARENA_HEADER_SIZE   ARENA_ALIGN(sizeof(arena_chunk_t))
+
+arena_t gBootArena  = ARENA_INITIALIZER("boot",  16 * 1024);
+arena_t gPhaseArena = ARENA_INITIALIZER("phase",  4 * 1024);
+
+static const char* gPhaseNames[ARENA_PHASES] = { "scan", "parse", "patch" };
+
+void* arena_alloc(arena_t* arena, size_t size)
+{
+    arena_chunk_t* chunk = arena->chunk;
+    void* pointer;
+
+    size = ARENA_ALIGN(size);
+
+    if(!chunk || (chunk->size - chunk->used) < size)
+    {
+        // Anything larger than a chunk gets a chunk of its own, the rest of the current one is abandoned.
+        size_t chunkSize = (size > arena->chunkSize) ? size : arena->chunkSize;
+
+        chunk = malloc(ARENA_HEADER_SIZE + chunkSize);
+        if(!chunk) return NULL;
+
+        chunk->prev = arena->chunk;
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        arena->chunk = chunk;
+    }
+
+    pointer = (char*)chunk + ARENA_HEADER_SIZE + chunk->used;
+    chunk->used += size;
+
+    arena->used += size;
+    arena->allocations++;
+    if(arena->used > arena->highWater) arena->highWater = arena->used;
+
+    return pointer;
+}
+
+char* arena_strdup(arena_t* arena, const char* string)
+{
+    size_t length = strlen(string) + 1;
+    char* copy = arena_alloc(arena, length);
+
+    if(copy) memcpy(copy, string, length);
+    return copy;
+}
+
+arena_scope_t arena_begin(arena_t* arena, int phase)
+{
+    arena_scope_t scope;
+
+    scope.arena     = arena;
+    scope.chunk     = arena->chunk;
+    scope.chunkUsed = arena->chunk ? arena->chunk->used : 0;
+    scope.used      = arena->used;
+    scope.highWater = arena->highWater;
+    scope.phase     = phase;
+
+    // Measure this scope's peak from here.
+    arena->highWater = arena->used;
+
+    return scope;
+}
+
+void arena_end(arena_scope_t* scope)
+{
+    arena_t* arena = scope->arena;
+    size_t peak = arena->highWater - scope->used;
+
+    while(arena->chunk != scope->chunk)
+    {
+        arena_chunk_t* chunk = arena->chunk;
+        arena->chunk = chunk->prev;
+        free(chunk);
+    }
+
+    if(arena->chunk) arena->chunk->used = scope->chunkUsed;
+    arena->used = scope->used;
+
+    if(scope->highWater > arena->highWater) arena->highWater = scope->highWater;
+    if(peak > arena->phaseHighWater[scope->phase]) arena->phaseHighWater[scope->phase] = peak;
+}
+
+void arena_report(const arena_t* arena)
+{
+    int phase;
+
+    verbose("FileNVRAM: %s arena %d bytes in use, %d high water, %d allocations\n",
+            arena->name, (int)arena->used, (int)arena->highWater, (int)arena->allocations);
+
+    for(phase = 0; phase < ARENA_PHASES; phase++)
+    {
+        if(arena->phaseHighWater[phase])
+        {
+            verbose("FileNVRAM:     %s phase high water %d bytes\n", gPhaseNames[phase], (int)arena->phaseHighWater[phase]);
+        }
+    }
+}
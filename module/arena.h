@@ -0,0 +1,74 @@
+/*
+ *  arena.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_ARENA_H
+#define __FILENVRAM_ARENA_H
+
+#include "libsaio.h"
+
+/**
+ ** Bump pointer arena on top of the libsaio heap. Allocations can't be freed individually, instead a scope
+ ** releases everything allocated since it began in one go.
+ **/
+enum
+{
+    ARENA_PHASE_SCAN = 0,
+    ARENA_PHASE_PARSE,
+    ARENA_PHASE_PATCH,
+    ARENA_PHASES
+};
+
+typedef struct arena_chunk
+{
+    struct arena_chunk* prev;       /* chunks are linked newest first */
+    size_t              size;
+    size_t              used;
+} arena_chunk_t;
+
+typedef struct
+{
+    const char*     name;
+    arena_chunk_t*  chunk;
+    size_t          chunkSize;
+    size_t          used;           /* bytes handed out */
+    size_t          highWater;
+    size_t          allocations;
+    size_t          phaseHighWater[ARENA_PHASES];
+} arena_t;
+
+typedef struct
+{
+    arena_t*        arena;
+    arena_chunk_t*  chunk;
+    size_t          chunkUsed;
+    size_t          used;
+    size_t          highWater;      /* arena high water when the scope began */
+    int             phase;
+} arena_scope_t;
+
+#define ARENA_INITIALIZER(name, chunkSize)  { name, NULL, chunkSize, 0, 0, 0, { 0 } }
+
+extern arena_t gBootArena;      /** Lives until the kernel is started: device tree values and strings **/
+extern arena_t gPhaseArena;     /** Scratch memory, released at the end of each phase **/
+
+/** 8 byte aligned, NULL if the heap is exhausted **/
+void*           arena_alloc(arena_t* arena, size_t size);
+char*           arena_strdup(arena_t* arena, const char* string);
+
+arena_scope_t   arena_begin(arena_t* arena, int phase);
+
+/** Release everything allocated in the scope and record the phase's high water mark **/
+void            arena_end(arena_scope_t* scope);
+
+void            arena_report(const arena_t* arena);
+
+#endif /* !__FILENVRAM_ARENA_H */
@@ -0,0 +1,142 @@
+/*
+ *  base64.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "base64.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#define BASE64_PAD      -2      /* '=' */
+#define BASE64_SKIP     -1      /* whitespace, line breaks and anything else */
+
+static int8_t gDecodeTable[256];
+static bool   gDecodeTableReady;
+
+static void base64_init(void)
+{
+    int i;
+
+    for(i = 0; i < 256; i++)        gDecodeTable[i] = BASE64_SKIP;
+    for(i = 0; i < 26; i++)         gDecodeTable['A' + i] = i;
+    for(i = 0; i < 26; i++)         gDecodeTable['a' + i] = 26 + i;
+    for(i = 0; i < 10; i++)         gDecodeTable['0' + i] = 52 + i;
+    gDecodeTable['+'] = 62;
+    gDecodeTable['/'] = 63;
+    gDecodeTable['='] = BASE64_PAD;
+
+    gDecodeTableReady = true;
+}
+
+#if defined(__SSSE3__)
+/**
+ ** Decode 16 characters to 12 bytes, or return false if any of them isn't in the alphabet
+ ** (whitespace, padding), leaving those for the scalar loop.
+ **/
+static inline bool base64_decode16(const char* text, uint8_t* out)
+{
+    const __m128i chars = _mm_loadu_si128((const __m128i*)text);
+
+    // Bytes >= 0x80 are negative here, so they fall outside every range.
+    const __m128i upper = _mm_andnot_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('Z')), _mm_cmpgt_epi8(chars, _mm_set1_epi8('A' - 1)));
+    const __m128i lower = _mm_andnot_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('z')), _mm_cmpgt_epi8(chars, _mm_set1_epi8('a' - 1)));
+    const __m128i digit = _mm_andnot_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('9')), _mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)));
+    const __m128i plus  = _mm_cmpeq_epi8(chars, _mm_set1_epi8('+'));
+    const __m128i slash = _mm_cmpeq_epi8(chars, _mm_set1_epi8('/'));
+
+    const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+    if(_mm_movemask_epi8(valid) != 0xFFFF) return false;
+
+    __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+    shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+    shift = _mm_or_si128(shift, _mm_and_si128(plus,  _mm_set1_epi8(62 - '+')));
+    shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(63 - '/')));
+
+    // Merge sextet pairs to 12 bits, then pairs of those to 24 bits per 32 bit lane.
+    __m128i merged = _mm_maddubs_epi16(_mm_add_epi8(chars, shift), _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+
+    // Each lane now holds its three output bytes little endian.
+    merged = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+    _mm_storel_epi64((__m128i*)out, merged);
+    uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(merged, 8));
+    memcpy(out + 8, &tail, sizeof(tail));
+
+    return true;
+}
+#endif /* __SSSE3__ */
+
+static int base64_decode_loop(const char* text, int length, uint8_t* out, bool vector)
+{
+    const uint8_t* pos = (const uint8_t*)text;
+    const uint8_t* end = pos + length;
+    uint32_t bits = 0;
+    int count = 0;
+    int decoded = 0;
+
+    if(!gDecodeTableReady) base64_init();
+
+    while(pos < end)
+    {
+#if defined(__SSSE3__)
+        // Only between quanta: a whole block then lines up with the output.
+        if(vector && !count)
+        {
+            while(end - pos >= 16 && base64_decode16((const char*)pos, out + decoded))
+            {
+                pos += 16;
+                decoded += 12;
+            }
+            if(pos >= end) break;
+        }
+#endif
+
+        int value = gDecodeTable[*pos++];
+        if(value == BASE64_PAD) break;
+        if(value == BASE64_SKIP) continue;
+
+        bits = (bits << 6) | value;
+        if(++count == 4)
+        {
+            out[decoded++] = (uint8_t)(bits >> 16);
+            out[decoded++] = (uint8_t)(bits >> 8);
+            out[decoded++] = (uint8_t)bits;
+            bits = 0;
+            count = 0;
+        }
+    }
+
+    if(count == 3)
+    {
+        out[decoded++] = (uint8_t)(bits >> 10);
+        out[decoded++] = (uint8_t)(bits >> 2);
+    }
+    else if(count == 2)
+    {
+        out[decoded++] = (uint8_t)(bits >> 4);
+    }
+
+    return decoded;
+}
+
+int base64_decode_scalar(const char* text, int length, uint8_t* out)
+{
+    return base64_decode_loop(text, length, out, false);
+}
+
+int base64_decode(const char* text, int length, uint8_t* out)
+{
+    return base64_decode_loop(text, length, out, true);
+}
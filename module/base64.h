@@ -0,0 +1,28 @@
+/*
+ *  base64.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_BASE64_H
+#define __FILENVRAM_BASE64_H
+
+#include "libsaio.h"
+
+/**
+ ** Decode length characters of base64 text into out, which needs room for (length * 3) / 4 bytes.
+ ** Like libsaio's BASE64Decode, characters outside the alphabet are skipped and the first '=' ends the data.
+ ** Returns the decoded length. Uses an SSSE3 kernel when the module is built for it.
+ **/
+int     base64_decode(const char* text, int length, uint8_t* out);
+
+/** Plain C version, always available **/
+int     base64_decode_scalar(const char* text, int length, uint8_t* out);
+
+#endif /* !__FILENVRAM_BASE64_H */
@@ -0,0 +1,65 @@
+/*
+ *  call_scan.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "call_scan.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define X86_CALL_REL32  0xE8
+
+#if defined(__SSE2__)
+/** Bit n set if bytes[n] is an E8 **/
+static inline UInt32 call_mask(const UInt8* bytes)
+{
+    __m128i chunk = _mm_loadu_si128((const __m128i*)bytes);
+    return (UInt32)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8((char)X86_CALL_REL32)));
+}
+#endif
+
+bool call_scan_next(const UInt8* bytes, UInt32 from, UInt32 end, UInt32* opcode, UInt32* target)
+{
+    UInt32 pos = from;
+    UInt32 last;
+
+    if(end < 5 || from > end - 5) return false;
+    last = end - 5;         // the rel32 has to fit
+
+#if defined(__SSE2__)
+    // pos passes last after a block that ends right at it, and last - pos would wrap.
+    for(; pos <= last && last - pos >= 15; pos += 16)
+    {
+        UInt32 mask = call_mask(bytes + pos);
+        if(mask)
+        {
+            pos += __builtin_ctz(mask);
+            break;
+        }
+    }
+#endif
+
+    while(pos <= last && bytes[pos] != X86_CALL_REL32) pos++;
+    if(pos > last) return false;
+
+    UInt32 rel = pos + 1;
+    UInt32 displacement = bytes[rel + 0] << 0  |
+                          bytes[rel + 1] << 8  |
+                          bytes[rel + 2] << 16 |
+                          (UInt32)bytes[rel + 3] << 24;
+
+    *opcode = pos;
+    *target = rel + 4 + displacement;
+
+    return true;
+}
@@ -0,0 +1,26 @@
+/*
+ *  call_scan.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_CALL_SCAN_H
+#define __FILENVRAM_CALL_SCAN_H
+
+#include "libsaio.h"
+
+/**
+ ** Walk the near calls (E8 rel32) in a code buffer. Positions and targets are offsets into bytes.
+ ** Candidates are found with SSE2 when the module is built for it.
+ **/
+
+/** First E8 at or after from whose rel32 ends at or below end, and the target it would call **/
+bool    call_scan_next(const UInt8* bytes, UInt32 from, UInt32 end, UInt32* opcode, UInt32* target);
+
+#endif /* !__FILENVRAM_CALL_SCAN_H */
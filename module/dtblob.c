@@ -0,0 +1,152 @@
+/*
+ *  dtblob.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "dtblob.h"
+
+#define DTBLOB_ALIGN(x)     (((x) + 3) & ~3)
+
+/** Size of the record at offset, including name, value and padding, or 0 if it doesn't fit in length **/
+static uint32_t record_size(const uint8_t* blob, uint32_t offset, uint32_t length)
+{
+    const dtblob_record_t* record;
+    uint64_t size;
+
+    if(length - offset < sizeof(dtblob_record_t)) return 0;
+    record = (const dtblob_record_t*)(blob + offset);
+
+    size = DTBLOB_ALIGN((uint64_t)sizeof(*record) + record->nameLength + record->valueLength);
+    if(!record->nameLength || size > length - offset) return 0;
+
+    // Names must be nul terminated.
+    if(blob[offset + sizeof(*record) + record->nameLength - 1]) return 0;
+
+    return (uint32_t)size;
+}
+
+bool dtblob_valid(const void* blob, long length, uint32_t stamp)
+{
+    const dtblob_header_t* header = blob;
+    const uint8_t* bytes = blob;
+    uint32_t offset;
+    int depth = 0;
+
+    if(!blob || length < (long)sizeof(*header))         return false;
+    if(header->magic != NVRAM_DTBLOB_MAGIC)             return false;
+    if(header->version != NVRAM_DTBLOB_VERSION)         return false;
+    if(header->length != length)                        return false;
+    if(header->stamp != stamp)                          return false;
+
+    for(offset = sizeof(*header); offset < header->length; )
+    {
+        const dtblob_record_t* record = (const dtblob_record_t*)(bytes + offset);
+        uint32_t size = record_size(bytes, offset, header->length);
+        if(!size) return false;
+
+        switch(record->type)
+        {
+            case NVRAM_DTBLOB_NODE:
+                if(++depth > NVRAM_DTBLOB_MAX_DEPTH) return false;
+                break;
+
+            case NVRAM_DTBLOB_END:
+                if(--depth < 0) return false;
+                break;
+
+            case NVRAM_DTBLOB_PROPERTY:
+                break;
+
+            default:
+                return false;
+        }
+
+        offset += size;
+    }
+
+    return depth == 0;
+}
+
+const void* dtblob_find(const void* blob, const char* parent, const char* name, uint32_t* length)
+{
+    const dtblob_header_t* header = blob;
+    const uint8_t* bytes = blob;
+    uint32_t offset;
+    int depth = 0;
+    bool inParent = !parent;
+
+    for(offset = sizeof(*header); offset < header->length; offset += record_size(bytes, offset, header->length))
+    {
+        const dtblob_record_t* record = (const dtblob_record_t*)(bytes + offset);
+        const char* recordName = (const char*)(record + 1);
+
+        if(record->type == NVRAM_DTBLOB_NODE)
+        {
+            if(++depth == 1) inParent = parent && !strcmp(recordName, parent);
+        }
+        else if(record->type == NVRAM_DTBLOB_END)
+        {
+            if(--depth == 0) inParent = !parent;
+        }
+        else if(inParent && (depth == (parent ? 1 : 0)) && !strcmp(recordName, name))
+        {
+            *length = record->valueLength;
+            return recordName + record->nameLength;
+        }
+    }
+
+    return NULL;
+}
+
+void dtblob_inject(const void* blob, Node* node, bool (*filter)(const char* name))
+{
+    const dtblob_header_t* header = blob;
+    const uint8_t* bytes = blob;
+    Node* parents[NVRAM_DTBLOB_MAX_DEPTH];
+    uint32_t offset;
+    int depth = 0;
+    int skipped = 0;        /* depth of a filtered out node being skipped */
+
+    for(offset = sizeof(*header); offset < header->length; offset += record_size(bytes, offset, header->length))
+    {
+        const dtblob_record_t* record = (const dtblob_record_t*)(bytes + offset);
+        char* name = (char*)(record + 1);
+
+        if(skipped)
+        {
+            if(record->type == NVRAM_DTBLOB_NODE)       skipped++;
+            else if(record->type == NVRAM_DTBLOB_END)   skipped--;
+            continue;
+        }
+
+        switch(record->type)
+        {
+            case NVRAM_DTBLOB_NODE:
+                if(!depth && filter && !filter(name))
+                {
+                    skipped = 1;
+                    break;
+                }
+                parents[depth++] = node;
+                node = DT__AddChild(node, name);
+                break;
+
+            case NVRAM_DTBLOB_END:
+                node = parents[--depth];
+                break;
+
+            case NVRAM_DTBLOB_PROPERTY:
+                if(!depth && filter && !filter(name)) break;
+                DT__AddProperty(node, name, record->valueLength, name + record->nameLength);
+                break;
+        }
+    }
+}
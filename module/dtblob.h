@@ -0,0 +1,58 @@
+/*
+ *  dtblob.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_DTBLOB_H
+#define __FILENVRAM_DTBLOB_H
+
+#include "libsaio.h"
+#include <libsaio/device_tree.h>
+
+/* Pre-flattened /chosen/nvram written by FileNVRAM.kext next to the nvram file. Must match kext/FileNVRAM/DTBlob.h */
+#define NVRAM_DTBLOB_MAGIC          0x42544446      /* 'FDTB' */
+#define NVRAM_DTBLOB_VERSION        1
+
+#define NVRAM_DTBLOB_NODE           1
+#define NVRAM_DTBLOB_PROPERTY       2
+#define NVRAM_DTBLOB_END            3
+
+#define NVRAM_DTBLOB_MAX_DEPTH      32
+
+typedef struct
+{
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    reserved;
+    uint32_t    length;         /* total, including this header */
+    uint32_t    stamp;          /* Adler-32 of the nvram file the blob was built with */
+} __attribute__((packed)) dtblob_header_t;
+
+typedef struct
+{
+    uint8_t     type;
+    uint8_t     reserved;
+    uint16_t    nameLength;     /* including the nul */
+    uint32_t    valueLength;
+} __attribute__((packed)) dtblob_record_t;
+
+/** Check the header, stamp and every record, so injecting can't fail half way **/
+bool        dtblob_valid(const void* blob, long length, uint32_t stamp);
+
+/** Property lookup on a valid blob, at the top level or in the top level node parent. Returns NULL if missing **/
+const void* dtblob_find(const void* blob, const char* parent, const char* name, uint32_t* length);
+
+/**
+ ** Add the blob's properties and nodes under node. Names and values point into the blob, which must stay allocated.
+ ** Top level properties and nodes are only added if filter, when given, returns true for their name.
+ **/
+void        dtblob_inject(const void* blob, Node* node, bool (*filter)(const char* name));
+
+#endif /* !__FILENVRAM_DTBLOB_H */
@@ -0,0 +1,37 @@
+/*
+ *  hash.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_HASH_H
+#define __FILENVRAM_HASH_H
+
+#define FNV1A_OFFSET    0x811C9DC5
+#define FNV1A_PRIME     0x01000193
+
+/** Continue a 32bit FNV-1a hash with a nul terminated string, so several strings can be hashed as one key **/
+static inline uint32_t fnv1a_update(uint32_t hash, const char* string)
+{
+    while(*string)
+    {
+        hash ^= (uint8_t)*string++;
+        hash *= FNV1A_PRIME;
+    }
+
+    return hash;
+}
+
+/** 32bit FNV-1a hash of a nul terminated string **/
+static inline uint32_t fnv1a(const char* string)
+{
+    return fnv1a_update(FNV1A_OFFSET, string);
+}
+
+#endif /* !__FILENVRAM_HASH_H */
@@ -10,6 +10,12 @@
 
 #include "libsaio.h"
 #include "kernel_patcher.h"
+#include "arena.h"
+#include "call_scan.h"
+#include "x86_insn.h"
+#include "adler32.h"
+#include "patch_cache.h"
+#include "hash.h"
 #include "modules.h"
 #include "sl.h"
 #include <libsaio/bootstruct.h>
@@ -22,19 +28,75 @@
 #define KERNEL_32	0x02
 #define KERNEL_ERR	0xFF
 
-#define X86_NOP     (0x90)
+#define KERNEL_SECTION_MAX      4       /* sections watched while parsing */
+#define KERNEL_SECTION_SLOTS    8       /* power of two, at least twice KERNEL_SECTION_MAX */
+
+enum
+{
+    PATCH_SKIPPED = 0,      /* wrong architecture, or a symbol or section is missing */
+    PATCH_SEARCHING,
+    PATCH_FOUND,
+    PATCH_NOT_FOUND,
+    PATCH_MISMATCH,         /* the code before the call isn't what the patch expects */
+    PATCH_APPLIED,
+};
 
 /***************************************** Datatypes *****************************************/
 
-typedef struct section_t
+typedef struct
 {
     const char* segment;
     const char* section;
+    UInt32 hash;            /* section_hash(segment, section) */
     UInt64 address;
     UInt64 offset;
-    struct section_t* next;
+    UInt64 size;
 } section_t;
 
+typedef struct
+{
+    const char* name;
+    UInt64 addr;
+    bool found;
+} kernel_symbol_t;
+
+/**
+ ** A patch rewrites one call inside of function: the last call to target before the landmarkCount'th call to landmark.
+ ** The setupLength bytes leading up to the call (its argument setup) are NOP'd out, replacement is written at their end
+ ** and the call is redirected to call. The setup has to consist of whole instructions, and if setup is given the bytes
+ ** are also checked against it under setupMask.
+ **/
+typedef struct
+{
+    const char*     name;
+    int             arch;           /* KERNEL_32, KERNEL_64 or KERNEL_ANY */
+    const char*     segment;
+    const char*     section;
+    const char*     function;
+    const char*     landmark;
+    int             landmarkCount;
+    const char*     target;
+    UInt32          setupLength;
+    const UInt8*    setup;
+    const UInt8*    setupMask;
+    const UInt8*    replacement;
+    UInt32          replacementLength;
+    const char*     call;
+} kernel_patch_t;
+
+/** Offsets into the kernel image while matching **/
+typedef struct
+{
+    int         state;
+    section_t*  section;
+    UInt32      function;
+    UInt32      landmark;
+    UInt32      target;
+    UInt32      call;
+    int         landmarks;      /* landmark calls seen so far */
+    UInt32      match;          /* E8 of the last target call seen, 0 if none */
+} kernel_patch_state_t;
+
 /***************************************** Functions *****************************************/
 
 /** section_handler: used by the macho loader to notify us of a section **/
@@ -43,15 +105,82 @@ static void             section_handler(char* base, char* new_base, char* sectio
 /** Determine the type of kernel being loaded / patched **/
 static int              determineKernelArchitecture(void* kernelData);
 static section_t*       lookup_section(const char* segment, const char* section);
-static symbolList_t*    lookup_kernel_symbol(const char* name);
+static kernel_symbol_t* lookup_kernel_symbol(const char* name);
+static long long        kernel_symbol_handler(char* symbol, long long addr, char is64);
 static void             register_section(const char* segment, const char* section);
-static void             patch_readStartupExtensions(void* kernelData);
+static void             apply_kernel_patches(void* kernelData, int arch);
+static bool             find_kernel_section(void* kernelData, int arch, const char* segment, const char* section, UInt32* offset, UInt32* size);
 
 
 /***************************************** Variable *****************************************/
 
-static section_t*       kernelSections = NULL;  /** Linked list holding memory sections **/
-static symbolList_t*    kernelSymbols = NULL;   /** List of kernel funciton addresses **/
+/** Sections watched while parsing, in registration order. kernelSectionSlots maps section_hash to index + 1, 0 is empty. **/
+static section_t        kernelSections[KERNEL_SECTION_MAX];
+static int              kernelSectionCount = 0;
+static UInt8            kernelSectionSlots[KERNEL_SECTION_SLOTS];
+
+/** Kernel functions the patches need. Only these are captured while parsing, add any new ones here. **/
+static kernel_symbol_t  kernelSymbols[] =
+{
+    { "_getsegbyname",                                              0, false },
+    { "_OSKextLog",                                                 0, false },
+    { "__ZN12KLDBootstrap20readBooterExtensionsEv",                 0, false },
+    { "__ZN12KLDBootstrap23readPrelinkedExtensionsEP10section_64",  0, false },     // 64bit
+    { "__ZN12KLDBootstrap23readPrelinkedExtensionsEP7section",      0, false },     // 32bit
+};
+
+#define KERNEL_SYMBOL_COUNT     (sizeof(kernelSymbols) / sizeof(kernelSymbols[0]))
+
+static int              kernelSymbolsFound = 0;
+
+/**
+ ** readPrelinkedExtensions logs and gives up when the kernel is prelinked and the bootloader passed an mkext.
+ ** Replace the _OSKextLog call preceding its second _getsegbyname call with a call to readBooterExtensions
+ ** so that mkexts can be loaded with prelinked kernels.
+ **/
+
+// 00886a73	movl	$0x00887508,0x08(%esp)
+// 00886a7b	movl	$0x00010084,0x04(%esp)
+// 00886a83	movl	$0x00000000,(%esp)
+// 00886a8a	calll	_OSKextLog
+static const UInt8 kOSKextLogSetup32[]      = { 0xC7, 0x44, 0x24, 0x08, 0x00, 0x00, 0x00, 0x00,
+                                                0xC7, 0x44, 0x24, 0x04, 0x00, 0x00, 0x00, 0x00,
+                                                0xC7, 0x04, 0x24, 0x00, 0x00, 0x00, 0x00 };
+static const UInt8 kOSKextLogSetupMask32[]  = { 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00,
+                                                0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00,
+                                                0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00 };
+
+// 00886ea6	movl	%esi,(%esp)
+// 00886ea9	calll	readBooterExtensions
+static const UInt8 kReadBooterArgs32[]      = { 0x89, 0x34, 0x24 };
+
+// movq	%rbx,%rdi
+static const UInt8 kReadBooterArgs64[]      = { 0x48, 0x89, 0xDF };
+
+static const kernel_patch_t kernelPatches[] =
+{
+    {
+        "readPrelinkedExtensions", KERNEL_32, "__KLD", "__text",
+        "__ZN12KLDBootstrap23readPrelinkedExtensionsEP7section",
+        "_getsegbyname", 2,
+        "_OSKextLog", sizeof(kOSKextLogSetup32), kOSKextLogSetup32, kOSKextLogSetupMask32,
+        kReadBooterArgs32, sizeof(kReadBooterArgs32),
+        "__ZN12KLDBootstrap20readBooterExtensionsEv"
+    },
+    {
+        // The arguments go in registers here, and compilers order and encode those loads differently, so there is no
+        // byte pattern to check. The call is pinned by its rel32 and the landmark, and check_kernel_patch_bounds makes
+        // sure the 0x12 bytes replaced are whole instructions.
+        "readPrelinkedExtensions", KERNEL_64, "__KLD", "__text",
+        "__ZN12KLDBootstrap23readPrelinkedExtensionsEP10section_64",
+        "_getsegbyname", 2,
+        "_OSKextLog", 0x12, NULL, NULL,
+        kReadBooterArgs64, sizeof(kReadBooterArgs64),
+        "__ZN12KLDBootstrap20readBooterExtensionsEv"
+    },
+};
+
+#define KERNEL_PATCH_COUNT      (sizeof(kernelPatches) / sizeof(kernelPatches[0]))
 
 
 
@@ -60,7 +189,6 @@ static symbolList_t*    kernelSymbols = NULL;   /** List of kernel funciton addr
  **/
 void patch_kernel(void* kernelData, void* arg2, void* arg3, void *arg4)
 {
-    extern symbolList_t* moduleSymbols;
     int arch = determineKernelArchitecture(kernelData);
 
     if(arch == KERNEL_ERR)
@@ -69,56 +197,163 @@ void patch_kernel(void* kernelData, void* arg2, void* arg3, void *arg4)
         return;
     }
 
-    // Use the symbol handler from the module system. This requires us to backup the moduleSymbols variable and restore it once complete
-    symbolList_t* origmoduleSymbols = moduleSymbols;
-    moduleSymbols = NULL;   // clear out list of symbols
+    // The same kernel gets the same patches: skip parsing it if the cache from a previous boot matches.
+    UInt32 textOffset, textSize;
+    if(find_kernel_section(kernelData, arch, "__KLD", "__text", &textOffset, &textSize))
+    {
+        UInt32 textHash = adler32_update(ADLER32_INIT, (UInt8*)kernelData + textOffset, textSize);
+
+        if(patch_cache_apply(kernelData, textOffset, textSize, textHash))
+        {
+            verbose("FileNVRAM: kernel patches applied from %s\n", PATCH_CACHE_PATH);
+            return;
+        }
+
+        patch_cache_begin(textSize, textHash);
+    }
+
+    // Copies of the patched bytes only live while patching.
+    arena_scope_t scope = arena_begin(&gPhaseArena, ARENA_PHASE_PATCH);
+
+    int i;
+    for(i = 0; i < KERNEL_SYMBOL_COUNT; i++) kernelSymbols[i].found = false;
+    kernelSymbolsFound = 0;
+
+    kernelSectionCount = 0;
+    bzero(kernelSectionSlots, sizeof(kernelSectionSlots));
 
     /* Watch for the following sections while being parsed*/
     register_section("__KLD", "__text");
     register_section("__TEXT","__text");
 
-    parse_mach(kernelData, NULL, NULL, &add_symbol, &section_handler);
-    kernelSymbols = moduleSymbols;    // save symbols for future use, if needed
-    moduleSymbols = origmoduleSymbols; // restore orig pointer;
+    parse_mach(kernelData, NULL, NULL, &kernel_symbol_handler, &section_handler);
 
     /** Perform patches **/
-    patch_readStartupExtensions(kernelData);
+    apply_kernel_patches(kernelData, arch);
+
+    arena_end(&scope);
+}
+
+/**
+ ** Locate a section by walking the load commands, without parsing the rest of the kernel
+ **/
+static bool find_kernel_section(void* kernelData, int arch, const char* segment, const char* section, UInt32* offset, UInt32* size)
+{
+    struct mach_header* header = (struct mach_header*)kernelData;
+    UInt8* command = (UInt8*)kernelData + ((arch == KERNEL_64) ? sizeof(struct mach_header_64) : sizeof(struct mach_header));
+    UInt32 i, j;
+
+    for(i = 0; i < header->ncmds; i++, command += ((struct load_command*)command)->cmdsize)
+    {
+        UInt32 cmd = ((struct load_command*)command)->cmd;
+
+        if(cmd == LC_SEGMENT_64 && arch == KERNEL_64)
+        {
+            struct segment_command_64* segCommand = (struct segment_command_64*)command;
+            struct section_64* sect = (struct section_64*)(segCommand + 1);
+
+            if(strncmp(segCommand->segname, segment, sizeof(segCommand->segname))) continue;
+
+            for(j = 0; j < segCommand->nsects; j++, sect++)
+            {
+                if(strncmp(sect->sectname, section, sizeof(sect->sectname))) continue;
+
+                *offset = sect->offset;
+                *size = (UInt32)sect->size;
+                return true;
+            }
+        }
+        else if(cmd == LC_SEGMENT && arch == KERNEL_32)
+        {
+            struct segment_command* segCommand = (struct segment_command*)command;
+            struct section* sect = (struct section*)(segCommand + 1);
+
+            if(strncmp(segCommand->segname, segment, sizeof(segCommand->segname))) continue;
+
+            for(j = 0; j < segCommand->nsects; j++, sect++)
+            {
+                if(strncmp(sect->sectname, section, sizeof(sect->sectname))) continue;
+
+                *offset = sect->offset;
+                *size = sect->size;
+                return true;
+            }
+        }
+    }
+
+    return false;
 }
 
-static symbolList_t* lookup_kernel_symbol(const char* name)
+/**
+ ** Symbol callback for parse_mach: record the address of wanted symbols, nothing is allocated.
+ ** parse_mach can't be stopped, so once everything is found the remaining symbols are dismissed right away.
+ **/
+static long long kernel_symbol_handler(char* symbol, long long addr, char is64)
 {
-    /* Locate the specified kernel symbol in the list */
-    symbolList_t *symbol = kernelSymbols;
-    
-    while(symbol && strcmp(symbol->symbol, name) !=0)
+    int i;
+
+    if(kernelSymbolsFound == KERNEL_SYMBOL_COUNT) return 0;
+
+    for(i = 0; i < KERNEL_SYMBOL_COUNT; i++)
     {
-        symbol = symbol->next;
+        if(!kernelSymbols[i].found && strcmp(kernelSymbols[i].name, symbol) == 0)
+        {
+            kernelSymbols[i].addr = addr;
+            kernelSymbols[i].found = true;
+            kernelSymbolsFound++;
+            break;
+        }
     }
 
-    /* Return the found symbol, or NULL */
-    return symbol;
+    return 0;
 }
 
+static kernel_symbol_t* lookup_kernel_symbol(const char* name)
+{
+    int i;
+
+    /* Locate the specified kernel symbol in the table */
+    for(i = 0; i < KERNEL_SYMBOL_COUNT; i++)
+    {
+        if(kernelSymbols[i].found && strcmp(kernelSymbols[i].name, name) == 0) return &kernelSymbols[i];
+    }
+
+    /* Not found, or not listed in kernelSymbols */
+    return NULL;
+}
+
+
+/**
+ ** Hash of a (segment, section) pair, the key of kernelSectionSlots
+ **/
+static UInt32 section_hash(const char* segment, const char* section)
+{
+    return fnv1a_update(fnv1a_update(FNV1A_OFFSET, segment) ^ ',', section);
+}
 
 /**
- ** Update the specified section in the section list, if it exists
+ ** Find the registered section with the given names, or NULL. Names are only compared on a hash match.
  **/
 static section_t* lookup_section(const char* segment, const char* section)
 {    
     if(!segment || !section) return NULL;
 
-    section_t* sections = kernelSections;
+    UInt32 hash = section_hash(segment, section);
+    UInt32 i;
 
-    /* Locate the first section with the given names */
-    while(sections && 
-          !(strcmp(sections->segment, segment) == 0 &&
-            strcmp(sections->section, section) == 0))
+    for(i = hash & (KERNEL_SECTION_SLOTS - 1); kernelSectionSlots[i]; i = (i + 1) & (KERNEL_SECTION_SLOTS - 1))
     {
-        sections = sections->next;
+        section_t* sect = &kernelSections[kernelSectionSlots[i] - 1];
+
+        if(sect->hash == hash &&
+           strcmp(sect->segment, segment) == 0 &&
+           strcmp(sect->section, section) == 0)
+        {
+            return sect;
+        }
     }
 
-    /* Return the section found, or NULL */
-    return sections;
+    return NULL;
 }
 
 /**
@@ -126,30 +361,20 @@ static section_t* lookup_section(const char* segment, const char* section)
  **/
 void register_section(const char* segment, const char* section)
 {
-    if(kernelSections == NULL)
-    {
-        /* First Entry */
-        kernelSections = malloc(sizeof(section_t));
-        kernelSections->next = NULL;
-
-        kernelSections->segment = segment;
-        kernelSections->section = section;
-        kernelSections->address = 0;
-        kernelSections->offset = 0;
-    }
-    else
-    {
-        section_t *sect = kernelSections;
-        while(sect->next != NULL) sect = sect->next;
+    if(kernelSectionCount >= KERNEL_SECTION_MAX || lookup_section(segment, section)) return;
 
-        sect->next = malloc(sizeof(section_t));
-        sect = sect->next;
+    section_t* sect = &kernelSections[kernelSectionCount++];
+    UInt32 i;
 
-        sect->segment = segment;
-        sect->section = section;
-        sect->address = 0;
-        sect->offset = 0;        
-    }
+    sect->segment = segment;
+    sect->section = section;
+    sect->hash = section_hash(segment, section);
+    sect->address = 0;
+    sect->offset = 0;
+    sect->size = 0;
+
+    for(i = sect->hash & (KERNEL_SECTION_SLOTS - 1); kernelSectionSlots[i]; i = (i + 1) & (KERNEL_SECTION_SLOTS - 1));
+    kernelSectionSlots[i] = kernelSectionCount;
 }
 
 /**
@@ -183,139 +408,177 @@ static void section_handler(char* base, char* new_base, char* section, char* seg
         // And save the address
         kernelSection->address = address;
         kernelSection->offset = offset;
+        kernelSection->size = (determineKernelArchitecture(base) == KERNEL_64) ?
+                                ((struct section_64*)cmd)->size :
+                                ((struct section*)cmd)->size;
     }
 }
 
 /**
- ** Locate the last instance of _OSKextLog inside of __ZN12KLDBootstrap23readPrelinkedExtensionsEP7section
- ** and replace it with __ZN12KLDBootstrap20readBooterExtensionsEv so that mkexts can be loaded with prelinked kernels.
+ ** File offset of a kernel symbol, 0 if it wasn't found. The kernel's segments share one address to offset slide,
+ ** so the patched section's is used for symbols in other segments too.
  **/
-void patch_readStartupExtensions(void* kernelData)
-{    
-    UInt8* bytes = (UInt8*)kernelData;
-    bool is64bit = (determineKernelArchitecture(kernelData) == KERNEL_64);
-
-    symbolList_t* getsegbyname              = lookup_kernel_symbol("_getsegbyname");
-    symbolList_t* readBooterExtensions      = lookup_kernel_symbol("__ZN12KLDBootstrap20readBooterExtensionsEv");
-    symbolList_t* readPrelinkedExtensions   = is64bit ?
-                lookup_kernel_symbol("__ZN12KLDBootstrap23readPrelinkedExtensionsEP10section_64") : //64bit
-                lookup_kernel_symbol("__ZN12KLDBootstrap23readPrelinkedExtensionsEP7section");      //32bit
-    
-    if(!readPrelinkedExtensions)
-    {
-        return;
-    }
+static UInt32 kernel_symbol_offset(void* kernelData, section_t* section, const char* name)
+{
+    kernel_symbol_t* symbol = lookup_kernel_symbol(name);
+    if(!symbol) return 0;
 
-    symbolList_t* OSKextLog  = lookup_kernel_symbol("_OSKextLog");
-    
-    section_t* __KLD = lookup_section("__KLD","__text");
-
-    UInt32 readBooterExtensionsLocation     = readBooterExtensions    ? readBooterExtensions->addr    - __KLD->address + __KLD->offset: 0;
-    UInt32 readPrelinkedExtensionsLocation  = readPrelinkedExtensions ? readPrelinkedExtensions->addr - __KLD->address + __KLD->offset : 0;
-    UInt32 OSKextLogLocation                = OSKextLog               ? OSKextLog->addr               - __KLD->address + __KLD->offset : 0;
-    UInt32 getsegbynameLocation             = getsegbyname            ? getsegbyname->addr            - __KLD->address + __KLD->offset : 0;
-
-    // Step 1: Locate the First _OSKextLog call inside of __ZN12KLDBootstrap23readPrelinkedExtensionsEP10section
-    UInt32 patchLocation = readPrelinkedExtensionsLocation - (UInt32)kernelData;
-    OSKextLogLocation -= (UInt32)kernelData;
-    readBooterExtensionsLocation -= (UInt32)kernelData;
-    getsegbynameLocation -= (UInt32)kernelData;
-    //printf("Starting at 0x%X\n", readPrelinkedExtensions->addr - (UInt32)kernelData + __KLD->offset - __KLD->address);
-    //printf("Starting at 0x%X\n", patchLocation + __KLD->address - __KLD->offset);
-    //printf("Starting at 0x%X\n", __KLD->address - __KLD->offset);
-
-
-
-    while(
-          (bytes[patchLocation -1] != 0xE8) ||
-          ( ( (UInt32)(getsegbynameLocation - patchLocation  - 4) ) != (UInt32)((bytes[patchLocation + 0] << 0  |
-                                                                                 bytes[patchLocation + 1] << 8  |
-                                                                                 bytes[patchLocation + 2] << 16 |
-                                                                                 bytes[patchLocation + 3] << 24)))
-         )
-    {
-        patchLocation++;
-    }
-    patchLocation++;
+    // Symbol addresses include kernelData, see parse_mach.
+    return (UInt32)(symbol->addr - section->address + section->offset) - (UInt32)kernelData;
+}
 
+/** Resolve everything a patch refers to, returns false if it can't be applied to this kernel **/
+static bool prepare_kernel_patch(void* kernelData, int arch, const kernel_patch_t* patch, kernel_patch_state_t* state)
+{
+    state->state = PATCH_SKIPPED;
+    state->section = NULL;
+    state->landmarks = 0;
+    state->match = 0;
 
-    // Second one...
-    while(
-          (bytes[patchLocation -1] != 0xE8) ||
-          ( ( (UInt32)(getsegbynameLocation - patchLocation  - 4) ) != (UInt32)((bytes[patchLocation + 0] << 0  |
-                                                                                 bytes[patchLocation + 1] << 8  |
-                                                                                 bytes[patchLocation + 2] << 16 |
-                                                                                 bytes[patchLocation + 3] << 24)))
-         )
-    {
-        patchLocation++;
-    }
-    patchLocation++;
+    if(patch->arch != KERNEL_ANY && patch->arch != arch) return false;
 
+    state->section = lookup_section(patch->segment, patch->section);
+    if(!state->section || !state->section->size) return false;
 
-    //printf("patchLocation at 0x%X\n", patchLocation - __KLD->offset + __KLD->address);
+    state->function = kernel_symbol_offset(kernelData, state->section, patch->function);
+    state->landmark = kernel_symbol_offset(kernelData, state->section, patch->landmark);
+    state->target   = kernel_symbol_offset(kernelData, state->section, patch->target);
+    state->call     = kernel_symbol_offset(kernelData, state->section, patch->call);
+    if(!state->function || !state->landmark || !state->target || !state->call) return false;
 
-    while(
-          (bytes[patchLocation -1] != 0xE8) ||
-          ( ( (UInt32)(OSKextLogLocation - patchLocation  - 4) ) != (UInt32)((bytes[patchLocation + 0] << 0  |
-                                                                              bytes[patchLocation + 1] << 8  |
-                                                                              bytes[patchLocation + 2] << 16 |
-                                                                              bytes[patchLocation + 3] << 24)))
-         )
-    {
-        patchLocation--;
-    }
-    //printf("patchLocation at 0x%X\n", patchLocation - __KLD->offset + __KLD->address);
+    // Searching starts at function, which has to be in the section.
+    if(state->function < state->section->offset || state->function - state->section->offset >= state->section->size) return false;
 
+    state->state = PATCH_SEARCHING;
+    return true;
+}
 
-    // Step 2: remove the _OSKextLog call, this call takes the form:
-    // 00886a73	movl	$0x00887508,0x08(%esp)
-    // 00886a7b	movl	$0x00010084,0x04(%esp)
-    // 00886a83	movl	$0x00000000,(%esp)
-    // 00886a8a	calll	0x006060c0
-    // 00886a8f
-    // This is a total of 28 bytes
-    int i = 0;
+/**
+ ** Decode from the start of the function to the call, making sure both the call and the start of its setup are
+ ** instruction boundaries. Otherwise the kernel was built differently and the patch would cut an instruction in half.
+ **/
+static bool check_kernel_patch_bounds(const UInt8* bytes, const kernel_patch_t* patch, const kernel_patch_state_t* state, bool is64)
+{
+    UInt32 call = state->match;
+    UInt32 setup = call - patch->setupLength;
+    UInt32 pos = state->function;
+    bool setupFound = false;
 
-    if(is64bit)
+    while(pos < call)
     {
-        // TODO: Calculate size programaticaly
-        patchLocation -= 0x14; // 64bit
-        for(i = 0; i < 0x10; i++) bytes[++patchLocation] = X86_NOP;
+        UInt32 length = x86_insn_length(&bytes[pos], call - pos, is64);
+        if(!length) return false;
+
+        if(pos == setup) setupFound = true;
+        pos += length;
     }
-    else
+
+    return (pos == call) && setupFound;
+}
+
+/** Rewrite the call found for a patch **/
+static int write_kernel_patch(UInt8* bytes, const kernel_patch_t* patch, kernel_patch_state_t* state, bool is64)
+{
+    UInt32 call = state->match;
+    UInt32 setup = call - patch->setupLength;
+    UInt32 i;
+
+    if(call < state->function || call - state->function < patch->setupLength) return PATCH_MISMATCH;
+    if(!check_kernel_patch_bounds(bytes, patch, state, is64)) return PATCH_MISMATCH;
+
+    if(patch->setup)
     {
-        patchLocation -= 0x19; // 32bit
-        for(i = 0; i < 0x15; i++) bytes[++patchLocation] = X86_NOP;
+        for(i = 0; i < patch->setupLength; i++)
+        {
+            if((bytes[setup + i] & patch->setupMask[i]) != (patch->setup[i] & patch->setupMask[i])) return PATCH_MISMATCH;
+        }
     }
 
+    // Remember the original bytes for the patch cache.
+    UInt32 length = patch->setupLength + 5;
+    UInt8* original = arena_alloc(&gPhaseArena, length);
+    if(original) memcpy(original, &bytes[setup], length);
 
+    x86_nop_fill(&bytes[setup], patch->setupLength - patch->replacementLength);
+    memcpy(&bytes[call - patch->replacementLength], patch->replacement, patch->replacementLength);
 
-    // Step 3: Add a call to __ZN12KLDBootstrap21readStartupExtensionsEv.
-    // This takes the form of
-    // 00886ea6	movl	%esi,(%esp)
-    // 00886ea9	calll	0x00886716
-    // 00886eae
+    // The E8 stays, only its rel32 changes.
+    UInt32 rel = state->call - (call + 5);
+    bytes[call + 1] = rel >> 0;
+    bytes[call + 2] = rel >> 8;
+    bytes[call + 3] = rel >> 16;
+    bytes[call + 4] = rel >> 24;
 
-    if(!is64bit)
+    if(original) patch_cache_record(setup, original, &bytes[setup], length);
+    else patch_cache_discard();
+
+    return PATCH_APPLIED;
+}
+
+/**
+ ** Apply every patch in kernelPatches. Each registered section is walked once, call by call,
+ ** from the first patched function on; every call is matched against the landmarks and targets of all
+ ** patches in that section at once, and the walk ends as soon as they have all been located.
+ **/
+static void apply_kernel_patches(void* kernelData, int arch)
+{
+    static const char* stateNames[] = { "skipped", "searching", "found", "not found", "code mismatch", "applied" };
+
+    UInt8* bytes = (UInt8*)kernelData;
+    kernel_patch_state_t states[KERNEL_PATCH_COUNT];
+    section_t* section;
+    int i;
+
+    for(i = 0; i < KERNEL_PATCH_COUNT; i++) prepare_kernel_patch(kernelData, arch, &kernelPatches[i], &states[i]);
+
+    for(section = kernelSections; section < &kernelSections[kernelSectionCount]; section++)
     {
-        // 32bit
-        bytes[patchLocation] = 0x89;
-        bytes[++patchLocation] = 0x34;
-        bytes[++patchLocation] = 0x24;
+        UInt32 end = section->offset + section->size;
+        UInt32 from = end;
+        UInt32 opcode, target;
+        int pending = 0;
+
+        for(i = 0; i < KERNEL_PATCH_COUNT; i++)
+        {
+            if(states[i].state != PATCH_SEARCHING || states[i].section != section) continue;
+            if(states[i].function < from) from = states[i].function;
+            pending++;
+        }
+
+        // Calls are only searched for inside of the section, a missed match gives up instead of running off of it.
+        while(pending && call_scan_next(bytes, from, end, &opcode, &target))
+        {
+            for(i = 0; i < KERNEL_PATCH_COUNT; i++)
+            {
+                kernel_patch_state_t* state = &states[i];
+
+                if(state->state != PATCH_SEARCHING || state->section != section || opcode < state->function) continue;
+
+                if(target == state->target)
+                {
+                    state->match = opcode;
+                }
+                else if(target == state->landmark && ++state->landmarks == kernelPatches[i].landmarkCount)
+                {
+                    state->state = state->match ? PATCH_FOUND : PATCH_NOT_FOUND;
+                    pending--;
+                }
+            }
+
+            from = opcode + 1;
+        }
+
+        for(i = 0; i < KERNEL_PATCH_COUNT; i++)
+        {
+            if(states[i].section != section) continue;
+            if(states[i].state == PATCH_SEARCHING) states[i].state = PATCH_NOT_FOUND;
+            if(states[i].state == PATCH_FOUND) states[i].state = write_kernel_patch(bytes, &kernelPatches[i], &states[i], arch == KERNEL_64);
+        }
     }
-    else
+
+    for(i = 0; i < KERNEL_PATCH_COUNT; i++)
     {
-        // 64bit
-        // movq	%rbx,%rdi
-        bytes[patchLocation] = 0x48;
-        bytes[++patchLocation] = 0x89;
-        bytes[++patchLocation] = 0xdf;
+        if(kernelPatches[i].arch != KERNEL_ANY && kernelPatches[i].arch != arch) continue;
+        verbose("FileNVRAM: kernel patch %s %s\n", kernelPatches[i].name, stateNames[states[i].state]);
     }
-    ++patchLocation;	// 0xe8 -> call
-    UInt32 rel = patchLocation+5;
-    bytes[++patchLocation] = (readBooterExtensionsLocation - rel) >> 0;
-    bytes[++patchLocation] = (readBooterExtensionsLocation - rel) >> 8;
-    bytes[++patchLocation] = (readBooterExtensionsLocation - rel) >> 16;
-    bytes[++patchLocation] = (readBooterExtensionsLocation - rel) >> 24;
 }
@@ -0,0 +1,118 @@
+/*
+ *  lz4.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "lz4.h"
+
+#define LZ4_MIN_MATCH       4
+
+static inline uint32_t read_le32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/** Lengths of 15 continue in the following bytes, each 255 adds and ends the run. **/
+static inline bool read_length(const uint8_t** src, const uint8_t* end, size_t* length)
+{
+    uint8_t byte;
+
+    if(*length != 15) return true;
+
+    do
+    {
+        if(*src >= end) return false;
+        byte = *(*src)++;
+        *length += byte;
+    } while(byte == 255);
+
+    return true;
+}
+
+long lz4_decode_block(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t dstLength)
+{
+    const uint8_t*  in      = src;
+    const uint8_t*  inEnd   = src + srcLength;
+    uint8_t*        out     = dst;
+    uint8_t*        outEnd  = dst + dstLength;
+
+    while(in < inEnd)
+    {
+        uint8_t token = *in++;
+        size_t  length = token >> 4;
+        size_t  offset;
+        const uint8_t* match;
+
+        // Literals
+        if(!read_length(&in, inEnd, &length)) return -1;
+        if(length > (size_t)(inEnd - in) || length > (size_t)(outEnd - out)) return -1;
+        memcpy(out, in, length);
+        in  += length;
+        out += length;
+
+        // The last sequence is literals only.
+        if(in == inEnd) break;
+
+        // Match
+        if(inEnd - in < 2) return -1;
+        offset = in[0] | (in[1] << 8);
+        in += 2;
+        if(!offset || offset > (size_t)(out - dst)) return -1;
+
+        length = token & 0x0F;
+        if(!read_length(&in, inEnd, &length)) return -1;
+        length += LZ4_MIN_MATCH;
+        if(length > (size_t)(outEnd - out)) return -1;
+
+        match = out - offset;
+        if(offset >= length)
+        {
+            memcpy(out, match, length);
+            out += length;
+        }
+        else
+        {
+            // Overlapping copy repeats the last offset bytes.
+            while(length--) *out++ = *match++;
+        }
+    }
+
+    return out - dst;
+}
+
+long lz4_decode_legacy(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t dstLength)
+{
+    const uint8_t*  end = src + srcLength;
+    size_t          decoded = 0;
+
+    if(srcLength < 4 || read_le32(src) != LZ4_LEGACY_MAGIC) return -1;
+    src += 4;
+
+    while(end - src >= 4)
+    {
+        uint32_t blockLength = read_le32(src);
+        long     length;
+
+        // Concatenated legacy frames repeat the magic.
+        if(blockLength == LZ4_LEGACY_MAGIC) { src += 4; continue; }
+
+        src += 4;
+        if(blockLength > (size_t)(end - src)) return -1;
+
+        length = lz4_decode_block(src, blockLength, dst + decoded, dstLength - decoded);
+        if(length < 0) return -1;
+
+        decoded += length;
+        src     += blockLength;
+    }
+
+    return (src == end) ? (long)decoded : -1;
+}
@@ -0,0 +1,32 @@
+/*
+ *  lz4.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_LZ4_H
+#define __FILENVRAM_LZ4_H
+
+#include "libsaio.h"
+
+#define LZ4_LEGACY_MAGIC    0x184C2102      /* lz4 -l */
+
+/**
+ ** Decode a single LZ4 block into dst, returns the decoded length or -1 if the block is malformed
+ ** or would overrun dst.
+ **/
+long    lz4_decode_block(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t dstLength);
+
+/**
+ ** Decode an lz4 legacy frame (magic, then blocks each prefixed by their compressed size),
+ ** returns the decoded length or -1.
+ **/
+long    lz4_decode_legacy(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t dstLength);
+
+#endif /* !__FILENVRAM_LZ4_H */
@@ -0,0 +1,218 @@
+/*
+ *  nvram_index.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include <libsaio/xml.h>
+#include "nvram_index.h"
+#include "hash.h"
+
+#define NVRAM_INDEX_MIN_CAPACITY    16
+
+static const char gDeletedKey[] = "";
+#define NVRAM_INDEX_DELETED         gDeletedKey
+
+static nvram_index_slot_t* find_slot(nvram_index_t* index, const char* key, uint32_t hash)
+{
+    uint32_t mask = index->capacity - 1;
+    uint32_t i = hash & mask;
+
+    while(index->slots[i].key)
+    {
+        nvram_index_slot_t* slot = &index->slots[i];
+
+        if((slot->key != NVRAM_INDEX_DELETED) &&
+           (slot->hash == hash) &&
+           (strcmp(slot->key, key) == 0))
+        {
+            return slot;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    return NULL;
+}
+
+/** Record a key known not to be in the index **/
+static void insert_slot(nvram_index_t* index, const char* key, uint32_t hash, TagPtr* link)
+{
+    uint32_t mask = index->capacity - 1;
+    uint32_t i = hash & mask;
+
+    while(index->slots[i].key && index->slots[i].key != NVRAM_INDEX_DELETED) i = (i + 1) & mask;
+
+    if(!index->slots[i].key) index->used++;
+    index->count++;
+
+    index->slots[i].key  = key;
+    index->slots[i].hash = hash;
+    index->slots[i].link = link;
+}
+
+static bool allocate_slots(nvram_index_t* index, uint32_t capacity)
+{
+    index->slots = malloc(capacity * sizeof(nvram_index_slot_t));
+    if(!index->slots) return false;
+
+    bzero(index->slots, capacity * sizeof(nvram_index_slot_t));
+    index->capacity = capacity;
+    index->count    = 0;
+    index->used     = 0;
+
+    return true;
+}
+
+/** Rehash into a table with room to grow, dropping deleted slots **/
+static bool rehash(nvram_index_t* index)
+{
+    nvram_index_slot_t* slots = index->slots;
+    uint32_t capacity = index->capacity;
+    uint32_t newCapacity = capacity;
+    uint32_t i;
+
+    while(newCapacity < (index->count + 1) * 2) newCapacity <<= 1;
+
+    if(!allocate_slots(index, newCapacity))
+    {
+        index->slots = slots;
+        return false;
+    }
+
+    for(i = 0; i < capacity; i++)
+    {
+        if(slots[i].key && slots[i].key != NVRAM_INDEX_DELETED)
+        {
+            insert_slot(index, slots[i].key, slots[i].hash, slots[i].link);
+        }
+    }
+
+    free(slots);
+    return true;
+}
+
+bool nvram_index_build(nvram_index_t* index, TagPtr dict)
+{
+    uint32_t capacity = NVRAM_INDEX_MIN_CAPACITY;
+    uint32_t count = 0;
+    TagPtr*  link;
+    TagPtr   tag;
+
+    bzero(index, sizeof(*index));
+    if(!XMLIsDict(dict)) return false;
+
+    for(tag = dict->tag; tag; tag = tag->tagNext) count++;
+    while(capacity < count * 2) capacity <<= 1;
+
+    if(!allocate_slots(index, capacity)) return false;
+
+    index->dict = dict;
+
+    for(link = &dict->tag; *link; link = &tag->tagNext)
+    {
+        tag = *link;
+        if((tag->type != kTagTypeKey) || (tag->string == 0)) continue;
+
+        // Like XMLGetProperty, the first of any duplicate keys wins.
+        uint32_t hash = fnv1a(tag->string);
+        if(!find_slot(index, tag->string, hash)) insert_slot(index, tag->string, hash, link);
+        else index->shadowed++;
+    }
+
+    index->tail = link;
+
+    return true;
+}
+
+void nvram_index_free(nvram_index_t* index)
+{
+    if(index->slots) free(index->slots);
+    bzero(index, sizeof(*index));
+}
+
+TagPtr nvram_index_get(nvram_index_t* index, const char* key)
+{
+    nvram_index_slot_t* slot = find_slot(index, key, fnv1a(key));
+
+    return slot ? (*slot->link)->tag : NULL;
+}
+
+bool nvram_index_remove(nvram_index_t* index, const char* key)
+{
+    nvram_index_slot_t* slot = find_slot(index, key, fnv1a(key));
+    if(!slot) return false;
+
+    TagPtr* link = slot->link;
+    TagPtr  tag  = *link;
+    TagPtr  next = tag->tagNext;
+    uint32_t hash = slot->hash;
+
+    if(next)
+    {
+        // The following key is now referenced through our link.
+        if((next->type == kTagTypeKey) && next->string)
+        {
+            nvram_index_slot_t* nextSlot = find_slot(index, next->string, fnv1a(next->string));
+            if(nextSlot && (nextSlot->link == &tag->tagNext)) nextSlot->link = slot->link;
+        }
+    }
+    else
+    {
+        index->tail = slot->link;
+    }
+
+    *slot->link = next;
+
+    slot->key  = NVRAM_INDEX_DELETED;
+    slot->link = NULL;
+    index->count--;
+
+    // Like XMLGetProperty, the next key of the same name is now the first. Only files with duplicates pay for the walk.
+    for(; index->shadowed && *link; link = &(*link)->tagNext)
+    {
+        TagPtr duplicate = *link;
+
+        if((duplicate->type == kTagTypeKey) && duplicate->string && (strcmp(duplicate->string, key) == 0))
+        {
+            insert_slot(index, duplicate->string, hash, link);
+            index->shadowed--;
+            break;
+        }
+    }
+
+    // free tag
+    tag->tagNext = 0;
+    XMLFreeTag(tag);
+
+    return true;
+}
+
+bool nvram_index_add(nvram_index_t* index, const char* key, TagPtr value)
+{
+    Tag holder;
+
+    while(nvram_index_remove(index, key));
+
+    if(((index->used + 1) * 4 > index->capacity * 3) && !rehash(index)) return false;
+
+    // Let the XML layer allocate the key tag, then link it at the tail ourselves instead of walking the list.
+    bzero(&holder, sizeof(holder));
+    holder.type = kTagTypeDict;
+    if(!XMLAddTagToDictionary(&holder, (char*)key, value)) return false;
+
+    TagPtr* link = index->tail;
+    *link = holder.tag;
+    index->tail = &holder.tag->tagNext;
+
+    insert_slot(index, holder.tag->string, fnv1a(holder.tag->string), link);
+
+    return true;
+}
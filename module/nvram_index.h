@@ -0,0 +1,54 @@
+/*
+ *  nvram_index.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_NVRAM_INDEX_H
+#define __FILENVRAM_NVRAM_INDEX_H
+
+#include "libsaio.h"
+#include <libsaio/xml.h>
+
+/**
+ ** Open addressing hash index over the key tags of an XML dictionary.
+ ** Each slot records the link (dict->tag or the previous key's tagNext) pointing at the key tag, so
+ ** keys can be unlinked from the singly linked tag list without walking it.
+ **/
+typedef struct
+{
+    const char* key;        /* key tag string, NULL if empty, NVRAM_INDEX_DELETED once removed */
+    TagPtr*     link;
+    uint32_t    hash;
+} nvram_index_slot_t;
+
+typedef struct
+{
+    nvram_index_slot_t* slots;
+    uint32_t            capacity;   /* power of two */
+    uint32_t            count;      /* live keys */
+    uint32_t            used;       /* live + deleted slots */
+    uint32_t            shadowed;   /* later duplicate key tags, hidden behind the first of their name */
+    TagPtr              dict;
+    TagPtr*             tail;       /* link the next key tag is appended to */
+} nvram_index_t;
+
+bool    nvram_index_build(nvram_index_t* index, TagPtr dict);
+void    nvram_index_free(nvram_index_t* index);
+
+/** Returns the value tag for key, or NULL **/
+TagPtr  nvram_index_get(nvram_index_t* index, const char* key);
+
+/** Remove every existing copy of key, then append key/value to the dictionary **/
+bool    nvram_index_add(nvram_index_t* index, const char* key, TagPtr value);
+
+/** Unlink and free the first key and its value from the dictionary, a later duplicate takes its place **/
+bool    nvram_index_remove(nvram_index_t* index, const char* key);
+
+#endif /* !__FILENVRAM_NVRAM_INDEX_H */
@@ -0,0 +1,161 @@
+/*
+ *  patch_cache.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "patch_cache.h"
+#include "arena.h"
+
+#define PATCH_CACHE_ALIGN(x)    (((x) + 3) & ~3U)
+
+static uint8_t* gCache;             /** Loaded from disk **/
+static uint32_t gCacheLength;
+static uint8_t* gPending;           /** Built this boot **/
+
+static uint32_t record_size(uint32_t length)
+{
+    return sizeof(patch_cache_record_t) + PATCH_CACHE_ALIGN(length * 2);
+}
+
+void patch_cache_read(BVRef bvr)
+{
+    char path[64];
+
+    sprintf(path, "hd(%d,%d)" PATCH_CACHE_PATH, BIOS_DEV_UNIT(bvr), bvr->part_no);
+    int fh = open(path, 0);
+    if(fh < 0) return;
+
+    unsigned int size = file_size(fh);
+    if(size >= sizeof(patch_cache_header_t) && size <= PATCH_CACHE_MAX_SIZE)
+    {
+        uint8_t* cache = arena_alloc(&gBootArena, size);
+        if(cache && read(fh, (char*)cache, size) == size)
+        {
+            gCache = cache;
+            gCacheLength = size;
+        }
+    }
+
+    close(fh);
+}
+
+/** Walk the records, checking them against the kernel text or, once all are known good, applying them **/
+static bool walk_records(uint8_t* kernel, uint32_t textOffset, uint32_t textSize, bool apply)
+{
+    const patch_cache_header_t* header = (const patch_cache_header_t*)gCache;
+    uint32_t offset = sizeof(*header);
+    int i;
+
+    for(i = 0; i < header->count; i++)
+    {
+        const patch_cache_record_t* record = (const patch_cache_record_t*)(gCache + offset);
+
+        if(offset + sizeof(*record) > header->length || record->length > PATCH_CACHE_MAX_SIZE) return false;
+        if(offset + record_size(record->length) > header->length) return false;
+
+        const uint8_t* original = (const uint8_t*)(record + 1);
+        const uint8_t* patched  = original + record->length;
+
+        if(apply)
+        {
+            memcpy(kernel + record->offset, patched, record->length);
+        }
+        else if(record->offset < textOffset ||
+                record->offset - textOffset > textSize ||
+                record->length > textSize - (record->offset - textOffset) ||
+                memcmp(kernel + record->offset, original, record->length))
+        {
+            return false;
+        }
+
+        offset += record_size(record->length);
+    }
+
+    return true;
+}
+
+bool patch_cache_apply(uint8_t* kernel, uint32_t textOffset, uint32_t textSize, uint32_t textHash)
+{
+    const patch_cache_header_t* header = (const patch_cache_header_t*)gCache;
+
+    if(!header ||
+       header->magic != PATCH_CACHE_MAGIC ||
+       header->version != PATCH_CACHE_VERSION ||
+       header->count == 0 ||
+       header->length != gCacheLength ||
+       header->textSize != textSize ||
+       header->textHash != textHash)
+    {
+        return false;
+    }
+
+    // Check every record before touching the kernel: in bounds, and the original bytes are still there.
+    if(!walk_records(kernel, textOffset, textSize, false)) return false;
+
+    return walk_records(kernel, textOffset, textSize, true);
+}
+
+void patch_cache_begin(uint32_t textSize, uint32_t textHash)
+{
+    patch_cache_header_t* header;
+
+    // Lives until FileNVRAM_hook has put it in the device tree.
+    gPending = arena_alloc(&gBootArena, PATCH_CACHE_MAX_SIZE);
+    if(!gPending) return;
+
+    header = (patch_cache_header_t*)gPending;
+    header->magic    = PATCH_CACHE_MAGIC;
+    header->version  = PATCH_CACHE_VERSION;
+    header->count    = 0;
+    header->length   = sizeof(*header);
+    header->textSize = textSize;
+    header->textHash = textHash;
+}
+
+void patch_cache_record(uint32_t offset, const uint8_t* original, const uint8_t* patched, uint32_t length)
+{
+    patch_cache_header_t* header = (patch_cache_header_t*)gPending;
+    patch_cache_record_t* record;
+
+    if(!header) return;
+
+    if(header->length + record_size(length) > PATCH_CACHE_MAX_SIZE)
+    {
+        patch_cache_discard();
+        return;
+    }
+
+    record = (patch_cache_record_t*)(gPending + header->length);
+    record->offset = offset;
+    record->length = length;
+
+    uint8_t* bytes = (uint8_t*)(record + 1);
+    memcpy(bytes, original, length);
+    memcpy(bytes + length, patched, length);
+    bzero(bytes + length * 2, PATCH_CACHE_ALIGN(length * 2) - length * 2);
+
+    header->length += record_size(length);
+    header->count++;
+}
+
+void patch_cache_discard(void)
+{
+    gPending = NULL;
+}
+
+const void* patch_cache_pending(uint32_t* length)
+{
+    // An empty cache would be taken as a hit next boot and leave the kernel unpatched for good.
+    if(!gPending || !((patch_cache_header_t*)gPending)->count) return NULL;
+
+    *length = ((patch_cache_header_t*)gPending)->length;
+    return gPending;
+}
@@ -0,0 +1,62 @@
+/*
+ *  patch_cache.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_PATCH_CACHE_H
+#define __FILENVRAM_PATCH_CACHE_H
+
+#include "libsaio.h"
+
+/**
+ ** Result of patching a given kernel, so the next boot with the same kernel can skip parsing it. The module can't
+ ** write files, so a new cache is handed to FileNVRAM.kext through the device tree and saved next to the nvram file.
+ ** Little endian, records padded to 4 bytes:
+ **     patch_cache_header_t
+ **     count times: patch_cache_record_t, length original bytes, length patched bytes
+ **/
+#define PATCH_CACHE_PATH        "/Extra/nvram.patches"
+#define PATCH_CACHE_MAGIC       0x4843504B      /* "KPCH" */
+#define PATCH_CACHE_VERSION     1
+#define PATCH_CACHE_MAX_SIZE    1024
+
+typedef struct
+{
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    count;
+    uint32_t    length;         /* header included */
+    uint32_t    textSize;       /* __KLD,__text the patches were found in */
+    uint32_t    textHash;       /* adler32 of it before patching */
+} patch_cache_header_t;
+
+typedef struct
+{
+    uint32_t    offset;         /* into the kernel image */
+    uint32_t    length;
+} patch_cache_record_t;
+
+/** Load the cache from the nvram file's volume, if there is one **/
+void        patch_cache_read(BVRef bvr);
+
+/** Apply the loaded cache if it was built for this exact kernel text and holds patches, returns false otherwise **/
+bool        patch_cache_apply(uint8_t* kernel, uint32_t textOffset, uint32_t textSize, uint32_t textHash);
+
+/** Start a new cache for this kernel text, filled in by patch_cache_record **/
+void        patch_cache_begin(uint32_t textSize, uint32_t textHash);
+void        patch_cache_record(uint32_t offset, const uint8_t* original, const uint8_t* patched, uint32_t length);
+
+/** Drop the new cache, a patch couldn't be recorded and incomplete caches must never be applied **/
+void        patch_cache_discard(void);
+
+/** Cache built this boot for FileNVRAM.kext to save, NULL if the loaded one was used or nothing was patched **/
+const void* patch_cache_pending(uint32_t* length);
+
+#endif /* !__FILENVRAM_PATCH_CACHE_H */
@@ -0,0 +1,280 @@
+/*
+ *  plist_stream.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "plist_stream.h"
+#include "base64.h"
+
+#define PLIST_STREAM_MAX_DEPTH  64
+
+typedef struct
+{
+    const char* name;
+    int         length;
+    int         open;
+    int         close;      /* kPlistTokenEnd for scalar elements */
+} plist_element_t;
+
+static const plist_element_t gElements[] =
+{
+    { "key",     3, kPlistTokenKey,     kPlistTokenEnd      },
+    { "string",  6, kPlistTokenString,  kPlistTokenEnd      },
+    { "data",    4, kPlistTokenData,    kPlistTokenEnd      },
+    { "integer", 7, kPlistTokenInteger, kPlistTokenEnd      },
+    { "true",    4, kPlistTokenTrue,    kPlistTokenEnd      },
+    { "false",   5, kPlistTokenFalse,   kPlistTokenEnd      },
+    { "date",    4, kPlistTokenOther,   kPlistTokenEnd      },
+    { "real",    4, kPlistTokenOther,   kPlistTokenEnd      },
+    { "dict",    4, kPlistTokenDict,    kPlistTokenDictEnd  },
+    { "array",   5, kPlistTokenArray,   kPlistTokenArrayEnd },
+    { "plist",   5, kPlistTokenEnd,     kPlistTokenEnd      },
+};
+
+static const char* find_char(const char* pos, const char* end, char c)
+{
+    while(pos < end && *pos != c) pos++;
+    return pos;
+}
+
+static bool has_prefix(const char* pos, const char* end, const char* prefix, int length)
+{
+    return (end - pos >= length) && !memcmp(pos, prefix, length);
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const plist_element_t* find_element(const char* name, int length)
+{
+    int i;
+    for(i = 0; i < sizeof(gElements)/sizeof(gElements[0]); i++)
+    {
+        if(gElements[i].length == length && !memcmp(gElements[i].name, name, length)) return &gElements[i];
+    }
+    return NULL;
+}
+
+static int fail(plist_stream_t* stream, plist_token_t* token)
+{
+    stream->pos = stream->end;
+    return token->type = kPlistTokenError;
+}
+
+void plist_stream_init(plist_stream_t* stream, const char* buffer, int length)
+{
+    stream->pos     = buffer;
+    stream->end     = buffer + length;
+    stream->pending = 0;
+    stream->refs    = 0;
+}
+
+int plist_stream_next(plist_stream_t* stream, plist_token_t* token)
+{
+    const char* end = stream->end;
+
+    token->text   = NULL;
+    token->length = 0;
+
+    if(stream->pending)
+    {
+        token->type = stream->pending;
+        stream->pending = 0;
+        return token->type;
+    }
+
+    for(;;)
+    {
+        const char* tag = find_char(stream->pos, end, '<');
+        const char* close;
+        const char* name;
+        const char* nameEnd;
+        const plist_element_t* element;
+        bool closing, empty;
+
+        if(tag >= end)
+        {
+            stream->pos = end;
+            return token->type = kPlistTokenEnd;
+        }
+
+        if(has_prefix(tag, end, "<!--", 4))
+        {
+            // Comments may contain '>', look for the real terminator.
+            for(close = tag + 4; close + 3 <= end && memcmp(close, "-->", 3); close++);
+            if(close + 3 > end) return fail(stream, token);
+            stream->pos = close + 3;
+            continue;
+        }
+
+        close = find_char(tag, end, '>');
+        if(close >= end) return fail(stream, token);
+        stream->pos = close + 1;
+
+        // <?xml ...?> and <!DOCTYPE ...>
+        if(tag + 1 < close && (tag[1] == '?' || tag[1] == '!')) continue;
+
+        closing = (tag + 1 < close) && (tag[1] == '/');
+        empty   = !closing && (close[-1] == '/');
+        name    = tag + (closing ? 2 : 1);
+        for(nameEnd = name; nameEnd < close && !is_space(*nameEnd) && *nameEnd != '/'; nameEnd++);
+
+        // IDREF values live elsewhere in the file, the caller has to resolve those with the full parser.
+        const char* attr;
+        for(attr = nameEnd; attr + 5 <= close; attr++)
+        {
+            if(!memcmp(attr, "IDREF", 5))
+            {
+                stream->refs++;
+                break;
+            }
+        }
+
+        element = find_element(name, (int)(nameEnd - name));
+        if(!element) return fail(stream, token);
+
+        if(element->open == kPlistTokenEnd) continue;       // <plist>, </plist>
+
+        if(closing)
+        {
+            if(element->close == kPlistTokenEnd) return fail(stream, token);   // stray scalar close
+            return token->type = element->close;
+        }
+
+        if(element->close != kPlistTokenEnd)
+        {
+            if(empty) stream->pending = element->close;
+            return token->type = element->open;
+        }
+
+        token->type = element->open;
+        token->text = stream->pos;
+        if(empty) return token->type;
+
+        // Scalar contents run up to the matching close tag.
+        const char* contentEnd = find_char(stream->pos, end, '<');
+        const char* after = contentEnd + 2 + element->length;
+        if(after >= end ||
+           contentEnd[1] != '/' ||
+           memcmp(contentEnd + 2, element->name, element->length) ||
+           *after != '>')
+        {
+            return fail(stream, token);
+        }
+
+        token->length = (int)(contentEnd - stream->pos);
+        stream->pos = after + 1;
+        return token->type;
+    }
+}
+
+bool plist_stream_skip(plist_stream_t* stream, const plist_token_t* token)
+{
+    uint64_t    dicts;      /* bit n set if nesting level n is a dict */
+    int         depth;
+    plist_token_t next;
+
+    switch(token->type)
+    {
+        case kPlistTokenDict:
+        case kPlistTokenArray:
+            break;
+
+        case kPlistTokenEnd:
+        case kPlistTokenError:
+        case kPlistTokenDictEnd:
+        case kPlistTokenArrayEnd:
+            return false;
+
+        default:
+            return true;
+    }
+
+    depth = 0;
+    dicts = (token->type == kPlistTokenDict);
+
+    while(depth >= 0)
+    {
+        switch(plist_stream_next(stream, &next))
+        {
+            case kPlistTokenDict:
+            case kPlistTokenArray:
+                if(++depth >= PLIST_STREAM_MAX_DEPTH) return false;
+                if(next.type == kPlistTokenDict) dicts |= (1ULL << depth);
+                else dicts &= ~(1ULL << depth);
+                break;
+
+            case kPlistTokenDictEnd:
+            case kPlistTokenArrayEnd:
+                if(((dicts >> depth) & 1) != (next.type == kPlistTokenDictEnd)) return false;
+                depth--;
+                break;
+
+            case kPlistTokenEnd:
+            case kPlistTokenError:
+                return false;
+
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool plist_token_equals(const plist_token_t* token, const char* string)
+{
+    int length = strlen(string);
+    return token->length == length && !memcmp(token->text, string, length);
+}
+
+int plist_decode_integer(const plist_token_t* token)
+{
+    const char* pos = token->text;
+    const char* end = pos + token->length;
+    bool negative = false;
+    unsigned int value = 0;     /* wraps like the 32 bit value the file holds */
+
+    while(pos < end && is_space(*pos)) pos++;
+
+    if(pos + 1 < end && pos[0] == '0' && (pos[1] == 'x' || pos[1] == 'X'))
+    {
+        for(pos += 2; pos < end; pos++)
+        {
+            char c = *pos;
+            if(c >= '0' && c <= '9')        value = (value << 4) | (c - '0');
+            else if(c >= 'a' && c <= 'f')   value = (value << 4) | (c - 'a' + 10);
+            else if(c >= 'A' && c <= 'F')   value = (value << 4) | (c - 'A' + 10);
+            else break;
+        }
+        return (int)value;
+    }
+
+    if(pos < end && *pos == '-')
+    {
+        negative = true;
+        pos++;
+    }
+
+    for(; pos < end && *pos >= '0' && *pos <= '9'; pos++)
+    {
+        value = (value * 10) + (*pos - '0');
+    }
+
+    return (int)(negative ? 0 - value : value);
+}
+
+int plist_decode_data(const plist_token_t* token, char* out)
+{
+    return base64_decode(token->text, token->length, (uint8_t*)out);
+}
@@ -0,0 +1,72 @@
+/*
+ *  plist_stream.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_PLIST_STREAM_H
+#define __FILENVRAM_PLIST_STREAM_H
+
+#include "libsaio.h"
+
+/**
+ ** Forward only tokenizer for the subset of the plist format libsaio's XML parser understands.
+ ** Tokens refer back into the caller's buffer, nothing is allocated or modified.
+ ** Like XMLParseFile, entities in keys and strings are left as-is.
+ **/
+enum
+{
+    kPlistTokenEnd = 0,
+    kPlistTokenError,
+    kPlistTokenDict,
+    kPlistTokenDictEnd,
+    kPlistTokenArray,
+    kPlistTokenArrayEnd,
+    kPlistTokenKey,
+    kPlistTokenString,
+    kPlistTokenData,
+    kPlistTokenInteger,
+    kPlistTokenTrue,
+    kPlistTokenFalse,
+    kPlistTokenOther,       /* date, real: well formed, but not injected */
+};
+
+typedef struct
+{
+    int         type;
+    const char* text;       /* element contents, for scalar tokens */
+    int         length;
+} plist_token_t;
+
+typedef struct
+{
+    const char* pos;
+    const char* end;
+    int         pending;    /* close token owed by an empty <dict/> or <array/> */
+    int         refs;       /* IDREF attributes seen so far */
+} plist_stream_t;
+
+void    plist_stream_init(plist_stream_t* stream, const char* buffer, int length);
+
+/** Return the next token, skipping the prolog, comments and <plist> wrapper **/
+int     plist_stream_next(plist_stream_t* stream, plist_token_t* token);
+
+/** Consume the rest of a value whose first token has been read, returns false on malformed input **/
+bool    plist_stream_skip(plist_stream_t* stream, const plist_token_t* token);
+
+/** True if the token is a key/string with exactly the given contents **/
+bool    plist_token_equals(const plist_token_t* token, const char* string);
+
+/** Integer contents, decimal or 0x prefixed hex, as XMLCastInteger **/
+int     plist_decode_integer(const plist_token_t* token);
+
+/** Base64 decode data contents into out, which needs room for (length * 3) / 4 bytes. Returns the decoded length. **/
+int     plist_decode_data(const plist_token_t* token, char* out);
+
+#endif /* !__FILENVRAM_PLIST_STREAM_H */
@@ -0,0 +1,91 @@
+/*
+ *  scan_hint.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "scan_hint.h"
+
+static const char* parse_number(const char* text, const char* end, unsigned long* value)
+{
+    const char* start = text;
+
+    *value = 0;
+    while(text < end && *text >= '0' && *text <= '9')
+    {
+        *value = (*value * 10) + (*text - '0');
+        text++;
+    }
+
+    return (text == start) ? NULL : text;
+}
+
+static const char* parse_literal(const char* text, const char* end, const char* literal)
+{
+    while(*literal)
+    {
+        if(text >= end || *text != *literal) return NULL;
+        text++;
+        literal++;
+    }
+
+    return text;
+}
+
+bool scan_hint_parse(const char* text, int length, scan_hint_t* hint)
+{
+    const char* end = text + length;
+    unsigned long unit, part, time;
+
+    if(!(text = parse_literal(text, end, "hd(")))  return false;
+    if(!(text = parse_number(text, end, &unit)))    return false;
+    if(!(text = parse_literal(text, end, ",")))     return false;
+    if(!(text = parse_number(text, end, &part)))    return false;
+    if(!(text = parse_literal(text, end, ") ")))    return false;
+    if(!(text = parse_number(text, end, &time)))    return false;
+
+    hint->unit = (int)unit;
+    hint->part = (int)part;
+    hint->time = time;
+
+    return true;
+}
+
+BVRef scan_hint_lookup(BVRef chain, const scan_hint_t* hint)
+{
+    BVRef bvr;
+
+    for(bvr = chain; bvr; bvr = bvr->next)
+    {
+        if(BIOS_DEV_UNIT(bvr) == hint->unit && bvr->part_no == hint->part) return bvr;
+    }
+
+    return NULL;
+}
+
+bool scan_hint_matches(const scan_hint_t* hint, long time)
+{
+    return (unsigned long)time == hint->time + NVRAM_HINT_HFS_EPOCH;
+}
+
+bool scan_hint_read(scan_hint_t* hint)
+{
+    char        text[NVRAM_HINT_MAX_LENGTH];
+    int         length;
+    int         fh;
+
+    fh = open(NVRAM_HINT_PATH, 0);
+    if(fh < 0) return false;
+
+    length = read(fh, text, sizeof(text));
+    close(fh);
+
+    return length > 0 && scan_hint_parse(text, length, hint);
+}
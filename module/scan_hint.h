@@ -0,0 +1,50 @@
+/*
+ *  scan_hint.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_SCAN_HINT_H
+#define __FILENVRAM_SCAN_HINT_H
+
+#include "libsaio.h"
+
+/**
+ ** FileNVRAM.kext records the volume holding the nvram file it writes to in a small text file next to it:
+ **     hd(<unit>,<partition>) <modification time of the nvram file, unix seconds>\n
+ ** The kext writes it through the root filesystem, which is the default boot volume here, so it is read without a
+ ** device. The module probes the hinted volume first and only scans every volume when the hint is missing or the
+ ** file there no longer carries the recorded time.
+ **/
+#define NVRAM_HINT_PATH         "/Extra/nvram.hint"
+#define NVRAM_HINT_MAX_LENGTH   64
+
+/** GetFileInfo reports HFS+ times, seconds since 1904. Any other filesystem just never matches and falls back to a scan. **/
+#define NVRAM_HINT_HFS_EPOCH    2082844800UL
+
+typedef struct
+{
+    int             unit;       /* BIOS_DEV_UNIT */
+    int             part;       /* part_no */
+    unsigned long   time;
+} scan_hint_t;
+
+/** Parse a hint, returns false if it is malformed **/
+bool    scan_hint_parse(const char* text, int length, scan_hint_t* hint);
+
+/** Locate the hinted volume in the chain **/
+BVRef   scan_hint_lookup(BVRef chain, const scan_hint_t* hint);
+
+/** Check a time reported by GetFileInfo against the time recorded in the hint **/
+bool    scan_hint_matches(const scan_hint_t* hint, long time);
+
+/** Read NVRAM_HINT_PATH, returns false if it is missing or malformed **/
+bool    scan_hint_read(scan_hint_t* hint);
+
+#endif /* !__FILENVRAM_SCAN_HINT_H */
@@ -0,0 +1,82 @@
+/*
+ *  smbios_index.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "smbios_index.h"
+
+#define SMBIOS_HEADER_LENGTH    4       /* type, length, handle */
+
+/**
+ ** Offset just past the string set starting at pos, which ends with two nul bytes, or 0 if it runs off of the table.
+ ** Only nul bytes need a second look, everything else is skipped with a single compare.
+ **/
+static uint32_t skip_strings(const uint8_t* table, uint32_t pos, uint32_t length)
+{
+    while(pos + 1 < length)
+    {
+        if(table[pos] == 0)
+        {
+            if(table[pos + 1] == 0) return pos + 2;
+            pos += 2;           // table[pos + 1] starts a string, it can't also end one
+        }
+        else
+        {
+            pos++;
+        }
+    }
+
+    return 0;
+}
+
+uint32_t smbios_index_build(smbios_index_t* index, const uint8_t* table, uint32_t length)
+{
+    uint32_t pos = 0;
+    int i;
+
+    for(i = 0; i < SMBIOS_INDEX_TYPES; i++) index->offset[i] = SMBIOS_INDEX_NONE;
+    bzero(index->length, sizeof(index->length));
+    index->count = 0;
+
+    if(!table) return 0;
+
+    while(pos + SMBIOS_HEADER_LENGTH <= length)
+    {
+        uint8_t type = table[pos];
+        uint8_t formatted = table[pos + 1];
+        uint32_t next;
+
+        if(formatted < SMBIOS_HEADER_LENGTH || pos + formatted > length) break;
+
+        next = skip_strings(table, pos + formatted, length);
+        if(!next) break;
+
+        if(type < SMBIOS_INDEX_TYPES && index->offset[type] == SMBIOS_INDEX_NONE)
+        {
+            index->offset[type] = pos;
+            index->length[type] = formatted;
+        }
+        index->count++;
+
+        if(type == SMBIOS_TYPE_END) break;
+        pos = next;
+    }
+
+    return index->count;
+}
+
+const uint8_t* smbios_index_find(const smbios_index_t* index, const uint8_t* table, uint8_t type, uint8_t minLength)
+{
+    if(type >= SMBIOS_INDEX_TYPES || index->offset[type] == SMBIOS_INDEX_NONE) return NULL;
+    if(index->length[type] < minLength) return NULL;
+
+    return table + index->offset[type];
+}
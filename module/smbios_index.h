@@ -0,0 +1,39 @@
+/*
+ *  smbios_index.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_SMBIOS_INDEX_H
+#define __FILENVRAM_SMBIOS_INDEX_H
+
+#include "libsaio.h"
+
+#define SMBIOS_INDEX_TYPES      128         /* 128-255 are OEM specific and not indexed */
+#define SMBIOS_INDEX_NONE       0xFFFFFFFF
+#define SMBIOS_TYPE_END         127
+
+/**
+ ** Offset of the first structure of each type in an SMBIOS structure table, built in one pass.
+ ** Only the raw table layout is used, so this doesn't depend on libsaio's SMBIOS definitions.
+ **/
+typedef struct
+{
+    uint32_t    offset[SMBIOS_INDEX_TYPES];     /* SMBIOS_INDEX_NONE if the type isn't present */
+    uint8_t     length[SMBIOS_INDEX_TYPES];     /* formatted length of that structure */
+    uint32_t    count;                          /* structures walked */
+} smbios_index_t;
+
+/** Walk the table up to the end of table structure or the first malformed one. Returns the number of structures. **/
+uint32_t        smbios_index_build(smbios_index_t* index, const uint8_t* table, uint32_t length);
+
+/** First structure of the given type, NULL if there is none or its formatted area is shorter than minLength. **/
+const uint8_t*  smbios_index_find(const smbios_index_t* index, const uint8_t* table, uint8_t type, uint8_t minLength);
+
+#endif /* !__FILENVRAM_SMBIOS_INDEX_H */
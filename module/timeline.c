@@ -0,0 +1,68 @@
+/*
+ *  timeline.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include <libsaio/cpu.h>
+#include <libsaio/platform.h>
+#include "timeline.h"
+
+static timeline_t   gTimeline = { NVRAM_TIMELINE_MAGIC, NVRAM_TIMELINE_VERSION, 0 };
+static uint64_t     gTimelineBase;
+
+static uint32_t timeline_us(uint64_t ticks)
+{
+    uint64_t ticksPerUS = Platform.CPU.TSCFrequency / 1000000;
+
+    if(!ticksPerUS) return 0;
+    return (uint32_t)(ticks / ticksPerUS);
+}
+
+uint64_t timeline_now(void)
+{
+    uint64_t now = rdtsc64();
+
+    if(!gTimelineBase) gTimelineBase = now;
+    return now;
+}
+
+void timeline_record(uint8_t phase, uint64_t start)
+{
+    uint32_t duration = timeline_us(rdtsc64() - start);
+    timeline_entry_t* entry;
+    int i;
+
+    /* Repeated runs of a phase (e.g. a boot retry) are folded into a single entry */
+    for(i = 0; i < gTimeline.count; i++)
+    {
+        entry = &gTimeline.entries[i];
+        if(entry->phase == phase)
+        {
+            entry->count++;
+            entry->duration += duration;
+            return;
+        }
+    }
+
+    if(gTimeline.count >= NVRAM_TIMELINE_ENTRIES) return;
+
+    entry = &gTimeline.entries[gTimeline.count++];
+    entry->source   = NVRAM_TIMELINE_LOADER;
+    entry->phase    = phase;
+    entry->count    = 1;
+    entry->start    = timeline_us(start - gTimelineBase);
+    entry->duration = duration;
+}
+
+timeline_t* timeline_get(void)
+{
+    return &gTimeline;
+}
@@ -0,0 +1,59 @@
+/*
+ *  timeline.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_TIMELINE_H
+#define __FILENVRAM_TIMELINE_H
+
+#include "libsaio.h"
+
+/* Boot phase timeline, forwarded to FileNVRAM.kext through the device tree. Must match kext/FileNVRAM/Timeline.h */
+#define NVRAM_TIMELINE_KEY          "BootTimeline"
+
+#define NVRAM_TIMELINE_MAGIC        0x4C544E46      /* 'FNTL' */
+#define NVRAM_TIMELINE_VERSION      1
+#define NVRAM_TIMELINE_ENTRIES      32
+
+#define NVRAM_TIMELINE_LOADER       0
+
+#define TIMELINE_LOADER_READPLIST   1
+#define TIMELINE_LOADER_SCAN        2
+#define TIMELINE_LOADER_PARSE       3
+#define TIMELINE_LOADER_HOOK        4
+#define TIMELINE_LOADER_INJECT      5
+#define TIMELINE_LOADER_MKEXT       6
+
+typedef struct
+{
+    uint8_t     source;
+    uint8_t     phase;
+    uint16_t    count;      /* number of times the phase ran */
+    uint32_t    start;      /* us since the first phase began */
+    uint32_t    duration;   /* us, summed over all runs */
+} __attribute__((packed)) timeline_entry_t;
+
+typedef struct
+{
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    count;
+    timeline_entry_t entries[NVRAM_TIMELINE_ENTRIES];
+} __attribute__((packed)) timeline_t;
+
+/** Current timestamp, the first call sets the timeline's origin **/
+uint64_t    timeline_now(void);
+
+/** Record a phase that began at start (a timeline_now() value) and ends now **/
+void        timeline_record(uint8_t phase, uint64_t start);
+
+timeline_t* timeline_get(void);
+
+#endif /* !__FILENVRAM_TIMELINE_H */
@@ -0,0 +1,240 @@
+/*
+ *  x86_insn.c
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include "x86_insn.h"
+
+/* Operand flags per opcode */
+#define OP_NONE     0x00
+#define OP_MODRM    0x01
+#define OP_IB       0x02        /* 8 bit immediate */
+#define OP_IW       0x04        /* 16 bit immediate */
+#define OP_IZ       0x08        /* 16 or 32 bit immediate, by operand size */
+#define OP_IV       0x10        /* 16, 32 or 64 bit immediate, by operand size */
+#define OP_MOFFS    0x20        /* address sized offset */
+#define OP_AP       0x40        /* far pointer, 32 bit only */
+#define OP_BAD      0x80        /* prefix handled elsewhere, unsupported, or invalid */
+
+#define M   OP_MODRM
+#define B   OP_IB
+#define Z   OP_IZ
+#define X   OP_BAD
+
+static const UInt8 gOneByte[256] =
+{
+/*        0      1      2      3      4      5      6      7      8      9      A      B      C      D      E      F  */
+/* 0 */   M,     M,     M,     M,     B,     Z,     0,     0,     M,     M,     M,     M,     B,     Z,     0,     X,
+/* 1 */   M,     M,     M,     M,     B,     Z,     0,     0,     M,     M,     M,     M,     B,     Z,     0,     0,
+/* 2 */   M,     M,     M,     M,     B,     Z,     X,     0,     M,     M,     M,     M,     B,     Z,     X,     0,
+/* 3 */   M,     M,     M,     M,     B,     Z,     X,     0,     M,     M,     M,     M,     B,     Z,     X,     0,
+/* 4 */   0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+/* 5 */   0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+/* 6 */   0,     0,     M,     M,     X,     X,     X,     X,     Z,     M|Z,   B,     M|B,   0,     0,     0,     0,
+/* 7 */   B,     B,     B,     B,     B,     B,     B,     B,     B,     B,     B,     B,     B,     B,     B,     B,
+/* 8 */   M|B,   M|Z,   M|B,   M|B,   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+/* 9 */   0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     OP_AP, 0,     0,     0,     0,     0,
+/* A */   OP_MOFFS, OP_MOFFS, OP_MOFFS, OP_MOFFS, 0, 0,   0,     0,     B,     Z,     0,     0,     0,     0,     0,     0,
+/* B */   B,     B,     B,     B,     B,     B,     B,     B,     OP_IV, OP_IV, OP_IV, OP_IV, OP_IV, OP_IV, OP_IV, OP_IV,
+/* C */   M|B,   M|B,   OP_IW, 0,     M,     M,     M|B,   M|Z,   OP_IW|B, 0,   OP_IW, 0,     0,     B,     0,     0,
+/* D */   M,     M,     M,     M,     B,     B,     0,     0,     M,     M,     M,     M,     M,     M,     M,     M,
+/* E */   B,     B,     B,     B,     B,     B,     B,     B,     Z,     Z,     OP_AP, B,     0,     0,     0,     0,
+/* F */   X,     0,     X,     X,     0,     0,     M,     M,     0,     0,     0,     0,     0,     0,     M,     M,
+};
+
+static const UInt8 gTwoByte[256] =
+{
+/*        0      1      2      3      4      5      6      7      8      9      A      B      C      D      E      F  */
+/* 0 */   M,     M,     M,     M,     X,     0,     0,     0,     0,     0,     X,     0,     X,     M,     0,     X,
+/* 1 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+/* 2 */   M,     M,     M,     M,     X,     X,     X,     X,     M,     M,     M,     M,     M,     M,     M,     M,
+/* 3 */   0,     0,     0,     0,     0,     0,     X,     0,     X,     X,     X,     X,     X,     X,     X,     X,
+/* 4 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+/* 5 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+/* 6 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+/* 7 */   M|B,   M|B,   M|B,   M|B,   M,     M,     M,     0,     M,     M,     X,     X,     M,     M,     M,     M,
+/* 8 */   Z,     Z,     Z,     Z,     Z,     Z,     Z,     Z,     Z,     Z,     Z,     Z,     Z,     Z,     Z,     Z,
+/* 9 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+/* A */   0,     0,     0,     M,     M|B,   M,     X,     X,     0,     0,     0,     M,     M|B,   M,     M,     M,
+/* B */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M|B,   M,     M,     M,     M,     M,
+/* C */   M,     M,     M|B,   M,     M|B,   M|B,   M|B,   M,     0,     0,     0,     0,     0,     0,     0,     0,
+/* D */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+/* E */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+/* F */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+};
+
+#undef M
+#undef B
+#undef Z
+#undef X
+
+/** Opcodes that don't exist in 64 bit mode **/
+static bool invalid64(UInt8 opcode)
+{
+    switch(opcode)
+    {
+        case 0x06: case 0x07: case 0x0E: case 0x16: case 0x17: case 0x1E: case 0x1F:
+        case 0x27: case 0x2F: case 0x37: case 0x3F: case 0x60: case 0x61: case 0x62:
+        case 0x82: case 0x9A: case 0xC4: case 0xC5: case 0xD4: case 0xD5: case 0xD6: case 0xEA:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+UInt32 x86_insn_length(const UInt8* code, UInt32 available, bool is64)
+{
+    const UInt8* pos = code;
+    const UInt8* end = code + ((available < X86_MAX_INSN_LENGTH) ? available : X86_MAX_INSN_LENGTH);
+    bool operand16 = false;
+    bool address16 = false;     /* 32 bit mode only, 67 selects 32 bit addressing in 64 bit mode */
+    bool address32 = false;
+    bool rexW = false;
+    bool escaped = false;       /* 0F map */
+    UInt8 opcode, flags;
+    UInt32 immediate = 0;
+
+    // Legacy prefixes, then REX
+    for(;; pos++)
+    {
+        if(pos >= end) return 0;
+
+        switch(*pos)
+        {
+            case 0x66: operand16 = true; continue;
+            case 0x67: if(is64) address32 = true; else address16 = true; continue;
+            case 0xF0: case 0xF2: case 0xF3:
+            case 0x26: case 0x2E: case 0x36: case 0x3E: case 0x64: case 0x65:
+                continue;
+        }
+        break;
+    }
+
+    if(is64 && (*pos & 0xF0) == 0x40)
+    {
+        rexW = (*pos & 0x08) != 0;
+        if(++pos >= end) return 0;
+    }
+
+    opcode = *pos++;
+
+    if(opcode == 0x0F)
+    {
+        if(pos >= end) return 0;
+        opcode = *pos++;
+        escaped = true;
+
+        if(opcode == 0x38 || opcode == 0x3A)
+        {
+            // Three byte maps: all ModRM, 0F 3A also takes an imm8.
+            if(pos >= end) return 0;
+            pos++;
+            flags = OP_MODRM | ((opcode == 0x3A) ? OP_IB : 0);
+        }
+        else
+        {
+            flags = gTwoByte[opcode];
+        }
+
+        // jcc rel32 is never shortened in 64 bit mode.
+        if(is64 && (opcode & 0xF0) == 0x80) operand16 = false;
+    }
+    else
+    {
+        if(is64 && invalid64(opcode)) return 0;
+
+        // LES/LDS and BOUND: with a register operand these are VEX and EVEX prefixes.
+        if((opcode == 0xC4 || opcode == 0xC5 || opcode == 0x62) && (pos >= end || (*pos & 0xC0) == 0xC0)) return 0;
+
+        flags = gOneByte[opcode];
+
+        // Near call and jmp take a rel32 in 64 bit mode regardless of 66.
+        if(is64 && (opcode == 0xE8 || opcode == 0xE9)) operand16 = false;
+    }
+
+    if(flags & OP_BAD) return 0;
+
+    if(flags & OP_MODRM)
+    {
+        UInt8 modrm, mod, rm;
+
+        if(pos >= end) return 0;
+        modrm = *pos++;
+        mod = modrm >> 6;
+        rm = modrm & 7;
+
+        // Group 3: only test takes an immediate
+        if(!escaped && (opcode == 0xF6 || opcode == 0xF7) && ((modrm >> 3) & 7) < 2)
+        {
+            flags |= (opcode == 0xF6) ? OP_IB : OP_IZ;
+        }
+
+        if(mod != 3)
+        {
+            if(address16)
+            {
+                if(mod == 0 && rm == 6)     immediate += 2;
+                else if(mod == 1)           immediate += 1;
+                else if(mod == 2)           immediate += 2;
+            }
+            else
+            {
+                if(rm == 4)
+                {
+                    if(pos >= end) return 0;
+                    if(mod == 0 && (*pos & 7) == 5) immediate += 4;
+                    pos++;
+                }
+
+                if(mod == 0 && rm == 5)     immediate += 4;     // disp32, or RIP relative
+                else if(mod == 1)           immediate += 1;
+                else if(mod == 2)           immediate += 4;
+            }
+        }
+    }
+
+    if(flags & OP_IB)       immediate += 1;
+    if(flags & OP_IW)       immediate += 2;
+    if(flags & OP_IZ)       immediate += operand16 ? 2 : 4;
+    if(flags & OP_IV)       immediate += rexW ? 8 : (operand16 ? 2 : 4);
+    if(flags & OP_AP)       immediate += operand16 ? 4 : 6;
+    if(flags & OP_MOFFS)    immediate += is64 ? (address32 ? 4 : 8) : (address16 ? 2 : 4);
+
+    if(immediate > (UInt32)(end - pos)) return 0;
+
+    return (UInt32)(pos - code) + immediate;
+}
+
+void x86_nop_fill(UInt8* code, UInt32 length)
+{
+    static const UInt8 nops[9][9] =
+    {
+        { 0x90 },
+        { 0x66, 0x90 },
+        { 0x0F, 0x1F, 0x00 },
+        { 0x0F, 0x1F, 0x40, 0x00 },
+        { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    };
+
+    while(length)
+    {
+        UInt32 size = (length < 9) ? length : 9;
+
+        memcpy(code, nops[size - 1], size);
+        code += size;
+        length -= size;
+    }
+}
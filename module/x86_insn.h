@@ -0,0 +1,30 @@
+/*
+ *  x86_insn.h
+ *  FileNVRAM
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __FILENVRAM_X86_INSN_H
+#define __FILENVRAM_X86_INSN_H
+
+#include "libsaio.h"
+
+#define X86_MAX_INSN_LENGTH     15
+
+/**
+ ** Length of the instruction at code, decoding no more than available bytes. Covers the general purpose, x87,
+ ** MMX and SSE opcode maps; returns 0 for anything else (VEX/EVEX, 3DNow!, opcodes invalid in the mode) or if the
+ ** instruction doesn't fit.
+ **/
+UInt32  x86_insn_length(const UInt8* code, UInt32 available, bool is64);
+
+/** Fill length bytes with the fewest recommended multi-byte NOPs (0F 1F /0, P6 and later) **/
+void    x86_nop_fill(UInt8* code, UInt32 length);
+
+#endif /* !__FILENVRAM_X86_INSN_H */
@@ -0,0 +1,140 @@
+/*
+ *  adler32_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "adler32.h"
+#include <zlib.h>
+
+/**
+ ** The module is built for SSE2, the SSSE3 kernel only when the bootloader is. Build a second copy with SSSE3
+ ** enabled so both kernels are checked against zlib.
+ **/
+#if defined(__x86_64__) || defined(__i386__)
+#pragma GCC push_options
+#pragma GCC target("ssse3")
+#define adler32_update  adler32_update_ssse3
+#define adler32_scalar  adler32_scalar_ssse3
+#include "../module/adler32.c"
+#undef adler32_update
+#undef adler32_scalar
+#pragma GCC pop_options
+#define HAVE_SSSE3_COPY
+#endif
+
+#define ADLER32_LONGEST     (3 * 5552 + 100)    /* a few NMAX blocks and then some */
+
+typedef uint32_t (*adler32_fn)(uint32_t adler, const uint8_t* buffer, size_t length);
+
+static const struct { const char* name; adler32_fn fn; } gKernels[] =
+{
+    { "scalar", adler32_scalar },
+    { "update", adler32_update },
+#ifdef HAVE_SSSE3_COPY
+    { "ssse3",  adler32_update_ssse3 },
+#endif
+};
+
+#define KERNELS     (sizeof(gKernels) / sizeof(gKernels[0]))
+
+/** Check every kernel against zlib for buffer[0, length) **/
+static void check_kernels(uint32_t adler, const uint8_t* buffer, size_t length)
+{
+    uint32_t expected = (uint32_t)adler32(adler, buffer, (uInt)length);
+    size_t k;
+
+    for(k = 0; k < KERNELS; k++)
+    {
+        uint32_t actual = gKernels[k].fn(adler, buffer, length);
+        if(actual != expected)
+        {
+            char message[128];
+            snprintf(message, sizeof(message), "%s(%08x, %zu bytes) = %08x, zlib %08x", gKernels[k].name, adler, length, actual, expected);
+            test_fail(__FILE__, __LINE__, message);
+            return;
+        }
+    }
+}
+
+TEST(adler32_known_values)
+{
+    size_t k;
+
+    for(k = 0; k < KERNELS; k++)
+    {
+        CHECK_INT(gKernels[k].fn(ADLER32_INIT, (const uint8_t*)"", 0), 1);
+        CHECK_INT(gKernels[k].fn(ADLER32_INIT, (const uint8_t*)"Wikipedia", 9), 0x11E60398);
+    }
+}
+
+TEST(adler32_every_length)
+{
+    uint8_t* buffer = malloc(ADLER32_LONGEST);
+    uint32_t state = 3;
+    size_t length;
+
+    for(length = 0; length < ADLER32_LONGEST; length++) buffer[length] = (uint8_t)harness_random(&state);
+
+    // Every tail length around the 16 byte chunks and the NMAX blocks
+    for(length = 0; length < 600; length++) check_kernels(ADLER32_INIT, buffer, length);
+    for(length = 5552 - 40; length < 5552 + 40; length++) check_kernels(ADLER32_INIT, buffer, length);
+    check_kernels(ADLER32_INIT, buffer, ADLER32_LONGEST);
+
+    free(buffer);
+}
+
+TEST(adler32_unaligned)
+{
+    uint8_t* buffer = malloc(4096 + 16);
+    uint32_t state = 5;
+    size_t offset, i;
+
+    for(i = 0; i < 4096 + 16; i++) buffer[i] = (uint8_t)harness_random(&state);
+    for(offset = 0; offset < 16; offset++) check_kernels(ADLER32_INIT, buffer + offset, 4096);
+
+    free(buffer);
+}
+
+TEST(adler32_saturated)
+{
+    uint8_t* buffer = malloc(ADLER32_LONGEST);
+
+    // All 0xff is the worst case for the sums between reductions, starting from the largest a and b
+    memset(buffer, 0xff, ADLER32_LONGEST);
+    check_kernels(ADLER32_INIT, buffer, ADLER32_LONGEST);
+    check_kernels(0xFFF0FFF0, buffer, ADLER32_LONGEST);
+    check_kernels(0xFFF0FFF0, buffer, 5552);
+
+    free(buffer);
+}
+
+TEST(adler32_continues)
+{
+    uint8_t* buffer = malloc(ADLER32_LONGEST);
+    uint32_t state = 9;
+    size_t split, k, i;
+
+    for(i = 0; i < ADLER32_LONGEST; i++) buffer[i] = (uint8_t)harness_random(&state);
+
+    uint32_t whole = (uint32_t)adler32(ADLER32_INIT, buffer, ADLER32_LONGEST);
+
+    // Split anywhere, the running value carries over
+    for(split = 0; split <= ADLER32_LONGEST; split += 997)
+    {
+        for(k = 0; k < KERNELS; k++)
+        {
+            uint32_t adler = gKernels[k].fn(ADLER32_INIT, buffer, split);
+            CHECK_INT(gKernels[k].fn(adler, buffer + split, ADLER32_LONGEST - split), whole);
+        }
+    }
+
+    free(buffer);
+}
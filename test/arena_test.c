@@ -0,0 +1,173 @@
+/*
+ *  arena_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "arena.h"
+
+/** Free every chunk left in the arena **/
+static void arena_free(arena_t* arena)
+{
+    arena_scope_t scope = { arena, NULL, 0, 0, 0, ARENA_PHASE_SCAN };
+    arena_end(&scope);
+}
+
+TEST(arena_alloc_aligned)
+{
+    arena_t arena = ARENA_INITIALIZER("test", 256);
+    char* first = arena_alloc(&arena, 1);
+    char* second = arena_alloc(&arena, 13);
+    char* third = arena_alloc(&arena, 8);
+
+    REQUIRE(first && second && third);
+    CHECK(((size_t)first & 7) == 0 && ((size_t)second & 7) == 0 && ((size_t)third & 7) == 0);
+
+    // Bumped within the chunk
+    CHECK(second == first + 8);
+    CHECK(third == second + 16);
+    CHECK_INT(arena.used, 32);
+    CHECK_INT(arena.allocations, 3);
+
+    arena_free(&arena);
+}
+
+TEST(arena_alloc_chunks)
+{
+    arena_t arena = ARENA_INITIALIZER("test", 64);
+    arena_chunk_t* first;
+
+    REQUIRE(arena_alloc(&arena, 48));
+    first = arena.chunk;
+
+    // Doesn't fit the rest of the chunk, a new one is started
+    REQUIRE(arena_alloc(&arena, 24));
+    CHECK(arena.chunk != first && arena.chunk->prev == first);
+    CHECK_INT(arena.chunk->size, 64);
+
+    // Bigger than a chunk, a chunk of its own
+    char* big = arena_alloc(&arena, 1000);
+    REQUIRE(big);
+    CHECK_INT(arena.chunk->size, 1000);
+    memset(big, 0xAA, 1000);
+
+    CHECK_INT(arena.used, 48 + 24 + 1000);
+
+    arena_free(&arena);
+}
+
+TEST(arena_strdup_copies)
+{
+    arena_t arena = ARENA_INITIALIZER("test", 64);
+    char source[] = "hd(0,2)/Extra/nvram.plist";
+    char* copy = arena_strdup(&arena, source);
+
+    REQUIRE(copy && copy != source);
+    CHECK_STR(copy, "hd(0,2)/Extra/nvram.plist");
+
+    arena_free(&arena);
+}
+
+TEST(arena_scope_releases)
+{
+    arena_t arena = ARENA_INITIALIZER("test", 64);
+    char* kept = arena_alloc(&arena, 16);
+    arena_chunk_t* chunk = arena.chunk;
+
+    arena_scope_t scope = arena_begin(&arena, ARENA_PHASE_PARSE);
+    char* scratch = arena_alloc(&arena, 16);
+    REQUIRE(arena_alloc(&arena, 200));
+    REQUIRE(arena_alloc(&arena, 40));
+    arena_end(&scope);
+
+    // Back to the chunk and offset the scope began at, chunks made since are gone
+    CHECK(arena.chunk == chunk);
+    CHECK_INT(arena.used, 16);
+    CHECK(arena_alloc(&arena, 16) == scratch);
+    CHECK(kept != scratch);
+
+    arena_free(&arena);
+}
+
+TEST(arena_scope_empty_arena)
+{
+    arena_t arena = ARENA_INITIALIZER("test", 64);
+
+    arena_scope_t scope = arena_begin(&arena, ARENA_PHASE_SCAN);
+    REQUIRE(arena_alloc(&arena, 16));
+    REQUIRE(arena_alloc(&arena, 100));
+    arena_end(&scope);
+
+    CHECK(arena.chunk == NULL);
+    CHECK_INT(arena.used, 0);
+}
+
+TEST(arena_high_water)
+{
+    arena_t arena = ARENA_INITIALIZER("test", 1024);
+    arena_scope_t scope, inner;
+
+    REQUIRE(arena_alloc(&arena, 64));
+
+    scope = arena_begin(&arena, ARENA_PHASE_SCAN);
+    REQUIRE(arena_alloc(&arena, 32));
+    arena_end(&scope);
+
+    scope = arena_begin(&arena, ARENA_PHASE_PARSE);
+    REQUIRE(arena_alloc(&arena, 128));
+
+    // Nested, its peak counts toward the outer scope too
+    inner = arena_begin(&arena, ARENA_PHASE_PATCH);
+    REQUIRE(arena_alloc(&arena, 256));
+    arena_end(&inner);
+    REQUIRE(arena_alloc(&arena, 16));
+    arena_end(&scope);
+
+    CHECK_INT(arena.phaseHighWater[ARENA_PHASE_SCAN], 32);
+    CHECK_INT(arena.phaseHighWater[ARENA_PHASE_PARSE], 128 + 256);
+    CHECK_INT(arena.phaseHighWater[ARENA_PHASE_PATCH], 256);
+    CHECK_INT(arena.highWater, 64 + 128 + 256);
+    CHECK_INT(arena.used, 64);
+
+    // A later, smaller run of a phase keeps the peak
+    scope = arena_begin(&arena, ARENA_PHASE_SCAN);
+    REQUIRE(arena_alloc(&arena, 8));
+    arena_end(&scope);
+    CHECK_INT(arena.phaseHighWater[ARENA_PHASE_SCAN], 32);
+
+    arena_free(&arena);
+}
+
+TEST(arena_malloc_failure)
+{
+    arena_t arena = ARENA_INITIALIZER("test", 64);
+
+    REQUIRE(arena_alloc(&arena, 16));
+
+    // Fits the chunk, no malloc needed
+    host_fail_malloc(1);
+    CHECK(arena_alloc(&arena, 16) != NULL);
+    host_fail_malloc(0);
+
+    host_fail_malloc(1);
+    CHECK(arena_alloc(&arena, 100) == NULL);
+    CHECK(arena_strdup(&arena, "boot-args") != NULL);
+    host_fail_malloc(0);
+
+    // Nothing was counted for the failed allocation
+    CHECK_INT(arena.used, 16 + 16 + 16);
+    CHECK_INT(arena.allocations, 3);
+
+    host_fail_malloc(1);
+    CHECK(arena_strdup(&arena, "a string too long for what is left of the chunk") == NULL);
+    host_fail_malloc(0);
+
+    arena_free(&arena);
+}
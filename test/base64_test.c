@@ -0,0 +1,224 @@
+/*
+ *  base64_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "base64.h"
+
+/** Like adler32_test.c, a second copy built with SSSE3 so the vector kernel is checked too **/
+#if defined(__x86_64__) || defined(__i386__)
+#pragma GCC push_options
+#pragma GCC target("ssse3")
+#define base64_decode           base64_decode_ssse3
+#define base64_decode_scalar    base64_decode_scalar_ssse3
+#include "../module/base64.c"
+#undef base64_decode
+#undef base64_decode_scalar
+#pragma GCC pop_options
+#define HAVE_SSSE3_COPY
+#endif
+
+typedef int (*base64_fn)(const char* text, int length, uint8_t* out);
+
+static const struct { const char* name; base64_fn fn; } gDecoders[] =
+{
+    { "scalar", base64_decode_scalar },
+    { "decode", base64_decode },
+#ifdef HAVE_SSSE3_COPY
+    { "ssse3",  base64_decode_ssse3 },
+#endif
+};
+
+#define DECODERS    (sizeof(gDecoders) / sizeof(gDecoders[0]))
+
+static const char gAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/** Reference encoder, breaking lines every wrap characters like OSSerialize does for data (0 for none) **/
+static int encode(const uint8_t* bytes, int length, char* text, int wrap)
+{
+    int count = 0;
+    int column = 0;
+    int i;
+
+    for(i = 0; i < length; i += 3)
+    {
+        uint32_t bits = (uint32_t)bytes[i] << 16;
+        int remain = length - i;
+        char quantum[4];
+        int j;
+
+        if(remain > 1) bits |= (uint32_t)bytes[i + 1] << 8;
+        if(remain > 2) bits |= bytes[i + 2];
+
+        quantum[0] = gAlphabet[(bits >> 18) & 63];
+        quantum[1] = gAlphabet[(bits >> 12) & 63];
+        quantum[2] = remain > 1 ? gAlphabet[(bits >> 6) & 63] : '=';
+        quantum[3] = remain > 2 ? gAlphabet[bits & 63] : '=';
+
+        for(j = 0; j < 4; j++)
+        {
+            if(wrap && column == wrap)
+            {
+                text[count++] = '\n';
+                text[count++] = '\t';
+                column = 0;
+            }
+            text[count++] = quantum[j];
+            column++;
+        }
+    }
+
+    return count;
+}
+
+/** Decode text with every decoder into a buffer of exactly the documented size, so ASan sees any write past it **/
+static void check_decoders(const char* text, int length, const uint8_t* expected, int expectedLength, int line)
+{
+    size_t k;
+
+    for(k = 0; k < DECODERS; k++)
+    {
+        char* in = malloc(length ? length : 1);
+        uint8_t* out = malloc((length * 3) / 4 + 1);
+        int decoded;
+
+        memcpy(in, text, length);
+        decoded = gDecoders[k].fn(in, length, out);
+        if(decoded != expectedLength || memcmp(out, expected, expectedLength))
+        {
+            char message[128];
+            snprintf(message, sizeof(message), "%s decoded %d of %d bytes wrong", gDecoders[k].name, decoded, expectedLength);
+            test_fail(__FILE__, line, message);
+        }
+
+        free(out);
+        free(in);
+    }
+}
+
+#define CHECK_DECODE(text, expected) \
+    check_decoders(text, (int)strlen(text), (const uint8_t*)expected, (int)strlen(expected), __LINE__)
+
+TEST(base64_known_values)
+{
+    CHECK_DECODE("", "");
+    CHECK_DECODE("Zg==", "f");
+    CHECK_DECODE("Zm8=", "fo");
+    CHECK_DECODE("Zm9v", "foo");
+    CHECK_DECODE("Zm9vYg==", "foob");
+    CHECK_DECODE("Zm9vYmE=", "fooba");
+    CHECK_DECODE("Zm9vYmFy", "foobar");
+    CHECK_DECODE("Q2hyaXMmYXBvcztzIE1hYyBQcm8=", "Chris&apos;s Mac Pro");
+}
+
+TEST(base64_like_libsaio)
+{
+    // Unpadded tails still decode, the first '=' ends the data
+    CHECK_DECODE("Zg", "f");
+    CHECK_DECODE("Zm8", "fo");
+    CHECK_DECODE("Zg==Zm9v", "f");
+    CHECK_DECODE("=Zm9v", "");
+
+    // Anything outside the alphabet is skipped, a lone sextet is dropped
+    CHECK_DECODE("\n\tZm 9v\r\n", "foo");
+    CHECK_DECODE("Zm9v*Y-m\xc3\xa9" "Fy", "foobar");
+    CHECK_DECODE("Zm9vY", "foo");
+}
+
+/** A 16 character block with one odd character anywhere falls back to the scalar loop and still decodes the same **/
+TEST(base64_block_fallback)
+{
+    const char* block = "Zm9vYmFyZm9vYmFy";
+    const char* odd = " \n=*\x80\xff";
+    int at;
+    size_t o;
+
+    for(o = 0; o < strlen(odd); o++)
+    {
+        for(at = 0; at <= 16; at++)
+        {
+            char text[40];
+            uint8_t expected[32];
+            int length;
+
+            // Twice the block with the character inserted, the reference is the scalar decode of the same
+            memcpy(text, block, at);
+            text[at] = odd[o];
+            memcpy(&text[at + 1], &block[at], 16 - at);
+            memcpy(&text[17], block, 16);
+
+            length = base64_decode_scalar(text, 33, expected);
+            check_decoders(text, 33, expected, length, __LINE__);
+        }
+    }
+}
+
+/** Every sextet value at every position of a block, and every byte that isn't one **/
+TEST(base64_every_character)
+{
+    uint8_t expected[12];
+    char text[16];
+    int at, c;
+
+    for(at = 0; at < 16; at++)
+    {
+        for(c = 0; c < 256; c++)
+        {
+            const char* sextet = memchr(gAlphabet, c, 64);
+            uint32_t bits = 0;
+            int i;
+
+            memset(text, 'A', sizeof(text));
+            text[at] = (char)c;
+
+            if(!sextet)
+            {
+                // Skipped or padding, the scalar loop is the reference
+                int length = base64_decode_scalar(text, 16, expected);
+                check_decoders(text, 16, expected, length, __LINE__);
+                continue;
+            }
+
+            bzero(expected, sizeof(expected));
+            for(i = 0; i < 4; i++) bits = (bits << 6) | ((at & 3) == i ? (uint32_t)(sextet - gAlphabet) : 0);
+            expected[(at / 4) * 3 + 0] = (uint8_t)(bits >> 16);
+            expected[(at / 4) * 3 + 1] = (uint8_t)(bits >> 8);
+            expected[(at / 4) * 3 + 2] = (uint8_t)bits;
+            check_decoders(text, 16, expected, 12, __LINE__);
+        }
+    }
+}
+
+TEST(base64_round_trip)
+{
+    uint8_t* bytes = malloc(1024);
+    char* text = malloc(2048);
+    uint32_t state = 11;
+    int length, i;
+
+    for(i = 0; i < 1024; i++) bytes[i] = (uint8_t)harness_random(&state);
+
+    // Every length around the block sizes, plain and wrapped like the kext and plutil write data
+    for(length = 0; length <= 200; length++)
+    {
+        check_decoders(text, encode(bytes, length, text, 0), bytes, length, __LINE__);
+        check_decoders(text, encode(bytes, length, text, 68), bytes, length, __LINE__);
+    }
+    check_decoders(text, encode(bytes, 1024, text, 0), bytes, 1024, __LINE__);
+    check_decoders(text, encode(bytes, 1024, text, 76), bytes, 1024, __LINE__);
+
+    // Every byte value in every position of a quantum
+    for(i = 0; i < 256 * 3; i++) bytes[i] = (uint8_t)(i / 3 + (i % 3) * 85);
+    check_decoders(text, encode(bytes, 256 * 3, text, 0), bytes, 256 * 3, __LINE__);
+
+    free(text);
+    free(bytes);
+}
@@ -0,0 +1,354 @@
+/*
+ *  bench.c
+ *  FileNVRAM benchmarks
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+/**
+ ** Runs every registered benchmark and prints one tab separated line per case:
+ **
+ **     name    keys=N size=N    ns per operation    score
+ **
+ **     ./bench [-r repeats] [-o results.tsv] [-c baseline.tsv] [-t threshold] [substring]
+ **
+ ** Each case is timed repeats times, each time in a new process after a short warm up, and the fastest run
+ ** is kept. The score is the time per operation relative to a fixed calibration loop, so results from machines
+ ** of different speeds can be compared. The loop is timed again before every case and the fastest time is the
+ ** unit, a busy machine only makes the unit look slower for a while. With -c the scores are compared to a baseline written by an earlier -o, and bench exits with 1 if
+ ** any case got slower than threshold times its baseline. A case that looks slower is measured again before
+ ** it counts as a regression.
+ **/
+#include "bench.h"
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_MAX           128
+#define BENCH_REPEATS       5
+#define BENCH_MIN_NS        20000000ULL     /* each repeat runs at least 20ms, after a quarter of that to warm up */
+#define BENCH_THRESHOLD     2.0
+#define BENCH_RETRIES       2               /* extra measurements before a slower case counts as a regression */
+
+struct bench
+{
+    bool        running;
+    bool        warm;
+    uint64_t    start;
+    uint64_t    paused;
+    uint64_t    excluded;       /* ns spent paused */
+    uint64_t    minimum;
+    uint64_t    ops;
+    uint64_t    elapsed;
+};
+
+typedef struct
+{
+    const char* name;
+    bench_fn_t  fn;
+    long        keys;
+    long        size;
+    double      ns;             /* per operation, fastest repeat */
+    double      score;
+} bench_case_t;
+
+typedef struct
+{
+    const bench_case_t* test;
+    int                 fd;     /* the child reports ops and elapsed here */
+} bench_run_t;
+
+static bench_case_t gCases[BENCH_MAX];
+static int          gCaseCount;
+static double       gUnit;          /* fastest calibration loop so far, ns */
+
+void bench_register(const char* name, bench_fn_t fn, long keys, long size)
+{
+    if(gCaseCount >= BENCH_MAX)
+    {
+        fprintf(stderr, "too many benchmarks, raise BENCH_MAX\n");
+        exit(1);
+    }
+
+    gCases[gCaseCount].name = name;
+    gCases[gCaseCount].fn = fn;
+    gCases[gCaseCount].keys = keys;
+    gCases[gCaseCount].size = size;
+    gCaseCount++;
+}
+
+bool bench_loop(bench_t* b)
+{
+    uint64_t now = harness_now();
+
+    if(!b->running)
+    {
+        b->running = true;
+        b->start = now;
+        return true;
+    }
+
+    b->ops++;
+
+    // The first operations fault in memory and fill caches, start timing once that settled
+    if(!b->warm)
+    {
+        if(now - b->start - b->excluded < b->minimum / 4) return true;
+
+        b->warm = true;
+        b->start = now;
+        b->excluded = 0;
+        b->ops = 0;
+        return true;
+    }
+
+    if(now - b->start - b->excluded < b->minimum) return true;
+
+    b->elapsed = now - b->start - b->excluded;
+    b->running = false;
+    return false;
+}
+
+void bench_pause(bench_t* b)
+{
+    b->paused = harness_now();
+}
+
+void bench_resume(bench_t* b)
+{
+    b->excluded += harness_now() - b->paused;
+}
+
+/** Fixed amount of hashing and copying, the unit scores are measured in **/
+static void calibrate(bench_t* b, long keys, long size)
+{
+    static char buffer[2][16384];
+    volatile uint32_t sink = 0;
+    uint32_t state = 1;
+    size_t i;
+
+    for(i = 0; i < sizeof(buffer[0]); i++) buffer[0][i] = (char)harness_random(&state);
+
+    while(bench_loop(b))
+    {
+        uint32_t hash = 2166136261U;
+
+        memcpy(buffer[1], buffer[0], sizeof(buffer[1]));
+        for(i = 0; i < sizeof(buffer[1]); i++) hash = (hash ^ (uint8_t)buffer[1][i]) * 16777619U;
+        sink += hash;
+    }
+}
+
+static void run_repeat(void* arg)
+{
+    const bench_run_t* run = arg;
+    bench_t b;
+    uint64_t result[2];
+
+    if(!getenv("TEST_VERBOSE")) freopen("/dev/null", "w", stdout);
+
+    memset(&b, 0, sizeof(b));
+    b.minimum = BENCH_MIN_NS;
+    if(getenv("BENCH_MIN_MS")) b.minimum = strtoull(getenv("BENCH_MIN_MS"), NULL, 10) * 1000000ULL;
+
+    run->test->fn(&b, run->test->keys, run->test->size);
+
+    result[0] = b.ops;
+    result[1] = b.elapsed;
+    if(write(run->fd, result, sizeof(result)) != sizeof(result)) _exit(1);
+    _exit(0);
+}
+
+/** Fastest time per operation over repeats runs, 0 if the case failed **/
+static double measure_ns(const bench_case_t* test, int repeats)
+{
+    double best = 0;
+    int i;
+
+    for(i = 0; i < repeats; i++)
+    {
+        bench_run_t run = { test, -1 };
+        uint64_t result[2];
+        int fds[2];
+        int status;
+
+        if(pipe(fds)) return 0;
+
+        run.fd = fds[1];
+        status = harness_run(run_repeat, &run);
+        close(fds[1]);
+
+        if(status || read(fds[0], result, sizeof(result)) != sizeof(result) || !result[0])
+        {
+            close(fds[0]);
+            return 0;
+        }
+        close(fds[0]);
+
+        if(!best || (double)result[1] / result[0] < best) best = (double)result[1] / result[0];
+    }
+
+    return best;
+}
+
+/** Time the case, and the calibration loop before it. False if either failed. **/
+static bool measure(bench_case_t* test, int repeats)
+{
+    static bench_case_t calibration = { "calibrate", calibrate, 0, 0, 0, 0 };
+    double unit = measure_ns(&calibration, repeats);
+
+    if(!unit) return false;
+    if(!gUnit || unit < gUnit) gUnit = unit;
+
+    test->ns = measure_ns(test, repeats);
+    return test->ns != 0;
+}
+
+static void rescore(void)
+{
+    int i;
+
+    for(i = 0; i < gCaseCount; i++) gCases[i].score = gCases[i].ns / gUnit;
+}
+
+static void params(const bench_case_t* test, char* out, size_t size)
+{
+    snprintf(out, size, "keys=%ld size=%ld", test->keys, test->size);
+}
+
+/** Compare against the baseline, returns the number of regressions **/
+static int compare(const char* path, double threshold, int repeats)
+{
+    char line[512], name[128], parameters[128];
+    int regressions = 0, compared = 0;
+    FILE* fp;
+
+    if(!(fp = fopen(path, "r")))
+    {
+        perror(path);
+        return 1;
+    }
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        double ns, score;
+        int i, retry;
+
+        if(line[0] == '#') continue;
+        if(sscanf(line, "%127[^\t]\t%127[^\t]\t%lf\t%lf", name, parameters, &ns, &score) != 4) continue;
+
+        for(i = 0; i < gCaseCount; i++)
+        {
+            char current[128];
+
+            params(&gCases[i], current, sizeof(current));
+            if(!gCases[i].score || strcmp(gCases[i].name, name) || strcmp(current, parameters)) continue;
+
+            compared++;
+            for(retry = 0; retry < BENCH_RETRIES && gCases[i].score > score * threshold; retry++)
+            {
+                bench_case_t again = gCases[i];
+
+                if(measure(&again, repeats) && again.ns < gCases[i].ns) gCases[i] = again;
+                rescore();
+            }
+
+            if(gCases[i].score > score * threshold)
+            {
+                fprintf(stderr, "REGRESSION %s %s: %.2fx the baseline (%.0f ns, baseline %.0f ns)\n",
+                        name, parameters, gCases[i].score / score, gCases[i].ns, ns);
+                regressions++;
+            }
+        }
+    }
+
+    fclose(fp);
+    fprintf(stderr, "%d cases compared against %s, %d regressed past %.2fx\n", compared, path, regressions, threshold);
+    return regressions;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-r repeats] [-o results.tsv] [-c baseline.tsv] [-t threshold] [substring]\n", name);
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    const char* output = NULL;
+    const char* baseline = NULL;
+    const char* filter = NULL;
+    double threshold = BENCH_THRESHOLD;
+    int repeats = BENCH_REPEATS;
+    FILE* out = NULL;
+    int opt, i, failed = 0;
+
+    while((opt = getopt(argc, argv, "r:o:c:t:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': repeats = atoi(optarg);       break;
+            case 'o': output = optarg;              break;
+            case 'c': baseline = optarg;            break;
+            case 't': threshold = atof(optarg);     break;
+            default:  usage(argv[0]);
+        }
+    }
+
+    if(optind < argc) filter = argv[optind];
+    if(repeats < 1 || threshold <= 1) usage(argv[0]);
+
+    if(output && !(out = fopen(output, "w")))
+    {
+        perror(output);
+        return 1;
+    }
+
+    for(i = 0; i < gCaseCount; i++)
+    {
+        char parameters[128];
+
+        if(filter && !strstr(gCases[i].name, filter)) continue;
+
+        params(&gCases[i], parameters, sizeof(parameters));
+        if(!measure(&gCases[i], repeats))
+        {
+            fprintf(stderr, "FAIL %s %s\n", gCases[i].name, parameters);
+            failed++;
+        }
+    }
+
+    if(!gUnit)
+    {
+        fprintf(stderr, "calibration failed\n");
+        return 1;
+    }
+    rescore();
+
+    // Scores need the final unit, so results are printed once everything ran
+    printf("# name\tparams\tns/op\tscore\n");
+    printf("calibrate\t-\t%.1f\t1.0000\n", gUnit);
+    if(out) fprintf(out, "# name\tparams\tns/op\tscore (ns/op relative to calibrate)\n");
+
+    for(i = 0; i < gCaseCount; i++)
+    {
+        char parameters[128];
+
+        if(!gCases[i].ns) continue;
+
+        params(&gCases[i], parameters, sizeof(parameters));
+        printf("%s\t%s\t%.1f\t%.4f\n", gCases[i].name, parameters, gCases[i].ns, gCases[i].score);
+        if(out) fprintf(out, "%s\t%s\t%.1f\t%.4f\n", gCases[i].name, parameters, gCases[i].ns, gCases[i].score);
+    }
+    fflush(stdout);
+
+    if(out) fclose(out);
+    if(baseline && compare(baseline, threshold, repeats)) failed++;
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+/*
+ *  bench.h
+ *  FileNVRAM benchmarks
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_BENCH_H
+#define __TEST_BENCH_H
+
+/**
+ ** BENCH_CASE(fn, name, keys, size) registers fn(b, keys, size) as one benchmark. fn does its setup, then
+ ** times its operation with
+ **
+ **     for(i = 0; bench_loop(b); i++) { ... }
+ **
+ ** which runs the body until enough time has passed. Work that isn't part of the operation, like putting
+ ** back what the body removed, goes between bench_pause and bench_resume. Every repeat runs in a new process,
+ ** see bench.c for the output and the baseline comparison.
+ **/
+#include "harness.h"
+#include "host.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bench bench_t;
+typedef void (*bench_fn_t)(bench_t* b, long keys, long size);
+
+void    bench_register(const char* name, bench_fn_t fn, long keys, long size);
+
+bool    bench_loop(bench_t* b);
+void    bench_pause(bench_t* b);
+void    bench_resume(bench_t* b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define BENCH_UNIQUE2(name, line)   name ## line
+#define BENCH_UNIQUE(name, line)    BENCH_UNIQUE2(name, line)
+
+#define BENCH_CASE(fn, name, keys, size)                                                        \
+    static void __attribute__((constructor)) BENCH_UNIQUE(register_ ## fn ## _, __LINE__)(void) \
+    {                                                                                           \
+        bench_register(name, fn, keys, size);                                                   \
+    }
+
+#endif /* !__TEST_BENCH_H */
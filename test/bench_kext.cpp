@@ -0,0 +1,244 @@
+/*
+ *  bench_kext.cpp
+ *  FileNVRAM benchmarks
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+/**
+ ** FileNVRAM.kext: variable access from user space, writing the nvram file and reading it back at boot.
+ ** OSDictionary is a linear list like xnu's, so building and restoring a table is quadratic in the number
+ ** of keys and the kext cases stop at 10k keys.
+ **/
+#include "kext.h"
+#include "bench.h"
+
+#define BENCH_VALUE_SIZE    16      /* value size for the key count sweeps */
+
+/** keys variables of size bytes each, a few under the Apple GUID like a real nvram file **/
+static OSDictionary* make_nvram(long keys, long size)
+{
+    OSDictionary* nvram = OSDictionary::withCapacity((unsigned int)keys);
+    OSDictionary* apple = OSDictionary::withCapacity(1);
+    UInt8* bytes = (UInt8*)calloc(1, size + 1);
+    uint32_t state = 1;
+    char key[32];
+    long i;
+
+    for(i = 0; i < size; i++) bytes[i] = (UInt8)harness_random(&state);
+
+    for(i = 0; i < keys; i++)
+    {
+        OSData* value = OSData::withBytes(bytes, (unsigned int)size);
+
+        snprintf(key, sizeof(key), "variable-%06ld", i);
+        if(i % 8 == 7) apple->setObject(key, value);
+        else           nvram->setObject(key, value);
+        value->release();
+    }
+
+    if(apple->getCount()) nvram->setObject("7C436110-AB2A-4BBB-A880-FE41995C9F82", apple);
+
+    apple->release();
+    free(bytes);
+    return nvram;
+}
+
+/** Write the nvram file the kext reads at boot **/
+static char* write_nvram(long keys, long size)
+{
+    OSDictionary* nvram = make_nvram(keys, size);
+    OSSerialize* s = OSSerialize::withCapacity(10000);
+    char* text;
+
+    kext_volume();
+    nvram->serialize(s);
+    kext_write_file(FILE_NVRAM_PATH, s->text());
+    text = strdup(s->text());
+
+    s->release();
+    nvram->release();
+    return text;
+}
+
+/** The flattened keys of make_nvram, as the kext names them after restoring **/
+static const OSSymbol** make_symbols(long keys)
+{
+    const OSSymbol** symbols = (const OSSymbol**)calloc(keys, sizeof(*symbols));
+    char key[80];
+    long i;
+
+    for(i = 0; i < keys; i++)
+    {
+        if(i % 8 == 7) snprintf(key, sizeof(key), "7C436110-AB2A-4BBB-A880-FE41995C9F82:variable-%06ld", i);
+        else           snprintf(key, sizeof(key), "variable-%06ld", i);
+        symbols[i] = OSSymbol::withCString(key);
+    }
+
+    return symbols;
+}
+
+/**
+ ** Boot read only with keys variables already set. Read only keeps doSync out of the set and remove cases,
+ ** the cost of writing the file is measured by kext.sync.
+ **/
+static FileNVRAM* boot_read_only(const OSSymbol** symbols, long keys, OSData* value)
+{
+    FileNVRAM* nvram = kext_boot("-FileNVRAMro");
+    long i;
+
+    for(i = 0; nvram && i < keys; i++) nvram->setProperty(symbols[i], value);
+
+    return nvram;
+}
+
+static OSData* make_value(long size)
+{
+    UInt8* bytes = (UInt8*)calloc(1, size + 1);
+    OSData* value = OSData::withBytes(bytes, (unsigned int)size);
+
+    free(bytes);
+    return value;
+}
+
+static void bench_set(bench_t* b, long keys, long size)
+{
+    const OSSymbol** symbols = make_symbols(keys);
+    OSData* value = make_value(size);
+    FileNVRAM* nvram = boot_read_only(symbols, keys, value);
+    long i;
+
+    if(!nvram) return;
+
+    for(i = 0; bench_loop(b); i++)
+    {
+        nvram->setProperty(symbols[i % keys], value);
+    }
+}
+
+static void bench_get(bench_t* b, long keys, long size)
+{
+    const OSSymbol** symbols = make_symbols(keys);
+    OSData* value = make_value(size);
+    FileNVRAM* nvram = boot_read_only(symbols, keys, value);
+    long i;
+
+    if(!nvram) return;
+
+    for(i = 0; bench_loop(b); i++)
+    {
+        if(!nvram->getProperty(symbols[i % keys])) return;
+    }
+}
+
+static void bench_remove(bench_t* b, long keys, long size)
+{
+    const OSSymbol** symbols = make_symbols(keys);
+    OSData* value = make_value(size);
+    FileNVRAM* nvram = boot_read_only(symbols, keys, value);
+    long i;
+
+    if(!nvram) return;
+
+    for(i = 0; bench_loop(b); i++)
+    {
+        nvram->removeProperty(symbols[i % keys]);
+
+        bench_pause(b);
+        nvram->IOService::setProperty(symbols[i % keys], value);
+        bench_resume(b);
+    }
+}
+
+static void bench_sync(bench_t* b, long keys, long size)
+{
+    FileNVRAM* nvram;
+
+    free(write_nvram(keys, size));
+    if(!(nvram = kext_boot("")) || !nvram->mSafeToSync) return;
+
+    while(bench_loop(b))
+    {
+        nvram->doSync();
+    }
+}
+
+static void bench_restore(bench_t* b, long keys, long size)
+{
+    free(write_nvram(keys, size));
+    xnu_publish_resource("IOBSD");
+
+    while(bench_loop(b))
+    {
+        bench_pause(b);
+        FileNVRAM* nvram = kext_start("");
+        if(!nvram) return;
+        bench_resume(b);
+
+        kext_fire(nvram);
+
+        bench_pause(b);
+        if(!nvram->mSafeToSync) return;
+        kext_stop(nvram);
+        bench_resume(b);
+    }
+}
+
+static void bench_parse(bench_t* b, long keys, long size)
+{
+    char* text = write_nvram(keys, size);
+
+    while(bench_loop(b))
+    {
+        OSObject* nvram = OSUnserializeXML(text);
+        if(!nvram) return;
+
+        bench_pause(b);
+        nvram->release();
+        bench_resume(b);
+    }
+}
+
+BENCH_CASE(bench_set,       "kext.set",         10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_set,       "kext.set",         1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_set,       "kext.set",         10000,  BENCH_VALUE_SIZE)
+BENCH_CASE(bench_set,       "kext.set",         100,    0)
+BENCH_CASE(bench_set,       "kext.set",         100,    1024)
+BENCH_CASE(bench_set,       "kext.set",         100,    65536)
+
+BENCH_CASE(bench_get,       "kext.get",         10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_get,       "kext.get",         1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_get,       "kext.get",         10000,  BENCH_VALUE_SIZE)
+BENCH_CASE(bench_get,       "kext.get",         100,    0)
+BENCH_CASE(bench_get,       "kext.get",         100,    1024)
+BENCH_CASE(bench_get,       "kext.get",         100,    65536)
+
+BENCH_CASE(bench_remove,    "kext.remove",      10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_remove,    "kext.remove",      1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_remove,    "kext.remove",      10000,  BENCH_VALUE_SIZE)
+BENCH_CASE(bench_remove,    "kext.remove",      100,    0)
+BENCH_CASE(bench_remove,    "kext.remove",      100,    65536)
+
+BENCH_CASE(bench_sync,      "kext.sync",        10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_sync,      "kext.sync",        1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_sync,      "kext.sync",        10000,  BENCH_VALUE_SIZE)
+BENCH_CASE(bench_sync,      "kext.sync",        100,    0)
+BENCH_CASE(bench_sync,      "kext.sync",        100,    1024)
+BENCH_CASE(bench_sync,      "kext.sync",        100,    65536)
+
+BENCH_CASE(bench_restore,   "kext.restore",     10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_restore,   "kext.restore",     1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_restore,   "kext.restore",     10000,  BENCH_VALUE_SIZE)
+BENCH_CASE(bench_restore,   "kext.restore",     100,    0)
+BENCH_CASE(bench_restore,   "kext.restore",     100,    1024)
+BENCH_CASE(bench_restore,   "kext.restore",     100,    65536)
+
+BENCH_CASE(bench_parse,     "kext.parse",       10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_parse,     "kext.parse",       1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_parse,     "kext.parse",       10000,  BENCH_VALUE_SIZE)
+BENCH_CASE(bench_parse,     "kext.parse",       100,    65536)
@@ -0,0 +1,240 @@
+/*
+ *  bench_module.c
+ *  FileNVRAM benchmarks
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+/**
+ ** The bootloader module: reading the nvram file into the device tree, streamed or through the XML tree,
+ ** and the public API other modules use once the tree has been parsed.
+ **/
+#include "module.h"
+#include "bench.h"
+
+#define BENCH_VALUE_SIZE    16      /* value size for the key count sweeps */
+
+/** An nvram plist with keys data variables of size bytes each, a few under the Apple GUID **/
+static char* make_plist(long keys, long size)
+{
+    size_t encoded = ((size + 2) / 3) * 4;
+    size_t length = keys * (encoded + 64) + 256;
+    char* nvram = calloc(1, length);
+    char* value = calloc(1, encoded + 1);
+    char* plist;
+    size_t used = 0;
+    uint32_t state = 1;
+    long i;
+
+    // Any base64 will do, the values are never looked at
+    for(i = 0; i < (long)encoded; i++) value[i] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef"[harness_random(&state) % 32];
+
+    used += snprintf(&nvram[used], length - used, "<dict><key>7C436110-AB2A-4BBB-A880-FE41995C9F82</key><dict>");
+    for(i = 7; i < keys; i += 8)
+    {
+        used += snprintf(&nvram[used], length - used, "<key>variable-%06ld</key><data>%s</data>", i, value);
+    }
+    used += snprintf(&nvram[used], length - used, "</dict>");
+
+    for(i = 0; i < keys; i++)
+    {
+        if(i % 8 == 7) continue;
+        used += snprintf(&nvram[used], length - used, "<key>variable-%06ld</key><data>%s</data>", i, value);
+    }
+    snprintf(&nvram[used], length - used, "</dict>");
+
+    plist = module_plist(nvram);
+    free(value);
+    free(nvram);
+    return plist;
+}
+
+/** Boot volume holding the plist, read by the module **/
+static bool load_plist(long keys, long size)
+{
+    char* plist = make_plist(keys, size);
+
+    module_volume(plist);
+    module_load();
+    free(plist);
+
+    return gPListBase != NULL;
+}
+
+static char** make_keys(long keys)
+{
+    char** names = calloc(keys, sizeof(*names));
+    long i;
+
+    for(i = 0; i < keys; i++)
+    {
+        names[i] = calloc(1, 32);
+        snprintf(names[i], 32, "variable-%06ld", i);
+    }
+
+    return names;
+}
+
+/** Top level variable key of make_plist, skipping those under the Apple GUID **/
+static long top_level(long i, long keys)
+{
+    i %= keys;
+    return (i % 8 == 7) ? i - 1 : i;
+}
+
+static TagPtr make_value(long size)
+{
+    TagPtr tag = calloc(1, sizeof(*tag));
+
+    tag->type = kTagTypeData;
+    tag->string = calloc(1, size + 1);
+    tag->offset = size;
+    return tag;
+}
+
+static void bench_parse(bench_t* b, long keys, long size)
+{
+    char* plist = make_plist(keys, size);
+
+    while(bench_loop(b))
+    {
+        TagPtr dict = NULL;
+        nvram_index_t index;
+
+        if(XMLParseFile(plist, &dict) || !dict) return;
+        if(!nvram_index_build(&index, XMLCastDict(XMLGetProperty(dict, "NVRAM")))) return;
+
+        bench_pause(b);
+        nvram_index_free(&index);
+        XMLFreeTag(dict);
+        bench_resume(b);
+    }
+}
+
+static void bench_stream(bench_t* b, long keys, long size)
+{
+    char* plist = make_plist(keys, size);
+    int length = (int)strlen(plist);
+    char* arena = malloc(length);
+
+    while(bench_loop(b))
+    {
+        bench_pause(b);
+        DT__Reset();
+        gNVRAMFound = false;
+        Node* node = DT__FindNode("/chosen/nvram", true);
+        char* next = arena;
+        bench_resume(b);
+
+        if(!scanplist(plist, length) || !gNVRAMFound) return;
+
+        plist_stream_t stream = gNVRAMStream;
+        if(!streamDict(&stream, node, &next, true)) return;
+    }
+}
+
+static void bench_inject(bench_t* b, long keys, long size)
+{
+    char* plist = make_plist(keys, size);
+    TagPtr dict = NULL;
+    TagPtr nvram;
+
+    if(XMLParseFile(plist, &dict) || !(nvram = XMLCastDict(XMLGetProperty(dict, "NVRAM")))) return;
+
+    while(bench_loop(b))
+    {
+        bench_pause(b);
+        DT__Reset();
+        Node* node = DT__FindNode("/chosen/nvram", true);
+        bench_resume(b);
+
+        if(!processDict(nvram, node, true)) return;
+    }
+}
+
+static void bench_get(bench_t* b, long keys, long size)
+{
+    char** names = make_keys(keys);
+    long i;
+
+    if(!load_plist(keys, size) || !loadNVRAMData()) return;
+
+    for(i = 0; bench_loop(b); i++)
+    {
+        if(!getNVRAMVariable(names[top_level(i, keys)])) return;
+    }
+}
+
+static void bench_add(bench_t* b, long keys, long size)
+{
+    char** names = make_keys(keys);
+    long i;
+
+    if(!load_plist(keys, size) || !loadNVRAMData()) return;
+
+    // Replaces the existing variable, which frees its value
+    for(i = 0; bench_loop(b); i++)
+    {
+        bench_pause(b);
+        TagPtr value = make_value(size);
+        bench_resume(b);
+
+        addNVRAMVariable(names[top_level(i, keys)], value);
+    }
+}
+
+static void bench_remove(bench_t* b, long keys, long size)
+{
+    char** names = make_keys(keys);
+    long i;
+
+    if(!load_plist(keys, size) || !loadNVRAMData()) return;
+
+    for(i = 0; bench_loop(b); i++)
+    {
+        char* name = names[top_level(i, keys)];
+
+        removeNVRAMVariable(name);
+
+        bench_pause(b);
+        addNVRAMVariable(name, make_value(size));
+        bench_resume(b);
+    }
+}
+
+BENCH_CASE(bench_parse,     "module.parse",     10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_parse,     "module.parse",     1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_parse,     "module.parse",     100000, BENCH_VALUE_SIZE)
+BENCH_CASE(bench_parse,     "module.parse",     100,    0)
+BENCH_CASE(bench_parse,     "module.parse",     100,    1024)
+BENCH_CASE(bench_parse,     "module.parse",     100,    65536)
+
+BENCH_CASE(bench_stream,    "module.stream",    10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_stream,    "module.stream",    1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_stream,    "module.stream",    100000, BENCH_VALUE_SIZE)
+BENCH_CASE(bench_stream,    "module.stream",    100,    0)
+BENCH_CASE(bench_stream,    "module.stream",    100,    1024)
+BENCH_CASE(bench_stream,    "module.stream",    100,    65536)
+
+BENCH_CASE(bench_inject,    "module.inject",    10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_inject,    "module.inject",    1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_inject,    "module.inject",    100000, BENCH_VALUE_SIZE)
+BENCH_CASE(bench_inject,    "module.inject",    100,    65536)
+
+BENCH_CASE(bench_get,       "module.get",       10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_get,       "module.get",       1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_get,       "module.get",       100000, BENCH_VALUE_SIZE)
+
+BENCH_CASE(bench_add,       "module.add",       10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_add,       "module.add",       1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_add,       "module.add",       100000, BENCH_VALUE_SIZE)
+BENCH_CASE(bench_add,       "module.add",       100,    65536)
+
+BENCH_CASE(bench_remove,    "module.remove",    10,     BENCH_VALUE_SIZE)
+BENCH_CASE(bench_remove,    "module.remove",    1000,   BENCH_VALUE_SIZE)
+BENCH_CASE(bench_remove,    "module.remove",    100000, BENCH_VALUE_SIZE)
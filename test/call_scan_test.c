@@ -0,0 +1,151 @@
+/*
+ *  call_scan_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "call_scan.h"
+
+/** The byte at a time loop patch_readStartupExtensions used to run **/
+static bool reference_next(const UInt8* bytes, UInt32 from, UInt32 end, UInt32* opcode, UInt32* target)
+{
+    UInt32 pos;
+
+    for(pos = from; pos + 5 <= end; pos++)
+    {
+        if(bytes[pos] != 0xE8) continue;
+
+        UInt32 rel = bytes[pos + 1] | bytes[pos + 2] << 8 | bytes[pos + 3] << 16 | (UInt32)bytes[pos + 4] << 24;
+        *opcode = pos;
+        *target = pos + 5 + rel;
+        return true;
+    }
+
+    return false;
+}
+
+/** A buffer of exactly length bytes, so ASan sees any read past the end **/
+static UInt8* code_buffer(UInt32 length, UInt8 fill)
+{
+    UInt8* bytes = malloc(length ? length : 1);
+    memset(bytes, fill, length);
+    return bytes;
+}
+
+static void code_call(UInt8* bytes, UInt32 at, UInt32 target)
+{
+    UInt32 rel = target - (at + 5);
+
+    bytes[at] = 0xE8;
+    memcpy(&bytes[at + 1], &rel, sizeof(rel));
+}
+
+TEST(call_scan_targets)
+{
+    UInt8* bytes = code_buffer(256, 0x90);
+    UInt32 opcode, target;
+
+    code_call(bytes, 3, 200);       /* forward */
+    code_call(bytes, 100, 10);      /* backward, negative rel32 */
+
+    REQUIRE(call_scan_next(bytes, 0, 256, &opcode, &target));
+    CHECK_INT(opcode, 3);
+    CHECK_INT(target, 200);
+
+    REQUIRE(call_scan_next(bytes, opcode + 1, 256, &opcode, &target));
+    CHECK_INT(opcode, 100);
+    CHECK_INT(target, 10);
+
+    CHECK(!call_scan_next(bytes, opcode + 1, 256, &opcode, &target));
+
+    free(bytes);
+}
+
+TEST(call_scan_every_position)
+{
+    UInt32 at, from, opcode, target;
+
+    // Every position and start within and around the 16 byte blocks
+    for(at = 0; at < 60; at++)
+    {
+        UInt8* bytes = code_buffer(64, 0x90);
+        code_call(bytes, at, 0x1000);
+
+        for(from = 0; from <= at; from++)
+        {
+            if(!call_scan_next(bytes, from, 64, &opcode, &target) || opcode != at || target != 0x1000)
+            {
+                test_fail(__FILE__, __LINE__, "call missed");
+                break;
+            }
+        }
+        CHECK(!call_scan_next(bytes, at + 5, 64, &opcode, &target));
+
+        free(bytes);
+    }
+}
+
+TEST(call_scan_bounded)
+{
+    UInt8* bytes = code_buffer(64, 0x90);
+    UInt32 opcode, target;
+
+    // The rel32 has to end by end, whatever follows isn't looked at
+    code_call(bytes, 40, 0);
+    CHECK(!call_scan_next(bytes, 0, 44, &opcode, &target));
+    CHECK(call_scan_next(bytes, 0, 45, &opcode, &target));
+
+    // A lone E8 in the last four bytes
+    bytes[62] = 0xE8;
+    CHECK(!call_scan_next(bytes, 41, 64, &opcode, &target));
+
+    CHECK(!call_scan_next(bytes, 0, 4, &opcode, &target));
+    CHECK(!call_scan_next(bytes, 0, 0, &opcode, &target));
+    CHECK(!call_scan_next(bytes, 61, 64, &opcode, &target));
+    CHECK(!call_scan_next(bytes, 100, 64, &opcode, &target));
+
+    free(bytes);
+}
+
+TEST(call_scan_matches_reference)
+{
+    UInt32 state = 17;
+    int round;
+
+    // Random code with E8 bytes sprinkled in, including inside other calls' rel32
+    for(round = 0; round < 200; round++)
+    {
+        UInt32 length = harness_random(&state) % 600;
+        UInt8* bytes = code_buffer(length, 0);
+        UInt32 from = 0, end = length;
+        UInt32 i;
+
+        for(i = 0; i < length; i++) bytes[i] = (harness_random(&state) % 8) ? (UInt8)harness_random(&state) : 0xE8;
+        if(length) end = length - harness_random(&state) % 8 % (length + 1);
+
+        for(;;)
+        {
+            UInt32 opcode, target, expectedOpcode, expectedTarget;
+            bool found = call_scan_next(bytes, from, end, &opcode, &target);
+            bool expected = reference_next(bytes, from, end, &expectedOpcode, &expectedTarget);
+
+            if(found != expected || (found && (opcode != expectedOpcode || target != expectedTarget)))
+            {
+                test_fail(__FILE__, __LINE__, "differs from the byte loop");
+                break;
+            }
+            if(!found) break;
+
+            from = opcode + 1;
+        }
+
+        free(bytes);
+    }
+}
@@ -0,0 +1,226 @@
+/*
+ *  dtblob_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "dtblob.h"
+
+#define BLOB_STAMP      0xA5A5A5A5
+#define BLOB_SIZE       4096
+
+/** A blob under construction, laid out the way the kext's blobCreate writes it **/
+typedef struct
+{
+    uint8_t     bytes[BLOB_SIZE];
+    uint32_t    length;
+} blob_t;
+
+static void blob_init(blob_t* blob)
+{
+    dtblob_header_t* header = (dtblob_header_t*)blob->bytes;
+
+    bzero(blob, sizeof(*blob));
+    header->magic   = NVRAM_DTBLOB_MAGIC;
+    header->version = NVRAM_DTBLOB_VERSION;
+    header->stamp   = BLOB_STAMP;
+    blob->length    = sizeof(*header);
+    header->length  = blob->length;
+}
+
+static void blob_record(blob_t* blob, uint8_t type, const char* name, const void* value, uint32_t length)
+{
+    dtblob_record_t* record = (dtblob_record_t*)&blob->bytes[blob->length];
+
+    record->type        = type;
+    record->nameLength  = (uint16_t)(strlen(name) + 1);
+    record->valueLength = length;
+    blob->length += sizeof(*record);
+
+    memcpy(&blob->bytes[blob->length], name, record->nameLength);
+    blob->length += record->nameLength;
+    if(length) memcpy(&blob->bytes[blob->length], value, length);
+    blob->length = (blob->length + length + 3) & ~3;
+
+    ((dtblob_header_t*)blob->bytes)->length = blob->length;
+}
+
+static void blob_property(blob_t* blob, const char* name, const char* value)
+{
+    blob_record(blob, NVRAM_DTBLOB_PROPERTY, name, value, (uint32_t)strlen(value));
+}
+
+/** boot-args, a settings node holding EarlyKeys and a nested node, and a variable **/
+static void blob_sample(blob_t* blob)
+{
+    blob_init(blob);
+    blob_property(blob, "boot-args", "-v");
+    blob_record(blob, NVRAM_DTBLOB_NODE, "settings", NULL, 0);
+    blob_property(blob, "EarlyKeys", "a b");
+    blob_record(blob, NVRAM_DTBLOB_NODE, "inner", NULL, 0);
+    blob_property(blob, "deep", "1");
+    blob_record(blob, NVRAM_DTBLOB_END, "", NULL, 0);
+    blob_record(blob, NVRAM_DTBLOB_END, "", NULL, 0);
+    blob_property(blob, "variable", "value");
+}
+
+TEST(dtblob_valid_sample)
+{
+    blob_t blob;
+
+    blob_sample(&blob);
+    CHECK(dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP + 1));
+    CHECK(!dtblob_valid(blob.bytes, blob.length - 4, BLOB_STAMP));
+    CHECK(!dtblob_valid(NULL, blob.length, BLOB_STAMP));
+    CHECK(!dtblob_valid(blob.bytes, sizeof(dtblob_header_t) - 1, BLOB_STAMP));
+
+    blob_init(&blob);
+    CHECK(dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+}
+
+TEST(dtblob_rejects_header)
+{
+    blob_t blob;
+
+    blob_sample(&blob);
+    ((dtblob_header_t*)blob.bytes)->magic++;
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    blob_sample(&blob);
+    ((dtblob_header_t*)blob.bytes)->version++;
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    blob_sample(&blob);
+    ((dtblob_header_t*)blob.bytes)->length += 4;
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+}
+
+TEST(dtblob_rejects_records)
+{
+    blob_t blob;
+    dtblob_record_t* first;
+    int i;
+
+    // Name without its nul
+    blob_sample(&blob);
+    first = (dtblob_record_t*)&blob.bytes[sizeof(dtblob_header_t)];
+    blob.bytes[sizeof(dtblob_header_t) + sizeof(*first) + first->nameLength - 1] = 'x';
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    // Value running past the end, and a length big enough to wrap
+    blob_sample(&blob);
+    first = (dtblob_record_t*)&blob.bytes[sizeof(dtblob_header_t)];
+    first->valueLength = blob.length;
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+    first->valueLength = 0xFFFFFFFC;
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    blob_sample(&blob);
+    first = (dtblob_record_t*)&blob.bytes[sizeof(dtblob_header_t)];
+    first->nameLength = 0;
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    blob_sample(&blob);
+    first = (dtblob_record_t*)&blob.bytes[sizeof(dtblob_header_t)];
+    first->type = 9;
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    // Half a record at the end
+    blob_sample(&blob);
+    blob.length += 4;
+    ((dtblob_header_t*)blob.bytes)->length = blob.length;
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    // Unbalanced nodes
+    blob_init(&blob);
+    blob_record(&blob, NVRAM_DTBLOB_NODE, "open", NULL, 0);
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    blob_init(&blob);
+    blob_record(&blob, NVRAM_DTBLOB_END, "", NULL, 0);
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    // Deeper than dtblob_inject keeps parents for
+    blob_init(&blob);
+    for(i = 0; i <= NVRAM_DTBLOB_MAX_DEPTH; i++) blob_record(&blob, NVRAM_DTBLOB_NODE, "n", NULL, 0);
+    for(i = 0; i <= NVRAM_DTBLOB_MAX_DEPTH; i++) blob_record(&blob, NVRAM_DTBLOB_END, "", NULL, 0);
+    CHECK(!dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+}
+
+TEST(dtblob_find_properties)
+{
+    blob_t blob;
+    uint32_t length;
+    const char* value;
+
+    blob_sample(&blob);
+    REQUIRE(dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    value = dtblob_find(blob.bytes, NULL, "boot-args", &length);
+    CHECK(value && length == 2 && !memcmp(value, "-v", 2));
+
+    // After a node, at the top level again
+    value = dtblob_find(blob.bytes, NULL, "variable", &length);
+    CHECK(value && length == 5 && !memcmp(value, "value", 5));
+
+    value = dtblob_find(blob.bytes, "settings", "EarlyKeys", &length);
+    CHECK(value && length == 3 && !memcmp(value, "a b", 3));
+
+    // Only the top level and the named node's own properties
+    CHECK(dtblob_find(blob.bytes, NULL, "EarlyKeys", &length) == NULL);
+    CHECK(dtblob_find(blob.bytes, "settings", "deep", &length) == NULL);
+    CHECK(dtblob_find(blob.bytes, "settings", "boot-args", &length) == NULL);
+    CHECK(dtblob_find(blob.bytes, "missing", "EarlyKeys", &length) == NULL);
+}
+
+static bool skip_settings(const char* name)
+{
+    return strcmp(name, "settings") != 0;
+}
+
+TEST(dtblob_inject_tree)
+{
+    blob_t blob;
+
+    blob_sample(&blob);
+    REQUIRE(dtblob_valid(blob.bytes, blob.length, BLOB_STAMP));
+
+    Node* node = DT__AddChild(NULL, "nvram");
+    dtblob_inject(blob.bytes, node, NULL);
+
+    Property* args = DT__FindProperty(node, "boot-args");
+    CHECK(args && args->length == 2 && !memcmp(args->value, "-v", 2));
+    CHECK(DT__FindProperty(node, "variable") != NULL);
+
+    // Values point into the blob
+    CHECK((uint8_t*)args->value > blob.bytes && (uint8_t*)args->value < blob.bytes + blob.length);
+
+    Node* settings = node->children;
+    REQUIRE(settings && !strcmp(DT__GetName(settings), "settings") && !settings->next);
+    CHECK(DT__FindProperty(settings, "EarlyKeys") != NULL);
+    REQUIRE(settings->children && !strcmp(DT__GetName(settings->children), "inner"));
+    CHECK(DT__FindProperty(settings->children, "deep") != NULL);
+}
+
+TEST(dtblob_inject_filters_top_level)
+{
+    blob_t blob;
+
+    blob_sample(&blob);
+
+    Node* node = DT__AddChild(NULL, "nvram");
+    dtblob_inject(blob.bytes, node, skip_settings);
+
+    // A filtered node is skipped with everything in it
+    CHECK(node->children == NULL);
+    CHECK(DT__FindProperty(node, "boot-args") != NULL);
+    CHECK(DT__FindProperty(node, "variable") != NULL);
+}
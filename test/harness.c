@@ -0,0 +1,121 @@
+/*
+ *  harness.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "harness.h"
+#include "host.h"
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#ifndef FIXTURE_DIR
+#define FIXTURE_DIR     "fixtures"
+#endif
+
+static char gRoot[256];
+
+const char* host_root(void)
+{
+    return gRoot;
+}
+
+static int remove_entry(const char* path, const struct stat* st, int type, struct FTW* ftw)
+{
+    return remove(path);
+}
+
+int harness_run(void (*fn)(void* arg), void* arg)
+{
+    const char* tmp = getenv("TMPDIR");
+    int status;
+    pid_t pid;
+
+    snprintf(gRoot, sizeof(gRoot), "%s/filenvram.XXXXXX", tmp ? tmp : "/tmp");
+    if(!mkdtemp(gRoot))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    if((pid = fork()) < 0)
+    {
+        perror("fork");
+        status = 1;
+    }
+    else if(pid == 0)
+    {
+        fn(arg);
+        fflush(stdout);
+        _exit(0);
+    }
+    else if(waitpid(pid, &status, 0) != pid)
+    {
+        status = 1;
+    }
+    else
+    {
+        status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+
+    nftw(gRoot, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    gRoot[0] = 0;
+
+    return status;
+}
+
+uint64_t harness_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/** xorshift32, state must not be 0 **/
+uint32_t harness_random(uint32_t* state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+char* harness_fixture(const char* name, size_t* length)
+{
+    char path[512];
+    struct stat st;
+    char* data = NULL;
+    FILE* fp;
+
+    snprintf(path, sizeof(path), "%s/%s", FIXTURE_DIR, name);
+    if(!(fp = fopen(path, "rb"))) return NULL;
+
+    if(fstat(fileno(fp), &st) || !(data = calloc(1, st.st_size + 1)) || fread(data, 1, st.st_size, fp) != (size_t)st.st_size)
+    {
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    if(length) *length = st.st_size;
+    return data;
+}
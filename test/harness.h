@@ -0,0 +1,44 @@
+/*
+ *  harness.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_HARNESS_H
+#define __TEST_HARNESS_H
+
+/**
+ ** Shared by the tests and the benchmarks. The module and the kext keep their state in statics, so every
+ ** test case (and every benchmark repeat) runs in a child process of its own, in a directory of its own.
+ **/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Run fn(arg) in a child process with a fresh root directory. Returns the child's exit status, 128 + signal if it crashed. **/
+int         harness_run(void (*fn)(void* arg), void* arg);
+
+/** Monotonic clock, in ns **/
+uint64_t    harness_now(void);
+
+/** Deterministic pseudo random numbers for fixtures **/
+uint32_t    harness_random(uint32_t* state);
+
+/** Fixture from test/fixtures, read into a nul terminated malloc'd buffer. NULL if it doesn't exist. **/
+char*       harness_fixture(const char* name, size_t* length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__TEST_HARNESS_H */
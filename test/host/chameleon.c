@@ -0,0 +1,346 @@
+/*
+ *  chameleon.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <libsaio/bootstruct.h>
+#include <libsaio/cpu.h>
+#include <libsaio/platform.h>
+#include <libsaio/smbios_getters.h>
+#include "modules.h"
+#include "host.h"
+
+/** Chameleon stores HFS+ times, seconds since 1904 **/
+#define HOST_HFS_EPOCH      2082844800L
+#define HOST_MAX_HOOKS      32
+#define HOST_MAX_VOLUMES    8
+
+typedef struct
+{
+    struct BootVolume   bvr;
+    char                label[64];
+} host_volume_t;
+
+typedef struct
+{
+    const char* name;
+    void        (*callback)(void*, void*, void*, void*);
+} host_hook_t;
+
+BVRef               bvChain;
+BVRef               gBootVolume;
+static uint8_t      gPlatformUUID[UUID_LEN];    /* all zero, no UUID in the SMBIOS table */
+PlatformInfo_t      Platform = { { 1000000000ULL }, gPlatformUUID };
+
+static host_volume_t        gVolumes[HOST_MAX_VOLUMES];
+static int                  gVolumeCount;
+static host_hook_t          gHooks[HOST_MAX_HOOKS];
+static int                  gHookCount;
+static PrivateBootInfo_t    gBootInfo;
+PrivateBootInfo_t*          bootInfo = &gBootInfo;
+static char                 gBootArgs[1024];
+static SMBEntryPoint        gSmbios;
+static bool                 gHasSmbios;
+static int                  gMallocFailure;
+static int                  gFileProbes;
+
+/********************************************************************/
+/**                         Filesystem                             **/
+/********************************************************************/
+
+static void host_volume_description(BVRef bvr, char* str, long strMaxLen)
+{
+    snprintf(str, strMaxLen, "%s", ((host_volume_t*)bvr)->label);
+}
+
+static void host_mkdirs(const char* path)
+{
+    char folder[1024];
+    char* slash;
+
+    snprintf(folder, sizeof(folder), "%s", path);
+    for(slash = strchr(folder + 1, '/'); slash; slash = strchr(slash + 1, '/'))
+    {
+        *slash = 0;
+        mkdir(folder, 0755);
+        *slash = '/';
+    }
+}
+
+BVRef host_add_volume(int unit, int part, const char* label)
+{
+    char path[64];
+
+    if(gVolumeCount >= HOST_MAX_VOLUMES) return NULL;
+
+    host_volume_t* volume = &gVolumes[gVolumeCount++];
+    volume->bvr.biosdev = 0x80 + unit;
+    volume->bvr.part_no = part;
+    volume->bvr.description = host_volume_description;
+    snprintf(volume->label, sizeof(volume->label), "%s", label ? label : "Macintosh HD");
+
+    // Keep the chain in the order volumes were added.
+    BVRef* link = &bvChain;
+    while(*link) link = &(*link)->next;
+    *link = &volume->bvr;
+
+    if(!gBootVolume) gBootVolume = &volume->bvr;
+
+    snprintf(path, sizeof(path), "hd(%d,%d)/Extra/", unit, part);
+    char folder[1024];
+    host_mkdirs(host_path(path, folder, sizeof(folder)));
+
+    return &volume->bvr;
+}
+
+void host_set_boot_volume(BVRef bvr)
+{
+    gBootVolume = bvr;
+}
+
+char* host_path(const char* path, char* out, size_t size)
+{
+    int unit, part, length;
+
+    if(sscanf(path, "hd(%d,%d)%n", &unit, &part, &length) == 2 && path[length] == '/')
+    {
+        snprintf(out, size, "%s/hd(%d,%d)%s", host_root(), unit, part, &path[length]);
+    }
+    else
+    {
+        if(!strncmp(path, "bt(0,0)", strlen("bt(0,0)"))) path += strlen("bt(0,0)");
+
+        if(gBootVolume) snprintf(out, size, "%s/hd(%d,%d)%s", host_root(), BIOS_DEV_UNIT(gBootVolume), gBootVolume->part_no, path);
+        else            snprintf(out, size, "%s%s", host_root(), path);
+    }
+
+    return out;
+}
+
+bool host_write_file(const char* path, const void* data, size_t length)
+{
+    char file[1024];
+    FILE* fp;
+    bool ok;
+
+    host_mkdirs(host_path(path, file, sizeof(file)));
+    if(!(fp = fopen(file, "wb"))) return false;
+
+    ok = fwrite(data, 1, length, fp) == length;
+    return (fclose(fp) == 0) && ok;
+}
+
+void* host_read_file(const char* path, size_t* length)
+{
+    char file[1024];
+    struct stat st;
+    char* data;
+    FILE* fp;
+
+    if(!(fp = fopen(host_path(path, file, sizeof(file)), "rb"))) return NULL;
+
+    // One spare byte so text files can be used as strings.
+    if(fstat(fileno(fp), &st) || !(data = calloc(1, st.st_size + 1)) || fread(data, 1, st.st_size, fp) != (size_t)st.st_size)
+    {
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    if(length) *length = st.st_size;
+    return data;
+}
+
+bool host_file_exists(const char* path)
+{
+    char file[1024];
+    struct stat st;
+
+    return stat(host_path(path, file, sizeof(file)), &st) == 0;
+}
+
+bool host_set_mtime(const char* path, long seconds)
+{
+    char file[1024];
+    struct timeval times[2] = { { seconds, 0 }, { seconds, 0 } };
+
+    return utimes(host_path(path, file, sizeof(file)), times) == 0;
+}
+
+bool host_remove_file(const char* path)
+{
+    char file[1024];
+
+    return unlink(host_path(path, file, sizeof(file))) == 0;
+}
+
+/** Chameleon's open only reads, flags are ignored **/
+int host_open(const char* path, int flags)
+{
+    char file[1024];
+
+    return (open)(host_path(path, file, sizeof(file)), O_RDONLY);
+}
+
+int host_file_probes(void)
+{
+    return gFileProbes;
+}
+
+long GetFileInfo(const char* dirSpec, const char* name, long* flags, long* time)
+{
+    char path[1024], file[1024];
+    struct stat st;
+
+    gFileProbes++;
+    snprintf(path, sizeof(path), "%s%s", dirSpec, name);
+    if(stat(host_path(path, file, sizeof(file)), &st)) return -1;
+
+    *flags = 0;
+    *time = st.st_mtime + HOST_HFS_EPOCH;
+    return 0;
+}
+
+BVRef getBootVolumeRef(const char* path, const char** outPath)
+{
+    if(outPath) *outPath = path;
+    return gBootVolume;
+}
+
+/********************************************************************/
+/**                     Modules and settings                       **/
+/********************************************************************/
+
+void register_hook_callback(const char* name, void (*callback)(void*, void*, void*, void*))
+{
+    if(gHookCount >= HOST_MAX_HOOKS) return;
+
+    gHooks[gHookCount].name = name;
+    gHooks[gHookCount].callback = callback;
+    gHookCount++;
+}
+
+int host_run_hook(const char* name, void* arg1, void* arg2, void* arg3, void* arg4)
+{
+    int i, ran = 0;
+
+    for(i = 0; i < gHookCount; i++)
+    {
+        if(strcmp(gHooks[i].name, name)) continue;
+
+        gHooks[i].callback(arg1, arg2, arg3, arg4);
+        ran++;
+    }
+
+    return ran;
+}
+
+int is_module_loaded(const char* name, UInt32 compat)
+{
+    return 0;
+}
+
+void host_set_options(const char* keys)
+{
+    gBootInfo.chameleonConfig.keys = keys;
+}
+
+bool getBoolForKey(const char* key, bool* value, config_file_t* config)
+{
+    const char* keys = config->keys;
+    size_t length = strlen(key);
+
+    while(keys && *keys)
+    {
+        const char* end = strchr(keys, ' ');
+        if(!end) end = keys + strlen(keys);
+
+        if((size_t)(end - keys) == length && !strncmp(keys, key, length))
+        {
+            *value = true;
+            return true;
+        }
+
+        keys = *end ? end + 1 : end;
+    }
+
+    return false;
+}
+
+void addBootArg(const char* argStr)
+{
+    size_t used = strlen(gBootArgs);
+
+    snprintf(&gBootArgs[used], sizeof(gBootArgs) - used, "%s%s", used ? " " : "", argStr);
+}
+
+const char* host_boot_args(void)
+{
+    return gBootArgs;
+}
+
+/********************************************************************/
+/**                     Platform and SMBIOS                        **/
+/********************************************************************/
+
+uint64_t rdtsc64(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void host_set_smbios(const void* table, uint32_t length)
+{
+    bzero(&gSmbios, sizeof(gSmbios));
+    memcpy(gSmbios.anchor, "_SM_", 4);
+    memcpy(gSmbios.dmi.anchor, "_DMI_", 5);
+    gSmbios.dmi.tableAddress = (uintptr_t)table;
+    gSmbios.dmi.tableLength = length;
+    gHasSmbios = (table != NULL);
+}
+
+SMBEntryPoint* getSmbios(int which)
+{
+    return gHasSmbios ? &gSmbios : NULL;
+}
+
+const char* getStringFromUUID(const EFI_CHAR8* uuid)
+{
+    static char string[UUID_LEN * 2 + 8];
+
+    if(!uuid) return "";
+
+    sprintf(string, "%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+            uuid[0], uuid[1], uuid[2], uuid[3], uuid[4], uuid[5], uuid[6], uuid[7],
+            uuid[8], uuid[9], uuid[10], uuid[11], uuid[12], uuid[13], uuid[14], uuid[15]);
+    return string;
+}
+
+/********************************************************************/
+/**                          Memory                                **/
+/********************************************************************/
+
+void host_fail_malloc(int count)
+{
+    gMallocFailure = count;
+}
+
+void* host_malloc(size_t size)
+{
+    if(gMallocFailure && --gMallocFailure == 0) return NULL;
+    return (malloc)(size);
+}
@@ -0,0 +1,158 @@
+/*
+ *  device_tree.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include <libsaio/device_tree.h>
+
+/**
+ ** Chameleon's device tree, without flattening. Like Chameleon, children are added to the front of the list and
+ ** every node gets a "name" property.
+ **/
+static Node* gRoot;
+
+static Node* root(void)
+{
+    if(!gRoot)
+    {
+        gRoot = calloc(1, sizeof(Node));
+        DT__AddProperty(gRoot, "name", 2, "/");
+    }
+
+    return gRoot;
+}
+
+Property* DT__AddProperty(Node* node, const char* name, uint32_t length, void* value)
+{
+    Property* property;
+
+    if(!node || !(property = calloc(1, sizeof(Property)))) return NULL;
+
+    property->name = name;
+    property->length = length;
+    property->value = value;
+
+    if(node->last_prop) node->last_prop->next = property;
+    else node->properties = property;
+    node->last_prop = property;
+
+    return property;
+}
+
+Node* DT__AddChild(Node* parent, const char* name)
+{
+    Node* node = calloc(1, sizeof(Node));
+    if(!node) return NULL;
+
+    if(!parent) parent = root();
+
+    node->next = parent->children;
+    parent->children = node;
+
+    DT__AddProperty(node, "name", strlen(name) + 1, (void*)name);
+    return node;
+}
+
+char* DT__GetName(Node* node)
+{
+    Property* property = DT__FindProperty(node, "name");
+    return property ? property->value : NULL;
+}
+
+Node* DT__FindChild(Node* parent, const char* name)
+{
+    Node* node;
+
+    for(node = parent ? parent->children : NULL; node; node = node->next)
+    {
+        if(!strcmp(DT__GetName(node), name)) return node;
+    }
+
+    return NULL;
+}
+
+Property* DT__FindProperty(Node* node, const char* name)
+{
+    Property* property;
+
+    for(property = node ? node->properties : NULL; property; property = property->next)
+    {
+        if(!strcmp(property->name, name)) return property;
+    }
+
+    return NULL;
+}
+
+int DT__CountProperties(Node* node)
+{
+    Property* property;
+    int count = 0;
+
+    for(property = node ? node->properties : NULL; property; property = property->next) count++;
+
+    return count;
+}
+
+Node* DT__FindNode(const char* path, bool createIfMissing)
+{
+    Node* node = root();
+    char name[128];
+
+    while(*path)
+    {
+        const char* end;
+        Node* child;
+
+        while(*path == '/') path++;
+        if(!*path) break;
+
+        end = strchr(path, '/');
+        if(!end) end = path + strlen(path);
+        snprintf(name, sizeof(name), "%.*s", (int)(end - path), path);
+
+        if(!(child = DT__FindChild(node, name)))
+        {
+            if(!createIfMissing) return NULL;
+            child = DT__AddChild(node, strdup(name));
+        }
+
+        node = child;
+        path = end;
+    }
+
+    return node;
+}
+
+static void free_node(Node* node)
+{
+    while(node)
+    {
+        Node* next = node->next;
+        Property* property = node->properties;
+
+        while(property)
+        {
+            Property* nextProperty = property->next;
+            free(property);
+            property = nextProperty;
+        }
+
+        free_node(node->children);
+        free(node);
+        node = next;
+    }
+}
+
+void DT__Reset(void)
+{
+    free_node(gRoot);
+    gRoot = NULL;
+}
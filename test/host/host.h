@@ -0,0 +1,70 @@
+/*
+ *  host.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_HOST_H
+#define __TEST_HOST_H
+
+/**
+ ** Controls for the host stand-ins of the booter (chameleon.c) and the kernel (xnu.cpp). Both share one filesystem:
+ ** each test runs in its own directory, volume hd(x,y) is the directory of that name in it and "/" on either side is
+ ** the boot volume, or the directory itself until a volume is added.
+ **/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct BootVolume;
+
+/** Directory the current test runs in, see harness.c **/
+const char*         host_root(void);
+
+/** Add volume hd(unit,part) with an empty Extra folder. The first volume added is the boot volume. **/
+struct BootVolume*  host_add_volume(int unit, int part, const char* label);
+void                host_set_boot_volume(struct BootVolume* bvr);
+
+/** Map a Chameleon or kernel path to the host, returns out **/
+char*               host_path(const char* path, char* out, size_t size);
+
+/** Whole file helpers on Chameleon paths, parent folders are created as needed **/
+bool                host_write_file(const char* path, const void* data, size_t length);
+void*               host_read_file(const char* path, size_t* length);
+bool                host_file_exists(const char* path);
+bool                host_set_mtime(const char* path, long seconds);
+bool                host_remove_file(const char* path);
+
+/** Number of GetFileInfo lookups so far, each one a filesystem probe on real hardware **/
+int                 host_file_probes(void);
+
+/** Run every callback registered for a hook, returns how many ran **/
+int                 host_run_hook(const char* name, void* arg1, void* arg2, void* arg3, void* arg4);
+
+/** Space separated boot options that read as Yes through getBoolForKey **/
+void                host_set_options(const char* keys);
+
+/** Boot arguments passed to addBootArg, space separated **/
+const char*         host_boot_args(void);
+
+/** SMBIOS structure table returned by getSmbios, NULL to have none **/
+void                host_set_smbios(const void* table, uint32_t length);
+
+/** Make the count'th malloc from now fail (1 is the next one), 0 to stop failing **/
+void                host_fail_malloc(int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__TEST_HOST_H */
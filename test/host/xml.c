@@ -0,0 +1,294 @@
+/*
+ *  xml.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "libsaio.h"
+#include <libsaio/xml.h>
+#include "plist_stream.h"
+
+/**
+ ** Chameleon's XML tree built on top of the module's own tokenizer, so both of the module's parse paths see the
+ ** same file the same way. Like libsaio, scalars may carry ID="n" and be referenced later with IDREF="n".
+ **/
+#define XML_MAX_IDS     256
+
+typedef struct
+{
+    plist_stream_t  stream;
+    TagPtr          ids[XML_MAX_IDS];
+} xml_parser_t;
+
+long gXMLLiveTags;
+
+static TagPtr new_tag(long type)
+{
+    TagPtr tag = calloc(1, sizeof(*tag));
+    if(!tag) return NULL;
+
+    tag->type = type;
+    gXMLLiveTags++;
+    return tag;
+}
+
+/** Value of attribute name in the element that ends just before tagEnd, -1 if it has none **/
+static long attribute(const char* tagEnd, const char* name)
+{
+    const char* tag = tagEnd - 1;
+    size_t length = strlen(name);
+
+    while(*tag != '<') tag--;
+
+    for(tag++; tag < tagEnd - length; tag++)
+    {
+        if(tag[-1] == ' ' && !memcmp(tag, name, length) && tag[length] == '=' && tag[length + 1] == '"')
+        {
+            return strtol(&tag[length + 2], NULL, 10);
+        }
+    }
+
+    return -1;
+}
+
+static TagPtr copy_tag(TagPtr source)
+{
+    TagPtr tag = new_tag(source->type);
+    if(!tag) return NULL;
+
+    switch(source->type)
+    {
+        case kTagTypeString:
+            tag->string = strdup(source->string);
+            break;
+
+        case kTagTypeData:
+            tag->string = calloc(1, source->offset + 1);
+            memcpy(tag->string, source->string, source->offset);
+            tag->offset = source->offset;
+            break;
+
+        default:
+            tag->string = source->string;
+            break;
+    }
+
+    return tag;
+}
+
+static TagPtr parse_value(xml_parser_t* parser, const plist_token_t* token);
+
+/** Key/value pairs up to the closing tag **/
+static bool parse_dict(xml_parser_t* parser, TagPtr dict)
+{
+    TagPtr* link = &dict->tag;
+    plist_token_t key, value;
+
+    while(plist_stream_next(&parser->stream, &key) == kPlistTokenKey)
+    {
+        TagPtr keyTag = new_tag(kTagTypeKey);
+        if(!keyTag) return false;
+
+        keyTag->string = strndup(key.text, key.length);
+        *link = keyTag;
+        link = &keyTag->tagNext;
+
+        plist_stream_next(&parser->stream, &value);
+        if(!(keyTag->tag = parse_value(parser, &value))) return false;
+    }
+
+    return key.type == kPlistTokenDictEnd;
+}
+
+static bool parse_array(xml_parser_t* parser, TagPtr array)
+{
+    TagPtr* link = &array->tag;
+    plist_token_t value;
+
+    while(plist_stream_next(&parser->stream, &value) != kPlistTokenArrayEnd)
+    {
+        if(!(*link = parse_value(parser, &value))) return false;
+        link = &(*link)->tagNext;
+    }
+
+    return true;
+}
+
+static TagPtr parse_value(xml_parser_t* parser, const plist_token_t* token)
+{
+    const char* tagEnd = token->text ? token->text : parser->stream.pos;
+    long id, ref;
+    TagPtr tag;
+
+    switch(token->type)
+    {
+        case kPlistTokenDict:
+            if((tag = new_tag(kTagTypeDict)) && !parse_dict(parser, tag)) goto fail;
+            return tag;
+
+        case kPlistTokenArray:
+            if((tag = new_tag(kTagTypeArray)) && !parse_array(parser, tag)) goto fail;
+            return tag;
+
+        case kPlistTokenString:
+        case kPlistTokenData:
+        case kPlistTokenInteger:
+        case kPlistTokenTrue:
+        case kPlistTokenFalse:
+        case kPlistTokenOther:
+            break;
+
+        default:
+            return NULL;
+    }
+
+    // Scalars: the element's start tag ends where its contents begin.
+    if(token->type != kPlistTokenTrue && token->type != kPlistTokenFalse)
+    {
+        ref = attribute(tagEnd, "IDREF");
+        if(ref >= 0) return (ref < XML_MAX_IDS && parser->ids[ref]) ? copy_tag(parser->ids[ref]) : NULL;
+    }
+
+    switch(token->type)
+    {
+        case kPlistTokenString:
+            if((tag = new_tag(kTagTypeString))) tag->string = strndup(token->text, token->length);
+            break;
+
+        case kPlistTokenData:
+            if((tag = new_tag(kTagTypeData)))
+            {
+                tag->string = calloc(1, ((token->length * 3) / 4) + 1);
+                tag->offset = plist_decode_data(token, tag->string);
+            }
+            break;
+
+        case kPlistTokenInteger:
+            if((tag = new_tag(kTagTypeInteger))) tag->string = (char*)(intptr_t)plist_decode_integer(token);
+            break;
+
+        case kPlistTokenTrue:
+            return new_tag(kTagTypeTrue);
+
+        case kPlistTokenFalse:
+            return new_tag(kTagTypeFalse);
+
+        default:
+            return new_tag(kTagTypeDate);
+    }
+
+    id = attribute(tagEnd, "ID");
+    if(tag && id >= 0 && id < XML_MAX_IDS) parser->ids[id] = tag;
+
+    return tag;
+
+fail:
+    XMLFreeTag(tag);
+    return NULL;
+}
+
+long XMLParseFile(char* buffer, TagPtr* dict)
+{
+    xml_parser_t parser;
+    plist_token_t token;
+
+    bzero(&parser, sizeof(parser));
+    plist_stream_init(&parser.stream, buffer, strlen(buffer));
+
+    *dict = NULL;
+    if(plist_stream_next(&parser.stream, &token) != kPlistTokenDict) return -1;
+
+    *dict = parse_value(&parser, &token);
+    return *dict ? 0 : -1;
+}
+
+TagPtr XMLGetProperty(TagPtr dict, const char* key)
+{
+    TagPtr tag;
+
+    if(!dict || dict->type != kTagTypeDict) return NULL;
+
+    for(tag = dict->tag; tag; tag = tag->tagNext)
+    {
+        if(tag->type == kTagTypeKey && tag->string && !strcmp(tag->string, key)) return tag->tag;
+    }
+
+    return NULL;
+}
+
+bool XMLAddTagToDictionary(TagPtr dict, char* key, TagPtr value)
+{
+    TagPtr* link;
+    TagPtr tag;
+
+    if(!dict || dict->type != kTagTypeDict) return false;
+    if(!(tag = new_tag(kTagTypeKey))) return false;
+
+    tag->string = strdup(key);
+    tag->tag = value;
+
+    for(link = &dict->tag; *link; link = &(*link)->tagNext);
+    *link = tag;
+
+    return true;
+}
+
+/** Like libsaio's, frees the tag, its value and everything after it **/
+void XMLFreeTag(TagPtr tag)
+{
+    while(tag)
+    {
+        TagPtr next = tag->tagNext;
+
+        if(tag->type != kTagTypeInteger && tag->string) free(tag->string);
+        XMLFreeTag(tag->tag);
+        free(tag);
+        gXMLLiveTags--;
+
+        tag = next;
+    }
+}
+
+TagPtr XMLCastDict(TagPtr dict)
+{
+    return XMLIsDict(dict) ? dict : NULL;
+}
+
+char* XMLCastString(TagPtr dict)
+{
+    return (dict && (dict->type == kTagTypeString || dict->type == kTagTypeKey)) ? dict->string : NULL;
+}
+
+char* XMLCastData(TagPtr dict, int* length)
+{
+    if(!XMLIsData(dict))
+    {
+        *length = 0;
+        return NULL;
+    }
+
+    *length = dict->offset;
+    return dict->string;
+}
+
+int XMLCastInteger(TagPtr dict)
+{
+    return XMLIsInteger(dict) ? (int)(intptr_t)dict->string : 0;
+}
+
+bool XMLCastBoolean(TagPtr dict)
+{
+    return dict && dict->type == kTagTypeTrue;
+}
+
+bool XMLIsDict(TagPtr entry)    { return entry && entry->type == kTagTypeDict; }
+bool XMLIsData(TagPtr entry)    { return entry && entry->type == kTagTypeData; }
+bool XMLIsString(TagPtr entry)  { return entry && entry->type == kTagTypeString; }
+bool XMLIsInteger(TagPtr entry) { return entry && entry->type == kTagTypeInteger; }
+bool XMLIsBoolean(TagPtr entry) { return entry && (entry->type == kTagTypeTrue || entry->type == kTagTypeFalse); }
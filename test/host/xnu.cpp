@@ -0,0 +1,2371 @@
+/*
+ *  xnu.cpp
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "xnu.h"
+#include "host.h"
+
+/** Normally generated by the kext's build from its Info.plist **/
+kmod_info_t kmod_info = { "com.xZenue.driver.FileNVRAM", "1.1.4" };
+
+static const IORegistryPlane gDeviceTreePlane = { "IODeviceTree" };
+static const IORegistryPlane gServicePlane = { "IOService" };
+const IORegistryPlane* gIODTPlane = &gDeviceTreePlane;
+const IORegistryPlane* gIOServicePlane = &gServicePlane;
+const OSSymbol* gIOProviderClassKey = OSSymbol::withCString("IOProviderClass");
+
+unsigned long gOSDictionaryGrows;
+
+#define XNU_MAX_RESOURCES   16
+
+static pthread_mutex_t  gHostLock = PTHREAD_MUTEX_INITIALIZER;
+static char             gBootArgs[1024];
+static IOReturn         gClientPrivilege = kIOReturnSuccess;
+static char*            gResources[XNU_MAX_RESOURCES];
+static int              gResourceCount;
+static char             gPlatformFunction[64];
+
+/********************************************************************/
+/**                     Mach and BSD                               **/
+/********************************************************************/
+
+struct vnode
+{
+    int     fd;             /* -1 for vnode_lookup's */
+    char    path[PATH_MAX];
+};
+
+static char gContext, gProc, gCred, gTask;
+
+static vnode_t vnode_create(const char* path, int fd)
+{
+    vnode_t vp = (vnode_t)calloc(1, sizeof(*vp));
+    if(!vp) return NULL;
+
+    vp->fd = fd;
+    snprintf(vp->path, sizeof(vp->path), "%s", path);
+    return vp;
+}
+
+int vnode_open(const char* path, int fmode, int cmode, int flags, vnode_t* vpp, vfs_context_t ctx)
+{
+    char file[PATH_MAX];
+    int fd;
+
+    host_path(path, file, sizeof(file));
+    if((fd = open(file, fmode & ~(FREAD | FWRITE), cmode)) < 0) return errno;
+
+    if(!(*vpp = vnode_create(file, fd)))
+    {
+        close(fd);
+        return ENOMEM;
+    }
+
+    return 0;
+}
+
+int vnode_close(vnode_t vp, int flags, vfs_context_t ctx)
+{
+    int error = close(vp->fd) ? errno : 0;
+
+    free(vp);
+    return error;
+}
+
+int vnode_lookup(const char* path, int flags, vnode_t* vpp, vfs_context_t ctx)
+{
+    char file[PATH_MAX];
+    struct stat st;
+
+    host_path(path, file, sizeof(file));
+    if(((flags & VNODE_LOOKUP_NOFOLLOW) ? lstat(file, &st) : stat(file, &st))) return errno;
+
+    return (*vpp = vnode_create(file, -1)) ? 0 : ENOMEM;
+}
+
+int vnode_put(vnode_t vp)
+{
+    if(vp->fd >= 0) close(vp->fd);
+    free(vp);
+    return 0;
+}
+
+static int vnode_stat(vnode_t vp, struct stat* st)
+{
+    return ((vp->fd >= 0) ? fstat(vp->fd, st) : lstat(vp->path, st)) ? errno : 0;
+}
+
+int vnode_isreg(vnode_t vp)
+{
+    struct stat st;
+
+    return !vnode_stat(vp, &st) && S_ISREG(st.st_mode);
+}
+
+int vnode_getattr(vnode_t vp, struct vnode_attr* vap, vfs_context_t ctx)
+{
+    struct stat st;
+    int error;
+
+    if((error = vnode_stat(vp, &st))) return error;
+
+    vap->va_data_size = st.st_size;
+    vap->va_modify_time = st.st_mtim;
+    vap->va_supported = vap->va_active & (VNODE_ATTR_va_data_size | VNODE_ATTR_va_modify_time);
+    return 0;
+}
+
+int vn_rdwr(enum uio_rw rw, vnode_t vp, caddr_t base, int len, off_t offset, enum uio_seg segflg,
+            int ioflg, kauth_cred_t cred, int* aresid, proc_t p)
+{
+    while(len > 0)
+    {
+        ssize_t done = (rw == UIO_READ) ? pread(vp->fd, base, len, offset) : pwrite(vp->fd, base, len, offset);
+
+        if(done < 0) return errno;
+        if(done == 0) break;
+
+        base += done;
+        offset += done;
+        len -= (int)done;
+    }
+
+    // Without a residual count a short transfer is an error.
+    if(aresid) *aresid = len;
+    else if(len) return EIO;
+
+    return 0;
+}
+
+vfs_context_t vfs_context_current(void)             { return (vfs_context_t)&gContext; }
+proc_t vfs_context_proc(vfs_context_t ctx)          { return (proc_t)&gProc; }
+kauth_cred_t vfs_context_ucred(vfs_context_t ctx)   { return (kauth_cred_t)&gCred; }
+int proc_pid(proc_t p)                              { return getpid(); }
+task_t current_task(void)                           { return (task_t)&gTask; }
+
+void proc_name(int pid, char* buf, int size)
+{
+    snprintf(buf, size, "%s", program_invocation_short_name);
+}
+
+void xnu_set_boot_args(const char* args)
+{
+    snprintf(gBootArgs, sizeof(gBootArgs), "%s", args ? args : "");
+}
+
+bool PE_parse_boot_argn(const char* arg_string, void* arg_ptr, int max_arg)
+{
+    size_t length = strlen(arg_string);
+    const char* arg = gBootArgs;
+
+    while(*arg)
+    {
+        const char* end = strchr(arg, ' ');
+        if(!end) end = arg + strlen(arg);
+
+        if((size_t)(end - arg) >= length && !strncmp(arg, arg_string, length))
+        {
+            // -flags match on their own, anything else needs a value.
+            if(arg_string[0] == '-' && arg + length == end) return true;
+            if(arg[length] == '=')
+            {
+                snprintf((char*)arg_ptr, max_arg, "%.*s", (int)(end - &arg[length + 1]), &arg[length + 1]);
+                return true;
+            }
+        }
+
+        arg = *end ? end + 1 : end;
+    }
+
+    return false;
+}
+
+void IOLog(const char* format, ...)
+{
+    va_list args;
+
+    if(!getenv("XNU_LOG")) return;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void* IOMalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void IOFree(void* address, size_t size)
+{
+    free(address);
+}
+
+size_t xnu_strlcpy(char* dst, const char* src, size_t size)
+{
+    size_t length = strlen(src);
+
+    if(size)
+    {
+        size_t copy = (length < size) ? length : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = 0;
+    }
+
+    return length;
+}
+
+void clock_get_uptime(uint64_t* result)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    *result = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t* result)
+{
+    *result = abstime;
+}
+
+/********************************************************************/
+/**                     OSObject                                   **/
+/********************************************************************/
+
+OSMetaClass OSObject::gMetaClass("OSObject", NULL);
+const OSMetaClass* const OSObject::metaClass = &OSObject::gMetaClass;
+const OSMetaClass* OSObject::getMetaClass() const { return &gMetaClass; }
+OSObject::OSObject() { }
+OSObject::~OSObject() { }
+
+const OSMetaClassBase* OSMetaClassBase::safeMetaCast(const OSMetaClassBase* anObject, const OSMetaClass* toMeta)
+{
+    return anObject ? anObject->metaCast(toMeta) : NULL;
+}
+
+const OSMetaClassBase* OSMetaClassBase::metaCast(const OSMetaClass* toMeta) const
+{
+    const OSMetaClass* meta;
+
+    for(meta = getMetaClass(); meta; meta = meta->superClassLink)
+    {
+        if(meta == toMeta) return this;
+    }
+
+    return NULL;
+}
+
+const OSMetaClassBase* OSMetaClassBase::metaCast(const char* toMeta) const
+{
+    const OSMetaClass* meta;
+
+    for(meta = getMetaClass(); meta; meta = meta->superClassLink)
+    {
+        if(!strcmp(meta->className, toMeta)) return this;
+    }
+
+    return NULL;
+}
+
+bool OSMetaClassBase::isEqualTo(const OSMetaClassBase* anObject) const
+{
+    return this == anObject;
+}
+
+void* OSObject::operator new(size_t size) noexcept
+{
+    return calloc(1, size);
+}
+
+void OSObject::operator delete(void* mem, size_t size)
+{
+    ::free(mem);
+}
+
+bool OSObject::init()
+{
+    return true;
+}
+
+void OSObject::free()
+{
+    delete this;
+}
+
+void OSObject::retain() const
+{
+    __sync_fetch_and_add(&retainCount, 1);
+}
+
+void OSObject::release() const
+{
+    if(__sync_fetch_and_sub(&retainCount, 1) == 0) const_cast<OSObject*>(this)->free();
+}
+
+int OSObject::getRetainCount() const
+{
+    return retainCount + 1;
+}
+
+bool OSObject::serialize(OSSerialize* s) const
+{
+    char string[128];
+
+    snprintf(string, sizeof(string), "<string>%s is not serializable</string>", getMetaClass()->getClassName());
+    return s->addString(string);
+}
+
+/********************************************************************/
+/**                     Strings and symbols                        **/
+/********************************************************************/
+
+OSDefineMetaClassAndStructors(OSString, OSObject)
+OSDefineMetaClassAndStructors(OSSymbol, OSString)
+
+/** Escape the characters OSSerialize and the module agree on **/
+static bool addEscaped(OSSerialize* s, const char* c)
+{
+    for(; *c; c++)
+    {
+        bool ok;
+
+        switch(*c)
+        {
+            case '<':   ok = s->addString("&lt;");  break;
+            case '>':   ok = s->addString("&gt;");  break;
+            case '&':   ok = s->addString("&amp;"); break;
+            default:    ok = s->addChar(*c);        break;
+        }
+
+        if(!ok) return false;
+    }
+
+    return true;
+}
+
+OSString* OSString::withCString(const char* cString)
+{
+    OSString* me = new OSString;
+
+    if(me && !me->initWithCString(cString))
+    {
+        me->release();
+        return NULL;
+    }
+
+    return me;
+}
+
+OSString* OSString::withString(const OSString* aString)
+{
+    return aString ? withCString(aString->getCStringNoCopy()) : NULL;
+}
+
+bool OSString::initWithCString(const char* cString)
+{
+    if(!cString || !OSObject::init()) return false;
+
+    length = (unsigned int)strlen(cString);
+    string = strdup(cString);
+    return string != NULL;
+}
+
+void OSString::free()
+{
+    ::free(string);
+    OSObject::free();
+}
+
+bool OSString::isEqualTo(const char* aCString) const
+{
+    return aCString && !strcmp(string, aCString);
+}
+
+bool OSString::isEqualTo(const OSString* aString) const
+{
+    return aString && length == aString->length && !strcmp(string, aString->string);
+}
+
+bool OSString::isEqualTo(const OSMetaClassBase* anObject) const
+{
+    return isEqualTo(OSDynamicCast(OSString, anObject));
+}
+
+bool OSString::serialize(OSSerialize* s) const
+{
+    if(s->previouslySerialized(this)) return true;
+
+    return s->addXMLStartTag(this, "string") && addEscaped(s, string) && s->addXMLEndTag("string");
+}
+
+/** Chained hash of every live symbol **/
+static pthread_mutex_t  gSymbolLock = PTHREAD_MUTEX_INITIALIZER;
+static OSSymbol**       gSymbols;
+static unsigned int     gSymbolCapacity;    /* power of two */
+static unsigned int     gSymbolCount;
+
+static UInt32 symbolHash(const char* string)
+{
+    UInt32 hash = 2166136261U;
+
+    for(; *string; string++) hash = (hash ^ (UInt8)*string) * 16777619U;
+    return hash;
+}
+
+static bool growSymbols()
+{
+    unsigned int capacity = gSymbolCapacity ? gSymbolCapacity * 2 : 256;
+    OSSymbol** symbols = (OSSymbol**)calloc(capacity, sizeof(OSSymbol*));
+    unsigned int i;
+
+    if(!symbols) return false;
+
+    for(i = 0; i < gSymbolCapacity; i++)
+    {
+        OSSymbol* symbol = gSymbols[i];
+        while(symbol)
+        {
+            OSSymbol* next = symbol->poolNext;
+            symbol->poolNext = symbols[symbol->hash & (capacity - 1)];
+            symbols[symbol->hash & (capacity - 1)] = symbol;
+            symbol = next;
+        }
+    }
+
+    free(gSymbols);
+    gSymbols = symbols;
+    gSymbolCapacity = capacity;
+    return true;
+}
+
+const OSSymbol* OSSymbol::withCString(const char* cString)
+{
+    UInt32 hash = symbolHash(cString);
+    OSSymbol* symbol = NULL;
+
+    pthread_mutex_lock(&gSymbolLock);
+
+    if(gSymbolCapacity)
+    {
+        for(symbol = gSymbols[hash & (gSymbolCapacity - 1)]; symbol; symbol = symbol->poolNext)
+        {
+            if(symbol->hash == hash && !strcmp(symbol->string, cString))
+            {
+                symbol->retain();
+                break;
+            }
+        }
+    }
+
+    if(!symbol && (gSymbolCount < gSymbolCapacity || growSymbols()) && (symbol = new OSSymbol))
+    {
+        if(symbol->initWithCString(cString))
+        {
+            symbol->hash = hash;
+            symbol->poolNext = gSymbols[hash & (gSymbolCapacity - 1)];
+            gSymbols[hash & (gSymbolCapacity - 1)] = symbol;
+            gSymbolCount++;
+        }
+        else
+        {
+            symbol->OSString::free();
+            symbol = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&gSymbolLock);
+    return symbol;
+}
+
+const OSSymbol* OSSymbol::withCStringNoCopy(const char* cString)
+{
+    return withCString(cString);
+}
+
+const OSSymbol* OSSymbol::withString(const OSString* aString)
+{
+    const OSSymbol* symbol = OSDynamicCast(OSSymbol, aString);
+
+    if(symbol)
+    {
+        symbol->retain();
+        return symbol;
+    }
+
+    return aString ? withCString(aString->getCStringNoCopy()) : NULL;
+}
+
+/** The last reference leaves the pool under its lock, so a lookup can't revive a dying symbol **/
+void OSSymbol::release() const
+{
+    OSSymbol** link;
+    bool last;
+
+    pthread_mutex_lock(&gSymbolLock);
+
+    if((last = (__sync_fetch_and_sub(&retainCount, 1) == 0)))
+    {
+        for(link = &gSymbols[hash & (gSymbolCapacity - 1)]; *link != this; link = &(*link)->poolNext);
+        *link = poolNext;
+        gSymbolCount--;
+    }
+
+    pthread_mutex_unlock(&gSymbolLock);
+
+    if(last) const_cast<OSSymbol*>(this)->free();
+}
+
+/********************************************************************/
+/**                     Data, numbers and booleans                 **/
+/********************************************************************/
+
+OSDefineMetaClassAndStructors(OSData, OSObject)
+OSDefineMetaClassAndStructors(OSNumber, OSObject)
+OSDefineMetaClassAndStructors(OSBoolean, OSObject)
+
+OSData* OSData::withCapacity(unsigned int capacity)
+{
+    OSData* me = new OSData;
+
+    if(me && !me->initWithCapacity(capacity))
+    {
+        me->release();
+        return NULL;
+    }
+
+    return me;
+}
+
+OSData* OSData::withBytes(const void* bytes, unsigned int numBytes)
+{
+    OSData* me = withCapacity(numBytes);
+
+    if(me && !me->appendBytes(bytes, numBytes))
+    {
+        me->release();
+        return NULL;
+    }
+
+    return me;
+}
+
+OSData* OSData::withData(const OSData* other)
+{
+    return other ? withBytes(other->data, other->length) : NULL;
+}
+
+bool OSData::initWithCapacity(unsigned int inCapacity)
+{
+    if(!OSObject::init()) return false;
+
+    if(inCapacity && !(data = malloc(inCapacity))) return false;
+
+    capacity = inCapacity;
+    capacityIncrement = (inCapacity < 4096) ? 16 : 4096;
+    return true;
+}
+
+void OSData::free()
+{
+    ::free(data);
+    OSObject::free();
+}
+
+unsigned int OSData::ensureCapacity(unsigned int newCapacity)
+{
+    unsigned int finalCapacity;
+    void* newData;
+
+    if(newCapacity <= capacity) return capacity;
+
+    finalCapacity = (((newCapacity - 1) / capacityIncrement) + 1) * capacityIncrement;
+    if(!(newData = realloc(data, finalCapacity))) return capacity;
+
+    data = newData;
+    capacity = finalCapacity;
+    return capacity;
+}
+
+const void* OSData::getBytesNoCopy(unsigned int start, unsigned int numBytes) const
+{
+    if(start >= length || numBytes > length - start) return NULL;
+    return (const char*)data + start;
+}
+
+bool OSData::appendBytes(const void* bytes, unsigned int numBytes)
+{
+    if(!numBytes) return true;
+    if(ensureCapacity(length + numBytes) < length + numBytes) return false;
+
+    if(bytes) memcpy((char*)data + length, bytes, numBytes);
+    else bzero((char*)data + length, numBytes);
+
+    length += numBytes;
+    return true;
+}
+
+bool OSData::appendBytes(const OSData* other)
+{
+    return appendBytes(other->data, other->length);
+}
+
+bool OSData::appendByte(unsigned char byte, unsigned int numBytes)
+{
+    if(!numBytes) return true;
+    if(ensureCapacity(length + numBytes) < length + numBytes) return false;
+
+    memset((char*)data + length, byte, numBytes);
+    length += numBytes;
+    return true;
+}
+
+bool OSData::isEqualTo(const void* bytes, unsigned int numBytes) const
+{
+    return numBytes == length && (!length || !memcmp(data, bytes, length));
+}
+
+bool OSData::isEqualTo(const OSData* aData) const
+{
+    return aData && isEqualTo(aData->data, aData->length);
+}
+
+bool OSData::isEqualTo(const OSMetaClassBase* anObject) const
+{
+    return isEqualTo(OSDynamicCast(OSData, anObject));
+}
+
+bool OSData::serialize(OSSerialize* s) const
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const UInt8* bytes = (const UInt8*)data;
+    unsigned int i;
+
+    if(s->previouslySerialized(this)) return true;
+    if(!s->addXMLStartTag(this, "data")) return false;
+
+    // Plain base64, no line breaks.
+    for(i = 0; i < length; i += 3)
+    {
+        UInt32 word = bytes[i] << 16;
+        if(i + 1 < length) word |= bytes[i + 1] << 8;
+        if(i + 2 < length) word |= bytes[i + 2];
+
+        if(!s->addChar(alphabet[(word >> 18) & 0x3F]) ||
+           !s->addChar(alphabet[(word >> 12) & 0x3F]) ||
+           !s->addChar((i + 1 < length) ? alphabet[(word >> 6) & 0x3F] : '=') ||
+           !s->addChar((i + 2 < length) ? alphabet[word & 0x3F] : '='))
+        {
+            return false;
+        }
+    }
+
+    return s->addXMLEndTag("data");
+}
+
+OSNumber* OSNumber::withNumber(unsigned long long value, unsigned int numberOfBits)
+{
+    OSNumber* me = new OSNumber;
+
+    if(!me) return NULL;
+
+    if(!numberOfBits || numberOfBits > 64)
+    {
+        me->release();
+        return NULL;
+    }
+
+    me->size = numberOfBits;
+    me->value = (numberOfBits == 64) ? value : (value & ((1ULL << numberOfBits) - 1));
+    return me;
+}
+
+bool OSNumber::isEqualTo(const OSMetaClassBase* anObject) const
+{
+    OSNumber* number = OSDynamicCast(OSNumber, anObject);
+
+    return number && number->value == value;
+}
+
+bool OSNumber::serialize(OSSerialize* s) const
+{
+    char temp[32];
+
+    if(s->previouslySerialized(this)) return true;
+
+    snprintf(temp, sizeof(temp), "integer size=\"%d\"", size);
+    if(!s->addXMLStartTag(this, temp)) return false;
+
+    snprintf(temp, sizeof(temp), "0x%llx", value);
+    return s->addString(temp) && s->addXMLEndTag("integer");
+}
+
+static OSBoolean* createBoolean(bool value)
+{
+    OSBoolean* boolean = new OSBoolean;
+
+    boolean->value = value;
+    return boolean;
+}
+
+OSBoolean* const kOSBooleanTrue = createBoolean(true);
+OSBoolean* const kOSBooleanFalse = createBoolean(false);
+
+OSBoolean* OSBoolean::withBoolean(bool value)
+{
+    return value ? kOSBooleanTrue : kOSBooleanFalse;
+}
+
+bool OSBoolean::serialize(OSSerialize* s) const
+{
+    return s->addString(value ? "<true/>" : "<false/>");
+}
+
+/********************************************************************/
+/**                     Collections                                **/
+/********************************************************************/
+
+OSDefineMetaClassAndAbstractStructors(OSIterator, OSObject)
+OSDefineMetaClassAndAbstractStructors(OSCollection, OSObject)
+OSDefineMetaClassAndStructors(OSArray, OSCollection)
+OSDefineMetaClassAndStructors(OSDictionary, OSCollection)
+OSDefineMetaClassAndStructors(OSCollectionIterator, OSIterator)
+
+bool OSCollection::initIterator(void* iterator) const
+{
+    *(unsigned int*)iterator = 0;
+    return true;
+}
+
+/** Collections grow by their initial capacity, or 16 elements if they started empty **/
+static unsigned int growCapacity(unsigned int needed, unsigned int increment)
+{
+    return (((needed - 1) / increment) + 1) * increment;
+}
+
+OSArray* OSArray::withCapacity(unsigned int capacity)
+{
+    OSArray* me = new OSArray;
+
+    if(me && !me->initWithCapacity(capacity))
+    {
+        me->release();
+        return NULL;
+    }
+
+    return me;
+}
+
+bool OSArray::initWithCapacity(unsigned int inCapacity)
+{
+    if(!OSObject::init()) return false;
+
+    if(inCapacity && !(array = (const OSMetaClassBase**)calloc(inCapacity, sizeof(*array)))) return false;
+
+    capacity = inCapacity;
+    capacityIncrement = inCapacity ? inCapacity : 16;
+    return true;
+}
+
+void OSArray::free()
+{
+    unsigned int i;
+
+    for(i = 0; i < count; i++) array[i]->release();
+    ::free(array);
+    OSObject::free();
+}
+
+unsigned int OSArray::ensureCapacity(unsigned int newCapacity)
+{
+    unsigned int finalCapacity;
+    const OSMetaClassBase** newArray;
+
+    if(newCapacity <= capacity) return capacity;
+
+    finalCapacity = growCapacity(newCapacity, capacityIncrement);
+    if(!(newArray = (const OSMetaClassBase**)realloc(array, finalCapacity * sizeof(*array)))) return capacity;
+
+    array = newArray;
+    capacity = finalCapacity;
+    return capacity;
+}
+
+bool OSArray::setObject(const OSMetaClassBase* anObject)
+{
+    if(!anObject || ensureCapacity(count + 1) <= count) return false;
+
+    haveUpdated();
+    anObject->retain();
+    array[count++] = anObject;
+    return true;
+}
+
+OSObject* OSArray::getObject(unsigned int index) const
+{
+    return (index < count) ? (OSObject*)array[index] : NULL;
+}
+
+void OSArray::removeObject(unsigned int index)
+{
+    const OSMetaClassBase* object;
+
+    if(index >= count) return;
+
+    haveUpdated();
+    object = array[index];
+    memmove(&array[index], &array[index + 1], (count - index - 1) * sizeof(*array));
+    count--;
+    object->release();
+}
+
+bool OSArray::getNextObjectForIterator(void* iterator, OSObject** ret) const
+{
+    unsigned int* index = (unsigned int*)iterator;
+
+    *ret = (*index < count) ? (OSObject*)array[(*index)++] : NULL;
+    return *ret != NULL;
+}
+
+bool OSArray::serialize(OSSerialize* s) const
+{
+    unsigned int i;
+
+    if(s->previouslySerialized(this)) return true;
+    if(!s->addXMLStartTag(this, "array")) return false;
+
+    for(i = 0; i < count; i++)
+    {
+        if(!array[i]->serialize(s)) return false;
+    }
+
+    return s->addXMLEndTag("array");
+}
+
+OSDictionary* OSDictionary::withCapacity(unsigned int capacity)
+{
+    OSDictionary* me = new OSDictionary;
+
+    if(me && !me->initWithCapacity(capacity))
+    {
+        me->release();
+        return NULL;
+    }
+
+    return me;
+}
+
+OSDictionary* OSDictionary::withDictionary(const OSDictionary* dict, unsigned int capacity)
+{
+    OSDictionary* me;
+    unsigned int i;
+
+    if(!dict) return NULL;
+    if(capacity < dict->count) capacity = dict->count;
+    if(!(me = withCapacity(capacity))) return NULL;
+
+    for(i = 0; i < dict->count; i++)
+    {
+        dict->dictionary[i].key->retain();
+        dict->dictionary[i].value->retain();
+        me->dictionary[i] = dict->dictionary[i];
+    }
+
+    me->count = dict->count;
+    return me;
+}
+
+bool OSDictionary::initWithCapacity(unsigned int inCapacity)
+{
+    if(!OSObject::init()) return false;
+
+    if(inCapacity && !(dictionary = (dictEntry*)calloc(inCapacity, sizeof(*dictionary)))) return false;
+
+    capacity = inCapacity;
+    capacityIncrement = inCapacity ? inCapacity : 16;
+    return true;
+}
+
+void OSDictionary::free()
+{
+    unsigned int i;
+
+    for(i = 0; i < count; i++)
+    {
+        dictionary[i].key->release();
+        dictionary[i].value->release();
+    }
+
+    ::free(dictionary);
+    OSObject::free();
+}
+
+unsigned int OSDictionary::ensureCapacity(unsigned int newCapacity)
+{
+    unsigned int finalCapacity;
+    dictEntry* newDictionary;
+
+    if(newCapacity <= capacity) return capacity;
+
+    finalCapacity = growCapacity(newCapacity, capacityIncrement);
+    if(!(newDictionary = (dictEntry*)realloc(dictionary, finalCapacity * sizeof(*dictionary)))) return capacity;
+
+    __sync_fetch_and_add(&gOSDictionaryGrows, 1);
+    dictionary = newDictionary;
+    capacity = finalCapacity;
+    return capacity;
+}
+
+bool OSDictionary::setObject(const OSSymbol* aKey, const OSMetaClassBase* anObject)
+{
+    unsigned int i;
+
+    if(!aKey || !anObject) return false;
+
+    for(i = 0; i < count; i++)
+    {
+        if(dictionary[i].key == aKey)
+        {
+            const OSMetaClassBase* oldObject = dictionary[i].value;
+
+            haveUpdated();
+            anObject->retain();
+            dictionary[i].value = anObject;
+            oldObject->release();
+            return true;
+        }
+    }
+
+    if(ensureCapacity(count + 1) <= count) return false;
+
+    haveUpdated();
+    aKey->retain();
+    anObject->retain();
+    dictionary[count].key = aKey;
+    dictionary[count].value = anObject;
+    count++;
+    return true;
+}
+
+bool OSDictionary::setObject(const OSString* aKey, const OSMetaClassBase* anObject)
+{
+    const OSSymbol* symbol = OSSymbol::withString(aKey);
+    bool result;
+
+    if(!symbol) return false;
+
+    result = setObject(symbol, anObject);
+    symbol->release();
+    return result;
+}
+
+bool OSDictionary::setObject(const char* aKey, const OSMetaClassBase* anObject)
+{
+    const OSSymbol* symbol = OSSymbol::withCString(aKey);
+    bool result;
+
+    if(!symbol) return false;
+
+    result = setObject(symbol, anObject);
+    symbol->release();
+    return result;
+}
+
+OSObject* OSDictionary::getObject(const OSSymbol* aKey) const
+{
+    unsigned int i;
+
+    for(i = 0; i < count; i++)
+    {
+        if(dictionary[i].key == aKey) return (OSObject*)dictionary[i].value;
+    }
+
+    return NULL;
+}
+
+OSObject* OSDictionary::getObject(const OSString* aKey) const
+{
+    const OSSymbol* symbol = OSSymbol::withString(aKey);
+    OSObject* object;
+
+    if(!symbol) return NULL;
+
+    object = getObject(symbol);
+    symbol->release();
+    return object;
+}
+
+OSObject* OSDictionary::getObject(const char* aKey) const
+{
+    const OSSymbol* symbol = OSSymbol::withCString(aKey);
+    OSObject* object;
+
+    if(!symbol) return NULL;
+
+    object = getObject(symbol);
+    symbol->release();
+    return object;
+}
+
+void OSDictionary::removeObject(const OSSymbol* aKey)
+{
+    unsigned int i;
+
+    for(i = 0; i < count; i++)
+    {
+        if(dictionary[i].key == aKey)
+        {
+            dictEntry entry = dictionary[i];
+
+            haveUpdated();
+            memmove(&dictionary[i], &dictionary[i + 1], (count - i - 1) * sizeof(*dictionary));
+            count--;
+
+            entry.key->release();
+            entry.value->release();
+            return;
+        }
+    }
+}
+
+void OSDictionary::removeObject(const OSString* aKey)
+{
+    const OSSymbol* symbol = OSSymbol::withString(aKey);
+
+    if(!symbol) return;
+
+    removeObject(symbol);
+    symbol->release();
+}
+
+void OSDictionary::removeObject(const char* aKey)
+{
+    const OSSymbol* symbol = OSSymbol::withCString(aKey);
+
+    if(!symbol) return;
+
+    removeObject(symbol);
+    symbol->release();
+}
+
+bool OSDictionary::getNextObjectForIterator(void* iterator, OSObject** ret) const
+{
+    unsigned int* index = (unsigned int*)iterator;
+
+    *ret = (*index < count) ? (OSObject*)dictionary[(*index)++].key : NULL;
+    return *ret != NULL;
+}
+
+bool OSDictionary::serialize(OSSerialize* s) const
+{
+    unsigned int i;
+
+    if(s->previouslySerialized(this)) return true;
+    if(!s->addXMLStartTag(this, "dict")) return false;
+
+    for(i = 0; i < count; i++)
+    {
+        if(!s->addString("<key>") ||
+           !addEscaped(s, dictionary[i].key->getCStringNoCopy()) ||
+           !s->addXMLEndTag("key") ||
+           !dictionary[i].value->serialize(s))
+        {
+            return false;
+        }
+    }
+
+    return s->addXMLEndTag("dict");
+}
+
+OSCollectionIterator* OSCollectionIterator::withCollection(const OSCollection* inColl)
+{
+    OSCollectionIterator* me;
+
+    if(!inColl || !(me = new OSCollectionIterator)) return NULL;
+
+    inColl->retain();
+    me->collection = inColl;
+    me->reset();
+    return me;
+}
+
+void OSCollectionIterator::free()
+{
+    collection->release();
+    OSObject::free();
+}
+
+void OSCollectionIterator::reset()
+{
+    collection->initIterator(&collIterator);
+    initialUpdateStamp = collection->updateStamp;
+    valid = true;
+}
+
+bool OSCollectionIterator::isValid()
+{
+    if(valid && initialUpdateStamp != collection->updateStamp) valid = false;
+    return valid;
+}
+
+OSObject* OSCollectionIterator::getNextObject()
+{
+    OSObject* object;
+
+    if(!isValid()) return NULL;
+
+    collection->getNextObjectForIterator(&collIterator, &object);
+    return object;
+}
+
+/********************************************************************/
+/**                     OSSerialize                                **/
+/********************************************************************/
+
+OSDefineMetaClassAndStructors(OSSerialize, OSObject)
+
+OSSerialize* OSSerialize::withCapacity(unsigned int inCapacity)
+{
+    OSSerialize* me = new OSSerialize;
+
+    if(!me) return NULL;
+
+    me->capacity = inCapacity ? inCapacity : 1;
+    me->capacityIncrement = (inCapacity > 256) ? inCapacity : 256;
+
+    if(!(me->data = (char*)malloc(me->capacity)))
+    {
+        me->release();
+        return NULL;
+    }
+
+    me->data[0] = 0;
+    return me;
+}
+
+void OSSerialize::free()
+{
+    ::free(data);
+    ::free(tags);
+    OSObject::free();
+}
+
+bool OSSerialize::ensureLength(unsigned int needed)
+{
+    unsigned int finalCapacity;
+    char* newData;
+
+    if(needed <= capacity) return true;
+
+    finalCapacity = (((needed - 1) / capacityIncrement) + 1) * capacityIncrement;
+    if(!(newData = (char*)realloc(data, finalCapacity))) return false;
+
+    data = newData;
+    capacity = finalCapacity;
+    return true;
+}
+
+bool OSSerialize::addChar(const char aChar)
+{
+    if(!ensureLength(length + 2)) return false;
+
+    data[length++] = aChar;
+    data[length] = 0;
+    return true;
+}
+
+bool OSSerialize::addString(const char* aString)
+{
+    unsigned int stringLength = (unsigned int)strlen(aString);
+
+    if(!ensureLength(length + stringLength + 1)) return false;
+
+    memcpy(&data[length], aString, stringLength + 1);
+    length += stringLength;
+    return true;
+}
+
+static unsigned int tagSlot(const OSMetaClassBase* o, unsigned int capacity)
+{
+    return (unsigned int)((((uintptr_t)o >> 4) * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1);
+}
+
+/** The object's tag, -1 if it hasn't been serialized yet **/
+static long findTag(const OSSerialize* s, const OSMetaClassBase* o)
+{
+    unsigned int i;
+
+    if(!s->tagCapacity) return -1;
+
+    for(i = tagSlot(o, s->tagCapacity); s->tags[i].object; i = (i + 1) & (s->tagCapacity - 1))
+    {
+        if(s->tags[i].object == o) return s->tags[i].tag;
+    }
+
+    return -1;
+}
+
+static bool insertTag(OSSerialize* s, const OSMetaClassBase* o)
+{
+    unsigned int i;
+
+    if((s->tagCount + 1) * 4 > s->tagCapacity * 3)
+    {
+        unsigned int capacity = s->tagCapacity ? s->tagCapacity * 2 : 64;
+        OSSerialize::tagEntry* tags = (OSSerialize::tagEntry*)calloc(capacity, sizeof(*tags));
+
+        if(!tags) return false;
+
+        for(i = 0; i < s->tagCapacity; i++)
+        {
+            if(!s->tags[i].object) continue;
+
+            unsigned int slot = tagSlot(s->tags[i].object, capacity);
+            while(tags[slot].object) slot = (slot + 1) & (capacity - 1);
+            tags[slot] = s->tags[i];
+        }
+
+        ::free(s->tags);
+        s->tags = tags;
+        s->tagCapacity = capacity;
+    }
+
+    for(i = tagSlot(o, s->tagCapacity); s->tags[i].object; i = (i + 1) & (s->tagCapacity - 1));
+    s->tags[i].object = o;
+    s->tags[i].tag = s->tagCount++;
+    return true;
+}
+
+bool OSSerialize::previouslySerialized(const OSMetaClassBase* o)
+{
+    char temp[64];
+    long tag = findTag(this, o);
+
+    if(tag < 0)
+    {
+        insertTag(this, o);
+        return false;
+    }
+
+    snprintf(temp, sizeof(temp), "<reference IDREF=\"%ld\"/>", tag);
+    addString(temp);
+    return true;
+}
+
+bool OSSerialize::addXMLStartTag(const OSMetaClassBase* o, const char* tagString)
+{
+    char temp[32];
+    long tag = findTag(this, o);
+
+    if(tag < 0)
+    {
+        if(!insertTag(this, o)) return false;
+        tag = tagCount - 1;
+    }
+
+    snprintf(temp, sizeof(temp), " ID=\"%ld\">", tag);
+    return addChar('<') && addString(tagString) && addString(temp);
+}
+
+bool OSSerialize::addXMLEndTag(const char* tagString)
+{
+    return addString("</") && addString(tagString) && addChar('>');
+}
+
+/********************************************************************/
+/**                     OSUnserializeXML                           **/
+/********************************************************************/
+
+typedef struct
+{
+    const char* pos;
+    const char* start;
+    const char* error;
+    OSObject**  ids;            /* objects by ID, not retained */
+    long        idCapacity;
+} xml_parser_t;
+
+typedef struct
+{
+    char        name[32];
+    const char* attributes;     /* up to end */
+    const char* end;            /* the '>' or "/>" */
+    bool        empty;
+    bool        closing;
+} xml_tag_t;
+
+static OSObject* parseObject(xml_parser_t* parser, const xml_tag_t* tag);
+
+static bool parseFail(xml_parser_t* parser, const char* error)
+{
+    if(!parser->error) parser->error = error;
+    return false;
+}
+
+/** The next element's tag, skipping text, the prolog and comments **/
+static bool parseTag(xml_parser_t* parser, xml_tag_t* tag)
+{
+    for(;;)
+    {
+        const char* pos = strchr(parser->pos, '<');
+        const char* name;
+        size_t length;
+
+        if(!pos) return parseFail(parser, "unexpected end of input");
+
+        if(!strncmp(pos, "<!--", 4))
+        {
+            const char* end = strstr(pos + 4, "-->");
+            if(!end) return parseFail(parser, "unterminated comment");
+            parser->pos = end + 3;
+            continue;
+        }
+
+        const char* end = strchr(pos, '>');
+        if(!end) return parseFail(parser, "unterminated tag");
+        parser->pos = end + 1;
+
+        if(pos[1] == '?' || pos[1] == '!') continue;
+
+        tag->closing = (pos[1] == '/');
+        name = pos + (tag->closing ? 2 : 1);
+        for(length = 0; name + length < end && name[length] != ' ' && name[length] != '/'; length++);
+
+        if(length >= sizeof(tag->name)) return parseFail(parser, "unknown tag");
+        memcpy(tag->name, name, length);
+        tag->name[length] = 0;
+
+        tag->attributes = name + length;
+        tag->end = end;
+        tag->empty = !tag->closing && end[-1] == '/';
+
+        // The plist wrapper is optional.
+        if(!strcmp(tag->name, "plist")) continue;
+
+        return true;
+    }
+}
+
+static long parseAttribute(const xml_tag_t* tag, const char* attribute)
+{
+    size_t length = strlen(attribute);
+    const char* pos;
+
+    for(pos = tag->attributes; pos + length + 2 < tag->end; pos++)
+    {
+        if(pos[-1] == ' ' && !strncmp(pos, attribute, length) && pos[length] == '=' && pos[length + 1] == '"')
+        {
+            return strtol(&pos[length + 2], NULL, 10);
+        }
+    }
+
+    return -1;
+}
+
+/** Contents up to the closing tag, entities decoded. Returns a malloc'd string. **/
+static char* parseText(xml_parser_t* parser, const xml_tag_t* tag)
+{
+    const char* end;
+    char* text;
+    char* out;
+    const char* in;
+
+    if(tag->empty) return strdup("");
+
+    if(!(end = strchr(parser->pos, '<')) || end[1] != '/' ||
+       strncmp(end + 2, tag->name, strlen(tag->name)) || end[2 + strlen(tag->name)] != '>')
+    {
+        parseFail(parser, "unterminated element");
+        return NULL;
+    }
+
+    if(!(text = (char*)malloc(end - parser->pos + 1))) return NULL;
+
+    for(in = parser->pos, out = text; in < end; )
+    {
+        static const struct { const char* entity; char c; } entities[] =
+        {
+            { "&lt;", '<' }, { "&gt;", '>' }, { "&amp;", '&' }, { "&quot;", '"' }, { "&apos;", '\'' },
+        };
+        unsigned int i;
+
+        if(*in != '&')
+        {
+            *out++ = *in++;
+            continue;
+        }
+
+        for(i = 0; i < sizeof(entities) / sizeof(entities[0]); i++)
+        {
+            size_t length = strlen(entities[i].entity);
+            if(!strncmp(in, entities[i].entity, length))
+            {
+                *out++ = entities[i].c;
+                in += length;
+                break;
+            }
+        }
+
+        if(i < sizeof(entities) / sizeof(entities[0])) continue;
+
+        if(in[1] == '#')
+        {
+            char* number;
+            long c = (in[2] == 'x') ? strtol(&in[3], &number, 16) : strtol(&in[2], &number, 10);
+            if(*number == ';')
+            {
+                *out++ = (char)c;
+                in = number + 1;
+                continue;
+            }
+        }
+
+        *out++ = *in++;
+    }
+
+    *out = 0;
+    parser->pos = end + 3 + strlen(tag->name);
+    return text;
+}
+
+static OSData* parseData(const char* text)
+{
+    OSData* data = OSData::withCapacity((unsigned int)((strlen(text) * 3) / 4));
+    UInt32 word = 0;
+    int bits = 0;
+
+    for(; data && *text && *text != '='; text++)
+    {
+        const char* c = strchr("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", *text);
+        if(!c || !*c) continue;     // whitespace
+
+        word = (word << 6) | (UInt32)(c - "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+        bits += 6;
+
+        if(bits >= 8)
+        {
+            bits -= 8;
+            data->appendByte((word >> bits) & 0xFF, 1);
+        }
+    }
+
+    return data;
+}
+
+/** Objects of a dictionary or array, in order. Keys are only read for dictionaries. **/
+static bool parseCollection(xml_parser_t* parser, const xml_tag_t* tag, OSObject*** objects, unsigned int* count)
+{
+    bool isDict = !strcmp(tag->name, "dict");
+    unsigned int capacity = 0;
+    xml_tag_t child;
+
+    *objects = NULL;
+    *count = 0;
+
+    if(tag->empty) return true;
+
+    for(;;)
+    {
+        OSObject* object;
+
+        if(!parseTag(parser, &child)) return false;
+        if(child.closing) return !strcmp(child.name, tag->name) || parseFail(parser, "mismatched closing tag");
+
+        if(isDict && !(*count & 1))
+        {
+            char* key;
+
+            if(strcmp(child.name, "key")) return parseFail(parser, "expected a key");
+            if(!(key = parseText(parser, &child))) return false;
+
+            object = (OSObject*)OSSymbol::withCString(key);
+            ::free(key);
+        }
+        else
+        {
+            object = parseObject(parser, &child);
+        }
+
+        if(!object) return false;
+
+        if(*count == capacity)
+        {
+            OSObject** grown = (OSObject**)realloc(*objects, (capacity = capacity ? capacity * 2 : 32) * sizeof(OSObject*));
+            if(!grown)
+            {
+                object->release();
+                return false;
+            }
+            *objects = grown;
+        }
+
+        (*objects)[(*count)++] = object;
+    }
+}
+
+static OSObject* parseObject(xml_parser_t* parser, const xml_tag_t* tag)
+{
+    OSObject* object = NULL;
+    long id = parseAttribute(tag, "ID");
+    long ref = parseAttribute(tag, "IDREF");
+    char* text = NULL;
+
+    if(ref >= 0 || !strcmp(tag->name, "reference"))
+    {
+        if(ref < 0 || ref >= parser->idCapacity || !(object = parser->ids[ref]))
+        {
+            parseFail(parser, "unknown IDREF");
+            return NULL;
+        }
+
+        object->retain();
+        return object;
+    }
+
+    if(!strcmp(tag->name, "dict") || !strcmp(tag->name, "array"))
+    {
+        OSObject** objects;
+        unsigned int count, i;
+        bool ok = parseCollection(parser, tag, &objects, &count);
+
+        if(ok && !strcmp(tag->name, "dict"))
+        {
+            OSDictionary* dict = OSDictionary::withCapacity(count / 2);
+            for(i = 0; dict && i + 1 < count; i += 2) dict->setObject((const OSSymbol*)objects[i], objects[i + 1]);
+            object = dict;
+        }
+        else if(ok)
+        {
+            OSArray* array = OSArray::withCapacity(count);
+            for(i = 0; array && i < count; i++) array->setObject(objects[i]);
+            object = array;
+        }
+
+        for(i = 0; i < count; i++) objects[i]->release();
+        ::free(objects);
+    }
+    else if(!strcmp(tag->name, "true") || !strcmp(tag->name, "false"))
+    {
+        object = (tag->name[0] == 't') ? kOSBooleanTrue : kOSBooleanFalse;
+        if(!tag->empty && !(text = parseText(parser, tag))) return NULL;
+    }
+    else if(!strcmp(tag->name, "string") || !strcmp(tag->name, "data") || !strcmp(tag->name, "integer"))
+    {
+        if(!(text = parseText(parser, tag))) return NULL;
+
+        if(tag->name[0] == 's')
+        {
+            object = OSString::withCString(text);
+        }
+        else if(tag->name[0] == 'd')
+        {
+            object = parseData(text);
+        }
+        else
+        {
+            long size = parseAttribute(tag, "size");
+            const char* digits = text;
+            while(*digits == ' ' || *digits == '\t' || *digits == '\n') digits++;
+
+            unsigned long long value = (*digits == '-') ? (unsigned long long)strtoll(digits, NULL, 0) : strtoull(digits, NULL, 0);
+            object = OSNumber::withNumber(value, (size > 0) ? (unsigned int)size : 64);
+        }
+    }
+    else
+    {
+        parseFail(parser, "unknown tag");
+    }
+
+    ::free(text);
+
+    if(object && id >= 0)
+    {
+        if(id >= parser->idCapacity)
+        {
+            long capacity = (id + 1) * 2;
+            OSObject** ids = (OSObject**)realloc(parser->ids, capacity * sizeof(OSObject*));
+            if(!ids)
+            {
+                object->release();
+                return NULL;
+            }
+            bzero(&ids[parser->idCapacity], (capacity - parser->idCapacity) * sizeof(OSObject*));
+            parser->ids = ids;
+            parser->idCapacity = capacity;
+        }
+
+        parser->ids[id] = object;
+    }
+
+    return object;
+}
+
+OSObject* OSUnserializeXML(const char* buffer, OSString** errorString)
+{
+    xml_parser_t parser;
+    xml_tag_t tag;
+    OSObject* object = NULL;
+
+    bzero(&parser, sizeof(parser));
+    parser.pos = parser.start = buffer;
+
+    if(errorString) *errorString = NULL;
+
+    if(buffer && parseTag(&parser, &tag))
+    {
+        if(tag.closing) parseFail(&parser, "unexpected closing tag");
+        else object = parseObject(&parser, &tag);
+    }
+
+    ::free(parser.ids);
+
+    if(!object && errorString)
+    {
+        char message[128];
+        snprintf(message, sizeof(message), "OSUnserializeXML: %s near offset %ld",
+                 parser.error ? parser.error : "syntax error", buffer ? (long)(parser.pos - buffer) : 0L);
+        *errorString = OSString::withCString(message);
+    }
+
+    return object;
+}
+
+/********************************************************************/
+/**                     Registry                                   **/
+/********************************************************************/
+
+OSDefineMetaClassAndStructors(IORegistryEntry, OSObject)
+OSDefineMetaClassAndStructors(IOService, IORegistryEntry)
+OSDefineMetaClassAndStructors(IODTNVRAM, IOService)
+
+static pthread_once_t   gRegistryOnce = PTHREAD_ONCE_INIT;
+static IORegistryEntry* gDeviceTreeRoot;
+static IOService*       gResourceService;
+
+static void registryInit(void)
+{
+    gDeviceTreeRoot = new IORegistryEntry;
+    gDeviceTreeRoot->init();
+    gDeviceTreeRoot->setName("device-tree");
+
+    gResourceService = new IOService;
+    gResourceService->init();
+    gResourceService->setName("IOResources");
+}
+
+IORegistryEntry* IORegistryEntry::fromPath(const char* path, const IORegistryPlane* plane, char* residualPath,
+                                           int* residualLength, IORegistryEntry* fromEntry)
+{
+    IORegistryEntry* entry;
+    char name[128];
+
+    pthread_once(&gRegistryOnce, registryInit);
+
+    if(!strncmp(path, "IODeviceTree:", strlen("IODeviceTree:")))
+    {
+        path += strlen("IODeviceTree:");
+        plane = gIODTPlane;
+    }
+
+    if(plane != gIODTPlane || path[0] != '/') return NULL;
+
+    for(entry = gDeviceTreeRoot; entry && *path; )
+    {
+        const char* end;
+        OSIterator* iter;
+        IORegistryEntry* child;
+
+        while(*path == '/') path++;
+        if(!*path) break;
+
+        if(!(end = strchr(path, '/'))) end = path + strlen(path);
+        snprintf(name, sizeof(name), "%.*s", (int)(end - path), path);
+        path = end;
+
+        if(!(iter = entry->getChildIterator(gIODTPlane))) return NULL;
+
+        while((child = OSDynamicCast(IORegistryEntry, iter->getNextObject())) && strcmp(child->getName(gIODTPlane), name));
+        iter->release();
+
+        entry = child;
+    }
+
+    // Like xnu, the entry is returned retained.
+    if(entry) entry->retain();
+    return entry;
+}
+
+bool IORegistryEntry::init(OSDictionary* dictionary)
+{
+    pthread_mutexattr_t attributes;
+
+    if(!OSObject::init()) return false;
+
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&fLock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+
+    if(dictionary)
+    {
+        dictionary->retain();
+        fPropertyTable = dictionary;
+    }
+    else
+    {
+        fPropertyTable = OSDictionary::withCapacity(16);
+    }
+
+    return fPropertyTable != NULL;
+}
+
+/** Take over old's properties and its place in plane **/
+bool IORegistryEntry::init(IORegistryEntry* old, const IORegistryPlane* plane)
+{
+    OSDictionary* properties = old ? old->dictionaryWithProperties() : NULL;
+    bool result = init(properties);
+
+    OSSafeReleaseNULL(properties);
+    if(!result || !old) return result;
+
+    setName(old->getName());
+    if(old->fParent && plane == gIODTPlane)
+    {
+        IORegistryEntry* parent = old->fParent;
+        attachToParent(parent, plane);
+        old->detachFromParent(parent, plane);
+    }
+
+    return true;
+}
+
+void IORegistryEntry::free()
+{
+    OSSafeReleaseNULL(fPropertyTable);
+    OSSafeReleaseNULL(fName);
+    OSSafeReleaseNULL(fPlaneName);
+    OSSafeReleaseNULL(fChildren);
+    pthread_mutex_destroy(&fLock);
+    OSObject::free();
+}
+
+const char* IORegistryEntry::getName(const IORegistryPlane* plane) const
+{
+    OSData* name;
+
+    if(plane == gIODTPlane && fPlaneName) return fPlaneName->getCStringNoCopy();
+    if(fName) return fName->getCStringNoCopy();
+
+    // Device tree entries are named by their "name" property.
+    if((name = OSDynamicCast(OSData, getProperty("name")))) return (const char*)name->getBytesNoCopy();
+
+    return getMetaClass()->getClassName();
+}
+
+void IORegistryEntry::setName(const char* name, const IORegistryPlane* plane)
+{
+    const OSSymbol* symbol = OSSymbol::withCString(name);
+
+    if(plane)
+    {
+        OSSafeReleaseNULL(fPlaneName);
+        fPlaneName = symbol;
+    }
+    else
+    {
+        OSSafeReleaseNULL(fName);
+        fName = symbol;
+    }
+}
+
+OSIterator* IORegistryEntry::getChildIterator(const IORegistryPlane* plane) const
+{
+    OSArray* children;
+    OSIterator* iter;
+    unsigned int i;
+
+    pthread_mutex_lock(&fLock);
+
+    children = OSArray::withCapacity((plane == gIODTPlane && fChildren) ? fChildren->getCount() : 0);
+    for(i = 0; children && plane == gIODTPlane && fChildren && i < fChildren->getCount(); i++)
+    {
+        children->setObject(fChildren->getObject(i));
+    }
+
+    pthread_mutex_unlock(&fLock);
+
+    if(!children) return NULL;
+
+    iter = OSCollectionIterator::withCollection(children);
+    children->release();
+    return iter;
+}
+
+IORegistryEntry* IORegistryEntry::getParentEntry(const IORegistryPlane* plane) const
+{
+    return (plane == gIODTPlane) ? fParent : NULL;
+}
+
+bool IORegistryEntry::attachToParent(IORegistryEntry* parent, const IORegistryPlane* plane)
+{
+    bool result;
+
+    if(!parent || plane != gIODTPlane) return false;
+    if(fParent == parent) return true;
+    if(fParent) detachFromParent(fParent, plane);
+
+    pthread_mutex_lock(&parent->fLock);
+    if(!parent->fChildren) parent->fChildren = OSArray::withCapacity(4);
+    result = parent->fChildren && parent->fChildren->setObject(this);
+    if(result) fParent = parent;
+    pthread_mutex_unlock(&parent->fLock);
+
+    return result;
+}
+
+void IORegistryEntry::detachFromParent(IORegistryEntry* parent, const IORegistryPlane* plane)
+{
+    unsigned int i;
+
+    if(!parent || parent != fParent || plane != gIODTPlane) return;
+
+    fParent = NULL;
+
+    pthread_mutex_lock(&parent->fLock);
+    for(i = 0; parent->fChildren && i < parent->fChildren->getCount(); i++)
+    {
+        if(parent->fChildren->getObject(i) == this)
+        {
+            // Drops the parent's reference, this may be the last.
+            parent->fChildren->removeObject(i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&parent->fLock);
+}
+
+OSDictionary* IORegistryEntry::dictionaryWithProperties() const
+{
+    OSDictionary* dict;
+
+    pthread_mutex_lock(&fLock);
+    dict = OSDictionary::withDictionary(fPropertyTable, fPropertyTable ? fPropertyTable->getCapacity() : 0);
+    pthread_mutex_unlock(&fLock);
+
+    return dict;
+}
+
+OSDictionary* IORegistryEntry::getPropertyTable() const
+{
+    return fPropertyTable;
+}
+
+void IORegistryEntry::setPropertyTable(OSDictionary* dict)
+{
+    OSDictionary* old;
+
+    if(dict) dict->retain();
+
+    pthread_mutex_lock(&fLock);
+    old = fPropertyTable;
+    fPropertyTable = dict;
+    pthread_mutex_unlock(&fLock);
+
+    if(old) old->release();
+}
+
+bool IORegistryEntry::serializeProperties(OSSerialize* s) const
+{
+    bool result;
+
+    pthread_mutex_lock(&fLock);
+    result = fPropertyTable->serialize(s);
+    pthread_mutex_unlock(&fLock);
+
+    return result;
+}
+
+IOReturn IORegistryEntry::setProperties(OSObject* properties)
+{
+    return kIOReturnUnsupported;
+}
+
+OSObject* IORegistryEntry::getProperty(const OSSymbol* aKey) const
+{
+    OSObject* object;
+
+    pthread_mutex_lock(&fLock);
+    object = fPropertyTable->getObject(aKey);
+    pthread_mutex_unlock(&fLock);
+
+    return object;
+}
+
+OSObject* IORegistryEntry::getProperty(const OSString* aKey) const
+{
+    const OSSymbol* symbol = OSSymbol::withString(aKey);
+    OSObject* object = symbol ? getProperty(symbol) : NULL;
+
+    OSSafeReleaseNULL(symbol);
+    return object;
+}
+
+OSObject* IORegistryEntry::getProperty(const char* aKey) const
+{
+    const OSSymbol* symbol = OSSymbol::withCString(aKey);
+    OSObject* object = symbol ? getProperty(symbol) : NULL;
+
+    OSSafeReleaseNULL(symbol);
+    return object;
+}
+
+OSObject* IORegistryEntry::copyProperty(const OSSymbol* aKey) const
+{
+    OSObject* object;
+
+    pthread_mutex_lock(&fLock);
+    if((object = fPropertyTable->getObject(aKey))) object->retain();
+    pthread_mutex_unlock(&fLock);
+
+    return object;
+}
+
+OSObject* IORegistryEntry::copyProperty(const OSString* aKey) const
+{
+    const OSSymbol* symbol = OSSymbol::withString(aKey);
+    OSObject* object = symbol ? copyProperty(symbol) : NULL;
+
+    OSSafeReleaseNULL(symbol);
+    return object;
+}
+
+OSObject* IORegistryEntry::copyProperty(const char* aKey) const
+{
+    const OSSymbol* symbol = OSSymbol::withCString(aKey);
+    OSObject* object = symbol ? copyProperty(symbol) : NULL;
+
+    OSSafeReleaseNULL(symbol);
+    return object;
+}
+
+bool IORegistryEntry::setProperty(const OSSymbol* aKey, OSObject* anObject)
+{
+    bool result;
+
+    pthread_mutex_lock(&fLock);
+    result = fPropertyTable->setObject(aKey, anObject);
+    pthread_mutex_unlock(&fLock);
+
+    return result;
+}
+
+bool IORegistryEntry::setProperty(const OSString* aKey, OSObject* anObject)
+{
+    const OSSymbol* symbol = OSSymbol::withString(aKey);
+    bool result = symbol && setProperty(symbol, anObject);
+
+    OSSafeReleaseNULL(symbol);
+    return result;
+}
+
+bool IORegistryEntry::setProperty(const char* aKey, OSObject* anObject)
+{
+    const OSSymbol* symbol = OSSymbol::withCString(aKey);
+    bool result = symbol && setProperty(symbol, anObject);
+
+    OSSafeReleaseNULL(symbol);
+    return result;
+}
+
+bool IORegistryEntry::setProperty(const char* aKey, const char* aString)
+{
+    OSString* string = OSString::withCString(aString);
+    bool result = string && setProperty(aKey, string);
+
+    OSSafeReleaseNULL(string);
+    return result;
+}
+
+bool IORegistryEntry::setProperty(const char* aKey, bool aBoolean)
+{
+    return setProperty(aKey, OSBoolean::withBoolean(aBoolean));
+}
+
+bool IORegistryEntry::setProperty(const char* aKey, unsigned long long aValue, unsigned int aNumberOfBits)
+{
+    OSNumber* number = OSNumber::withNumber(aValue, aNumberOfBits);
+    bool result = number && setProperty(aKey, number);
+
+    OSSafeReleaseNULL(number);
+    return result;
+}
+
+bool IORegistryEntry::setProperty(const char* aKey, void* bytes, unsigned int length)
+{
+    OSData* data = OSData::withBytes(bytes, length);
+    bool result = data && setProperty(aKey, data);
+
+    OSSafeReleaseNULL(data);
+    return result;
+}
+
+void IORegistryEntry::removeProperty(const OSSymbol* aKey)
+{
+    pthread_mutex_lock(&fLock);
+    fPropertyTable->removeObject(aKey);
+    pthread_mutex_unlock(&fLock);
+}
+
+void IORegistryEntry::removeProperty(const OSString* aKey)
+{
+    const OSSymbol* symbol = OSSymbol::withString(aKey);
+
+    if(symbol) removeProperty(symbol);
+    OSSafeReleaseNULL(symbol);
+}
+
+void IORegistryEntry::removeProperty(const char* aKey)
+{
+    const OSSymbol* symbol = OSSymbol::withCString(aKey);
+
+    if(symbol) removeProperty(symbol);
+    OSSafeReleaseNULL(symbol);
+}
+
+IORegistryEntry* xnu_dt_add_entry(IORegistryEntry* parent, const char* name)
+{
+    IORegistryEntry* entry = new IORegistryEntry;
+
+    if(!entry || !entry->init())
+    {
+        OSSafeReleaseNULL(entry);
+        return NULL;
+    }
+
+    if(!parent)
+    {
+        pthread_once(&gRegistryOnce, registryInit);
+        parent = gDeviceTreeRoot;
+    }
+
+    entry->setName(name);
+    entry->setProperty("name", (void*)name, (unsigned int)strlen(name) + 1);
+    entry->attachToParent(parent, gIODTPlane);
+
+    // The parent holds the only reference.
+    entry->release();
+    return entry;
+}
+
+/********************************************************************/
+/**                     Services                                   **/
+/********************************************************************/
+
+OSDictionary* IOService::resourceMatching(const char* name, OSDictionary* table)
+{
+    if(table) table->retain();
+    else if(!(table = OSDictionary::withCapacity(2))) return NULL;
+
+    OSString* provider = OSString::withCString("IOResources");
+    OSString* resource = OSString::withCString(name);
+
+    table->setObject(gIOProviderClassKey, provider);
+    table->setObject("IOResourceMatch", resource);
+
+    OSSafeReleaseNULL(provider);
+    OSSafeReleaseNULL(resource);
+    return table;
+}
+
+IOService* IOService::waitForMatchingService(OSDictionary* matching, uint64_t timeout)
+{
+    OSString* resource = OSDynamicCast(OSString, matching->getObject("IOResourceMatch"));
+    bool found = false;
+    int i;
+
+    pthread_once(&gRegistryOnce, registryInit);
+
+    pthread_mutex_lock(&gHostLock);
+    for(i = 0; resource && i < gResourceCount && !found; i++) found = resource->isEqualTo(gResources[i]);
+    pthread_mutex_unlock(&gHostLock);
+
+    if(!found) return NULL;
+
+    // Like xnu, the match is returned retained.
+    gResourceService->retain();
+    return gResourceService;
+}
+
+void xnu_publish_resource(const char* name)
+{
+    pthread_mutex_lock(&gHostLock);
+    if(gResourceCount < XNU_MAX_RESOURCES) gResources[gResourceCount++] = strdup(name);
+    pthread_mutex_unlock(&gHostLock);
+}
+
+bool IOService::start(IOService* provider)
+{
+    return true;
+}
+
+void IOService::stop(IOService* provider)
+{
+}
+
+bool IOService::passiveMatch(OSDictionary* matching, bool changesOK)
+{
+    return false;
+}
+
+IOWorkLoop* IOService::getWorkLoop() const
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    static IOWorkLoop* workLoop;
+
+    struct create { static void workLoop_() { workLoop = IOWorkLoop::workLoop(); } };
+    pthread_once(&once, create::workLoop_);
+
+    return workLoop;
+}
+
+void IOService::registerService(IOOptionBits options)
+{
+    fRegistered = true;
+}
+
+IOReturn IOService::callPlatformFunction(const OSSymbol* functionName, bool waitForFunction,
+                                         void* param1, void* param2, void* param3, void* param4)
+{
+    pthread_mutex_lock(&gHostLock);
+    snprintf(gPlatformFunction, sizeof(gPlatformFunction), "%s", functionName->getCStringNoCopy());
+    pthread_mutex_unlock(&gHostLock);
+
+    return kIOReturnSuccess;
+}
+
+const char* xnu_platform_function(void)
+{
+    return gPlatformFunction[0] ? gPlatformFunction : NULL;
+}
+
+IOReturn IOService::setPowerState(unsigned long powerStateOrdinal, IOService* whatDevice)
+{
+    return kIOPMAckImplied;
+}
+
+void IOService::PMinit()
+{
+}
+
+void IOService::PMstop()
+{
+}
+
+IOReturn IOService::registerPowerDriver(IOService* controllingDriver, IOPMPowerState* powerStates, unsigned long numberOfStates)
+{
+    return kIOReturnSuccess;
+}
+
+IOReturn IOService::joinPMtree(IOService* driver)
+{
+    return kIOReturnSuccess;
+}
+
+bool IODTNVRAM::init(IORegistryEntry* old, const IORegistryPlane* plane)
+{
+    return IORegistryEntry::init(old, plane);
+}
+
+void IODTNVRAM::registerNVRAMController(IONVRAMController* nvram) { }
+void IODTNVRAM::sync(void) { }
+IOReturn IODTNVRAM::syncOFVariables(void) { return kIOReturnSuccess; }
+
+IOReturn IODTNVRAM::readXPRAM(IOByteCount offset, UInt8* buffer, IOByteCount length) { return kIOReturnUnsupported; }
+IOReturn IODTNVRAM::writeXPRAM(IOByteCount offset, UInt8* buffer, IOByteCount length) { return kIOReturnUnsupported; }
+IOReturn IODTNVRAM::readNVRAMProperty(IORegistryEntry* entry, const OSSymbol** name, OSData** value) { return kIOReturnUnsupported; }
+IOReturn IODTNVRAM::writeNVRAMProperty(IORegistryEntry* entry, const OSSymbol* name, OSData* value) { return kIOReturnUnsupported; }
+
+OSDictionary* IODTNVRAM::getNVRAMPartitions(void) { return NULL; }
+IOReturn IODTNVRAM::readNVRAMPartition(const OSSymbol* partitionID, IOByteCount offset, UInt8* buffer, IOByteCount length) { return kIOReturnNotFound; }
+IOReturn IODTNVRAM::writeNVRAMPartition(const OSSymbol* partitionID, IOByteCount offset, UInt8* buffer, IOByteCount length) { return kIOReturnNotFound; }
+
+IOByteCount IODTNVRAM::savePanicInfo(UInt8* buffer, IOByteCount length) { return 0; }
+bool IODTNVRAM::safeToSync(void) { return true; }
+
+OSDefineMetaClassAndAbstractStructors(IOUserClient, IOService)
+
+void xnu_set_client_privilege(IOReturn result)
+{
+    gClientPrivilege = result;
+}
+
+IOReturn IOUserClient::clientHasPrivilege(void* securityToken, const char* privilegeName)
+{
+    return gClientPrivilege;
+}
+
+/********************************************************************/
+/**                     Work loops                                 **/
+/********************************************************************/
+
+OSDefineMetaClassAndAbstractStructors(IOEventSource, OSObject)
+OSDefineMetaClassAndStructors(IOWorkLoop, OSObject)
+OSDefineMetaClassAndStructors(IOCommandGate, IOEventSource)
+OSDefineMetaClassAndStructors(IOTimerEventSource, IOEventSource)
+
+bool IOEventSource::init(OSObject* inOwner)
+{
+    owner = inOwner;
+    return OSObject::init();
+}
+
+IOWorkLoop* IOWorkLoop::workLoop()
+{
+    IOWorkLoop* me = new IOWorkLoop;
+    pthread_mutexattr_t attributes;
+
+    if(!me) return NULL;
+
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&me->gateLock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+
+    if(!(me->eventSources = OSArray::withCapacity(4)))
+    {
+        me->release();
+        return NULL;
+    }
+
+    return me;
+}
+
+void IOWorkLoop::free()
+{
+    OSSafeReleaseNULL(eventSources);
+    pthread_mutex_destroy(&gateLock);
+    OSObject::free();
+}
+
+IOReturn IOWorkLoop::addEventSource(IOEventSource* newEvent)
+{
+    bool added;
+
+    closeGate();
+    if((added = eventSources->setObject(newEvent))) newEvent->workLoop = this;
+    openGate();
+
+    return added ? kIOReturnSuccess : kIOReturnNoMemory;
+}
+
+IOReturn IOWorkLoop::removeEventSource(IOEventSource* toRemove)
+{
+    unsigned int i;
+
+    closeGate();
+    for(i = 0; i < eventSources->getCount(); i++)
+    {
+        if(eventSources->getObject(i) == toRemove)
+        {
+            toRemove->workLoop = NULL;
+            eventSources->removeObject(i);
+            break;
+        }
+    }
+    openGate();
+
+    return kIOReturnSuccess;
+}
+
+void IOWorkLoop::closeGate()
+{
+    pthread_mutex_lock(&gateLock);
+}
+
+void IOWorkLoop::openGate()
+{
+    pthread_mutex_unlock(&gateLock);
+}
+
+IOCommandGate* IOCommandGate::commandGate(OSObject* owner, Action action)
+{
+    IOCommandGate* me = new IOCommandGate;
+
+    if(me && !me->init(owner))
+    {
+        me->release();
+        return NULL;
+    }
+
+    if(me) me->action = action;
+    return me;
+}
+
+IOReturn IOCommandGate::runCommand(void* arg0, void* arg1, void* arg2, void* arg3)
+{
+    IOWorkLoop* wl = workLoop;
+    IOReturn result;
+
+    if(!wl) return kIOReturnNotReady;
+    if(!action) return kIOReturnBadArgument;
+
+    wl->closeGate();
+    result = action(owner, arg0, arg1, arg2, arg3);
+    wl->openGate();
+
+    return result;
+}
+
+IOTimerEventSource* IOTimerEventSource::timerEventSource(OSObject* owner, Action action)
+{
+    IOTimerEventSource* me = new IOTimerEventSource;
+
+    if(me && !me->init(owner))
+    {
+        me->release();
+        return NULL;
+    }
+
+    if(me) me->action = action;
+    return me;
+}
+
+IOReturn IOTimerEventSource::setTimeoutMS(UInt32 ms)
+{
+    timeoutMS = ms;
+    armed = true;
+    return kIOReturnSuccess;
+}
+
+void IOTimerEventSource::cancelTimeout()
+{
+    armed = false;
+}
+
+/** The action may remove and release the timer, so both it and the work loop are held until it returns **/
+bool IOTimerEventSource::fire()
+{
+    IOWorkLoop* wl = workLoop;
+
+    if(!armed || !wl) return false;
+
+    retain();
+    wl->retain();
+    wl->closeGate();
+
+    armed = false;
+    if(action) action(owner, this);
+
+    wl->openGate();
+    wl->release();
+    release();
+
+    return true;
+}
@@ -0,0 +1,35 @@
+/*
+ *  libsaio.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_LIBSAIO_H
+#define __TEST_LIBSAIO_H
+
+/**
+ ** The tools' libsaio, plus what the rest of the module needs from the booter. Volumes are directories named
+ ** hd(<unit>,<partition>) below the test's root, see host/chameleon.c.
+ **/
+#include_next <libsaio.h>
+
+/** Paths are Chameleon's: hd(x,y)/path, bt(0,0)/path or /path on the boot volume **/
+#define open(path, flags)   host_open(path, flags)
+#define malloc(size)        host_malloc(size)
+
+int     host_open(const char* path, int flags);
+void*   host_malloc(size_t size);
+
+extern BVRef bvChain;
+extern BVRef gBootVolume;
+
+long    GetFileInfo(const char* dirSpec, const char* name, long* flags, long* time);
+BVRef   getBootVolumeRef(const char* path, const char** outPath);
+
+#endif /* !__TEST_LIBSAIO_H */
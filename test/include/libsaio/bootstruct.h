@@ -0,0 +1,33 @@
+/*
+ *  bootstruct.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_LIBSAIO_BOOTSTRUCT_H
+#define __TEST_LIBSAIO_BOOTSTRUCT_H
+
+#include "libsaio.h"
+
+/** Boot options come from the test, see host_set_options **/
+typedef struct
+{
+    const char* keys;       /* space separated keys set to Yes */
+} config_file_t;
+
+typedef struct
+{
+    config_file_t chameleonConfig;
+} PrivateBootInfo_t;
+
+extern PrivateBootInfo_t* bootInfo;
+
+bool    getBoolForKey(const char* key, bool* value, config_file_t* config);
+
+#endif /* !__TEST_LIBSAIO_BOOTSTRUCT_H */
@@ -0,0 +1,23 @@
+/*
+ *  convert.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_LIBSAIO_CONVERT_H
+#define __TEST_LIBSAIO_CONVERT_H
+
+#include "libsaio.h"
+
+typedef uint8_t EFI_CHAR8;
+
+/** Formatted into a static buffer shared by every caller, like Chameleon's **/
+const char* getStringFromUUID(const EFI_CHAR8* uuid);
+
+#endif /* !__TEST_LIBSAIO_CONVERT_H */
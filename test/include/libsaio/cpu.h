@@ -0,0 +1,21 @@
+/*
+ *  cpu.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_LIBSAIO_CPU_H
+#define __TEST_LIBSAIO_CPU_H
+
+#include "libsaio.h"
+
+/** The host's monotonic clock in ns, Platform.CPU.TSCFrequency is 1GHz to match **/
+uint64_t    rdtsc64(void);
+
+#endif /* !__TEST_LIBSAIO_CPU_H */
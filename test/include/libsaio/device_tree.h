@@ -0,0 +1,46 @@
+/*
+ *  device_tree.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_LIBSAIO_DEVICE_TREE_H
+#define __TEST_LIBSAIO_DEVICE_TREE_H
+
+#include "libsaio.h"
+
+/** Chameleon's device tree, properties reference the caller's name and value until the tree is flattened **/
+typedef struct _Property
+{
+    const char*         name;
+    uint32_t            length;
+    void*               value;
+    struct _Property*   next;
+} Property;
+
+typedef struct _Node
+{
+    struct _Property*   properties;
+    struct _Property*   last_prop;
+    struct _Node*       children;
+    struct _Node*       next;
+} Node;
+
+Property*   DT__AddProperty(Node* node, const char* name, uint32_t length, void* value);
+Node*       DT__AddChild(Node* parent, const char* name);
+Node*       DT__FindNode(const char* path, bool createIfMissing);
+char*       DT__GetName(Node* node);
+
+/** Host only: lookups for checking what was injected, and dropping the whole tree **/
+Node*       DT__FindChild(Node* parent, const char* name);
+Property*   DT__FindProperty(Node* node, const char* name);
+int         DT__CountProperties(Node* node);
+void        DT__Reset(void);
+
+#endif /* !__TEST_LIBSAIO_DEVICE_TREE_H */
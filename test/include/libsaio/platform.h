@@ -0,0 +1,32 @@
+/*
+ *  platform.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_LIBSAIO_PLATFORM_H
+#define __TEST_LIBSAIO_PLATFORM_H
+
+#include "libsaio.h"
+
+#define UUID_LEN    16
+
+typedef struct
+{
+    struct
+    {
+        uint64_t    TSCFrequency;   /* rdtsc64 counts ns on the host */
+    } CPU;
+
+    uint8_t*        UUID;
+} PlatformInfo_t;
+
+extern PlatformInfo_t Platform;
+
+#endif /* !__TEST_LIBSAIO_PLATFORM_H */
@@ -0,0 +1,78 @@
+/*
+ *  smbios_getters.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_LIBSAIO_SMBIOS_GETTERS_H
+#define __TEST_LIBSAIO_SMBIOS_GETTERS_H
+
+#include "libsaio.h"
+#include <stddef.h>
+#include <libsaio/convert.h>
+#include <libsaio/platform.h>
+
+typedef uint8_t     SMBByte;
+typedef uint16_t    SMBWord;
+typedef uint32_t    SMBDWord;
+typedef uint8_t     SMBString;
+
+#define SMBIOS_ORIGINAL     0
+#define SMBIOS_PATCHED      1
+
+enum
+{
+    kSMBTypeBIOSInformation     = 0,
+    kSMBTypeSystemInformation   = 1,
+    kSMBTypeBaseBoard           = 2,
+    kSMBTypeEndOfTable          = 127
+};
+
+typedef struct
+{
+    SMBByte     anchor[5];
+    SMBByte     checksum;
+    SMBWord     tableLength;
+    uintptr_t   tableAddress;       /* SMBDWord in the firmware, host tables live above 4GB */
+    SMBWord     structureCount;
+    SMBByte     bcdRevision;
+} __attribute__((packed)) DMIEntryPoint;
+
+typedef struct
+{
+    SMBByte     anchor[4];
+    SMBByte     checksum;
+    SMBByte     entryPointLength;
+    SMBByte     majorVersion;
+    SMBByte     minorVersion;
+    SMBWord     maxStructureSize;
+    SMBByte     entryPointRevision;
+    SMBByte     formattedArea[5];
+    DMIEntryPoint dmi;
+} __attribute__((packed)) SMBEntryPoint;
+
+typedef struct
+{
+    SMBByte     type;
+    SMBByte     length;
+    SMBWord     handle;
+    SMBString   manufacturer;
+    SMBString   productName;
+    SMBString   version;
+    SMBString   serialNumber;
+    SMBByte     uuid[UUID_LEN];
+    SMBByte     wakeupReason;
+    SMBString   skuNumber;
+    SMBString   family;
+} __attribute__((packed)) SMBSystemInformation;
+
+/** The table set with host_set_smbios, NULL without one **/
+SMBEntryPoint*  getSmbios(int which);
+
+#endif /* !__TEST_LIBSAIO_SMBIOS_GETTERS_H */
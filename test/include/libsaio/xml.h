@@ -0,0 +1,68 @@
+/*
+ *  xml.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_LIBSAIO_XML_H
+#define __TEST_LIBSAIO_XML_H
+
+#include "libsaio.h"
+
+/**
+ ** Chameleon's XML tag tree. Dictionaries hold a list of key tags, each pointing at its value through tag.
+ ** Data tags hold the decoded bytes in string and their length in offset, integers hold their value in string.
+ **/
+enum
+{
+    kTagTypeNone = 0,
+    kTagTypeDict,
+    kTagTypeKey,
+    kTagTypeString,
+    kTagTypeInteger,
+    kTagTypeData,
+    kTagTypeDate,
+    kTagTypeFalse,
+    kTagTypeTrue,
+    kTagTypeArray
+};
+
+struct Tag
+{
+    long        type;
+    char*       string;
+    long        offset;
+    struct Tag* tag;
+    struct Tag* tagNext;
+};
+typedef struct Tag Tag, *TagPtr;
+
+/** Parse a whole plist, returns 0 on success. Unlike Chameleon's, buffer is left untouched. **/
+long    XMLParseFile(char* buffer, TagPtr* dict);
+
+TagPtr  XMLGetProperty(TagPtr dict, const char* key);
+bool    XMLAddTagToDictionary(TagPtr dict, char* key, TagPtr value);
+void    XMLFreeTag(TagPtr tag);
+
+TagPtr  XMLCastDict(TagPtr dict);
+char*   XMLCastString(TagPtr dict);
+char*   XMLCastData(TagPtr dict, int* length);
+int     XMLCastInteger(TagPtr dict);
+bool    XMLCastBoolean(TagPtr dict);
+
+bool    XMLIsDict(TagPtr entry);
+bool    XMLIsData(TagPtr entry);
+bool    XMLIsString(TagPtr entry);
+bool    XMLIsInteger(TagPtr entry);
+bool    XMLIsBoolean(TagPtr entry);
+
+/** Tags allocated by the host parser that are still alive, for leak checks **/
+extern long gXMLLiveTags;
+
+#endif /* !__TEST_LIBSAIO_XML_H */
@@ -0,0 +1,22 @@
+/*
+ *  modules.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_MODULES_H
+#define __TEST_MODULES_H
+
+#include_next <modules.h>
+
+/** Callbacks are run by host_run_hook **/
+void    register_hook_callback(const char* name, void (*callback)(void*, void*, void*, void*));
+int     is_module_loaded(const char* name, UInt32 compat);
+
+#endif /* !__TEST_MODULES_H */
@@ -0,0 +1,741 @@
+/*
+ *  kernel_patcher_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+/**
+ ** patch_kernel against synthetic kernels, parsed by the kpatch shim's parse_mach. Each image has a __KLD,__text
+ ** holding readPrelinkedExtensions and a __TEXT,__text holding the functions it calls, with the same slide:
+ **
+ **     FUNCTION + 0x40     call _getsegbyname          first landmark
+ **     FUNCTION + 0x80     call _OSKextLog             the call patched, after its argument setup
+ **     FUNCTION + 0xA0     call _getsegbyname          second landmark
+ **/
+
+#include "test.h"
+#include "kpatch.h"
+#include "kernel_patcher.h"
+#include "arena.h"
+#include "patch_cache.h"
+#include "x86_insn.h"
+
+#define IMAGE_VM            0x800000
+#define KLD_OFFSET          0x1000      /* __KLD,__text */
+#define TEXT_OFFSET         0x2000      /* __TEXT,__text */
+#define SECTION_SIZE        0x1000
+#define SYMTAB_OFFSET       0x3000
+
+#define FUNCTION            0x1400
+#define LANDMARK_CALL1      (FUNCTION + 0x40)
+#define TARGET_CALL         (FUNCTION + 0x80)
+#define LANDMARK_CALL2      (FUNCTION + 0xA0)
+#define GETSEGBYNAME        0x2100
+#define OSKEXTLOG           0x2200
+#define READBOOTER          0x2300
+
+#define SETUP_LENGTH_32     23
+#define SETUP_LENGTH_64     0x12
+
+#define READ_PRELINKED_32   "__ZN12KLDBootstrap23readPrelinkedExtensionsEP7section"
+#define READ_PRELINKED_64   "__ZN12KLDBootstrap23readPrelinkedExtensionsEP10section_64"
+#define READ_BOOTER         "__ZN12KLDBootstrap20readBooterExtensionsEv"
+
+typedef struct
+{
+    UInt8*      bytes;
+    uint32_t    length;
+    bool        is64;
+    uint32_t    command;        /* where the next load command goes */
+} image_t;
+
+typedef struct
+{
+    const char* name;
+    uint32_t    offset;         /* file offset, the symbol's address is IMAGE_VM + offset */
+} image_symbol_t;
+
+/** Every symbol the patcher wants, at the layout above **/
+static image_symbol_t gSymbols[] =
+{
+    { "_getsegbyname",      GETSEGBYNAME },
+    { "_OSKextLog",         OSKEXTLOG },
+    { READ_BOOTER,          READBOOTER },
+    { READ_PRELINKED_32,    FUNCTION },
+    { READ_PRELINKED_64,    FUNCTION },
+};
+
+#define SYMBOL_COUNT    (sizeof(gSymbols) / sizeof(gSymbols[0]))
+
+static void image_init(image_t* image, bool is64)
+{
+    struct mach_header* header;
+
+    image->length = SYMTAB_OFFSET;
+    image->bytes = calloc(1, image->length);
+    image->is64 = is64;
+    image->command = is64 ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+
+    header = (struct mach_header*)image->bytes;
+    header->magic = is64 ? MH_MAGIC_64 : MH_MAGIC;
+    header->cputype = is64 ? 0x01000007 : 7;
+    header->filetype = 2;
+}
+
+static void* image_command(image_t* image, uint32_t cmd, uint32_t size)
+{
+    struct mach_header* header = (struct mach_header*)image->bytes;
+    struct load_command* command = (struct load_command*)&image->bytes[image->command];
+
+    command->cmd = cmd;
+    command->cmdsize = size;
+    header->ncmds++;
+    header->sizeofcmds += size;
+    image->command += size;
+
+    return command;
+}
+
+/** A segment whose count sections split [offset, offset + size) evenly **/
+static void image_segment(image_t* image, const char* segname, const char* const* sectnames, uint32_t count, uint32_t offset, uint32_t size)
+{
+    uint32_t i, each = size / count;
+
+    if(image->is64)
+    {
+        struct segment_command_64* segment = image_command(image, LC_SEGMENT_64, sizeof(*segment) + count * sizeof(struct section_64));
+        struct section_64* sect = (struct section_64*)(segment + 1);
+
+        strncpy(segment->segname, segname, sizeof(segment->segname));
+        segment->vmaddr = IMAGE_VM + offset;
+        segment->vmsize = segment->filesize = size;
+        segment->fileoff = offset;
+        segment->nsects = count;
+
+        for(i = 0; i < count; i++, sect++)
+        {
+            strncpy(sect->sectname, sectnames[i], sizeof(sect->sectname));
+            strncpy(sect->segname, segname, sizeof(sect->segname));
+            sect->addr = IMAGE_VM + offset + i * each;
+            sect->offset = offset + i * each;
+            sect->size = each;
+        }
+    }
+    else
+    {
+        struct segment_command* segment = image_command(image, LC_SEGMENT, sizeof(*segment) + count * sizeof(struct section));
+        struct section* sect = (struct section*)(segment + 1);
+
+        strncpy(segment->segname, segname, sizeof(segment->segname));
+        segment->vmaddr = IMAGE_VM + offset;
+        segment->vmsize = segment->filesize = size;
+        segment->fileoff = offset;
+        segment->nsects = count;
+
+        for(i = 0; i < count; i++, sect++)
+        {
+            strncpy(sect->sectname, sectnames[i], sizeof(sect->sectname));
+            strncpy(sect->segname, segname, sizeof(sect->segname));
+            sect->addr = IMAGE_VM + offset + i * each;
+            sect->offset = offset + i * each;
+            sect->size = each;
+        }
+    }
+}
+
+/** The usual __KLD,__text and __TEXT,__text **/
+static void image_sections(image_t* image)
+{
+    static const char* const text[] = { "__text" };
+
+    image_segment(image, "__KLD", text, 1, KLD_OFFSET, SECTION_SIZE);
+    image_segment(image, "__TEXT", text, 1, TEXT_OFFSET, SECTION_SIZE);
+}
+
+/** The symbol table, with junk other symbols before the given ones. Closes the image, it can't grow after this. **/
+static void image_symtab(image_t* image, const image_symbol_t* symbols, uint32_t count, uint32_t junk)
+{
+    uint32_t entrySize = image->is64 ? sizeof(struct nlist_64) : sizeof(struct nlist);
+    uint32_t nsyms = junk + count;
+    uint32_t stroff = SYMTAB_OFFSET + nsyms * entrySize;
+    uint32_t strsize = 1;
+    uint32_t i;
+
+    for(i = 0; i < count; i++) strsize += strlen(symbols[i].name) + 1;
+    strsize += junk * sizeof("_junk_0000000");
+
+    image->length = stroff + strsize;
+    image->bytes = realloc(image->bytes, image->length);
+    bzero(&image->bytes[SYMTAB_OFFSET], image->length - SYMTAB_OFFSET);
+
+    struct symtab_command* symtab = image_command(image, LC_SYMTAB, sizeof(*symtab));
+    symtab->symoff = SYMTAB_OFFSET;
+    symtab->nsyms = nsyms;
+    symtab->stroff = stroff;
+    symtab->strsize = strsize;
+
+    uint32_t strx = 1;
+    for(i = 0; i < nsyms; i++)
+    {
+        char name[32];
+        const char* string = name;
+        uint32_t offset = TEXT_OFFSET + 0xF00;
+
+        if(i < junk) snprintf(name, sizeof(name), "_junk_%07u", i);
+        else
+        {
+            string = symbols[i - junk].name;
+            offset = symbols[i - junk].offset;
+        }
+
+        if(image->is64)
+        {
+            struct nlist_64* entry = (struct nlist_64*)&image->bytes[SYMTAB_OFFSET + i * entrySize];
+            entry->n_un.n_strx = strx;
+            entry->n_type = N_SECT;
+            entry->n_value = IMAGE_VM + offset;
+        }
+        else
+        {
+            struct nlist* entry = (struct nlist*)&image->bytes[SYMTAB_OFFSET + i * entrySize];
+            entry->n_un.n_strx = strx;
+            entry->n_type = N_SECT;
+            entry->n_value = IMAGE_VM + offset;
+        }
+
+        strcpy((char*)&image->bytes[stroff + strx], string);
+        strx += strlen(string) + 1;
+    }
+}
+
+static void code_call(UInt8* bytes, uint32_t at, uint32_t target)
+{
+    uint32_t rel = target - (at + 5);
+
+    bytes[at] = 0xE8;
+    memcpy(&bytes[at + 1], &rel, sizeof(rel));
+}
+
+/** readPrelinkedExtensions as the compiler leaves it, NOPs around the three calls **/
+static void image_code(image_t* image)
+{
+    // movl $msg,8(%esp); movl $flags,4(%esp); movl $0,(%esp)
+    static const UInt8 setup32[SETUP_LENGTH_32] = { 0xC7, 0x44, 0x24, 0x08, 0x08, 0x75, 0x88, 0x00,
+                                                    0xC7, 0x44, 0x24, 0x04, 0x84, 0x00, 0x01, 0x00,
+                                                    0xC7, 0x04, 0x24, 0x00, 0x00, 0x00, 0x00 };
+    // lea msg(%rip),%rdx; mov $flags,%esi; xor %edi,%edi; xor %ecx,%ecx; xor %eax,%eax
+    static const UInt8 setup64[SETUP_LENGTH_64] = { 0x48, 0x8D, 0x15, 0x10, 0x20, 0x00, 0x00,
+                                                    0xBE, 0x84, 0x00, 0x01, 0x00,
+                                                    0x31, 0xFF, 0x31, 0xC9, 0x31, 0xC0 };
+    UInt8* bytes = image->bytes;
+
+    memset(&bytes[KLD_OFFSET], 0x90, SECTION_SIZE);
+    memset(&bytes[TEXT_OFFSET], 0xC3, SECTION_SIZE);
+
+    code_call(bytes, LANDMARK_CALL1, GETSEGBYNAME);
+    if(image->is64) memcpy(&bytes[TARGET_CALL - SETUP_LENGTH_64], setup64, SETUP_LENGTH_64);
+    else            memcpy(&bytes[TARGET_CALL - SETUP_LENGTH_32], setup32, SETUP_LENGTH_32);
+    code_call(bytes, TARGET_CALL, OSKEXTLOG);
+    code_call(bytes, LANDMARK_CALL2, GETSEGBYNAME);
+    bytes[LANDMARK_CALL2 + 5] = 0xC3;
+}
+
+/** A complete kernel with junk extra symbols **/
+static void image_kernel(image_t* image, bool is64, uint32_t junk)
+{
+    image_init(image, is64);
+    image_sections(image);
+    image_code(image);
+    image_symtab(image, gSymbols, SYMBOL_COUNT, junk);
+}
+
+/** Run patch_kernel on the image, returning what it reported **/
+static char* patch(image_t* image)
+{
+    char* report = NULL;
+    size_t length;
+
+    gReport = open_memstream(&report, &length);
+    gMachLength = image->length;
+    patch_kernel(image->bytes, NULL, NULL, NULL);
+    fclose(gReport);
+    gReport = NULL;
+
+    return report;
+}
+
+/** True if the report has the readPrelinkedExtensions patch in the given state **/
+static bool patched(image_t* image, const char* state)
+{
+    char expected[64];
+    char* report = patch(image);
+    bool found;
+
+    snprintf(expected, sizeof(expected), "readPrelinkedExtensions %s\n", state);
+    found = strstr(report, expected) != NULL;
+
+    free(report);
+    return found;
+}
+
+/** The call was redirected to readBooterExtensions, its setup replaced by NOPs and the new argument **/
+static bool check_patch(const image_t* image)
+{
+    static const UInt8 args32[] = { 0x89, 0x34, 0x24 };
+    static const UInt8 args64[] = { 0x48, 0x89, 0xDF };
+    uint32_t setupLength = image->is64 ? SETUP_LENGTH_64 : SETUP_LENGTH_32;
+    const UInt8* args = image->is64 ? args64 : args32;
+    UInt8 nops[SETUP_LENGTH_32];
+    uint32_t rel;
+
+    x86_nop_fill(nops, setupLength - 3);
+    memcpy(&rel, &image->bytes[TARGET_CALL + 1], sizeof(rel));
+
+    return !memcmp(&image->bytes[TARGET_CALL - setupLength], nops, setupLength - 3) &&
+           !memcmp(&image->bytes[TARGET_CALL - 3], args, 3) &&
+           image->bytes[TARGET_CALL] == 0xE8 &&
+           rel == READBOOTER - (TARGET_CALL + 5);
+}
+
+/** Patch a copy of the image, true if no byte changed **/
+static bool unchanged(image_t* image, const char* state)
+{
+    UInt8* original = malloc(image->length);
+    bool same;
+
+    memcpy(original, image->bytes, image->length);
+    same = patched(image, state) && !memcmp(original, image->bytes, image->length);
+
+    free(original);
+    return same;
+}
+
+/** Arena allocations made patching a kernel with junk extra symbols **/
+static size_t patch_allocations(bool is64, uint32_t junk)
+{
+    image_t image;
+    size_t before = gBootArena.allocations + gPhaseArena.allocations;
+
+    image_kernel(&image, is64, junk);
+    free(patch(&image));
+    free(image.bytes);
+
+    return gBootArena.allocations + gPhaseArena.allocations - before;
+}
+
+TEST(kernel_symbols_among_many)
+{
+    image_t image;
+
+    // The wanted symbols come last, after 50k others
+    image_kernel(&image, true, 50000);
+    CHECK(patched(&image, "applied"));
+    CHECK(check_patch(&image));
+    free(image.bytes);
+
+    image_kernel(&image, false, 50000);
+    CHECK(patched(&image, "applied"));
+    CHECK(check_patch(&image));
+    free(image.bytes);
+}
+
+TEST(kernel_symbols_allocate_nothing)
+{
+    // Capturing symbols costs no memory, only the patch itself allocates
+    CHECK_INT(patch_allocations(true, 50000), patch_allocations(true, 0));
+    CHECK_INT(patch_allocations(false, 50000), patch_allocations(false, 0));
+}
+
+TEST(kernel_symbols_first_definition)
+{
+    image_symbol_t symbols[SYMBOL_COUNT + 1];
+    image_t image;
+
+    // A second _OSKextLog after all symbols were found is never looked at
+    memcpy(symbols, gSymbols, sizeof(gSymbols));
+    symbols[SYMBOL_COUNT].name = "_OSKextLog";
+    symbols[SYMBOL_COUNT].offset = TEXT_OFFSET + 0x800;
+
+    image_init(&image, true);
+    image_sections(&image);
+    image_code(&image);
+    image_symtab(&image, symbols, SYMBOL_COUNT + 1, 0);
+
+    CHECK(patched(&image, "applied"));
+    CHECK(check_patch(&image));
+    free(image.bytes);
+}
+
+TEST(kernel_symbols_missing)
+{
+    size_t i;
+
+    // Without any one of the patch's symbols the kernel is left alone
+    for(i = 0; i < SYMBOL_COUNT; i++)
+    {
+        image_symbol_t symbols[SYMBOL_COUNT];
+        image_t image;
+
+        if(!strcmp(gSymbols[i].name, READ_PRELINKED_32)) continue;
+
+        memcpy(symbols, gSymbols, sizeof(gSymbols));
+        symbols[i] = symbols[SYMBOL_COUNT - 1];
+
+        image_init(&image, true);
+        image_sections(&image);
+        image_code(&image);
+        image_symtab(&image, symbols, SYMBOL_COUNT - 1, 10);
+
+        if(!unchanged(&image, "skipped")) test_fail(__FILE__, __LINE__, gSymbols[i].name);
+        free(image.bytes);
+    }
+}
+
+/** Number of times text occurs in report **/
+static int occurrences(const char* report, const char* text)
+{
+    int count = 0;
+
+    while((report = strstr(report, text)))
+    {
+        report += strlen(text);
+        count++;
+    }
+
+    return count;
+}
+
+TEST(kernel_patch_applies)
+{
+    image_t image;
+    char* report;
+
+    image_kernel(&image, false, 10);
+    report = patch(&image);
+    CHECK(check_patch(&image));
+
+    // Only the patch for this architecture is reported
+    CHECK_INT(occurrences(report, "kernel patch "), 1);
+    CHECK_INT(occurrences(report, "readPrelinkedExtensions applied\n"), 1);
+    free(report);
+    free(image.bytes);
+
+    image_kernel(&image, true, 10);
+    report = patch(&image);
+    CHECK(check_patch(&image));
+    CHECK_INT(occurrences(report, "kernel patch "), 1);
+    CHECK_INT(occurrences(report, "readPrelinkedExtensions applied\n"), 1);
+    free(report);
+    free(image.bytes);
+}
+
+TEST(kernel_patch_last_target_call)
+{
+    image_t image;
+    UInt8 early[5], late[5];
+
+    // Calls to _OSKextLog before the one patched and after the landmark are left alone
+    image_kernel(&image, true, 10);
+    code_call(image.bytes, FUNCTION + 0x10, OSKEXTLOG);
+    code_call(image.bytes, LANDMARK_CALL2 + 0x10, OSKEXTLOG);
+    memcpy(early, &image.bytes[FUNCTION + 0x10], 5);
+    memcpy(late, &image.bytes[LANDMARK_CALL2 + 0x10], 5);
+
+    CHECK(patched(&image, "applied"));
+    CHECK(check_patch(&image));
+    CHECK(!memcmp(early, &image.bytes[FUNCTION + 0x10], 5));
+    CHECK(!memcmp(late, &image.bytes[LANDMARK_CALL2 + 0x10], 5));
+
+    free(image.bytes);
+}
+
+TEST(kernel_patch_needs_landmarks)
+{
+    image_t image;
+
+    // No second _getsegbyname call
+    image_kernel(&image, true, 10);
+    memset(&image.bytes[LANDMARK_CALL2], 0x90, 5);
+    CHECK(unchanged(&image, "not found"));
+    free(image.bytes);
+
+    // The landmark comes first, there's no _OSKextLog call before it
+    image_kernel(&image, false, 10);
+    memset(&image.bytes[TARGET_CALL], 0x90, 5);
+    CHECK(unchanged(&image, "not found"));
+    free(image.bytes);
+
+    // Calls before the function don't count
+    image_kernel(&image, true, 10);
+    memset(&image.bytes[LANDMARK_CALL1], 0x90, 5);
+    code_call(image.bytes, FUNCTION - 0x20, GETSEGBYNAME);
+    CHECK(unchanged(&image, "not found"));
+    free(image.bytes);
+}
+
+TEST(kernel_patch_setup_mismatch)
+{
+    image_t image;
+
+    // movl $msg,0xc(%esp): same length, but not the setup the patch was written for
+    image_kernel(&image, false, 10);
+    image.bytes[TARGET_CALL - SETUP_LENGTH_32 + 3] = 0x0C;
+    CHECK(unchanged(&image, "code mismatch"));
+    free(image.bytes);
+
+    // Immediates are masked out
+    image_kernel(&image, false, 10);
+    image.bytes[TARGET_CALL - SETUP_LENGTH_32 + 4] ^= 0xFF;
+    image.bytes[TARGET_CALL - 1] ^= 0xFF;
+    CHECK(patched(&image, "applied"));
+    free(image.bytes);
+}
+
+TEST(kernel_patch_rejects_images)
+{
+    static const uint32_t magics[] = { 0xBEBAFECA, 0xCAFEBABE, 0 };
+    size_t i;
+
+    // Fat or not a kernel at all, nothing is parsed or patched
+    for(i = 0; i < sizeof(magics) / sizeof(magics[0]); i++)
+    {
+        image_t image;
+        UInt8* original;
+        char* report;
+
+        image_kernel(&image, i & 1, 10);
+        ((struct mach_header*)image.bytes)->magic = magics[i];
+        original = malloc(image.length);
+        memcpy(original, image.bytes, image.length);
+
+        report = patch(&image);
+        CHECK_STR(report, "");
+        CHECK(!memcmp(original, image.bytes, image.length));
+
+        free(report);
+        free(original);
+        free(image.bytes);
+    }
+}
+
+TEST(kernel_patch_instruction_boundaries)
+{
+    image_t image;
+
+    // movabs $imm64,%rax straddles the start of the 64 bit setup, replacing it would cut the instruction in half
+    image_kernel(&image, true, 10);
+    memcpy(&image.bytes[TARGET_CALL - SETUP_LENGTH_64 - 4], "\x48\xB8\x01\x02\x03\x04\x05\x06\x07\x08", 10);
+    memset(&image.bytes[TARGET_CALL - SETUP_LENGTH_64 + 6], 0x90, SETUP_LENGTH_64 - 6);
+    CHECK(unchanged(&image, "code mismatch"));
+    free(image.bytes);
+
+    // The call itself has to be an instruction boundary too
+    image_kernel(&image, true, 10);
+    memcpy(&image.bytes[TARGET_CALL - 2], "\xB8\x00", 2);
+    memset(&image.bytes[TARGET_CALL - SETUP_LENGTH_64], 0x90, SETUP_LENGTH_64 - 2);
+    CHECK(unchanged(&image, "code mismatch"));
+    free(image.bytes);
+
+    // Nothing the decoder knows between the function and the call
+    image_kernel(&image, true, 10);
+    image.bytes[FUNCTION + 0x08] = 0x06;
+    CHECK(unchanged(&image, "code mismatch"));
+    free(image.bytes);
+
+    // Any whole instructions of the right total length are replaced, padded with the fewest NOPs
+    image_kernel(&image, true, 10);
+    memset(&image.bytes[TARGET_CALL - SETUP_LENGTH_64], 0x90, SETUP_LENGTH_64);
+    CHECK(patched(&image, "applied"));
+    CHECK(check_patch(&image));
+    free(image.bytes);
+}
+
+/** Patch the image, then save its patch cache where the next boot reads it **/
+static bool patch_and_save(image_t* image)
+{
+    const void* cache;
+    uint32_t length;
+    bool saved;
+
+    free(patch(image));
+    cache = patch_cache_pending(&length);
+    saved = cache && host_write_file("hd(0,2)" PATCH_CACHE_PATH, cache, length);
+
+    // The next boot starts with nothing pending
+    patch_cache_discard();
+    return saved;
+}
+
+TEST(kernel_patch_cache_hit)
+{
+    BVRef bvr = host_add_volume(0, 2, "Macintosh HD");
+    int is64;
+
+    for(is64 = 0; is64 < 2; is64++)
+    {
+        image_t first, image;
+        uint32_t length;
+        char* report;
+
+        image_kernel(&first, is64, 10);
+        REQUIRE(patch_and_save(&first));
+        patch_cache_read(bvr);
+
+        // The same kernel again: patched from the cache, to the very same bytes, and nothing new to save
+        image_kernel(&image, is64, 10);
+        report = patch(&image);
+        CHECK(strstr(report, "kernel patches applied from " PATCH_CACHE_PATH) != NULL);
+        CHECK_INT(occurrences(report, "kernel patch "), 0);
+        CHECK(image.length == first.length && !memcmp(image.bytes, first.bytes, image.length));
+        CHECK(patch_cache_pending(&length) == NULL);
+
+        free(report);
+        free(image.bytes);
+        free(first.bytes);
+    }
+}
+
+TEST(kernel_patch_cache_miss)
+{
+    BVRef bvr = host_add_volume(0, 2, "Macintosh HD");
+    image_t image;
+    char* report;
+
+    image_kernel(&image, false, 10);
+    REQUIRE(patch_and_save(&image));
+    free(image.bytes);
+    patch_cache_read(bvr);
+
+    // Any change to the text is another kernel, parsed and patched as usual
+    image_kernel(&image, false, 10);
+    image.bytes[FUNCTION + 0x300] = 0xCC;
+    report = patch(&image);
+    CHECK(strstr(report, "applied from") == NULL);
+    CHECK_INT(occurrences(report, "readPrelinkedExtensions applied\n"), 1);
+    CHECK(check_patch(&image));
+    free(report);
+    free(image.bytes);
+
+    // As is the other architecture
+    image_kernel(&image, true, 10);
+    report = patch(&image);
+    CHECK(strstr(report, "applied from") == NULL);
+    CHECK(check_patch(&image));
+    free(report);
+    free(image.bytes);
+}
+
+TEST(kernel_patch_cache_not_built_unpatched)
+{
+    image_t image;
+    uint32_t length;
+
+    // Nothing patched, nothing to cache
+    image_kernel(&image, true, 10);
+    image.bytes[TARGET_CALL] = 0x90;
+    free(patch(&image));
+    CHECK(patch_cache_pending(&length) == NULL);
+    free(image.bytes);
+}
+
+/** A kernel with the given segments in place of image_sections **/
+static void image_kernel_segments(image_t* image, bool is64, void (*segments)(image_t* image))
+{
+    image_init(image, is64);
+    segments(image);
+    image_code(image);
+    image_symtab(image, gSymbols, SYMBOL_COUNT, 10);
+}
+
+/** Segments and sections of a real kernel, __KLD,__text last and sharing its name with others **/
+static void segments_many(image_t* image)
+{
+    static const char* const text[]     = { "__text", "__const", "__cstring", "__ustring" };
+    static const char* const data[]     = { "__data", "__const", "__text", "__bss", "__common" };
+    static const char* const prelink[]  = { "__text", "__info" };
+    static const char* const kld[]      = { "__text", "__cstring", "__const" };
+
+    image_segment(image, "__TEXT", text, 4, TEXT_OFFSET, SECTION_SIZE);
+    image_segment(image, "__DATA", data, 5, TEXT_OFFSET, SECTION_SIZE);
+    image_segment(image, "__PRELINK_TEXT", prelink, 2, TEXT_OFFSET, SECTION_SIZE);
+    image_segment(image, "__KLD", kld, 3, KLD_OFFSET, SECTION_SIZE);
+}
+
+/** __text only in segments that aren't __KLD, and __KLD without it **/
+static void segments_no_kld_text(image_t* image)
+{
+    static const char* const text[]     = { "__text" };
+    static const char* const kld[]      = { "__text_cold", "__textx", "__const" };
+
+    image_segment(image, "__KLDDATA", text, 1, KLD_OFFSET, SECTION_SIZE);
+    image_segment(image, "__KL", text, 1, KLD_OFFSET, SECTION_SIZE);
+    image_segment(image, "__KLD", kld, 3, KLD_OFFSET, SECTION_SIZE);
+    image_segment(image, "__TEXT", text, 1, TEXT_OFFSET, SECTION_SIZE);
+}
+
+static uint32_t gKldSize;
+
+/** __KLD,__text gKldSize bytes long **/
+static void segments_kld_size(image_t* image)
+{
+    static const char* const text[]     = { "__text" };
+
+    image_segment(image, "__KLD", text, 1, KLD_OFFSET, gKldSize);
+    image_segment(image, "__TEXT", text, 1, TEXT_OFFSET, SECTION_SIZE);
+}
+
+TEST(kernel_sections_among_many)
+{
+    image_t image;
+    int is64;
+
+    for(is64 = 0; is64 < 2; is64++)
+    {
+        image_kernel_segments(&image, is64, segments_many);
+        CHECK(patched(&image, "applied"));
+        CHECK(check_patch(&image));
+        free(image.bytes);
+    }
+}
+
+TEST(kernel_sections_matched_by_both_names)
+{
+    image_t image;
+    int is64;
+
+    for(is64 = 0; is64 < 2; is64++)
+    {
+        image_kernel_segments(&image, is64, segments_no_kld_text);
+        CHECK(unchanged(&image, "skipped"));
+        free(image.bytes);
+    }
+}
+
+TEST(kernel_sections_bound_scan)
+{
+    image_t image;
+
+    // The second landmark call ends right at the end of the section
+    gKldSize = LANDMARK_CALL2 + 5 - KLD_OFFSET;
+    image_kernel_segments(&image, false, segments_kld_size);
+    CHECK(patched(&image, "applied"));
+    free(image.bytes);
+
+    // One byte short, its rel32 is past the section and never read
+    gKldSize = LANDMARK_CALL2 + 4 - KLD_OFFSET;
+    image_kernel_segments(&image, false, segments_kld_size);
+    CHECK(unchanged(&image, "not found"));
+    free(image.bytes);
+
+    // A function outside of the section is never searched
+    gKldSize = FUNCTION - KLD_OFFSET;
+    image_kernel_segments(&image, true, segments_kld_size);
+    CHECK(unchanged(&image, "skipped"));
+    free(image.bytes);
+}
@@ -0,0 +1,163 @@
+/*
+ *  kext.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_KEXT_H
+#define __TEST_KEXT_H
+
+/**
+ ** FileNVRAM.kext built against the host shim, see xnu/xnu.h. Like the kext's own build this is a single
+ ** translation unit, so only one file per binary includes it. FileNVRAM.h makes everything public and
+ ** renames the class to AppleNVRAM, tests keep calling it FileNVRAM.
+ **/
+#include "xnu.h"
+#include "host.h"
+
+/* The kext brings its own strstr */
+#define strstr kext_strstr
+#include "../kext/FileNVRAM/FileNVRAM.cpp"
+#undef strstr
+
+/** Where the kext keeps the nvram file, on the boot volume **/
+#define KEXT_VOLUME_UNIT    0
+#define KEXT_VOLUME_PART    2
+
+static IOService* gKextProvider;
+
+/** Give the kernel a boot volume for /Extra **/
+static inline void kext_volume(void)
+{
+    host_add_volume(KEXT_VOLUME_UNIT, KEXT_VOLUME_PART, "Macintosh HD");
+}
+
+/** Load and start the kext with the given boot arguments, NULL if start() failed **/
+static inline FileNVRAM* kext_start(const char* bootArgs)
+{
+    FileNVRAM* nvram = new FileNVRAM;
+
+    xnu_set_boot_args(bootArgs);
+
+    if(!gKextProvider)
+    {
+        gKextProvider = new IOService;
+        gKextProvider->IORegistryEntry::init();
+    }
+
+    if(!nvram->IORegistryEntry::init() || !nvram->start(gKextProvider))
+    {
+        nvram->release();
+        return NULL;
+    }
+
+    return nvram;
+}
+
+/** Fire the kext's timer once, false if it wasn't armed **/
+static inline bool kext_fire(FileNVRAM* nvram)
+{
+    return nvram->mTimer && nvram->mTimer->fire();
+}
+
+/** Start the kext and let it read the nvram file as soon as the root filesystem is up **/
+static inline FileNVRAM* kext_boot(const char* bootArgs)
+{
+    FileNVRAM* nvram = kext_start(bootArgs);
+
+    xnu_publish_resource("IOBSD");
+    if(nvram) kext_fire(nvram);
+
+    return nvram;
+}
+
+static inline void kext_stop(FileNVRAM* nvram)
+{
+    nvram->stop(gKextProvider);
+    nvram->release();
+}
+
+/** Write an nvram file the way doSync does, dict is the serialized NVRAM dictionary **/
+static inline bool kext_write_file(const char* path, const char* dict)
+{
+    size_t length = strlen(NVRAM_FILE_HEADER) + strlen(dict) + strlen(NVRAM_FILE_FOOTER);
+    char* file = (char*)malloc(length + 1);
+    bool ok;
+
+    snprintf(file, length + 1, "%s%s%s", NVRAM_FILE_HEADER, dict, NVRAM_FILE_FOOTER);
+    ok = host_write_file(path, file, length);
+    free(file);
+
+    return ok;
+}
+
+/** Set a variable the way IOKit does from user space **/
+static inline bool kext_set(FileNVRAM* nvram, const char* key, OSObject* value)
+{
+    const OSSymbol* symbol = OSSymbol::withCString(key);
+    bool result = nvram->setProperty(symbol, value);
+
+    symbol->release();
+    value->release();
+    return result;
+}
+
+static inline bool kext_set_string(FileNVRAM* nvram, const char* key, const char* value)
+{
+    return kext_set(nvram, key, OSString::withCString(value));
+}
+
+static inline bool kext_set_data(FileNVRAM* nvram, const char* key, const void* bytes, unsigned int length)
+{
+    return kext_set(nvram, key, OSData::withBytes(bytes, length));
+}
+
+static inline OSObject* kext_get(FileNVRAM* nvram, const char* key)
+{
+    const OSSymbol* symbol = OSSymbol::withCString(key);
+    OSObject* value = nvram->getProperty(symbol);
+
+    symbol->release();
+    return value;
+}
+
+static inline void kext_remove(FileNVRAM* nvram, const char* key)
+{
+    const OSSymbol* symbol = OSSymbol::withCString(key);
+
+    nvram->removeProperty(symbol);
+    symbol->release();
+}
+
+/** The string value of key, or NULL if it isn't an OSString **/
+static inline const char* kext_get_string(FileNVRAM* nvram, const char* key)
+{
+    OSString* string = OSDynamicCast(OSString, kext_get(nvram, key));
+    return string ? string->getCStringNoCopy() : NULL;
+}
+
+/** The bootloader's /chosen/nvram, as the module leaves it in the device tree **/
+static inline IORegistryEntry* kext_dt_nvram(void)
+{
+    IORegistryEntry* chosen = IORegistryEntry::fromPath("/chosen", gIODTPlane);
+    IORegistryEntry* nvram;
+
+    if(!chosen)
+    {
+        chosen = xnu_dt_add_entry(NULL, "chosen");
+        chosen->retain();
+    }
+
+    nvram = xnu_dt_add_entry(chosen, "nvram");
+    chosen->release();
+
+    return nvram;
+}
+
+#endif /* !__TEST_KEXT_H */
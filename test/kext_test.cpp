@@ -0,0 +1,1012 @@
+/*
+ *  kext_test.cpp
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "kext.h"
+#include "test.h"
+
+#define APPLE_GUID  "7C436110-AB2A-4BBB-A880-FE41995C9F82"
+
+/** Boot with the fixture as /Extra/nvram.plist **/
+static FileNVRAM* boot_fixture(const char* name, const char* bootArgs)
+{
+    size_t length;
+    char* file = harness_fixture(name, &length);
+
+    kext_volume();
+    if(!file || !host_write_file(FILE_NVRAM_PATH, file, length))
+    {
+        free(file);
+        return NULL;
+    }
+    free(file);
+
+    return kext_boot(bootArgs);
+}
+
+/** The NVRAM dictionary last written to path **/
+static OSDictionary* read_file(const char* path)
+{
+    size_t length;
+    char* file = (char*)host_read_file(path, &length);
+    OSObject* plist = file ? OSUnserializeXML(file) : NULL;
+    OSDictionary* nvram = NULL;
+
+    if(plist && OSDynamicCast(OSDictionary, plist))
+    {
+        nvram = OSDynamicCast(OSDictionary, ((OSDictionary*)plist)->getObject("NVRAM"));
+        if(nvram) nvram->retain();
+    }
+
+    OSSafeReleaseNULL(plist);
+    free(file);
+    return nvram;
+}
+
+TEST(kext_boot_restores_file)
+{
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    CHECK(nvram->mSafeToSync);
+    CHECK(nvram->mTimer == NULL);
+    CHECK_STR(xnu_platform_function(), "RegisterNVRAM");
+
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-v keepsyms=1 npci=0x2000");
+    CHECK_STR(kext_get_string(nvram, FILE_NVRAM_GUID ":EarlyKeys"), "bluetoothActiveControllerInfo");
+
+    OSData* csr = OSDynamicCast(OSData, kext_get(nvram, APPLE_GUID ":csr-active-config"));
+    CHECK(csr && csr->isEqualTo("g\0\0\0", 4));
+
+    OSNumber* count = OSDynamicCast(OSNumber, kext_get(nvram, "boot-count"));
+    CHECK(count && count->unsigned32BitValue() == 12);
+
+    // GUID dictionaries are flattened into GUID:key
+    CHECK(kext_get(nvram, APPLE_GUID) == NULL);
+
+    kext_stop(nvram);
+}
+
+TEST(kext_boot_without_file)
+{
+    kext_volume();
+
+    FileNVRAM* nvram = kext_boot("");
+    REQUIRE(nvram);
+
+    // Retries until the root filesystem has the file
+    CHECK(nvram->mTimer != NULL);
+    CHECK(!nvram->mSafeToSync);
+    CHECK(kext_get(nvram, "boot-args") == NULL);
+
+    kext_stop(nvram);
+}
+
+TEST(kext_boot_disabled)
+{
+    CHECK(kext_start("-v -NoFileNVRAM") == NULL);
+}
+
+TEST(kext_set_syncs)
+{
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    CHECK(kext_set_string(nvram, "boot-args", "-v"));
+    CHECK(kext_set_data(nvram, APPLE_GUID ":prev-lang:kbd", "de:3", 4));
+    CHECK(kext_set_data(nvram, "new-key", "\x01\x02", 2));
+
+    OSDictionary* file = read_file(FILE_NVRAM_PATH);
+    REQUIRE(file);
+
+    OSString* args = OSDynamicCast(OSString, file->getObject("boot-args"));
+    CHECK(args && args->isEqualTo("-v"));
+
+    OSData* added = OSDynamicCast(OSData, file->getObject("new-key"));
+    CHECK(added && added->isEqualTo("\x01\x02", 2));
+
+    // Only the first separator splits off the GUID
+    OSDictionary* apple = OSDynamicCast(OSDictionary, file->getObject(APPLE_GUID));
+    OSData* lang = apple ? OSDynamicCast(OSData, apple->getObject("prev-lang:kbd")) : NULL;
+    CHECK(lang && lang->isEqualTo("de:3", 4));
+    CHECK(apple && apple->getObject("csr-active-config"));
+
+    // Per boot keys stay out of the file
+    CHECK(!file->getObject(NVRAM_TIMELINE_KEY));
+    CHECK(!file->getObject(NVRAM_STATISTICS_KEY));
+
+    file->release();
+    kext_stop(nvram);
+}
+
+TEST(kext_legacy_keys_become_strings)
+{
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    CHECK(kext_set_data(nvram, "boot-args", "-s", 2));
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-s");
+
+    // The converted string is held no more than a string set directly
+    int retainCount = kext_get(nvram, "boot-args")->getRetainCount();
+    CHECK(kext_set_string(nvram, "boot-args", "-x"));
+    CHECK_INT(retainCount, kext_get(nvram, "boot-args")->getRetainCount());
+
+    kext_stop(nvram);
+}
+
+TEST(kext_remove_syncs)
+{
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    kext_remove(nvram, "SystemAudioVolume");
+    CHECK(kext_get(nvram, "SystemAudioVolume") == NULL);
+
+    OSDictionary* file = read_file(FILE_NVRAM_PATH);
+    REQUIRE(file);
+    CHECK(!file->getObject("SystemAudioVolume"));
+    CHECK(file->getObject("LocationServicesEnabled"));
+
+    file->release();
+    kext_stop(nvram);
+}
+
+TEST(kext_privilege_required)
+{
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    xnu_set_client_privilege(kIOReturnNotPrivileged);
+    CHECK(!kext_set_string(nvram, "boot-args", "-s"));
+    kext_remove(nvram, "boot-args");
+    xnu_set_client_privilege(kIOReturnSuccess);
+
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-v keepsyms=1 npci=0x2000");
+
+    kext_stop(nvram);
+}
+
+TEST(kext_read_only_never_writes)
+{
+    size_t before, after;
+    void* original;
+    void* current;
+
+    kext_volume();
+    original = harness_fixture("nvram.plist", &before);
+    REQUIRE(original);
+    host_write_file(FILE_NVRAM_PATH, original, before);
+
+    FileNVRAM* nvram = kext_boot("-FileNVRAMro");
+    REQUIRE(nvram);
+
+    // Read only trusts the bootloader, the file isn't read either
+    CHECK(kext_get(nvram, "boot-args") == NULL);
+    CHECK(kext_set_string(nvram, "boot-args", "-s"));
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-s");
+
+    current = host_read_file(FILE_NVRAM_PATH, &after);
+    CHECK(current && after == before && !memcmp(current, original, before));
+
+    free(current);
+    free(original);
+    kext_stop(nvram);
+}
+
+TEST(kext_sync_roundtrip)
+{
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    CHECK(kext_set_string(nvram, "escaped", "<&\"'>"));
+    CHECK(kext_set_data(nvram, APPLE_GUID ":SystemAudioVolume", "\0\xff", 2));
+    kext_stop(nvram);
+
+    // The next boot reads back what the last one wrote
+    nvram = kext_boot("");
+    REQUIRE(nvram);
+
+    CHECK_STR(kext_get_string(nvram, "escaped"), "<&\"'>");
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-v keepsyms=1 npci=0x2000");
+
+    OSData* volume = OSDynamicCast(OSData, kext_get(nvram, APPLE_GUID ":SystemAudioVolume"));
+    CHECK(volume && volume->isEqualTo("\0\xff", 2));
+
+    OSData* panic = OSDynamicCast(OSData, kext_get(nvram, "aapl,panic-info"));
+    CHECK(panic && panic->getLength() == 0);
+
+    kext_stop(nvram);
+}
+
+/** /chosen/nvram as the module leaves it: a few variables, the Apple GUID and our own settings **/
+static IORegistryEntry* add_dt_nvram(void)
+{
+    IORegistryEntry* nvram = kext_dt_nvram();
+    IORegistryEntry* apple = xnu_dt_add_entry(nvram, APPLE_GUID);
+    IORegistryEntry* settings = xnu_dt_add_entry(nvram, FILE_NVRAM_GUID);
+
+    nvram->setProperty("boot-args", (void*)"-v", 3);
+    nvram->setProperty("SystemAudioVolume", (void*)"*", 1);
+    apple->setProperty("csr-active-config", (void*)"g\0\0\0", 4);
+    settings->setProperty(NVRAM_SET_FILE_PATH, (void*)"/Extra/nvram.alt.plist", 23);
+    settings->setProperty(NVRAM_SET_VOLUME, (void*)"hd(0,2)", 8);
+
+    return nvram;
+}
+
+TEST(kext_append_key)
+{
+    char key[NVRAM_KEY_BUFFER_SIZE];
+    char name[NVRAM_KEY_BUFFER_SIZE];
+    size_t length;
+
+    CHECK_INT(length = appendKey(key, 0, APPLE_GUID), strlen(APPLE_GUID));
+    CHECK_STR(key, APPLE_GUID);
+
+    CHECK_INT(appendKey(key, length, "boot-args"), length + 10);
+    CHECK_STR(key, APPLE_GUID ":boot-args");
+
+    // Siblings overwrite the previous name in place
+    CHECK_INT(appendKey(key, length, "csr"), length + 4);
+    CHECK_STR(key, APPLE_GUID ":csr");
+
+    // Exactly filling the buffer, nul included, still fits
+    memset(name, 'x', sizeof(name));
+    name[NVRAM_KEY_BUFFER_SIZE - length - 2] = 0;
+    CHECK_INT(appendKey(key, length, name), NVRAM_KEY_BUFFER_SIZE - 1);
+
+    name[NVRAM_KEY_BUFFER_SIZE - length - 2] = 'x';
+    name[NVRAM_KEY_BUFFER_SIZE - length - 1] = 0;
+    CHECK_INT(appendKey(key, length, name), 0);
+}
+
+TEST(kext_restores_device_tree)
+{
+    add_dt_nvram();
+
+    FileNVRAM* nvram = kext_start("-FileNVRAMro");
+    REQUIRE(nvram);
+
+    // Legacy keys come back as strings, data stays data
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-v");
+
+    OSData* volume = OSDynamicCast(OSData, kext_get(nvram, "SystemAudioVolume"));
+    CHECK(volume && volume->isEqualTo("*", 1));
+
+    OSData* csr = OSDynamicCast(OSData, kext_get(nvram, APPLE_GUID ":csr-active-config"));
+    CHECK(csr && csr->isEqualTo("g\0\0\0", 4));
+
+    // The registry's own name property isn't a variable
+    CHECK(kext_get(nvram, "name") == NULL);
+    CHECK(kext_get(nvram, APPLE_GUID ":name") == NULL);
+
+    // Settings were handled while restoring
+    CHECK(nvram->mFilePath && nvram->mFilePath->isEqualTo("/Extra/nvram.alt.plist"));
+    CHECK(nvram->mVolume && nvram->mVolume->isEqualTo("hd(0,2)"));
+
+    kext_stop(nvram);
+}
+
+TEST(kext_restore_skips_long_keys)
+{
+    char name[NVRAM_KEY_BUFFER_SIZE];
+    char guidName[NVRAM_KEY_BUFFER_SIZE * 2];
+    IORegistryEntry* dt = add_dt_nvram();
+    IORegistryEntry* apple = xnu_dt_add_entry(dt, APPLE_GUID);
+
+    // Fits at the top level, not once the GUID is in front of it
+    memset(name, 'k', sizeof(name));
+    name[NVRAM_KEY_BUFFER_SIZE - 10] = 0;
+    dt->setProperty(name, (void*)"1", 1);
+    apple->setProperty(name, (void*)"2", 1);
+    snprintf(guidName, sizeof(guidName), "%s:%s", APPLE_GUID, name);
+
+    FileNVRAM* nvram = kext_start("-FileNVRAMro");
+    REQUIRE(nvram);
+
+    CHECK(kext_get(nvram, name) != NULL);
+    CHECK(kext_get(nvram, guidName) == NULL);
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-v");
+
+    kext_stop(nvram);
+}
+
+TEST(kext_restore_replaces_device_tree_values)
+{
+    size_t length;
+    char* file = harness_fixture("nvram.plist", &length);
+
+    REQUIRE(file);
+    kext_volume();
+    host_write_file("/Extra/nvram.plist", file, length);
+    free(file);
+
+    IORegistryEntry* dt = kext_dt_nvram();
+    dt->setProperty("boot-args", (void*)"-s", 3);
+    dt->setProperty("only-in-dt", (void*)"1", 1);
+
+    FileNVRAM* nvram = kext_boot("");
+    REQUIRE(nvram);
+
+    // The file wins over what the bootloader passed, variables only the bootloader had are kept
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-v keepsyms=1 npci=0x2000");
+    CHECK(kext_get(nvram, "only-in-dt") != NULL);
+    CHECK(kext_get(nvram, "LocationServicesEnabled") != NULL);
+
+    kext_stop(nvram);
+}
+
+/** /chosen/nvram as the module leaves it in lazy mode, only an early variable and the marker **/
+static void add_dt_lazy(void)
+{
+    IORegistryEntry* dt = kext_dt_nvram();
+    IORegistryEntry* settings = xnu_dt_add_entry(dt, FILE_NVRAM_GUID);
+    int lazy = 1;
+
+    dt->setProperty("SystemAudioVolume", (void*)"*", 1);
+    settings->setProperty(NVRAM_LAZY_LOAD, &lazy, sizeof(lazy));
+}
+
+TEST(kext_lazy_reads_file_read_only)
+{
+    size_t before, after;
+    char* file = harness_fixture("nvram.plist", &before);
+
+    REQUIRE(file);
+    kext_volume();
+    host_write_file(FILE_NVRAM_PATH, file, before);
+    add_dt_lazy();
+
+    FileNVRAM* nvram = kext_boot("-FileNVRAMro");
+    REQUIRE(nvram);
+    CHECK(nvram->mLazyLoad);
+
+    // Read only still loads what the bootloader deferred
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-v keepsyms=1 npci=0x2000");
+    CHECK(kext_get(nvram, "LocationServicesEnabled") != NULL);
+    CHECK(kext_get(nvram, APPLE_GUID ":prev-lang:kbd") != NULL);
+
+    // but never writes
+    CHECK(kext_set_string(nvram, "boot-args", "-s"));
+    char* current = (char*)host_read_file(FILE_NVRAM_PATH, &after);
+    CHECK(current && after == before && !memcmp(current, file, before));
+
+    free(current);
+    free(file);
+    kext_stop(nvram);
+}
+
+TEST(kext_lazy_marker_not_saved)
+{
+    size_t length;
+    char* file = harness_fixture("nvram.plist", &length);
+
+    REQUIRE(file);
+    kext_volume();
+    host_write_file(FILE_NVRAM_PATH, file, length);
+    free(file);
+    add_dt_lazy();
+
+    FileNVRAM* nvram = kext_boot("");
+    REQUIRE(nvram);
+    CHECK(nvram->mLazyLoad);
+    CHECK(kext_get(nvram, "LocationServicesEnabled") != NULL);
+
+    CHECK(kext_set_string(nvram, "boot-args", "-s"));
+    kext_stop(nvram);
+
+    // The marker is for this boot only
+    OSDictionary* saved = read_file(FILE_NVRAM_PATH);
+    REQUIRE(saved);
+    OSString* args = OSDynamicCast(OSString, saved->getObject("boot-args"));
+    CHECK(args && args->isEqualTo("-s"));
+    OSDictionary* settings = OSDynamicCast(OSDictionary, saved->getObject(FILE_NVRAM_GUID));
+    CHECK(!settings || !settings->getObject(NVRAM_LAZY_LOAD));
+    CHECK(saved->getObject("LocationServicesEnabled") != NULL);
+    saved->release();
+}
+
+/** An nvram file at path with keys variables **/
+static void write_many(const char* path, long keys)
+{
+    OSDictionary* dict = OSDictionary::withCapacity((unsigned int)keys);
+    OSSerialize* s = OSSerialize::withCapacity(10000);
+    char key[32];
+    long i;
+
+    for(i = 0; i < keys; i++)
+    {
+        snprintf(key, sizeof(key), "variable-%06ld", i);
+        dict->setObject(key, kOSBooleanTrue);
+    }
+
+    kext_volume();
+    dict->serialize(s);
+    kext_write_file(path, s->text());
+
+    s->release();
+    dict->release();
+}
+
+TEST(kext_start_presizes_table)
+{
+    add_dt_nvram();
+
+    unsigned long grows = gOSDictionaryGrows;
+    FileNVRAM* nvram = kext_start("-FileNVRAMro");
+    REQUIRE(nvram);
+
+    // Restored and published without growing, including the timeline published at registration
+    CHECK_INT(gOSDictionaryGrows, grows);
+    CHECK(nvram->getProperty(NVRAM_TIMELINE_KEY) != NULL);
+
+    kext_stop(nvram);
+}
+
+TEST(kext_restore_presizes_table)
+{
+    // The device tree names the file to read
+    write_many("/Extra/nvram.alt.plist", 1000);
+    add_dt_nvram();
+
+    FileNVRAM* nvram = kext_start("");
+    REQUIRE(nvram);
+
+    unsigned long grows = gOSDictionaryGrows;
+    xnu_publish_resource("IOBSD");
+    kext_fire(nvram);
+
+    CHECK(nvram->mSafeToSync);
+    CHECK_INT(gOSDictionaryGrows, grows);
+    CHECK(kext_get(nvram, "variable-000999") == kOSBooleanTrue);
+    CHECK_STR(kext_get_string(nvram, "boot-args"), "-v");
+
+    kext_stop(nvram);
+}
+
+TEST(kext_set_before_restore_kept)
+{
+    write_many(FILE_NVRAM_PATH, 10);
+
+    FileNVRAM* nvram = kext_start("");
+    REQUIRE(nvram);
+
+    // Set while the timer waits for the root filesystem, nothing is written yet
+    CHECK(kext_set_string(nvram, "set-early", "1"));
+    CHECK(kext_set_string(nvram, "variable-000001", "early"));
+    CHECK(!host_file_exists("/Extra/nvram.blob"));
+
+    xnu_publish_resource("IOBSD");
+    kext_fire(nvram);
+
+    CHECK_STR(kext_get_string(nvram, "set-early"), "1");
+    CHECK(kext_get(nvram, "variable-000009") == kOSBooleanTrue);
+
+    // The file is what the last boot saved, it wins over values set before it was read
+    CHECK(kext_get(nvram, "variable-000001") == kOSBooleanTrue);
+
+    kext_stop(nvram);
+}
+
+/** A number in the published statistics, or in one of its histograms **/
+static UInt64 stats_number(OSDictionary* stats, const char* histogram, const char* key)
+{
+    OSDictionary* dict = histogram ? OSDynamicCast(OSDictionary, stats->getObject(histogram)) : stats;
+    OSNumber* number = dict ? OSDynamicCast(OSNumber, dict->getObject(key)) : NULL;
+
+    return number ? number->unsigned64BitValue() : ~0ULL;
+}
+
+TEST(kext_stats_histogram_buckets)
+{
+    NVRAMHistogram histogram;
+
+    bzero(&histogram, sizeof(histogram));
+
+    // Bucket n holds [2^n, 2^(n+1)) us, 0 and 1 share the first
+    statsRecord(&histogram, 0);
+    statsRecord(&histogram, 1);
+    statsRecord(&histogram, 2);
+    statsRecord(&histogram, 3);
+    statsRecord(&histogram, 1023);
+    statsRecord(&histogram, 1024);
+    statsRecord(&histogram, 1ULL << 40);
+
+    CHECK_INT(histogram.buckets[0], 2);
+    CHECK_INT(histogram.buckets[1], 2);
+    CHECK_INT(histogram.buckets[9], 1);
+    CHECK_INT(histogram.buckets[10], 1);
+    CHECK_INT(histogram.buckets[NVRAM_HISTOGRAM_BUCKETS - 1], 1);
+
+    CHECK_INT(histogram.count, 7);
+    CHECK_INT(histogram.total, 0 + 1 + 2 + 3 + 1023 + 1024 + (1LL << 40));
+    CHECK_INT(histogram.max, 1LL << 40);
+}
+
+TEST(kext_stats_max_only_rises)
+{
+    volatile SInt64 max = 0;
+
+    statsMax(&max, 10);
+    statsMax(&max, 5);
+    CHECK_INT(max, 10);
+    statsMax(&max, 11);
+    CHECK_INT(max, 11);
+}
+
+TEST(kext_stats_published)
+{
+    size_t length;
+    char* file = harness_fixture("nvram.plist", &length);
+    free(file);
+
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    CHECK_INT(nvram->mStatistics.bytesRead, length);
+    CHECK(nvram->mStatistics.restoreTime >= 0);
+
+    CHECK(kext_set_string(nvram, "boot-args", "-s"));
+    CHECK(kext_set_string(nvram, "boot-args", "-x"));
+
+    OSDictionary* stats = OSDynamicCast(OSDictionary, kext_get(nvram, NVRAM_STATISTICS_KEY));
+    REQUIRE(stats);
+
+    size_t written;
+    free(host_read_file(FILE_NVRAM_PATH, &written));
+
+    CHECK_INT(stats_number(stats, NULL, "Syncs"), 2);
+    CHECK_INT(stats_number(stats, NULL, "SetProperty"), 2);
+    CHECK_INT(stats_number(stats, NULL, "BytesRead"), length);
+    CHECK(stats_number(stats, NULL, "BytesWritten") >= 2 * (UInt64)written);
+    CHECK_INT(stats_number(stats, NULL, "FileSizeMax"), written > length ? written : length);
+    CHECK(stats_number(stats, NULL, "GetProperty") >= 1);
+
+    CHECK_INT(stats_number(stats, "doSyncLatency", "Count"), 2);
+    CHECK(stats_number(stats, "WriteLatency", "Count") >= 2);
+
+    OSArray* buckets = OSDynamicCast(OSArray, ((OSDictionary*)stats->getObject("doSyncLatency"))->getObject("Log2USBuckets"));
+    CHECK(buckets && buckets->getCount() == NVRAM_HISTOGRAM_BUCKETS);
+
+    // Read only, and never written to the file
+    CHECK(!kext_set_string(nvram, NVRAM_STATISTICS_KEY, "0"));
+    OSDictionary* saved = read_file(FILE_NVRAM_PATH);
+    REQUIRE(saved);
+    CHECK(!saved->getObject(NVRAM_STATISTICS_KEY));
+    OSDictionary* settings = OSDynamicCast(OSDictionary, saved->getObject(FILE_NVRAM_GUID));
+    CHECK(!settings || !settings->getObject("Statistics"));
+    saved->release();
+
+    kext_stop(nvram);
+}
+
+TEST(kext_stats_reset)
+{
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    CHECK(kext_set_string(nvram, "boot-args", "-s"));
+    CHECK(nvram->mStatistics.syncs == 1);
+
+    // Only root resets
+    xnu_set_client_privilege(kIOReturnNotPrivileged);
+    kOSBooleanTrue->retain();
+    CHECK(!kext_set(nvram, NVRAM_RESET_STATISTICS_KEY, kOSBooleanTrue));
+    xnu_set_client_privilege(kIOReturnSuccess);
+    CHECK(nvram->mStatistics.syncs == 1);
+
+    kOSBooleanTrue->retain();
+    CHECK(kext_set(nvram, NVRAM_RESET_STATISTICS_KEY, kOSBooleanTrue));
+    CHECK_INT(nvram->mStatistics.syncs, 0);
+    CHECK_INT(nvram->mStatistics.bytesRead, 0);
+    CHECK_INT(nvram->mStatistics.doSyncLatency.count, 0);
+
+    // Resetting isn't a variable, nothing is stored or written
+    CHECK(nvram->IOService::getProperty(NVRAM_RESET_STATISTICS_KEY) == NULL);
+
+    OSDictionary* stats = OSDynamicCast(OSDictionary, kext_get(nvram, NVRAM_STATISTICS_KEY));
+    REQUIRE(stats);
+    CHECK_INT(stats_number(stats, NULL, "Syncs"), 0);
+
+    kext_stop(nvram);
+}
+
+TEST(kext_stats_read_only_skips)
+{
+    FileNVRAM* nvram = kext_boot("-FileNVRAMro");
+    REQUIRE(nvram);
+
+    CHECK(kext_set_string(nvram, "boot-args", "-s"));
+    CHECK_INT(nvram->mStatistics.syncs, 0);
+    CHECK_INT(nvram->mStatistics.skippedSyncs, 1);
+    CHECK_INT(nvram->mStatistics.setCalls, 1);
+
+    kext_stop(nvram);
+}
+
+/** The published timeline, NULL if it isn't there or isn't valid **/
+static const NVRAMTimeline* published_timeline(FileNVRAM* nvram)
+{
+    OSData* data = OSDynamicCast(OSData, kext_get(nvram, NVRAM_TIMELINE_KEY));
+
+    if(!data || !timelineValid(data->getBytesNoCopy(), data->getLength())) return NULL;
+    return (const NVRAMTimeline*)data->getBytesNoCopy();
+}
+
+static const NVRAMTimelineEntry* timeline_find(const NVRAMTimeline* timeline, UInt8 source, UInt8 phase)
+{
+    for(int i = 0; i < timeline->count; i++)
+    {
+        if(timeline->entries[i].source == source && timeline->entries[i].phase == phase) return &timeline->entries[i];
+    }
+
+    return NULL;
+}
+
+/** A loader timeline as the module forwards it, count entries **/
+static void add_dt_timeline(IORegistryEntry* nvram, int count, UInt32 magic)
+{
+    IORegistryEntry* settings = xnu_dt_add_entry(nvram, FILE_NVRAM_GUID);
+    NVRAMTimeline timeline;
+
+    timelineReset(&timeline);
+    timeline.magic = magic;
+    for(int i = 0; i < count; i++) timelineRecord(&timeline, NVRAM_TIMELINE_LOADER, (UInt8)(i + 1), i * 100, 10);
+
+    settings->setProperty("BootTimeline", &timeline, (unsigned int)(NVRAM_TIMELINE_HEADER_SIZE + count * sizeof(NVRAMTimelineEntry)));
+}
+
+TEST(kext_timeline_record)
+{
+    NVRAMTimeline timeline;
+
+    timelineReset(&timeline);
+    timelineRecord(&timeline, NVRAM_TIMELINE_KEXT, TIMELINE_KEXT_TIMER_WAIT, 10, 50);
+    timelineRecord(&timeline, NVRAM_TIMELINE_KEXT, TIMELINE_KEXT_TIMER_WAIT, 70, 50);
+    timelineRecord(&timeline, NVRAM_TIMELINE_LOADER, TIMELINE_KEXT_TIMER_WAIT, 0, 1);
+
+    // Retries fold into one entry which keeps the first start, the same phase number from another source doesn't
+    CHECK_INT(timeline.count, 2);
+    CHECK_INT(timeline.entries[0].count, 2);
+    CHECK_INT(timeline.entries[0].start, 10);
+    CHECK_INT(timeline.entries[0].duration, 100);
+    CHECK_INT(timeline.entries[1].source, NVRAM_TIMELINE_LOADER);
+
+    for(int i = 0; i < 2 * NVRAM_TIMELINE_ENTRIES; i++) timelineRecord(&timeline, NVRAM_TIMELINE_KEXT, (UInt8)(100 + i), 0, 0);
+    CHECK_INT(timeline.count, NVRAM_TIMELINE_ENTRIES);
+
+    CHECK_STR(timelinePhaseName(NVRAM_TIMELINE_KEXT, TIMELINE_KEXT_READ), "read_buffer");
+    CHECK_STR(timelinePhaseName(NVRAM_TIMELINE_LOADER, TIMELINE_LOADER_HOOK), "FileNVRAM_hook");
+    CHECK_STR(timelinePhaseName(NVRAM_TIMELINE_KEXT, 200), "unknown");
+}
+
+TEST(kext_timeline_valid)
+{
+    NVRAMTimeline timeline;
+    size_t header = NVRAM_TIMELINE_HEADER_SIZE;
+
+    timelineReset(&timeline);
+    timelineRecord(&timeline, NVRAM_TIMELINE_LOADER, TIMELINE_LOADER_SCAN, 0, 1);
+
+    CHECK_INT(header, 8);
+    CHECK(timelineValid(&timeline, header + sizeof(NVRAMTimelineEntry)));
+    CHECK(!timelineValid(&timeline, header + sizeof(NVRAMTimelineEntry) - 1));
+    CHECK(!timelineValid(&timeline, header - 1));
+    CHECK(!timelineValid(NULL, sizeof(timeline)));
+
+    timeline.version++;
+    CHECK(!timelineValid(&timeline, sizeof(timeline)));
+    timeline.version--;
+
+    timeline.count = NVRAM_TIMELINE_ENTRIES + 1;
+    CHECK(!timelineValid(&timeline, sizeof(timeline)));
+}
+
+TEST(kext_timeline_published)
+{
+    kext_volume();
+    write_many(FILE_NVRAM_PATH, 10);
+
+    FileNVRAM* nvram = kext_boot("");
+    REQUIRE(nvram && nvram->mSafeToSync);
+
+    const NVRAMTimeline* timeline = published_timeline(nvram);
+    REQUIRE(timeline);
+
+    // No loader timeline in the device tree, only ours
+    for(int i = 0; i < timeline->count; i++) CHECK_INT(timeline->entries[i].source, NVRAM_TIMELINE_KEXT);
+
+    const UInt8 phases[] = {
+        TIMELINE_KEXT_START, TIMELINE_KEXT_TIMER_WAIT, TIMELINE_KEXT_WAIT_BSD, TIMELINE_KEXT_READ,
+        TIMELINE_KEXT_UNSERIALIZE, TIMELINE_KEXT_RESTORE, TIMELINE_KEXT_REGISTER,
+    };
+    for(size_t i = 0; i < sizeof(phases); i++) CHECK(timeline_find(timeline, NVRAM_TIMELINE_KEXT, phases[i]));
+
+    // Registering comes last, after reading the file
+    const NVRAMTimelineEntry* read = timeline_find(timeline, NVRAM_TIMELINE_KEXT, TIMELINE_KEXT_READ);
+    const NVRAMTimelineEntry* registered = timeline_find(timeline, NVRAM_TIMELINE_KEXT, TIMELINE_KEXT_REGISTER);
+    CHECK(read && registered && registered->start >= read->start);
+
+    kext_stop(nvram);
+}
+
+TEST(kext_timeline_merges_loader)
+{
+    IORegistryEntry* dt = add_dt_nvram();
+    add_dt_timeline(dt, 3, NVRAM_TIMELINE_MAGIC);
+
+    FileNVRAM* nvram = kext_start("-FileNVRAMro");
+    REQUIRE(nvram);
+
+    const NVRAMTimeline* timeline = published_timeline(nvram);
+    REQUIRE(timeline);
+
+    // The loader's phases come first, then ours
+    REQUIRE(timeline->count > 3);
+    for(int i = 0; i < 3; i++)
+    {
+        CHECK_INT(timeline->entries[i].source, NVRAM_TIMELINE_LOADER);
+        CHECK_INT(timeline->entries[i].phase, i + 1);
+        CHECK_INT(timeline->entries[i].start, i * 100);
+    }
+    CHECK(timeline_find(timeline, NVRAM_TIMELINE_KEXT, TIMELINE_KEXT_DT_IMPORT));
+    CHECK(timeline_find(timeline, NVRAM_TIMELINE_KEXT, TIMELINE_KEXT_REGISTER));
+
+    // Published for this boot only, it can't be set
+    CHECK(!kext_set_string(nvram, NVRAM_TIMELINE_KEY, "x"));
+
+    kext_stop(nvram);
+}
+
+TEST(kext_timeline_ignores_bad_loader)
+{
+    IORegistryEntry* dt = add_dt_nvram();
+    add_dt_timeline(dt, 3, 0x12345678);
+
+    FileNVRAM* nvram = kext_start("-FileNVRAMro");
+    REQUIRE(nvram);
+
+    const NVRAMTimeline* timeline = published_timeline(nvram);
+    REQUIRE(timeline);
+    for(int i = 0; i < timeline->count; i++) CHECK_INT(timeline->entries[i].source, NVRAM_TIMELINE_KEXT);
+
+    kext_stop(nvram);
+}
+
+TEST(kext_sync_writes_hint)
+{
+    write_many("/Extra/nvram.alt.plist", 10);
+    add_dt_nvram();
+
+    FileNVRAM* nvram = kext_boot("");
+    REQUIRE(nvram && nvram->mSafeToSync);
+    REQUIRE(kext_set_string(nvram, "boot-args", "-s"));
+
+    // The bootloader volume the module passed on, and the time of the file it read
+    char file[1024], expected[64];
+    struct stat st;
+    REQUIRE(!stat(host_path("/Extra/nvram.alt.plist", file, sizeof(file)), &st));
+    snprintf(expected, sizeof(expected), "hd(0,2) %lu\n", (unsigned long)st.st_mtime);
+
+    char* hint = (char*)host_read_file(FILE_NVRAM_HINT_PATH, NULL);
+    CHECK_STR(hint, expected);
+    free(hint);
+
+    kext_stop(nvram);
+}
+
+TEST(kext_no_hint_without_volume)
+{
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    // Booted without /chosen/nvram, the kext never learned which bootloader volume holds the file
+    CHECK(kext_set_string(nvram, "boot-args", "-s"));
+    CHECK(!host_file_exists(FILE_NVRAM_HINT_PATH));
+
+    kext_stop(nvram);
+}
+
+/**
+ ** fixtures/nvram-kext.plist and nvram-kext.blob are what syncing nvram.plist writes. module_test.c boots the
+ ** module from them, so the two tests together cover a blob going from the kext to the next boot's module.
+ **/
+TEST(kext_sync_writes_blob)
+{
+    size_t plistLength, blobLength, writtenLength;
+    char* plist = harness_fixture("nvram-kext.plist", &plistLength);
+    char* blob = harness_fixture("nvram-kext.blob", &blobLength);
+
+    REQUIRE(plist && blob);
+
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+    nvram->doSync();
+
+    char* written = (char*)host_read_file(FILE_NVRAM_PATH, &writtenLength);
+    CHECK(written && writtenLength == plistLength && !memcmp(written, plist, plistLength));
+    free(written);
+
+    written = (char*)host_read_file(FILE_NVRAM_BLOB_PATH, &writtenLength);
+    CHECK(written && writtenLength == blobLength && !memcmp(written, blob, blobLength));
+    free(written);
+
+    // Stamped with the file's Adler-32, sized to the whole blob
+    const NVRAMBlobHeader* header = (const NVRAMBlobHeader*)blob;
+    CHECK_INT(header->magic, NVRAM_DTBLOB_MAGIC);
+    CHECK_INT(header->length, blobLength);
+    CHECK_INT(header->stamp, adler32(1, (const Bytef*)plist, (uInt)plistLength));
+
+    kext_stop(nvram);
+    free(blob);
+    free(plist);
+}
+
+TEST(kext_sync_writes_default_path)
+{
+    size_t before, after, writtenLength;
+    write_many("/Extra/nvram.alt.plist", 10);
+    char* original = (char*)host_read_file("/Extra/nvram.alt.plist", &before);
+    add_dt_nvram();
+
+    FileNVRAM* nvram = kext_boot("");
+    REQUIRE(nvram && nvram->mSafeToSync && original);
+    REQUIRE(kext_set_string(nvram, "boot-args", "-s"));
+
+    // Whatever file the module read, syncs go to nvram.plist and the blob is stamped against it
+    char* current = (char*)host_read_file("/Extra/nvram.alt.plist", &after);
+    CHECK(current && after == before && !memcmp(current, original, before));
+
+    char* written = (char*)host_read_file(FILE_NVRAM_PATH, &writtenLength);
+    char* blob = (char*)host_read_file(FILE_NVRAM_BLOB_PATH, NULL);
+    REQUIRE(written && blob);
+    CHECK_INT(((const NVRAMBlobHeader*)blob)->stamp, adler32(1, (const Bytef*)written, (uInt)writtenLength));
+
+    kext_stop(nvram);
+    free(blob);
+    free(written);
+    free(current);
+    free(original);
+}
+
+/** The value of a top level property in a blob the kext built **/
+static const char* blob_property(OSData* blob, const char* name, UInt32* length)
+{
+    const UInt8* bytes = (const UInt8*)blob->getBytesNoCopy();
+    const NVRAMBlobHeader* header = (const NVRAMBlobHeader*)bytes;
+    UInt32 offset = sizeof(*header);
+    int depth = 0;
+
+    while(offset < header->length)
+    {
+        const NVRAMBlobRecord* record = (const NVRAMBlobRecord*)(bytes + offset);
+        const char* recordName = (const char*)(record + 1);
+
+        if(record->type == NVRAM_DTBLOB_NODE) depth++;
+        else if(record->type == NVRAM_DTBLOB_END) depth--;
+        else if(!depth && !strcmp(recordName, name))
+        {
+            *length = record->valueLength;
+            return recordName + record->nameLength;
+        }
+
+        offset += (sizeof(*record) + record->nameLength + record->valueLength + 3) & ~3;
+    }
+
+    return NULL;
+}
+
+TEST(kext_blob_values)
+{
+    OSDictionary* dict = OSDictionary::withCapacity(8);
+    OSDictionary* child = OSDictionary::withCapacity(1);
+    OSNumber* number = OSNumber::withNumber(0x1234567890ULL, 64);
+    OSData* data = OSData::withBytes("\0\1", 2);
+    OSString* string = OSString::withCString("a<b>&c");
+    UInt32 length;
+
+    dict->setObject("data", data);
+    dict->setObject("string", string);
+    dict->setObject("number", number);
+    dict->setObject("yes", kOSBooleanTrue);
+    dict->setObject("no", kOSBooleanFalse);
+    dict->setObject("child", child);
+    dict->setObject("a&b", data);
+
+    OSData* blob = blobCreate(dict, 0x1234);
+    REQUIRE(blob);
+    CHECK_INT(blob->getLength() % 4, 0);
+    CHECK_INT(((const NVRAMBlobHeader*)blob->getBytesNoCopy())->length, blob->getLength());
+    CHECK_INT(((const NVRAMBlobHeader*)blob->getBytesNoCopy())->stamp, 0x1234);
+
+    const char* value = blob_property(blob, "data", &length);
+    CHECK(value && length == 2 && !memcmp(value, "\0\1", 2));
+
+    // Like the file the module would otherwise stream, strings and names stay escaped
+    value = blob_property(blob, "string", &length);
+    CHECK(value && length == strlen("a&lt;b&gt;&amp;c") && !memcmp(value, "a&lt;b&gt;&amp;c", length));
+    CHECK(blob_property(blob, "a&amp;b", &length) != NULL);
+
+    // Numbers and booleans are 32 bit, like processDict
+    UInt32 integer;
+    value = blob_property(blob, "number", &length);
+    REQUIRE(value && length == 4);
+    memcpy(&integer, value, 4);
+    CHECK_INT(integer, 0x34567890);
+
+    value = blob_property(blob, "yes", &length);
+    REQUIRE(value && length == 4);
+    memcpy(&integer, value, 4);
+    CHECK_INT(integer, 1);
+
+    CHECK(blob_property(blob, "child", &length) == NULL);
+
+    blob->release();
+    string->release();
+    data->release();
+    number->release();
+    child->release();
+    dict->release();
+}
+
+/** /chosen/nvram with the kernel patch cache the module built this boot **/
+static void add_dt_patch_cache(const void* cache, int length)
+{
+    IORegistryEntry* settings = xnu_dt_add_entry(kext_dt_nvram(), FILE_NVRAM_GUID);
+
+    settings->setProperty(NVRAM_PATCH_CACHE, (void*)cache, length);
+}
+
+TEST(kext_sync_writes_patch_cache)
+{
+    static const char cache[] = "KPCH patch cache bytes, \0 and all";
+    size_t length;
+
+    add_dt_patch_cache(cache, sizeof(cache));
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "");
+    REQUIRE(nvram);
+
+    // Saved with the first sync, byte for byte, and never as a variable
+    CHECK(!host_file_exists(FILE_NVRAM_PATCH_CACHE_PATH));
+    CHECK(kext_set_string(nvram, "boot-args", "-s"));
+
+    char* written = (char*)host_read_file(FILE_NVRAM_PATCH_CACHE_PATH, &length);
+    CHECK(written && length == sizeof(cache) && !memcmp(written, cache, length));
+    free(written);
+
+    OSDictionary* saved = read_file(FILE_NVRAM_PATH);
+    REQUIRE(saved);
+    OSDictionary* settings = OSDynamicCast(OSDictionary, saved->getObject(FILE_NVRAM_GUID));
+    CHECK(!settings || !settings->getObject(NVRAM_PATCH_CACHE));
+    saved->release();
+
+    // Once per boot
+    REQUIRE(host_remove_file(FILE_NVRAM_PATCH_CACHE_PATH));
+    CHECK(kext_set_string(nvram, "boot-args", "-v"));
+    CHECK(!host_file_exists(FILE_NVRAM_PATCH_CACHE_PATH));
+
+    kext_stop(nvram);
+}
+
+TEST(kext_read_only_skips_patch_cache)
+{
+    static const char cache[] = "KPCH";
+
+    add_dt_patch_cache(cache, sizeof(cache));
+    FileNVRAM* nvram = boot_fixture("nvram.plist", "-FileNVRAMro");
+    REQUIRE(nvram);
+
+    CHECK(kext_set_string(nvram, "boot-args", "-s"));
+    CHECK(!host_file_exists(FILE_NVRAM_PATCH_CACHE_PATH));
+
+    kext_stop(nvram);
+}
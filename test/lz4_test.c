@@ -0,0 +1,200 @@
+/*
+ *  lz4_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "lz4.h"
+
+/* fixtures/nvram.plist.lz4 is nvram.plist through lz4 -l -9, like the module Makefile does for the mkext */
+
+/** Decode into a buffer of exactly dstLength bytes, so ASan sees any write past it **/
+static long decode_block(const char* src, size_t srcLength, uint8_t** out, size_t dstLength)
+{
+    uint8_t* in = malloc(srcLength ? srcLength : 1);
+    long length;
+
+    memcpy(in, src, srcLength);
+    *out = malloc(dstLength ? dstLength : 1);
+    length = lz4_decode_block(in, srcLength, *out, dstLength);
+
+    free(in);
+    return length;
+}
+
+TEST(lz4_legacy_fixture)
+{
+    size_t plistLength, frameLength;
+    char* plist = harness_fixture("nvram.plist", &plistLength);
+    char* frame = harness_fixture("nvram.plist.lz4", &frameLength);
+    uint8_t* out = malloc(plistLength);
+
+    REQUIRE(plist && frame);
+    CHECK(frameLength < plistLength);
+
+    CHECK_INT(lz4_decode_legacy((uint8_t*)frame, frameLength, out, plistLength), plistLength);
+    CHECK(!memcmp(out, plist, plistLength));
+
+    // One byte short of room
+    CHECK_INT(lz4_decode_legacy((uint8_t*)frame, frameLength, out, plistLength - 1), -1);
+
+    free(out);
+    free(frame);
+    free(plist);
+}
+
+TEST(lz4_legacy_concatenated)
+{
+    size_t plistLength, frameLength;
+    char* plist = harness_fixture("nvram.plist", &plistLength);
+    char* frame = harness_fixture("nvram.plist.lz4", &frameLength);
+    uint8_t* frames = malloc(2 * frameLength);
+    uint8_t* out = malloc(2 * plistLength);
+
+    REQUIRE(plist && frame);
+
+    // lz4 -l output appended to another repeats the magic
+    memcpy(frames, frame, frameLength);
+    memcpy(frames + frameLength, frame, frameLength);
+
+    CHECK_INT(lz4_decode_legacy(frames, 2 * frameLength, out, 2 * plistLength), 2 * plistLength);
+    CHECK(!memcmp(out, plist, plistLength) && !memcmp(out + plistLength, plist, plistLength));
+
+    free(out);
+    free(frames);
+    free(frame);
+    free(plist);
+}
+
+TEST(lz4_legacy_rejects)
+{
+    size_t frameLength;
+    char* frame = harness_fixture("nvram.plist.lz4", &frameLength);
+    uint8_t* copy = malloc(frameLength + 2);
+    uint8_t out[2048];
+
+    REQUIRE(frame);
+    memcpy(copy, frame, frameLength);
+
+    CHECK_INT(lz4_decode_legacy(copy, 3, out, sizeof(out)), -1);
+    CHECK_INT(lz4_decode_legacy(copy, frameLength - 1, out, sizeof(out)), -1);
+
+    // Bytes after the last block that can't be a block header
+    copy[frameLength] = copy[frameLength + 1] = 0;
+    CHECK_INT(lz4_decode_legacy(copy, frameLength + 2, out, sizeof(out)), -1);
+
+    copy[0] ^= 1;
+    CHECK_INT(lz4_decode_legacy(copy, frameLength, out, sizeof(out)), -1);
+
+    free(copy);
+    free(frame);
+}
+
+TEST(lz4_block_literals)
+{
+    uint8_t* out;
+
+    // 3 literals, no match
+    CHECK_INT(decode_block("\x30" "abc", 4, &out, 3), 3);
+    CHECK(!memcmp(out, "abc", 3));
+    free(out);
+
+    // 15 + 255 + 2 literals, the length runs on while bytes are 255
+    char block[1 + 2 + 272];
+    block[0] = (char)0xF0;
+    block[1] = (char)255;
+    block[2] = 2;
+    memset(&block[3], 'x', 272);
+    CHECK_INT(decode_block(block, sizeof(block), &out, 272), 272);
+    CHECK(out[0] == 'x' && out[271] == 'x');
+    free(out);
+
+    CHECK_INT(decode_block("", 0, &out, 0), 0);
+    free(out);
+}
+
+TEST(lz4_block_matches)
+{
+    uint8_t* out;
+
+    // "ab", then copy 6 from offset 2 (overlapping), then literal "!"
+    CHECK_INT(decode_block("\x22" "ab" "\x02\x00" "\x10" "!", 7, &out, 9), 9);
+    CHECK(!memcmp(out, "abababab!", 9));
+    free(out);
+
+    // Run length: one literal repeated 4 + 15 + 1 times
+    CHECK_INT(decode_block("\x1F" "z" "\x01\x00" "\x01" "\x00", 6, &out, 21), 21);
+    CHECK(out[0] == 'z' && out[20] == 'z');
+    free(out);
+
+    // Non overlapping copy from further back
+    CHECK_INT(decode_block("\x80" "01234567" "\x08\x00" "\x00", 12, &out, 12), 12);
+    CHECK(!memcmp(out, "012345670123", 12));
+    free(out);
+}
+
+TEST(lz4_block_rejects)
+{
+    uint8_t* out;
+
+    CHECK_INT(decode_block("\x30" "ab", 3, &out, 16), -1);                  /* literals past the input */
+    free(out);
+    CHECK_INT(decode_block("\x30" "abc", 4, &out, 2), -1);                  /* literals past the output */
+    free(out);
+    CHECK_INT(decode_block("\x10" "a" "\x00\x00" "\x00", 5, &out, 16), -1); /* offset 0 */
+    free(out);
+    CHECK_INT(decode_block("\x10" "a" "\x02\x00" "\x00", 5, &out, 16), -1); /* before the start */
+    free(out);
+    CHECK_INT(decode_block("\x10" "a" "\x01", 3, &out, 16), -1);            /* truncated offset */
+    free(out);
+    CHECK_INT(decode_block("\x1F" "a" "\x01\x00", 4, &out, 64), -1);        /* truncated match length */
+    free(out);
+    CHECK_INT(decode_block("\xF0", 1, &out, 64), -1);                       /* truncated literal length */
+    free(out);
+    CHECK_INT(decode_block("\x10" "a" "\x01\x00" "\x00", 5, &out, 4), -1);  /* match past the output */
+    free(out);
+}
+
+/** Random corruptions of the fixture frame decode or fail, never touching memory outside the buffers **/
+TEST(lz4_fuzz)
+{
+    size_t frameLength, plistLength;
+    char* frame = harness_fixture("nvram.plist.lz4", &frameLength);
+    char* plist = harness_fixture("nvram.plist", &plistLength);
+    uint32_t state = 13;
+    int round;
+
+    REQUIRE(frame && plist);
+
+    for(round = 0; round < 5000; round++)
+    {
+        uint8_t* copy = malloc(frameLength);
+        uint8_t* out = malloc(plistLength);
+        size_t size = frameLength;
+        int i;
+
+        memcpy(copy, frame, frameLength);
+        for(i = 0; i < 3; i++)
+        {
+            size_t at = 4 + harness_random(&state) % (frameLength - 4);
+            if(harness_random(&state) % 8) copy[at] = (uint8_t)harness_random(&state);
+            else size = at;
+        }
+
+        long length = lz4_decode_legacy(copy, size, out, plistLength);
+        CHECK(length >= -1 && length <= (long)plistLength);
+
+        free(out);
+        free(copy);
+    }
+
+    free(plist);
+    free(frame);
+}
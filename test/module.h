@@ -0,0 +1,91 @@
+/*
+ *  module.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_MODULE_H
+#define __TEST_MODULE_H
+
+/**
+ ** The module's main file, included so its statics can be reached. Only one file per binary includes it,
+ ** the module's other sources are linked as they are. Built without an embedded mkext.
+ **/
+#include "host.h"
+#include "../module/FileNVRAM.c"
+
+#include <libsaio/device_tree.h>
+
+/** Where the module finds the nvram file **/
+#define MODULE_VOLUME_UNIT  0
+#define MODULE_VOLUME_PART  2
+
+/** Add the boot volume holding plist as its nvram file, NULL for none **/
+static inline BVRef module_volume(const char* plist)
+{
+    BVRef bvr = host_add_volume(MODULE_VOLUME_UNIT, MODULE_VOLUME_PART, "Macintosh HD");
+    if(plist) host_write_file("hd(0,2)/Extra/nvram.plist", plist, strlen(plist));
+    return bvr;
+}
+
+/** Load the module and run its ModulesLoaded hook, which finds and reads the nvram file **/
+static inline void module_load(void)
+{
+    FileNVRAM_start();
+    host_run_hook("ModulesLoaded", NULL, NULL, NULL, NULL);
+}
+
+/** The booter is about to start the kernel **/
+static inline void module_inject(void)
+{
+    host_run_hook("DriversLoaded", NULL, NULL, NULL, NULL);
+}
+
+/**
+ ** Property key of /chosen/nvram, or of its child node when child isn't NULL. The module adds the FileNVRAM
+ ** GUID node for its own settings and again for the plist's, so every child of that name is searched.
+ **/
+static inline Property* module_property(const char* child, const char* key)
+{
+    Node* nvram = DT__FindNode("/chosen/nvram", false);
+    Node* node;
+
+    if(!child) return nvram ? DT__FindProperty(nvram, key) : NULL;
+
+    for(node = nvram ? nvram->children : NULL; node; node = node->next)
+    {
+        Property* property = strcmp(DT__GetName(node), child) ? NULL : DT__FindProperty(node, key);
+        if(property) return property;
+    }
+
+    return NULL;
+}
+
+/** True if the property holds exactly the nul terminated string value, with or without the nul **/
+static inline bool module_property_is(const Property* property, const char* value)
+{
+    size_t length = strlen(value);
+
+    return property && (property->length == length || property->length == length + 1) &&
+           !memcmp(property->value, value, length);
+}
+
+/** A plist holding an NVRAM dictionary with the given contents **/
+static inline char* module_plist(const char* nvram)
+{
+    static const char header[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<plist version=\"1.0\">\n<dict>\n<key>NVRAM</key>\n";
+    static const char footer[] = "</dict>\n</plist>\n";
+    size_t length = strlen(header) + strlen(nvram) + strlen(footer) + 1;
+    char* plist = (malloc)(length);
+
+    snprintf(plist, length, "%s%s%s", header, nvram, footer);
+    return plist;
+}
+
+#endif /* !__TEST_MODULE_H */
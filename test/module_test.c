@@ -0,0 +1,806 @@
+/*
+ *  module_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "module.h"
+#include "test.h"
+
+#define APPLE_GUID  "7C436110-AB2A-4BBB-A880-FE41995C9F82"
+
+/** Boot volume with the fixture as its nvram file, loaded but not yet injected **/
+static bool load_fixture(const char* name)
+{
+    char* file = harness_fixture(name, NULL);
+
+    if(!file) return false;
+
+    module_volume(file);
+    module_load();
+    free(file);
+
+    return true;
+}
+
+/** A value tag, as a caller of the public API would build one **/
+static TagPtr make_tag(const char* value)
+{
+    char buffer[256];
+    TagPtr dict = NULL;
+
+    snprintf(buffer, sizeof(buffer), "<dict><key>value</key>%s</dict>", value);
+    if(XMLParseFile(buffer, &dict) || !dict) return NULL;
+
+    return XMLGetProperty(dict, "value");
+}
+
+TEST(module_streams_fixture)
+{
+    int backlight = 0x3f0;
+
+    REQUIRE(load_fixture("nvram.plist"));
+    CHECK(gNVRAMStreamable);
+    CHECK(gNVRAMData == NULL);
+    CHECK_STR(gBootArgs, "-v keepsyms=1 npci=0x2000");
+
+    module_inject();
+
+    Property* volume = module_property(NULL, "SystemAudioVolume");
+    CHECK(volume && volume->length == 1 && *(char*)volume->value == '*');
+
+    Property* level = module_property(NULL, "backlight-level");
+    CHECK(level && level->length == sizeof(int) && !memcmp(level->value, &backlight, sizeof(int)));
+
+    // Strings are injected as they are in the file, like Chameleon's parser the module doesn't decode entities
+    Property* recovery = module_property(NULL, "efi-apple-recovery");
+    CHECK(module_property_is(recovery, "&lt;array&gt;&lt;dict&gt;&lt;/dict&gt;&lt;/array&gt;"));
+
+    Property* panic = module_property(NULL, "aapl,panic-info");
+    CHECK(panic && panic->length == 0);
+
+    Property* csr = module_property(APPLE_GUID, "csr-active-config");
+    CHECK(csr && csr->length == 4 && !memcmp(csr->value, "g\0\0\0", 4));
+
+    // No boot options were entered, the kernel gets empty boot-args
+    CHECK(module_property_is(module_property(NULL, "boot-args"), ""));
+
+    CHECK(module_property_is(module_property(FILE_NVRAM_GULD, NVRAM_SET_VOLUME), "hd(0,2)"));
+    CHECK(module_property_is(module_property(FILE_NVRAM_GULD, NVRAM_SET_FILE_PATH), "/Extra/nvram.plist"));
+    CHECK(module_property_is(module_property(FILE_NVRAM_GULD, NVRAM_EARLY_KEYS), "bluetoothActiveControllerInfo"));
+}
+
+TEST(module_boot_options_kept)
+{
+    char args[] = "-v -s";
+
+    REQUIRE(load_fixture("nvram.plist"));
+
+    host_run_hook("BootOptions", args, args + strlen(args), NULL, NULL);
+    module_inject();
+
+    CHECK(module_property_is(module_property(NULL, "boot-args"), "-v -s"));
+}
+
+TEST(module_clear_args_restores_boot_args)
+{
+    REQUIRE(load_fixture("nvram.plist"));
+
+    host_run_hook("ClearArgs", NULL, NULL, NULL, NULL);
+    CHECK_STR(host_boot_args(), "-v keepsyms=1 npci=0x2000");
+}
+
+TEST(module_idref_needs_parser)
+{
+    REQUIRE(load_fixture("nvram-idref.plist"));
+    CHECK(!gNVRAMStreamable);
+    REQUIRE(gNVRAMData);
+
+    module_inject();
+
+    Property* volume = module_property(NULL, "SystemAudioVolumeDB");
+    CHECK(volume && volume->length == 1 && *(char*)volume->value == '*');
+    CHECK(module_property_is(module_property(NULL, "previous-system-uuid"), "-v"));
+    CHECK(module_property_is(module_property(NULL, "boot-args"), ""));
+}
+
+TEST(module_public_api)
+{
+    REQUIRE(load_fixture("nvram.plist"));
+
+    TagPtr args = getNVRAMVariable("boot-args");
+    CHECK(XMLIsString(args) && !strcmp(XMLCastString(args), "-v keepsyms=1 npci=0x2000"));
+    CHECK(gNVRAMData != NULL);
+    CHECK(!gNVRAMStreamable);
+
+    addNVRAMVariable("added", make_tag("<string>new</string>"));
+    addNVRAMVariable("backlight-level", make_tag("<integer>7</integer>"));
+    removeNVRAMVariable("SystemAudioVolume");
+
+    TagPtr added = getNVRAMVariable("added");
+    CHECK(XMLIsString(added) && !strcmp(XMLCastString(added), "new"));
+    CHECK(getNVRAMVariable("SystemAudioVolume") == NULL);
+    CHECK(getNVRAMVariable("missing") == NULL);
+
+    // Changes made through the API are what the kernel gets
+    module_inject();
+
+    int seven = 7;
+    Property* level = module_property(NULL, "backlight-level");
+    CHECK(level && level->length == sizeof(int) && !memcmp(level->value, &seven, sizeof(int)));
+    CHECK(module_property_is(module_property(NULL, "added"), "new"));
+    CHECK(module_property(NULL, "SystemAudioVolume") == NULL);
+    CHECK(module_property(NULL, "LocationServicesEnabled") != NULL);
+}
+
+TEST(module_without_file)
+{
+    module_volume(NULL);
+    module_load();
+
+    CHECK(gPListBase == NULL);
+    CHECK(getNVRAMVariable("boot-args") == NULL);
+
+    // Nothing found, so no hooks were registered
+    module_inject();
+    CHECK(DT__FindNode("/chosen/nvram", false) == NULL);
+}
+
+TEST(module_disabled)
+{
+    REQUIRE(load_fixture("nvram.plist"));
+
+    host_set_options("NoFileNVRAM");
+    module_inject();
+
+    CHECK(DT__FindNode("/chosen/nvram", false) == NULL);
+}
+
+TEST(module_arena_phases)
+{
+    REQUIRE(load_fixture("nvram.plist"));
+    module_inject();
+
+    // Scratch is gone once each phase ends, the plist and the device tree values stay for the boot
+    CHECK_INT(gPhaseArena.used, 0);
+    CHECK(gPhaseArena.phaseHighWater[ARENA_PHASE_PARSE] >= sizeof("hd(0,2)/Extra/nvram.plist"));
+    CHECK(gBootArena.used > gPListSize);
+    CHECK_INT(gPListBase[gPListSize], 0);
+}
+
+TEST(module_arena_exhausted)
+{
+    char* file = harness_fixture("nvram.plist", NULL);
+
+    REQUIRE(file);
+    module_volume(file);
+    free(file);
+
+    // No heap for the path, nothing is loaded and the scope is still released
+    host_fail_malloc(1);
+    module_load();
+    host_fail_malloc(0);
+
+    CHECK_STR(gNVRAMVolume, "hd(0,2)");
+    CHECK(gPListBase == NULL);
+    CHECK_INT(gPhaseArena.used, 0);
+
+    module_inject();
+    CHECK(DT__FindNode("/chosen/nvram", false) == NULL);
+}
+
+/** The entry for phase in a forwarded timeline, NULL if it didn't run **/
+static const timeline_entry_t* timeline_find(const timeline_t* timeline, uint8_t phase)
+{
+    int i;
+
+    for(i = 0; i < timeline->count; i++)
+    {
+        if(timeline->entries[i].phase == phase) return &timeline->entries[i];
+    }
+
+    return NULL;
+}
+
+TEST(module_timeline_folds_repeats)
+{
+    uint64_t start = timeline_now();
+    int i;
+
+    timeline_record(TIMELINE_LOADER_SCAN, start);
+    timeline_record(TIMELINE_LOADER_SCAN, start);
+    timeline_record(TIMELINE_LOADER_PARSE, start);
+
+    timeline_t* timeline = timeline_get();
+    CHECK_INT(timeline->magic, NVRAM_TIMELINE_MAGIC);
+    CHECK_INT(timeline->version, NVRAM_TIMELINE_VERSION);
+    CHECK_INT(timeline->count, 2);
+    CHECK_INT(timeline->entries[0].phase, TIMELINE_LOADER_SCAN);
+    CHECK_INT(timeline->entries[0].count, 2);
+    CHECK_INT(timeline->entries[0].source, NVRAM_TIMELINE_LOADER);
+    CHECK_INT(timeline->entries[1].count, 1);
+
+    // Phases past the last entry are dropped
+    for(i = 0; i < 2 * NVRAM_TIMELINE_ENTRIES; i++) timeline_record((uint8_t)(100 + i), start);
+    CHECK_INT(timeline->count, NVRAM_TIMELINE_ENTRIES);
+}
+
+TEST(module_timeline_forwarded)
+{
+    REQUIRE(load_fixture("nvram.plist"));
+    module_inject();
+
+    Property* property = module_property(FILE_NVRAM_GULD, NVRAM_TIMELINE_KEY);
+    REQUIRE(property && property->length == sizeof(timeline_t));
+
+    const timeline_t* timeline = (const timeline_t*)property->value;
+    CHECK_INT(timeline->magic, NVRAM_TIMELINE_MAGIC);
+
+    const timeline_entry_t* readplist = timeline_find(timeline, TIMELINE_LOADER_READPLIST);
+    const timeline_entry_t* scan = timeline_find(timeline, TIMELINE_LOADER_SCAN);
+    const timeline_entry_t* parse = timeline_find(timeline, TIMELINE_LOADER_PARSE);
+    const timeline_entry_t* hook = timeline_find(timeline, TIMELINE_LOADER_HOOK);
+    const timeline_entry_t* inject = timeline_find(timeline, TIMELINE_LOADER_INJECT);
+
+    REQUIRE(readplist && scan && parse && hook && inject);
+    CHECK_INT(parse->count, 1);
+
+    // Scanning for the volume and reading the file run inside readplist, injecting inside the hook
+    CHECK(scan->start >= readplist->start && scan->duration <= readplist->duration);
+    CHECK(parse->start >= scan->start && parse->duration <= readplist->duration);
+    CHECK(inject->start >= hook->start && inject->duration <= hook->duration);
+    CHECK(hook->start >= readplist->start);
+}
+
+/** Parse a dictionary, NULL if it isn't one **/
+static TagPtr parse_dict(const char* xml)
+{
+    TagPtr dict = NULL;
+
+    if(XMLParseFile((char*)xml, &dict) || !XMLIsDict(dict)) return NULL;
+    return dict;
+}
+
+TEST(module_process_dict_types)
+{
+    TagPtr dict = parse_dict("<dict>"
+                             "<key>data</key><data>AAEC</data>"
+                             "<key>string</key><string>text</string>"
+                             "<key>integer</key><integer>-5</integer>"
+                             "<key>yes</key><true/>"
+                             "<key>no</key><false/>"
+                             "<key>array</key><array><string>x</string></array>"
+                             "<key>child</key><dict><key>inner</key><string>in</string></dict>"
+                             "</dict>");
+    REQUIRE(dict);
+
+    Node* node = DT__FindNode("/chosen/nvram", true);
+    REQUIRE(processDict(dict, node, false));
+
+    int minus5 = -5, one = 1, zero = 0;
+    Property* data = module_property(NULL, "data");
+    CHECK(data && data->length == 3 && !memcmp(data->value, "\0\1\2", 3));
+    CHECK(module_property_is(module_property(NULL, "string"), "text"));
+
+    Property* integer = module_property(NULL, "integer");
+    CHECK(integer && integer->length == sizeof(int) && !memcmp(integer->value, &minus5, sizeof(int)));
+    Property* yes = module_property(NULL, "yes");
+    CHECK(yes && yes->length == sizeof(int) && !memcmp(yes->value, &one, sizeof(int)));
+    Property* no = module_property(NULL, "no");
+    CHECK(no && no->length == sizeof(int) && !memcmp(no->value, &zero, sizeof(int)));
+
+    // Arrays aren't supported, dictionaries become child nodes
+    CHECK(module_property(NULL, "array") == NULL);
+    CHECK(module_property(NULL, "child") == NULL);
+    CHECK(module_property_is(module_property("child", "inner"), "in"));
+
+    // Anything but a dictionary is nothing to inject
+    CHECK(processDict(XMLGetProperty(dict, "string"), node, false));
+    CHECK(processDict(NULL, node, false));
+}
+
+TEST(module_process_dict_keeps_order)
+{
+    long keys = 10000, i;
+    size_t length = keys * 64 + 32, used = 0;
+    char* xml = malloc(length);
+    char name[32];
+
+    used += snprintf(&xml[used], length - used, "<dict>");
+    for(i = 0; i < keys; i++)
+    {
+        used += snprintf(&xml[used], length - used, "<key>variable-%06ld</key><string>%ld</string>", (i * 7919) % keys, i);
+    }
+    snprintf(&xml[used], length - used, "</dict>");
+
+    TagPtr dict = parse_dict(xml);
+    REQUIRE(dict);
+
+    Node* node = DT__FindNode("/chosen/nvram", true);
+    REQUIRE(processDict(dict, node, false));
+
+    // One property per key after the node's name, in file order
+    Property* property = node->properties;
+    CHECK_STR(property->name, "name");
+    property = property->next;
+
+    for(i = 0; i < keys && property; i++, property = property->next)
+    {
+        snprintf(name, sizeof(name), "variable-%06ld", (i * 7919) % keys);
+        CHECK_STR(property->name, name);
+    }
+    CHECK_INT(i, keys);
+    CHECK(property == NULL);
+
+    free(xml);
+}
+
+/** Three volumes with the nvram file on hd(0,2) and a newer one on hd(1,1), the scan hint on the boot volume **/
+static void add_scan_volumes(const char* hint)
+{
+    host_add_volume(0, 1, "EFI");
+    host_add_volume(0, 2, "Macintosh HD");
+    host_add_volume(1, 1, "Backup");
+
+    host_write_file("hd(0,2)/Extra/nvram.plist", "<plist/>", 8);
+    host_write_file("hd(1,1)/Extra/nvram.plist", "<plist/>", 8);
+    host_set_mtime("hd(0,2)/Extra/nvram.plist", 1000);
+    host_set_mtime("hd(1,1)/Extra/nvram.plist", 2000);
+
+    if(hint) host_write_file(NVRAM_HINT_PATH, hint, strlen(hint));
+}
+
+TEST(module_scan_newest_without_hint)
+{
+    extern BVRef bvChain;
+
+    add_scan_volumes(NULL);
+
+    int probes = host_file_probes();
+    BVRef bvr = scanforNVRAM(bvChain);
+
+    // Every volume is probed, the newest file wins
+    REQUIRE(bvr);
+    CHECK_INT(BIOS_DEV_UNIT(bvr), 1);
+    CHECK_INT(host_file_probes() - probes, 3);
+}
+
+TEST(module_scan_hint_probes_once)
+{
+    extern BVRef bvChain;
+
+    add_scan_volumes("hd(0,2) 1000\n");
+
+    int probes = host_file_probes();
+    BVRef bvr = scanforNVRAM(bvChain);
+
+    // The kext last wrote to hd(0,2), newer copies elsewhere aren't looked for
+    REQUIRE(bvr);
+    CHECK_INT(BIOS_DEV_UNIT(bvr), 0);
+    CHECK_INT(bvr->part_no, 2);
+    CHECK_INT(host_file_probes() - probes, 1);
+}
+
+TEST(module_scan_stale_hint)
+{
+    extern BVRef bvChain;
+
+    // The file changed since the kext wrote it
+    add_scan_volumes("hd(0,2) 999\n");
+
+    int probes = host_file_probes();
+    BVRef bvr = scanforNVRAM(bvChain);
+
+    REQUIRE(bvr);
+    CHECK_INT(BIOS_DEV_UNIT(bvr), 1);
+    CHECK_INT(host_file_probes() - probes, 1 + 3);
+}
+
+TEST(module_scan_hint_missing_volume)
+{
+    extern BVRef bvChain;
+
+    add_scan_volumes("hd(3,1) 1000\n");
+
+    int probes = host_file_probes();
+    BVRef bvr = scanforNVRAM(bvChain);
+
+    REQUIRE(bvr);
+    CHECK_INT(BIOS_DEV_UNIT(bvr), 1);
+    CHECK_INT(host_file_probes() - probes, 3);
+}
+
+/** Same properties, values and child nodes, in the same order **/
+static bool same_nodes(Node* a, Node* b)
+{
+    Property* pa = a->properties;
+    Property* pb = b->properties;
+    Node* ca = a->children;
+    Node* cb = b->children;
+
+    for(; pa && pb; pa = pa->next, pb = pb->next)
+    {
+        if(strcmp(pa->name, pb->name) || pa->length != pb->length || memcmp(pa->value, pb->value, pa->length)) return false;
+    }
+    if(pa || pb) return false;
+
+    for(; ca && cb; ca = ca->next, cb = cb->next)
+    {
+        if(!same_nodes(ca, cb)) return false;
+    }
+
+    return !ca && !cb;
+}
+
+/** Stream the plist's NVRAM dictionary into node, with an arena the size of the plist like readplist **/
+static bool stream_plist(const char* plist, int length, Node* node, char** arena)
+{
+    gNVRAMFound = false;
+    gBootArgs = NULL;
+    gEarlyKeys = NULL;
+
+    if(!scanplist(plist, length) || !gNVRAMFound) return false;
+
+    plist_stream_t stream = gNVRAMStream;
+    char* next = *arena = malloc(length);
+    return streamDict(&stream, node, &next, true);
+}
+
+TEST(module_stream_matches_parser)
+{
+    size_t length;
+    char* plist = harness_fixture("nvram.plist", &length);
+    char* copy = strdup(plist);
+    char* arena;
+    TagPtr dict = NULL;
+
+    REQUIRE(plist && !XMLParseFile(copy, &dict) && dict);
+
+    Node* parsed = DT__AddChild(NULL, "nvram");
+    Node* streamed = DT__AddChild(NULL, "nvram");
+
+    REQUIRE(processDict(XMLCastDict(XMLGetProperty(dict, "NVRAM")), parsed, true));
+    REQUIRE(stream_plist(plist, (int)length, streamed, &arena));
+
+    // Both loaders hand the kernel exactly the same device tree
+    CHECK(parsed->properties->next != NULL);
+    CHECK(same_nodes(parsed, streamed));
+
+    free(arena);
+    free(copy);
+    free(plist);
+}
+
+TEST(module_stream_aligns_integers)
+{
+    const char* plist = module_plist("<dict><key>k</key><data>AA==</data><key>number</key><integer>7</integer>"
+                                     "<key>odd</key><data>AAEC</data><key>flag</key><true/></dict>");
+    char* arena;
+    Node* node = DT__AddChild(NULL, "nvram");
+
+    REQUIRE(stream_plist(plist, (int)strlen(plist), node, &arena));
+
+    // Keys and data leave the arena at odd offsets, numbers are still stored aligned
+    Property* number = DT__FindProperty(node, "number");
+    Property* flag = DT__FindProperty(node, "flag");
+    REQUIRE(number && flag);
+    CHECK(((size_t)number->value % sizeof(int)) == 0 && *(int*)number->value == 7);
+    CHECK(((size_t)flag->value % sizeof(int)) == 0 && *(int*)flag->value == 1);
+
+    free(arena);
+    free((void*)plist);
+}
+
+/** Mutated fixtures the scan accepts have to stream within the plist sized arena **/
+TEST(module_stream_fuzz)
+{
+    size_t length;
+    char* fixture = harness_fixture("nvram.plist", &length);
+    uint32_t state = 11;
+    int round, streamed = 0;
+
+    REQUIRE(fixture);
+
+    for(round = 0; round < 1000; round++)
+    {
+        char* plist = malloc(length);
+        size_t size = length;
+        int i;
+
+        memcpy(plist, fixture, length);
+        for(i = 0; i < 4; i++)
+        {
+            size_t at = harness_random(&state) % length;
+            if(harness_random(&state) % 4) plist[at] = "<>/ka0=x"[harness_random(&state) % 8];
+            else size = at ? at : 1;
+        }
+
+        char* arena = NULL;
+        Node* node = DT__AddChild(NULL, "nvram");
+        if(stream_plist(plist, (int)size, node, &arena)) streamed++;
+
+        free(arena);
+        free(plist);
+    }
+
+    // Most mutations only touch values
+    CHECK(streamed > 0);
+    free(fixture);
+}
+
+/** The kext's nvram file and blob on the boot volume, see kext_sync_writes_blob **/
+static bool load_kext_files(bool stale)
+{
+    size_t plistLength, blobLength;
+    char* plist = harness_fixture("nvram-kext.plist", &plistLength);
+    char* blob = harness_fixture("nvram-kext.blob", &blobLength);
+
+    if(!plist || !blob) return false;
+
+    // Edited since the kext wrote it
+    if(stale) plist[strstr(plist, "keepsyms=1") - plist + 9] = '0';
+
+    module_volume(plist);
+    host_write_file("hd(0,2)/Extra/nvram.blob", blob, blobLength);
+    module_load();
+
+    free(blob);
+    free(plist);
+    return true;
+}
+
+TEST(module_blob_injects)
+{
+    REQUIRE(load_kext_files(false));
+    REQUIRE(gNVRAMBlob);
+    CHECK(!gNVRAMStreamable);
+    CHECK(gPListData == NULL);
+    CHECK_STR(gBootArgs, "-v keepsyms=1 npci=0x2000");
+    CHECK_STR(gEarlyKeys, "bluetoothActiveControllerInfo");
+
+    module_inject();
+
+    int backlight = 0x3f0;
+    Property* level = module_property(NULL, "backlight-level");
+    CHECK(level && level->length == sizeof(int) && !memcmp(level->value, &backlight, sizeof(int)));
+    CHECK(module_property_is(module_property(NULL, "efi-apple-recovery"), "&lt;array&gt;&lt;dict&gt;&lt;/dict&gt;&lt;/array&gt;"));
+    CHECK(module_property_is(module_property(APPLE_GUID, "fmm-computer-name"), "Chris&apos;s Mac Pro"));
+    CHECK(module_property_is(module_property(NULL, "boot-args"), ""));
+}
+
+TEST(module_blob_matches_parser)
+{
+    size_t length;
+    char* plist = harness_fixture("nvram-kext.plist", &length);
+    TagPtr dict = NULL;
+
+    REQUIRE(load_kext_files(false) && gNVRAMBlob);
+    REQUIRE(plist && !XMLParseFile(plist, &dict) && dict);
+
+    Node* parsed = DT__AddChild(NULL, "nvram");
+    Node* injected = DT__AddChild(NULL, "nvram");
+
+    // Parsing the file the blob was built from gives exactly the same device tree
+    REQUIRE(processDict(XMLCastDict(XMLGetProperty(dict, "NVRAM")), parsed, false));
+    dtblob_inject(gNVRAMBlob, injected, NULL);
+    CHECK(same_nodes(parsed, injected));
+
+    free(plist);
+}
+
+TEST(module_stale_blob_ignored)
+{
+    REQUIRE(load_kext_files(true));
+    CHECK(gNVRAMBlob == NULL);
+    CHECK(gNVRAMStreamable);
+    CHECK_STR(gBootArgs, "-v keepsyms=0 npci=0x2000");
+}
+
+TEST(module_list_contains)
+{
+    CHECK(listContains("a b,c", "a"));
+    CHECK(listContains("a b,c", "b"));
+    CHECK(listContains("a b,c", "c"));
+    CHECK(listContains("a,,b", "b"));
+
+    // Whole names only
+    CHECK(!listContains("abc", "ab"));
+    CHECK(!listContains("ab", "abc"));
+    CHECK(!listContains("a b", ""));
+    CHECK(!listContains("", "a"));
+    CHECK(!listContains(NULL, "a"));
+}
+
+TEST(module_lazy_streams_early_keys)
+{
+    int lazy = 1;
+
+    REQUIRE(load_fixture("nvram.plist"));
+    CHECK(gNVRAMStreamable);
+
+    host_set_options("FileNVRAMLazy");
+    module_inject();
+
+    // The allowlist, the file's EarlyKeys and our own settings
+    CHECK(module_property(NULL, "SystemAudioVolume") != NULL);
+    CHECK(module_property(NULL, "backlight-level") != NULL);
+    CHECK(module_property(NULL, "bluetoothActiveControllerInfo") != NULL);
+    CHECK(module_property_is(module_property(FILE_NVRAM_GULD, NVRAM_EARLY_KEYS), "bluetoothActiveControllerInfo"));
+
+    // Everything else is left for the kext, which is told to read the file
+    CHECK(module_property(NULL, "LocationServicesEnabled") == NULL);
+    CHECK(module_property(NULL, "efi-apple-recovery") == NULL);
+    CHECK(module_property(NULL, "boot-count") == NULL);
+    CHECK(module_property(NULL, "aapl,panic-info") == NULL);
+    CHECK(module_property(APPLE_GUID, "prev-lang:kbd") == NULL);
+    CHECK_INT(gDeferredKeys, 5);
+
+    Property* marker = module_property(FILE_NVRAM_GULD, NVRAM_LAZY_LOAD);
+    CHECK(marker && marker->length == sizeof(lazy) && !memcmp(marker->value, &lazy, sizeof(lazy)));
+
+    // boot-args is still zero'd out
+    CHECK(module_property_is(module_property(NULL, "boot-args"), ""));
+}
+
+TEST(module_lazy_off_injects_all)
+{
+    REQUIRE(load_fixture("nvram.plist"));
+    module_inject();
+
+    CHECK(module_property(NULL, "LocationServicesEnabled") != NULL);
+    CHECK(module_property(APPLE_GUID, "prev-lang:kbd") != NULL);
+    CHECK(module_property(FILE_NVRAM_GULD, NVRAM_LAZY_LOAD) == NULL);
+    CHECK_INT(gDeferredKeys, 0);
+}
+
+TEST(module_lazy_parsed_early_keys)
+{
+    // IDREF needs the parser, EarlyKeys as data is taken from the XML tree
+    char* plist = module_plist("<dict><key>" FILE_NVRAM_GULD "</key><dict><key>" NVRAM_EARLY_KEYS "</key><data>Yixj</data></dict>"
+                               "<key>a</key><string ID=\"1\">x</string><key>b</key><string IDREF=\"1\"/>"
+                               "<key>c</key><string>y</string><key>SystemAudioVolume</key><data>Kg==</data></dict>");
+
+    module_volume(plist);
+    module_load();
+    free(plist);
+    REQUIRE(gPListData);
+
+    host_set_options("FileNVRAMLazy");
+    module_inject();
+
+    CHECK(module_property(NULL, "a") == NULL);
+    CHECK(module_property_is(module_property(NULL, "b"), "x"));
+    CHECK(module_property_is(module_property(NULL, "c"), "y"));
+    CHECK(module_property(NULL, "SystemAudioVolume") != NULL);
+    CHECK_INT(gDeferredKeys, 1);
+}
+
+TEST(module_lazy_blob_early_keys)
+{
+    REQUIRE(load_kext_files(false) && gNVRAMBlob);
+
+    host_set_options("FileNVRAMLazy");
+    module_inject();
+
+    CHECK(module_property(NULL, "bluetoothActiveControllerInfo") != NULL);
+    CHECK(module_property(NULL, "backlight-level") != NULL);
+    CHECK(module_property(NULL, "LocationServicesEnabled") == NULL);
+    CHECK(module_property(APPLE_GUID, "fmm-computer-name") == NULL);
+    CHECK(module_property(FILE_NVRAM_GULD, NVRAM_LAZY_LOAD) != NULL);
+}
+
+#define PLATFORM_UUID   "00112233-4455-6677-8899-AABBCCDDEEFF"
+
+/** BIOS and system information, the latter systemLength long with uuid in it when that fits **/
+static const uint8_t* smbios_table(const uint8_t* uuid, uint8_t systemLength, uint32_t* length)
+{
+    static uint8_t table[256];
+    SMBSystemInformation* system;
+    uint32_t pos = 0;
+
+    bzero(table, sizeof(table));
+    table[pos + 0] = kSMBTypeBIOSInformation;
+    table[pos + 1] = 0x18;
+    pos += 0x18;
+    memcpy(&table[pos], "Apple Inc.\0IM131.88Z\0", 22);
+    pos += 22;
+
+    system = (SMBSystemInformation*)&table[pos];
+    system->type = kSMBTypeSystemInformation;
+    system->length = systemLength;
+    memset(&system->manufacturer, 0x11, systemLength - 4);
+    if(systemLength >= offsetof(SMBSystemInformation, uuid) + UUID_LEN) memcpy(system->uuid, uuid, UUID_LEN);
+    pos += systemLength;
+    memcpy(&table[pos], "Apple Inc.\0iMac13,2\0", 21);
+    pos += 21;
+
+    table[pos + 0] = kSMBTypeEndOfTable;
+    table[pos + 1] = 4;
+    pos += 4 + 2;
+
+    *length = pos;
+    return table;
+}
+
+/** Boot with the given system information, nvram.plist and nvram.PLATFORM_UUID.plist on the boot volume **/
+static void load_smbios(const uint8_t* uuid, uint8_t systemLength)
+{
+    char* plain = module_plist("<dict><key>boot-args</key><string>-plain</string></dict>");
+    char* platform = module_plist("<dict><key>boot-args</key><string>-platform</string></dict>");
+    uint32_t length;
+    const uint8_t* table = smbios_table(uuid, systemLength, &length);
+
+    host_set_smbios(table, length);
+    module_volume(plain);
+    host_write_file("hd(0,2)/Extra/nvram." PLATFORM_UUID ".plist", platform, strlen(platform));
+    module_load();
+
+    free(platform);
+    free(plain);
+}
+
+static const uint8_t gPlatformUUIDBytes[UUID_LEN] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                                                      0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF };
+
+TEST(module_smbios_uuid_names_file)
+{
+    load_smbios(gPlatformUUIDBytes, sizeof(SMBSystemInformation));
+    CHECK_STR(gBootArgs, "-platform");
+
+    module_inject();
+    CHECK(module_property_is(module_property(FILE_NVRAM_GULD, NVRAM_SET_FILE_PATH), "/Extra/nvram." PLATFORM_UUID ".plist"));
+}
+
+TEST(module_smbios_empty_uuid)
+{
+    static const uint8_t zeros[UUID_LEN];
+
+    // An empty UUID is none at all
+    load_smbios(zeros, sizeof(SMBSystemInformation));
+    CHECK_STR(gBootArgs, "-plain");
+
+    module_inject();
+    CHECK(module_property_is(module_property(FILE_NVRAM_GULD, NVRAM_SET_FILE_PATH), "/Extra/nvram.plist"));
+}
+
+TEST(module_smbios_settable_uuid)
+{
+    uint8_t ones[UUID_LEN];
+
+    memset(ones, 0xFF, sizeof(ones));
+    load_smbios(ones, sizeof(SMBSystemInformation));
+    CHECK_STR(gBootArgs, "-plain");
+}
+
+TEST(module_smbios_2_0)
+{
+    // SMBIOS 2.0 system information ends before the UUID, what follows it isn't read as one
+    load_smbios(gPlatformUUIDBytes, offsetof(SMBSystemInformation, uuid));
+    CHECK_STR(gBootArgs, "-plain");
+}
+
+TEST(module_smbios_without_table)
+{
+    host_set_smbios(NULL, 0);
+    REQUIRE(load_fixture("nvram.plist"));
+    CHECK_STR(gBootArgs, "-v keepsyms=1 npci=0x2000");
+}
+
+TEST(module_smbios_read_once)
+{
+    static const uint8_t other[UUID_LEN] = { 1 };
+    uint32_t length;
+
+    load_smbios(gPlatformUUIDBytes, sizeof(SMBSystemInformation));
+
+    // The UUID found while scanning is the one the kext is told about, the table isn't read again
+    host_set_smbios(smbios_table(other, sizeof(SMBSystemInformation), &length), length);
+    module_inject();
+    CHECK(module_property_is(module_property(FILE_NVRAM_GULD, NVRAM_SET_FILE_PATH), "/Extra/nvram." PLATFORM_UUID ".plist"));
+}
@@ -0,0 +1,308 @@
+/*
+ *  nvram_index_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "nvram_index.h"
+
+#define REFERENCE_KEYS      64
+#define REFERENCE_STEPS     20000
+
+/** An integer tag, allocated by the XML layer so it can free it **/
+static TagPtr make_value(int value)
+{
+    char xml[64];
+    TagPtr dict = NULL;
+    TagPtr tag;
+
+    snprintf(xml, sizeof(xml), "<dict><key>v</key><integer>%d</integer></dict>", value);
+    if(XMLParseFile(xml, &dict) || !dict) return NULL;
+
+    tag = dict->tag->tag;
+    dict->tag->tag = NULL;
+    XMLFreeTag(dict);
+
+    return tag;
+}
+
+static TagPtr make_dict(const char* xml)
+{
+    TagPtr dict = NULL;
+
+    if(XMLParseFile((char*)xml, &dict)) return NULL;
+    return dict;
+}
+
+/** Number of keys in the dictionary, walking the tag list **/
+static int count_keys(TagPtr dict)
+{
+    TagPtr tag;
+    int count = 0;
+
+    for(tag = dict->tag; tag; tag = tag->tagNext) count++;
+    return count;
+}
+
+TEST(nvram_index_build_and_get)
+{
+    long live = gXMLLiveTags;
+    TagPtr dict = make_dict("<dict><key>a</key><integer>1</integer><key>b</key><string>two</string>"
+                            "<key>a</key><integer>3</integer></dict>");
+    nvram_index_t index;
+
+    REQUIRE(dict);
+    REQUIRE(nvram_index_build(&index, dict));
+
+    // Like XMLGetProperty, the first of duplicate keys wins
+    CHECK(nvram_index_get(&index, "a") == XMLGetProperty(dict, "a"));
+    CHECK_INT(XMLCastInteger(nvram_index_get(&index, "a")), 1);
+    CHECK_STR(XMLCastString(nvram_index_get(&index, "b")), "two");
+    CHECK(nvram_index_get(&index, "c") == NULL);
+    CHECK_INT(index.count, 2);
+
+    nvram_index_free(&index);
+    CHECK(index.slots == NULL);
+
+    XMLFreeTag(dict);
+    CHECK_INT(gXMLLiveTags, live);
+}
+
+TEST(nvram_index_not_a_dict)
+{
+    nvram_index_t index;
+
+    CHECK(!nvram_index_build(&index, NULL));
+    CHECK(index.slots == NULL);
+}
+
+TEST(nvram_index_remove_relinks)
+{
+    TagPtr dict = make_dict("<dict><key>a</key><integer>1</integer><key>b</key><integer>2</integer>"
+                            "<key>c</key><integer>3</integer><key>d</key><integer>4</integer></dict>");
+    nvram_index_t index;
+
+    REQUIRE(dict);
+    REQUIRE(nvram_index_build(&index, dict));
+
+    // Middle, head and tail, each unlinked without breaking the keys around it
+    CHECK(nvram_index_remove(&index, "b"));
+    CHECK_INT(XMLCastInteger(nvram_index_get(&index, "c")), 3);
+    CHECK(nvram_index_remove(&index, "a"));
+    CHECK_INT(XMLCastInteger(nvram_index_get(&index, "c")), 3);
+    CHECK(nvram_index_remove(&index, "d"));
+    CHECK(!nvram_index_remove(&index, "d"));
+
+    CHECK_STR(dict->tag->string, "c");
+    CHECK_INT(count_keys(dict), 1);
+
+    // Appended after the new tail
+    CHECK(nvram_index_add(&index, "e", make_value(5)));
+    CHECK_STR(dict->tag->tagNext->string, "e");
+    CHECK_INT(XMLCastInteger(nvram_index_get(&index, "e")), 5);
+
+    CHECK(nvram_index_remove(&index, "c"));
+    CHECK(nvram_index_remove(&index, "e"));
+    CHECK(dict->tag == NULL);
+
+    CHECK(nvram_index_add(&index, "f", make_value(6)));
+    CHECK_STR(dict->tag->string, "f");
+
+    nvram_index_free(&index);
+    XMLFreeTag(dict);
+}
+
+TEST(nvram_index_add_replaces)
+{
+    long live = gXMLLiveTags;
+    TagPtr dict = make_dict("<dict><key>a</key><integer>1</integer><key>b</key><integer>2</integer></dict>");
+    nvram_index_t index;
+
+    REQUIRE(dict);
+    REQUIRE(nvram_index_build(&index, dict));
+
+    // The old key and value are freed, the new one goes last
+    CHECK(nvram_index_add(&index, "a", make_value(10)));
+    CHECK_INT(XMLCastInteger(nvram_index_get(&index, "a")), 10);
+    CHECK_INT(count_keys(dict), 2);
+    CHECK_STR(dict->tag->string, "b");
+    CHECK_STR(dict->tag->tagNext->string, "a");
+
+    nvram_index_free(&index);
+    XMLFreeTag(dict);
+    CHECK_INT(gXMLLiveTags, live);
+}
+
+TEST(nvram_index_remove_uncovers_duplicates)
+{
+    long live = gXMLLiveTags;
+    TagPtr dict = make_dict("<dict><key>a</key><integer>1</integer><key>b</key><integer>2</integer>"
+                            "<key>a</key><integer>3</integer><key>c</key><integer>4</integer>"
+                            "<key>a</key><integer>5</integer></dict>");
+    nvram_index_t index;
+
+    REQUIRE(dict);
+    REQUIRE(nvram_index_build(&index, dict));
+    CHECK_INT(index.shadowed, 2);
+
+    // Each remove takes the first key, the next one of the same name is found just as XMLGetProperty would
+    CHECK(nvram_index_remove(&index, "a"));
+    CHECK(nvram_index_get(&index, "a") == XMLGetProperty(dict, "a"));
+    CHECK_INT(XMLCastInteger(nvram_index_get(&index, "a")), 3);
+
+    // The uncovered key is relinked like any other when its neighbours go
+    CHECK(nvram_index_remove(&index, "b"));
+    CHECK_INT(XMLCastInteger(nvram_index_get(&index, "a")), 3);
+    CHECK(nvram_index_remove(&index, "a"));
+    CHECK_INT(XMLCastInteger(nvram_index_get(&index, "a")), 5);
+    CHECK_INT(index.shadowed, 0);
+
+    CHECK(nvram_index_remove(&index, "a"));
+    CHECK(nvram_index_get(&index, "a") == NULL);
+    CHECK(!nvram_index_remove(&index, "a"));
+    CHECK_STR(dict->tag->string, "c");
+    CHECK_INT(count_keys(dict), 1);
+
+    nvram_index_free(&index);
+    XMLFreeTag(dict);
+    CHECK_INT(gXMLLiveTags, live);
+}
+
+TEST(nvram_index_add_replaces_duplicates)
+{
+    long live = gXMLLiveTags;
+    TagPtr dict = make_dict("<dict><key>a</key><integer>1</integer><key>b</key><integer>2</integer>"
+                            "<key>a</key><integer>3</integer></dict>");
+    nvram_index_t index;
+
+    REQUIRE(dict);
+    REQUIRE(nvram_index_build(&index, dict));
+
+    // Every old copy goes, so the new value is the only one left to find
+    CHECK(nvram_index_add(&index, "a", make_value(10)));
+    CHECK(nvram_index_get(&index, "a") == XMLGetProperty(dict, "a"));
+    CHECK_INT(XMLCastInteger(nvram_index_get(&index, "a")), 10);
+    CHECK_INT(count_keys(dict), 2);
+    CHECK_STR(dict->tag->string, "b");
+    CHECK_STR(dict->tag->tagNext->string, "a");
+
+    CHECK(nvram_index_remove(&index, "a"));
+    CHECK(XMLGetProperty(dict, "a") == NULL);
+
+    nvram_index_free(&index);
+    XMLFreeTag(dict);
+    CHECK_INT(gXMLLiveTags, live);
+}
+
+TEST(nvram_index_grows)
+{
+    TagPtr dict = make_dict("<dict></dict>");
+    nvram_index_t index;
+    char key[32];
+    int i;
+
+    REQUIRE(dict);
+    REQUIRE(nvram_index_build(&index, dict));
+
+    for(i = 0; i < 1000; i++)
+    {
+        snprintf(key, sizeof(key), "variable-%d", i);
+        REQUIRE(nvram_index_add(&index, key, make_value(i)));
+    }
+
+    CHECK_INT(index.count, 1000);
+    CHECK(index.used * 4 <= index.capacity * 3);
+    CHECK_INT(count_keys(dict), 1000);
+
+    for(i = 0; i < 1000; i++)
+    {
+        snprintf(key, sizeof(key), "variable-%d", i);
+        CHECK_INT(XMLCastInteger(nvram_index_get(&index, key)), i);
+    }
+
+    nvram_index_free(&index);
+    XMLFreeTag(dict);
+}
+
+/**
+ ** Random gets, adds and removes checked against a plain model of the dictionary. Keys come from a small
+ ** pool so the same slots are deleted and reused over and over.
+ **/
+TEST(nvram_index_matches_reference)
+{
+    long live = gXMLLiveTags;
+    TagPtr dict = make_dict("<dict></dict>");
+    nvram_index_t index;
+    int order[REFERENCE_KEYS];      /* key numbers in list order */
+    int values[REFERENCE_KEYS];     /* -1 when absent */
+    int count = 0;
+    uint32_t state = 1;
+    char key[32];
+    int step, i, j;
+
+    REQUIRE(dict);
+    REQUIRE(nvram_index_build(&index, dict));
+    for(i = 0; i < REFERENCE_KEYS; i++) values[i] = -1;
+
+    for(step = 0; step < REFERENCE_STEPS; step++)
+    {
+        int k = harness_random(&state) % REFERENCE_KEYS;
+        int op = harness_random(&state) % 3;
+
+        snprintf(key, sizeof(key), "key-%d", k);
+
+        if(op == 0)
+        {
+            REQUIRE(nvram_index_add(&index, key, make_value(step)));
+
+            if(values[k] >= 0)
+            {
+                for(i = 0; order[i] != k; i++);
+                memmove(&order[i], &order[i + 1], (count - i - 1) * sizeof(*order));
+                count--;
+            }
+            order[count++] = k;
+            values[k] = step;
+        }
+        else if(op == 1)
+        {
+            CHECK(nvram_index_remove(&index, key) == (values[k] >= 0));
+
+            if(values[k] >= 0)
+            {
+                for(i = 0; order[i] != k; i++);
+                memmove(&order[i], &order[i + 1], (count - i - 1) * sizeof(*order));
+                count--;
+                values[k] = -1;
+            }
+        }
+
+        TagPtr value = nvram_index_get(&index, key);
+        CHECK(value == XMLGetProperty(dict, key));
+        if(values[k] < 0) CHECK(value == NULL);
+        else              CHECK(value && XMLCastInteger(value) == values[k]);
+
+        if(step % 256) continue;
+
+        // The tag list itself, in order
+        TagPtr tag = dict->tag;
+        for(j = 0; j < count && tag; j++, tag = tag->tagNext)
+        {
+            snprintf(key, sizeof(key), "key-%d", order[j]);
+            CHECK_STR(tag->string, key);
+        }
+        CHECK(j == count && tag == NULL);
+        CHECK_INT(index.count, count);
+    }
+
+    nvram_index_free(&index);
+    XMLFreeTag(dict);
+    CHECK_INT(gXMLLiveTags, live);
+}
@@ -0,0 +1,278 @@
+/*
+ *  patch_cache_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "patch_cache.h"
+
+#define KERNEL_SIZE     256
+#define TEXT_OFFSET     64
+#define TEXT_SIZE       128
+#define TEXT_HASH       0x12345678
+
+/** A kernel whose byte i is i **/
+static uint8_t* kernel_new(void)
+{
+    uint8_t* kernel = malloc(KERNEL_SIZE);
+    int i;
+
+    for(i = 0; i < KERNEL_SIZE; i++) kernel[i] = (uint8_t)i;
+    return kernel;
+}
+
+/** Record a patch of length bytes at offset, each byte inverted **/
+static void record_patch(const uint8_t* kernel, uint32_t offset, uint32_t length)
+{
+    uint8_t patched[64];
+    uint32_t i;
+
+    for(i = 0; i < length; i++) patched[i] = ~kernel[offset + i];
+    patch_cache_record(offset, &kernel[offset], patched, length);
+}
+
+/** Two patches inside the text, bytes 10-14 and 40-47 of it **/
+static const void* build_cache(const uint8_t* kernel, uint32_t* length)
+{
+    patch_cache_begin(TEXT_SIZE, TEXT_HASH);
+    record_patch(kernel, TEXT_OFFSET + 10, 5);
+    record_patch(kernel, TEXT_OFFSET + 40, 8);
+
+    return patch_cache_pending(length);
+}
+
+/** Save a cache the way FileNVRAM.kext does and load it as the next boot would **/
+static void load_cache(const void* cache, uint32_t length)
+{
+    static BVRef bvr;
+
+    if(!bvr) bvr = host_add_volume(0, 2, "Macintosh HD");
+
+    host_write_file("hd(0,2)" PATCH_CACHE_PATH, cache, length);
+    patch_cache_read(bvr);
+}
+
+/** Apply the loaded cache to a fresh kernel, checking it either patched exactly the recorded bytes or nothing **/
+static bool apply(uint32_t textOffset, uint32_t textSize, uint32_t textHash)
+{
+    uint8_t* kernel = kernel_new();
+    bool applied = patch_cache_apply(kernel, textOffset, textSize, textHash);
+    int i;
+
+    for(i = 0; i < KERNEL_SIZE; i++)
+    {
+        bool patched = applied && ((i >= TEXT_OFFSET + 10 && i < TEXT_OFFSET + 15) ||
+                                   (i >= TEXT_OFFSET + 40 && i < TEXT_OFFSET + 48));
+
+        if(kernel[i] != (uint8_t)(patched ? ~i : i))
+        {
+            test_fail(__FILE__, __LINE__, applied ? "wrong bytes patched" : "kernel changed by a rejected cache");
+            break;
+        }
+    }
+
+    free(kernel);
+    return applied;
+}
+
+TEST(patch_cache_format)
+{
+    uint8_t* kernel = kernel_new();
+    const uint8_t* cache;
+    const patch_cache_header_t* header;
+    const patch_cache_record_t* record;
+    uint32_t length;
+
+    patch_cache_begin(TEXT_SIZE, TEXT_HASH);
+    record_patch(kernel, 100, 5);
+    record_patch(kernel, 120, 2);
+
+    REQUIRE((cache = patch_cache_pending(&length)));
+    header = (const patch_cache_header_t*)cache;
+    CHECK_INT(header->magic, PATCH_CACHE_MAGIC);
+    CHECK_INT(header->version, PATCH_CACHE_VERSION);
+    CHECK_INT(header->count, 2);
+    CHECK_INT(header->textSize, TEXT_SIZE);
+    CHECK_INT(header->textHash, TEXT_HASH);
+
+    // Original then patched bytes, padded to 4
+    CHECK_INT(length, sizeof(*header) + sizeof(*record) + 12 + sizeof(*record) + 4);
+    CHECK_INT(header->length, length);
+
+    record = (const patch_cache_record_t*)(header + 1);
+    CHECK_INT(record->offset, 100);
+    CHECK_INT(record->length, 5);
+    CHECK(!memcmp(record + 1, "\x64\x65\x66\x67\x68\x9b\x9a\x99\x98\x97\0\0", 12));
+
+    record = (const patch_cache_record_t*)((const uint8_t*)(record + 1) + 12);
+    CHECK_INT(record->offset, 120);
+    CHECK(!memcmp(record + 1, "\x78\x79\x87\x86", 4));
+
+    free(kernel);
+}
+
+TEST(patch_cache_pending_empty)
+{
+    uint8_t* kernel = kernel_new();
+    uint32_t length;
+
+    CHECK(patch_cache_pending(&length) == NULL);
+
+    // A cache with no patches would be a hit that patches nothing
+    patch_cache_begin(TEXT_SIZE, TEXT_HASH);
+    CHECK(patch_cache_pending(&length) == NULL);
+
+    record_patch(kernel, 100, 5);
+    CHECK(patch_cache_pending(&length) != NULL);
+    patch_cache_discard();
+    CHECK(patch_cache_pending(&length) == NULL);
+
+    // Recording after a discard doesn't bring it back
+    record_patch(kernel, 100, 5);
+    CHECK(patch_cache_pending(&length) == NULL);
+
+    free(kernel);
+}
+
+TEST(patch_cache_overflow_discards)
+{
+    uint8_t* kernel = kernel_new();
+    uint32_t length;
+    int i;
+
+    patch_cache_begin(TEXT_SIZE, TEXT_HASH);
+    for(i = 0; i < (PATCH_CACHE_MAX_SIZE - sizeof(patch_cache_header_t)) / (sizeof(patch_cache_record_t) + 2 * 32); i++)
+    {
+        record_patch(kernel, 0, 32);
+    }
+    REQUIRE(patch_cache_pending(&length) != NULL);
+    CHECK(length <= PATCH_CACHE_MAX_SIZE);
+
+    // One more doesn't fit, an incomplete cache is worse than none
+    record_patch(kernel, 0, 32);
+    CHECK(patch_cache_pending(&length) == NULL);
+
+    free(kernel);
+}
+
+TEST(patch_cache_hit)
+{
+    uint8_t* kernel = kernel_new();
+    const void* cache;
+    uint32_t length;
+
+    REQUIRE((cache = build_cache(kernel, &length)));
+    load_cache(cache, length);
+    CHECK(apply(TEXT_OFFSET, TEXT_SIZE, TEXT_HASH));
+
+    free(kernel);
+}
+
+TEST(patch_cache_miss)
+{
+    uint8_t* kernel = kernel_new();
+    const void* cache;
+    uint32_t length;
+
+    // Nothing loaded
+    CHECK(!apply(TEXT_OFFSET, TEXT_SIZE, TEXT_HASH));
+
+    REQUIRE((cache = build_cache(kernel, &length)));
+    load_cache(cache, length);
+
+    // Another kernel
+    CHECK(!apply(TEXT_OFFSET, TEXT_SIZE, TEXT_HASH + 1));
+    CHECK(!apply(TEXT_OFFSET, TEXT_SIZE + 4, TEXT_HASH));
+
+    // Patches outside of the text are never applied
+    CHECK(!apply(TEXT_OFFSET + 20, TEXT_SIZE, TEXT_HASH));
+
+    free(kernel);
+}
+
+TEST(patch_cache_checks_original_bytes)
+{
+    uint8_t* kernel = kernel_new();
+    const void* cache;
+    uint32_t length;
+    int i;
+
+    REQUIRE((cache = build_cache(kernel, &length)));
+    load_cache(cache, length);
+
+    // The second patch's bytes differ, so not even the first is applied
+    kernel[TEXT_OFFSET + 44] ^= 1;
+    CHECK(!patch_cache_apply(kernel, TEXT_OFFSET, TEXT_SIZE, TEXT_HASH));
+    for(i = 0; i < KERNEL_SIZE; i++) CHECK_INT(kernel[i], (uint8_t)(i == TEXT_OFFSET + 44 ? i ^ 1 : i));
+
+    free(kernel);
+}
+
+TEST(patch_cache_rejects_files)
+{
+    uint8_t* kernel = kernel_new();
+    uint8_t good[PATCH_CACHE_MAX_SIZE], bad[PATCH_CACHE_MAX_SIZE];
+    patch_cache_header_t* header = (patch_cache_header_t*)bad;
+    patch_cache_record_t* record = (patch_cache_record_t*)(header + 1);
+    const void* cache;
+    uint32_t length;
+
+    REQUIRE((cache = build_cache(kernel, &length)));
+    memcpy(good, cache, length);
+
+    // Each read replaces what was loaded before
+#define REJECTED(change)                        \
+    memcpy(bad, good, length);                  \
+    change;                                     \
+    load_cache(bad, length);                    \
+    CHECK(!apply(TEXT_OFFSET, TEXT_SIZE, TEXT_HASH))
+
+    REJECTED(header->magic = 0);
+    REJECTED(header->version++);
+    REJECTED(header->count = 0);
+    REJECTED(header->count++);
+    REJECTED(header->length -= 4);
+    REJECTED(header->textSize++);
+    REJECTED(header->textHash++);
+    REJECTED(record->length = PATCH_CACHE_MAX_SIZE + 1);
+    REJECTED(record->length = 100);
+    REJECTED(record->offset = TEXT_OFFSET + TEXT_SIZE - 2);
+    REJECTED(record->offset = 0);
+#undef REJECTED
+
+    // A truncated file
+    load_cache(good, length - 4);
+    CHECK(!apply(TEXT_OFFSET, TEXT_SIZE, TEXT_HASH));
+
+    // And the good one still works after all that
+    load_cache(good, length);
+    CHECK(apply(TEXT_OFFSET, TEXT_SIZE, TEXT_HASH));
+
+    free(kernel);
+}
+
+TEST(patch_cache_ignores_big_files)
+{
+    uint8_t* kernel = kernel_new();
+    uint8_t big[PATCH_CACHE_MAX_SIZE + 4];
+    const void* cache;
+    uint32_t length;
+
+    REQUIRE((cache = build_cache(kernel, &length)));
+    bzero(big, sizeof(big));
+    memcpy(big, cache, length);
+    ((patch_cache_header_t*)big)->length = sizeof(big);
+
+    // Valid but for its size, never read
+    load_cache(big, sizeof(big));
+    CHECK(!apply(TEXT_OFFSET, TEXT_SIZE, TEXT_HASH));
+
+    free(kernel);
+}
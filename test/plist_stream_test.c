@@ -0,0 +1,300 @@
+/*
+ *  plist_stream_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "plist_stream.h"
+
+#define FUZZ_ROUNDS     2000
+#define FUZZ_TOKENS     100000      /* more than any mutated fixture can hold */
+
+/** The text goes at the very end of the allocation, so ASan sees any read past its length **/
+static plist_stream_t* open_text(const char* text)
+{
+    int length = (int)strlen(text);
+    plist_stream_t* stream = malloc(sizeof(*stream) + length);
+    char* buffer = (char*)(stream + 1);
+
+    memcpy(buffer, text, length);
+    plist_stream_init(stream, buffer, length);
+    return stream;
+}
+
+/** Token types of the whole text, terminated by kPlistTokenEnd or kPlistTokenError **/
+static int tokens(const char* text, int* types, int max)
+{
+    plist_stream_t* stream = open_text(text);
+    plist_token_t token;
+    int count = 0;
+
+    do
+    {
+        plist_stream_next(stream, &token);
+        types[count++] = token.type;
+    } while(count < max && token.type != kPlistTokenEnd && token.type != kPlistTokenError);
+
+    free(stream);
+    return count;
+}
+
+TEST(plist_stream_tokens)
+{
+    const char* text =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+        "<plist version=\"1.0\">\n"
+        "<!-- a comment with <tags> -->\n"
+        "<dict>\n"
+        "\t<key>a</key><string>one</string>\n"
+        "\t<key>b</key><data>AAEC</data>\n"
+        "\t<key>c</key><integer>3</integer>\n"
+        "\t<key>d</key><true/><key>e</key><false/>\n"
+        "\t<key>f</key><dict/>\n"
+        "\t<key>g</key><array><date>2017-01-01T00:00:00Z</date><real>1.5</real></array>\n"
+        "\t<key>h</key><string/>\n"
+        "</dict>\n"
+        "</plist>\n";
+    const int expected[] = {
+        kPlistTokenDict,
+        kPlistTokenKey, kPlistTokenString,
+        kPlistTokenKey, kPlistTokenData,
+        kPlistTokenKey, kPlistTokenInteger,
+        kPlistTokenKey, kPlistTokenTrue, kPlistTokenKey, kPlistTokenFalse,
+        kPlistTokenKey, kPlistTokenDict, kPlistTokenDictEnd,
+        kPlistTokenKey, kPlistTokenArray, kPlistTokenOther, kPlistTokenOther, kPlistTokenArrayEnd,
+        kPlistTokenKey, kPlistTokenString,
+        kPlistTokenDictEnd,
+        kPlistTokenEnd,
+    };
+    int types[64];
+    int count = tokens(text, types, 64);
+    int i;
+
+    CHECK_INT(count, sizeof(expected) / sizeof(expected[0]));
+    for(i = 0; i < count && i < (int)(sizeof(expected) / sizeof(expected[0])); i++) CHECK_INT(types[i], expected[i]);
+}
+
+TEST(plist_stream_token_text)
+{
+    plist_stream_t* stream = open_text("<dict><key>boot-args</key><string>-v &amp; -s</string><key>e</key><string/></dict>");
+    plist_token_t token;
+
+    plist_stream_next(stream, &token);
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenKey);
+    CHECK(plist_token_equals(&token, "boot-args"));
+    CHECK(!plist_token_equals(&token, "boot-arg"));
+    CHECK(!plist_token_equals(&token, "boot-args2"));
+
+    // Entities are left for the caller, like XMLParseFile
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenString);
+    CHECK(plist_token_equals(&token, "-v &amp; -s"));
+
+    plist_stream_next(stream, &token);
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenString);
+    CHECK_INT(token.length, 0);
+
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenDictEnd);
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenEnd);
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenEnd);
+
+    free(stream);
+}
+
+TEST(plist_stream_errors)
+{
+    const char* broken[] = {
+        "<dict><key>a</key",                        /* unterminated tag */
+        "<dict><key>a</key><strong>x</strong>",     /* unknown element */
+        "<dict><key>a</key><string>x</data>",       /* mismatched close */
+        "<dict><key>a</key><string>x",              /* unterminated value */
+        "<dict><key>a</key><string>x</string",      /* unterminated close */
+        "<dict><!-- never closed",                  /* unterminated comment */
+        "<dict></key>",                             /* stray scalar close */
+    };
+    int types[16];
+    size_t i;
+
+    for(i = 0; i < sizeof(broken) / sizeof(broken[0]); i++)
+    {
+        int count = tokens(broken[i], types, 16);
+        if(types[count - 1] != kPlistTokenError) test_fail(__FILE__, __LINE__, broken[i]);
+    }
+}
+
+TEST(plist_stream_error_ends_stream)
+{
+    plist_stream_t* stream = open_text("<dict><bogus/><key>a</key></dict>");
+    plist_token_t token;
+
+    plist_stream_next(stream, &token);
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenError);
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenEnd);
+
+    free(stream);
+}
+
+TEST(plist_stream_skip_values)
+{
+    plist_stream_t* stream = open_text("<dict><key>a</key><dict><key>x</key><array><dict/><array/></array></dict>"
+                                       "<key>b</key><string>after</string></dict>");
+    plist_token_t token;
+
+    plist_stream_next(stream, &token);
+    plist_stream_next(stream, &token);
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenDict);
+    CHECK(plist_stream_skip(stream, &token));
+
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenKey);
+    CHECK(plist_token_equals(&token, "b"));
+
+    // Scalars are already consumed, closes and the end are nothing to skip
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenString);
+    CHECK(plist_stream_skip(stream, &token));
+    CHECK_INT(plist_stream_next(stream, &token), kPlistTokenDictEnd);
+    CHECK(!plist_stream_skip(stream, &token));
+
+    free(stream);
+}
+
+TEST(plist_stream_skip_rejects)
+{
+    char deep[65 * 7 + 65 * 8 + 1];
+    plist_stream_t* stream;
+    plist_token_t token;
+    int i;
+
+    stream = open_text("<dict><key>a</key><array></dict>");
+    plist_stream_next(stream, &token);
+    CHECK(!plist_stream_skip(stream, &token));
+    free(stream);
+
+    stream = open_text("<dict><key>a</key>");
+    plist_stream_next(stream, &token);
+    CHECK(!plist_stream_skip(stream, &token));
+    free(stream);
+
+    // Nesting is bounded, the bootloader stack isn't
+    deep[0] = 0;
+    for(i = 0; i < 65; i++) strcat(deep, "<array>");
+    for(i = 0; i < 65; i++) strcat(deep, "</array>");
+    stream = open_text(deep);
+    plist_stream_next(stream, &token);
+    CHECK(!plist_stream_skip(stream, &token));
+    free(stream);
+}
+
+TEST(plist_stream_counts_idrefs)
+{
+    plist_stream_t* stream = open_text("<dict><key>a</key><string ID=\"1\">x</string><key>b</key><string IDREF=\"1\"/></dict>");
+    plist_token_t token;
+
+    while(plist_stream_next(stream, &token) != kPlistTokenEnd && token.type != kPlistTokenError);
+    CHECK_INT(stream->refs, 1);
+
+    free(stream);
+}
+
+TEST(plist_stream_decode_integer)
+{
+    const struct { const char* text; int value; } cases[] = {
+        { "0", 0 }, { "42", 42 }, { "-42", -42 }, { " \t12", 12 }, { "0x3f0", 0x3f0 }, { "0XFF", 255 },
+        { "0xffffffff", -1 }, { "4294967295", -1 }, { "-2147483648", -2147483647 - 1 }, { "12abc", 12 }, { "", 0 },
+    };
+    size_t i;
+
+    for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        plist_token_t token = { kPlistTokenInteger, cases[i].text, (int)strlen(cases[i].text) };
+        CHECK_INT(plist_decode_integer(&token), cases[i].value);
+    }
+
+    // Only the token's own length is read
+    plist_token_t token = { kPlistTokenInteger, "123", 2 };
+    CHECK_INT(plist_decode_integer(&token), 12);
+}
+
+TEST(plist_stream_decode_data)
+{
+    plist_token_t token = { kPlistTokenData, "\n\tAAEC\n\t/w==\n", 14 };
+    char out[16];
+
+    CHECK_INT(plist_decode_data(&token, out), 4);
+    CHECK(!memcmp(out, "\x00\x01\x02\xff", 4));
+}
+
+/**
+ ** Random byte flips, truncations and tag swaps of the fixture. The stream has to stop with kPlistTokenEnd or
+ ** kPlistTokenError without reading past the buffer, and every token has to lie within it.
+ **/
+TEST(plist_stream_fuzz)
+{
+    static const char* fragments[] = { "<", ">", "/", "<dict>", "</dict>", "<array>", "<!--", "<key>", "</string>", "IDREF" };
+    size_t length;
+    char* fixture = harness_fixture("nvram.plist", &length);
+    uint32_t state = 7;
+    int round;
+
+    REQUIRE(fixture);
+
+    for(round = 0; round < FUZZ_ROUNDS; round++)
+    {
+        size_t size = length;
+        char* buffer = malloc(size);
+        int mutations = 1 + harness_random(&state) % 8;
+        int i;
+
+        memcpy(buffer, fixture, size);
+        for(i = 0; i < mutations; i++)
+        {
+            size_t at = harness_random(&state) % size;
+            const char* fragment = fragments[harness_random(&state) % (sizeof(fragments) / sizeof(fragments[0]))];
+            size_t fragmentLength = strlen(fragment);
+
+            switch(harness_random(&state) % 3)
+            {
+                case 0:  buffer[at] = (char)harness_random(&state);                        break;
+                case 1:  size = at ? at : 1;                                                break;
+                default: if(at + fragmentLength <= size) memcpy(&buffer[at], fragment, fragmentLength); break;
+            }
+        }
+
+        // Exactly size bytes, no terminator
+        char* exact = malloc(size);
+        memcpy(exact, buffer, size);
+        free(buffer);
+
+        plist_stream_t stream;
+        plist_token_t token;
+        int count = 0;
+
+        plist_stream_init(&stream, exact, (int)size);
+        do
+        {
+            plist_stream_next(&stream, &token);
+            if(token.text && (token.text < exact || token.text + token.length > exact + size))
+            {
+                test_fail(__FILE__, __LINE__, "token outside the buffer");
+                break;
+            }
+            if(token.type == kPlistTokenInteger) plist_decode_integer(&token);
+        } while(++count < FUZZ_TOKENS && token.type != kPlistTokenEnd && token.type != kPlistTokenError);
+        CHECK(count < FUZZ_TOKENS);
+
+        // Skipping from the top must terminate too
+        plist_stream_init(&stream, exact, (int)size);
+        if(plist_stream_next(&stream, &token) == kPlistTokenDict) plist_stream_skip(&stream, &token);
+        CHECK(stream.pos <= stream.end);
+
+        free(exact);
+    }
+
+    free(fixture);
+}
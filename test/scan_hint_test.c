@@ -0,0 +1,98 @@
+/*
+ *  scan_hint_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "scan_hint.h"
+
+static bool parse(const char* text, scan_hint_t* hint)
+{
+    return scan_hint_parse(text, (int)strlen(text), hint);
+}
+
+TEST(scan_hint_parse_valid)
+{
+    scan_hint_t hint;
+
+    REQUIRE(parse("hd(1,12) 1500000000\n", &hint));
+    CHECK_INT(hint.unit, 1);
+    CHECK_INT(hint.part, 12);
+    CHECK_INT(hint.time, 1500000000);
+
+    // Anything after the time is ignored
+    REQUIRE(parse("hd(0,2) 42 trailing", &hint));
+    CHECK_INT(hint.time, 42);
+}
+
+TEST(scan_hint_parse_malformed)
+{
+    scan_hint_t hint;
+
+    CHECK(!parse("", &hint));
+    CHECK(!parse("hd(0,2)", &hint));
+    CHECK(!parse("hd(0,2) ", &hint));
+    CHECK(!parse("hd(,2) 1", &hint));
+    CHECK(!parse("hd(0 2) 1", &hint));
+    CHECK(!parse("hd(0,2)1", &hint));
+    CHECK(!parse("fd(0,2) 1", &hint));
+    CHECK(!parse("hd(0,x) 1", &hint));
+
+    // The length bounds the parse, the text needn't be terminated
+    CHECK(!scan_hint_parse("hd(0,2) 1", 7, &hint));
+    CHECK(scan_hint_parse("hd(0,2) 1", 9, &hint));
+}
+
+TEST(scan_hint_lookup_chain)
+{
+    BVRef first = host_add_volume(0, 1, "EFI");
+    BVRef second = host_add_volume(0, 2, "Macintosh HD");
+    BVRef third = host_add_volume(1, 2, "Backup");
+    scan_hint_t hint = { 0, 2, 0 };
+
+    CHECK(scan_hint_lookup(first, &hint) == second);
+
+    hint.unit = 1;
+    CHECK(scan_hint_lookup(first, &hint) == third);
+
+    // Only volumes from the given one on are searched
+    hint.unit = 0;
+    hint.part = 1;
+    CHECK(scan_hint_lookup(second, &hint) == NULL);
+
+    hint.part = 3;
+    CHECK(scan_hint_lookup(first, &hint) == NULL);
+    CHECK(scan_hint_lookup(NULL, &hint) == NULL);
+}
+
+TEST(scan_hint_matches_hfs_time)
+{
+    scan_hint_t hint = { 0, 2, 1000 };
+
+    CHECK(scan_hint_matches(&hint, 1000 + NVRAM_HINT_HFS_EPOCH));
+    CHECK(!scan_hint_matches(&hint, 1000));
+    CHECK(!scan_hint_matches(&hint, 1001 + NVRAM_HINT_HFS_EPOCH));
+}
+
+TEST(scan_hint_read_file)
+{
+    scan_hint_t hint;
+
+    host_add_volume(0, 2, "Macintosh HD");
+    CHECK(!scan_hint_read(&hint));
+
+    host_write_file(NVRAM_HINT_PATH, "hd(0,2) 77\n", 11);
+    REQUIRE(scan_hint_read(&hint));
+    CHECK_INT(hint.part, 2);
+    CHECK_INT(hint.time, 77);
+
+    host_write_file(NVRAM_HINT_PATH, "garbage", 7);
+    CHECK(!scan_hint_read(&hint));
+}
@@ -0,0 +1,351 @@
+/*
+ *  shim_test.cpp
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+/**
+ ** The kernel side of the host shim. The kext's tests and benchmarks are only as good as its stand-ins for
+ ** libkern, so their xnu behaviour is checked here.
+ **/
+#include "xnu.h"
+#include "test.h"
+
+static OSObject* unserialize(const char* xml)
+{
+    OSString* error = NULL;
+    OSObject* object = OSUnserializeXML(xml, &error);
+
+    if(error)
+    {
+        fprintf(stderr, "    %s\n", error->getCStringNoCopy());
+        error->release();
+    }
+
+    return object;
+}
+
+TEST(xnu_serialize_roundtrip)
+{
+    UInt8 bytes[256];
+    unsigned int i;
+
+    for(i = 0; i < sizeof(bytes); i++) bytes[i] = (UInt8)i;
+
+    OSDictionary* dict = OSDictionary::withCapacity(4);
+    OSDictionary* guid = OSDictionary::withCapacity(1);
+    OSString* shared = OSString::withCString("a <b> & c");
+    OSData* data = OSData::withBytes(bytes, sizeof(bytes));
+    OSNumber* number = OSNumber::withNumber(0x1234, 32);
+
+    dict->setObject("string", shared);
+    dict->setObject("again", shared);
+    dict->setObject("data", data);
+    dict->setObject("number", number);
+    dict->setObject("true", kOSBooleanTrue);
+    guid->setObject("false", kOSBooleanFalse);
+    dict->setObject("7C436110-AB2A-4BBB-A880-FE41995C9F82", guid);
+
+    OSSerialize* s = OSSerialize::withCapacity(16);
+    REQUIRE(dict->serialize(s));
+    CHECK(strstr(s->text(), "<string ID=\"1\">a &lt;b&gt; &amp; c</string>") != NULL);
+    CHECK(strstr(s->text(), "<reference IDREF=\"1\"/>") != NULL);
+    CHECK(strstr(s->text(), "<integer size=\"32\" ID=\"3\">0x1234</integer>") != NULL);
+
+    OSDictionary* copy = OSDynamicCast(OSDictionary, unserialize(s->text()));
+    REQUIRE(copy);
+    CHECK_INT(copy->getCount(), 6);
+    CHECK_INT(copy->getCapacity(), 6);
+
+    OSString* string = OSDynamicCast(OSString, copy->getObject("string"));
+    CHECK(string && string->isEqualTo("a <b> & c"));
+    CHECK(string && copy->getObject("again") == string);
+    CHECK(data->isEqualTo(copy->getObject("data")));
+    CHECK(number->isEqualTo(copy->getObject("number")));
+    CHECK(copy->getObject("true") == kOSBooleanTrue);
+
+    OSDictionary* guidCopy = OSDynamicCast(OSDictionary, copy->getObject("7C436110-AB2A-4BBB-A880-FE41995C9F82"));
+    CHECK(guidCopy && guidCopy->getObject("false") == kOSBooleanFalse);
+
+    // Keys are interned.
+    const OSSymbol* key = OSSymbol::withCString("number");
+    CHECK(copy->getObject(key) == copy->getObject("number"));
+    key->release();
+
+    copy->release();
+    s->release();
+    number->release();
+    data->release();
+    shared->release();
+    guid->release();
+    dict->release();
+}
+
+TEST(xnu_unserialize_fixture)
+{
+    char* file = harness_fixture("nvram.plist", NULL);
+    REQUIRE(file);
+
+    OSDictionary* plist = OSDynamicCast(OSDictionary, unserialize(file));
+    REQUIRE(plist);
+
+    OSDictionary* nvram = OSDynamicCast(OSDictionary, plist->getObject("NVRAM"));
+    REQUIRE(nvram);
+    CHECK_INT(nvram->getCount(), 10);
+
+    OSString* args = OSDynamicCast(OSString, nvram->getObject("boot-args"));
+    CHECK(args && args->isEqualTo("-v keepsyms=1 npci=0x2000"));
+
+    OSString* recovery = OSDynamicCast(OSString, nvram->getObject("efi-apple-recovery"));
+    CHECK(recovery && recovery->isEqualTo("<array><dict></dict></array>"));
+
+    OSNumber* backlight = OSDynamicCast(OSNumber, nvram->getObject("backlight-level"));
+    CHECK(backlight && backlight->unsigned32BitValue() == 0x3f0 && backlight->numberOfBits() == 64);
+
+    OSData* panic = OSDynamicCast(OSData, nvram->getObject("aapl,panic-info"));
+    CHECK(panic && panic->getLength() == 0);
+
+    OSDictionary* apple = OSDynamicCast(OSDictionary, nvram->getObject("7C436110-AB2A-4BBB-A880-FE41995C9F82"));
+    OSData* name = apple ? OSDynamicCast(OSData, apple->getObject("fmm-computer-name")) : NULL;
+    CHECK(name && name->isEqualTo("Chris&apos;s Mac Pro", 20));
+
+    plist->release();
+    free(file);
+}
+
+TEST(xnu_unserialize_idref)
+{
+    char* file = harness_fixture("nvram-idref.plist", NULL);
+    REQUIRE(file);
+
+    OSDictionary* plist = OSDynamicCast(OSDictionary, unserialize(file));
+    OSDictionary* nvram = plist ? OSDynamicCast(OSDictionary, plist->getObject("NVRAM")) : NULL;
+    REQUIRE(nvram);
+
+    CHECK(nvram->getObject("SystemAudioVolumeDB") == nvram->getObject("SystemAudioVolume"));
+    CHECK(nvram->getObject("previous-system-uuid") == nvram->getObject("boot-args"));
+
+    plist->release();
+    free(file);
+}
+
+TEST(xnu_unserialize_errors)
+{
+    static const char* bad[] =
+    {
+        "",
+        "<dict><key>a</key>",
+        "<dict><key>a</key><string>b</data></dict>",
+        "<dict><string>a</string></dict>",
+        "<set><string>a</string></set>",
+        "<array><string IDREF=\"9\"/></array>",
+        "</dict>",
+    };
+    unsigned int i;
+
+    for(i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        OSString* error = NULL;
+        OSObject* object = OSUnserializeXML(bad[i], &error);
+
+        CHECK(!object);
+        CHECK(error != NULL);
+        OSSafeReleaseNULL(object);
+        OSSafeReleaseNULL(error);
+    }
+}
+
+TEST(xnu_symbols_interned)
+{
+    const OSSymbol* a = OSSymbol::withCString("boot-args");
+    const OSSymbol* b = OSSymbol::withCString("boot-args");
+    OSString* string = OSString::withCString("boot-args");
+    const OSSymbol* c = OSSymbol::withString(string);
+
+    CHECK(a == b);
+    CHECK(a == c);
+    CHECK_INT(a->getRetainCount(), 3);
+    CHECK(OSDynamicCast(OSString, a) == a);
+    CHECK(OSDynamicCast(OSSymbol, string) == NULL);
+
+    c->release();
+    b->release();
+    a->release();
+    string->release();
+
+    // Dropped from the pool with the last reference, a new one can be made.
+    a = OSSymbol::withCString("boot-args");
+    CHECK_INT(a->getRetainCount(), 1);
+    a->release();
+}
+
+TEST(xnu_dictionary_growth)
+{
+    OSDictionary* dict = OSDictionary::withCapacity(4);
+    unsigned long grows = gOSDictionaryGrows;
+    char key[16];
+    int i;
+
+    for(i = 0; i < 4; i++)
+    {
+        snprintf(key, sizeof(key), "key%d", i);
+        dict->setObject(key, kOSBooleanTrue);
+    }
+    CHECK_INT(gOSDictionaryGrows, grows);
+
+    dict->setObject("key4", kOSBooleanTrue);
+    CHECK_INT(gOSDictionaryGrows, grows + 1);
+    CHECK_INT(dict->getCapacity(), 8);
+
+    // Replacing keeps the count.
+    dict->setObject("key4", kOSBooleanFalse);
+    CHECK_INT(dict->getCount(), 5);
+    CHECK(dict->getObject("key4") == kOSBooleanFalse);
+
+    OSDictionary* copy = OSDictionary::withDictionary(dict, 2);
+    CHECK_INT(copy->getCount(), 5);
+    CHECK(copy->getCapacity() >= 5);
+
+    dict->removeObject("key0");
+    CHECK_INT(dict->getCount(), 4);
+    CHECK(dict->getObject("key0") == NULL);
+    CHECK(copy->getObject("key0") == kOSBooleanTrue);
+
+    copy->release();
+    dict->release();
+}
+
+TEST(xnu_iterator_invalidated)
+{
+    OSDictionary* dict = OSDictionary::withCapacity(2);
+    dict->setObject("a", kOSBooleanTrue);
+    dict->setObject("b", kOSBooleanTrue);
+
+    OSCollectionIterator* iter = OSCollectionIterator::withCollection(dict);
+    const OSSymbol* key = OSDynamicCast(OSSymbol, iter->getNextObject());
+    CHECK(key && key->isEqualTo("a"));
+    CHECK(iter->isValid());
+
+    dict->setObject("c", kOSBooleanTrue);
+    CHECK(!iter->isValid());
+    CHECK(iter->getNextObject() == NULL);
+
+    iter->reset();
+    CHECK(iter->isValid());
+    int count = 0;
+    while(iter->getNextObject()) count++;
+    CHECK_INT(count, 3);
+
+    iter->release();
+    dict->release();
+}
+
+TEST(xnu_boot_args)
+{
+    char value[16];
+
+    xnu_set_boot_args("-v -FileNVRAMro NVRAMFile=/Extra/nvram.alt.plist debug=0x100");
+
+    CHECK(PE_parse_boot_argn("-FileNVRAMro", value, sizeof(value)));
+    CHECK(!PE_parse_boot_argn("-FileNVRAM", value, sizeof(value)));
+    CHECK(!PE_parse_boot_argn("-NoFileNVRAM", value, sizeof(value)));
+
+    CHECK(PE_parse_boot_argn("debug", value, sizeof(value)));
+    CHECK_STR(value, "0x100");
+
+    // Values are truncated to fit.
+    CHECK(PE_parse_boot_argn("NVRAMFile", value, sizeof(value)));
+    CHECK_STR(value, "/Extra/nvram.al");
+}
+
+TEST(xnu_vnode_roundtrip)
+{
+    vfs_context_t ctx = vfs_context_current();
+    struct vnode_attr va;
+    char buffer[32];
+    vnode_t vp;
+    int resid;
+
+    host_write_file("/Extra/.folder", "", 0);
+
+    REQUIRE(!vnode_open("/Extra/nvram.plist", O_WRONLY | O_CREAT | O_TRUNC | FWRITE | O_NOFOLLOW, S_IRUSR | S_IWUSR, 0, &vp, ctx));
+    CHECK(vnode_isreg(vp));
+    CHECK(!vn_rdwr(UIO_WRITE, vp, (caddr_t)"hello world", 11, 0, UIO_SYSSPACE, 0, vfs_context_ucred(ctx), &resid, vfs_context_proc(ctx)));
+    CHECK_INT(resid, 0);
+    CHECK(!vnode_close(vp, FWASWRITTEN, ctx));
+
+    REQUIRE(!vnode_lookup("/Extra/nvram.plist", VNODE_LOOKUP_NOFOLLOW, &vp, ctx));
+    VATTR_INIT(&va);
+    VATTR_WANTED(&va, va_data_size);
+    CHECK(!vnode_getattr(vp, &va, ctx));
+    CHECK(VATTR_IS_SUPPORTED(&va, va_data_size));
+    CHECK(!VATTR_IS_SUPPORTED(&va, va_modify_time));
+    CHECK_INT(va.va_data_size, 11);
+    vnode_put(vp);
+
+    // Reading past the end is only an error without a residual count.
+    REQUIRE(!vnode_open("/Extra/nvram.plist", O_RDONLY | FREAD, 0, 0, &vp, ctx));
+    CHECK(!vn_rdwr(UIO_READ, vp, buffer, 16, 0, UIO_SYSSPACE, 0, NULL, &resid, NULL));
+    CHECK_INT(resid, 5);
+    CHECK(!memcmp(buffer, "hello world", 11));
+    CHECK_INT(vn_rdwr(UIO_READ, vp, buffer, 16, 0, UIO_SYSSPACE, 0, NULL, NULL, NULL), EIO);
+    vnode_close(vp, 0, ctx);
+
+    CHECK_INT(vnode_open("/Extra/missing.plist", O_RDONLY | FREAD, 0, 0, &vp, ctx), ENOENT);
+}
+
+static int gTimerRuns;
+
+static void releaseTimer(OSObject* owner, IOTimerEventSource* timer)
+{
+    IOWorkLoop* workLoop = (IOWorkLoop*)owner;
+
+    gTimerRuns++;
+    workLoop->removeEventSource(timer);
+    timer->release();
+}
+
+TEST(xnu_timer_releases_itself)
+{
+    IOWorkLoop* workLoop = IOWorkLoop::workLoop();
+    IOTimerEventSource* timer = IOTimerEventSource::timerEventSource(workLoop, releaseTimer);
+
+    workLoop->addEventSource(timer);
+    CHECK(!timer->fire());
+
+    timer->setTimeoutMS(50);
+    CHECK(timer->isArmed());
+    CHECK_INT(timer->getTimeoutMS(), 50);
+
+    // The action drops the last reference, fire must not touch the timer afterwards.
+    CHECK(timer->fire());
+    CHECK_INT(gTimerRuns, 1);
+
+    workLoop->release();
+}
+
+static IOReturn gateAction(OSObject* owner, void* arg0, void* arg1, void* arg2, void* arg3)
+{
+    return (IOReturn)(uintptr_t)arg0;
+}
+
+TEST(xnu_command_gate)
+{
+    IOWorkLoop* workLoop = IOWorkLoop::workLoop();
+    IOCommandGate* gate = IOCommandGate::commandGate(workLoop, gateAction);
+
+    CHECK_INT(gate->runCommand((void*)7), kIOReturnNotReady);
+
+    workLoop->addEventSource(gate);
+    CHECK_INT(gate->runCommand((void*)7), 7);
+
+    workLoop->removeEventSource(gate);
+    gate->release();
+    workLoop->release();
+}
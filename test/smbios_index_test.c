@@ -0,0 +1,262 @@
+/*
+ *  smbios_index_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "smbios_index.h"
+
+#define TABLE_SIZE      2048
+
+/** A structure table under construction **/
+typedef struct
+{
+    uint8_t     bytes[TABLE_SIZE];
+    uint32_t    length;
+} table_t;
+
+/** Add a structure with a formatted area of length bytes, filled with type, and strings given as "a\0b\0" **/
+static uint32_t table_add(table_t* table, uint8_t type, uint8_t length, const char* strings, uint32_t stringsLength)
+{
+    uint32_t offset = table->length;
+    uint8_t* bytes = &table->bytes[offset];
+
+    memset(bytes, type, length);
+    bytes[0] = type;
+    bytes[1] = length;
+    bytes[2] = (uint8_t)offset;
+    bytes[3] = (uint8_t)(offset >> 8);
+    table->length += length;
+
+    // No strings is still two nul bytes
+    if(stringsLength) memcpy(&table->bytes[table->length], strings, stringsLength);
+    else table->bytes[table->length++] = 0;
+    table->length += stringsLength;
+    table->bytes[table->length++] = 0;
+
+    return offset;
+}
+
+#define TABLE_ADD(table, type, length, strings) table_add(table, type, length, strings, sizeof(strings) - 1)
+
+/** Laid out like the dump of an iMac's table, OEM structures and all **/
+static void table_imac(table_t* table, uint32_t* offsets)
+{
+    table->length = 0;
+    offsets[0]   = TABLE_ADD(table, 0,   0x18, "Apple Inc.\0IM131.88Z.010A.B05.1210121459\0" "10/12/12\0");
+    offsets[1]   = TABLE_ADD(table, 1,   0x1B, "Apple Inc.\0iMac13,2\0" "1.0\0C02J1234DNMP\0" "System SKU#\0iMac\0");
+    offsets[2]   = TABLE_ADD(table, 2,   0x10, "Apple Inc.\0Mac-FC02E91DDD3FA6A4\0iMac13,2\0");
+    offsets[3]   = TABLE_ADD(table, 3,   0x15, "Apple Inc.\0Mac-FC02E91DDD3FA6A4\0");
+    offsets[4]   = TABLE_ADD(table, 4,   0x2A, "U2E1\0Intel(R) Corporation\0Intel(R) Core(TM) i7-3770S CPU @ 3.10GHz\0");
+    offsets[5]   = TABLE_ADD(table, 16,  0x0F, "");
+    offsets[6]   = TABLE_ADD(table, 17,  0x1B, "DIMM0\0BANK 0\0" "0x80CE\0" "0x00000000\0M471B5273DH0-CK0\0");
+    offsets[7]   = TABLE_ADD(table, 17,  0x1B, "DIMM1\0BANK 1\0" "0x80CE\0" "0x00000000\0M471B5273DH0-CK0\0");
+    offsets[8]   = TABLE_ADD(table, 19,  0x0F, "");
+    offsets[9]   = TABLE_ADD(table, 32,  0x0B, "");
+    offsets[10]  = TABLE_ADD(table, 128, 0x58, "");
+    offsets[11]  = TABLE_ADD(table, 130, 0x14, "");
+    offsets[12]  = TABLE_ADD(table, 131, 0x06, "");
+    offsets[13]  = TABLE_ADD(table, 127, 0x04, "");
+}
+
+#define IMAC_STRUCTURES     14
+
+/** The walk smbios_index replaced: every string set skipped a byte at a time with a 16 bit read **/
+static uint32_t reference_walk(const uint8_t* table, uint32_t length, uint32_t* offsets)
+{
+    uint32_t pos = 0, count = 0;
+
+    while(pos + 4 <= length)
+    {
+        uint8_t type = table[pos];
+        uint32_t next = pos + table[pos + 1];
+        bool terminated = false;
+
+        if(table[pos + 1] < 4 || next > length) break;
+
+        for(; next + 1 < length; next++)
+        {
+            uint16_t word;
+
+            memcpy(&word, &table[next], sizeof(word));
+            if(word == 0)
+            {
+                terminated = true;
+                next += 2;
+                break;
+            }
+        }
+        if(!terminated) break;
+
+        offsets[count++] = pos;
+        if(type == SMBIOS_TYPE_END) break;
+        pos = next;
+    }
+
+    return count;
+}
+
+/** Index a copy of exactly length bytes, so ASan catches any read past the table **/
+static uint32_t build(smbios_index_t* index, const table_t* table, uint32_t length)
+{
+    uint8_t* bytes = malloc(length ? length : 1);
+    uint32_t count;
+
+    memcpy(bytes, table->bytes, length);
+    count = smbios_index_build(index, bytes, length);
+    free(bytes);
+
+    return count;
+}
+
+TEST(smbios_index_imac)
+{
+    smbios_index_t index;
+    table_t table;
+    uint32_t offsets[IMAC_STRUCTURES];
+
+    table_imac(&table, offsets);
+    CHECK_INT(smbios_index_build(&index, table.bytes, table.length), IMAC_STRUCTURES);
+    CHECK_INT(index.count, IMAC_STRUCTURES);
+
+    CHECK_INT(index.offset[0], offsets[0]);
+    CHECK_INT(index.offset[1], offsets[1]);
+    CHECK_INT(index.length[1], 0x1B);
+    CHECK_INT(index.offset[4], offsets[4]);
+    CHECK_INT(index.offset[16], offsets[5]);
+    CHECK_INT(index.offset[32], offsets[9]);
+    CHECK_INT(index.offset[SMBIOS_TYPE_END], offsets[13]);
+
+    // The first of a type is kept
+    CHECK_INT(index.offset[17], offsets[6]);
+
+    // Absent types, and OEM types which are walked but not indexed
+    CHECK_INT(index.offset[5], SMBIOS_INDEX_NONE);
+    CHECK_INT(index.offset[126], SMBIOS_INDEX_NONE);
+    CHECK(smbios_index_find(&index, table.bytes, 128, 4) == NULL);
+    CHECK(smbios_index_find(&index, table.bytes, 255, 4) == NULL);
+}
+
+TEST(smbios_index_find_length)
+{
+    smbios_index_t index;
+    table_t table;
+    uint32_t offsets[IMAC_STRUCTURES];
+
+    table_imac(&table, offsets);
+    smbios_index_build(&index, table.bytes, table.length);
+
+    CHECK(smbios_index_find(&index, table.bytes, 1, 0x1B) == &table.bytes[offsets[1]]);
+    CHECK(smbios_index_find(&index, table.bytes, 1, 4) == &table.bytes[offsets[1]]);
+    CHECK(smbios_index_find(&index, table.bytes, 1, 0x1C) == NULL);
+    CHECK(smbios_index_find(&index, table.bytes, 2, 0x08) == &table.bytes[offsets[2]]);
+    CHECK(smbios_index_find(&index, table.bytes, 6, 4) == NULL);
+
+    // Nothing is found in an empty index
+    smbios_index_build(&index, NULL, 100);
+    CHECK_INT(index.count, 0);
+    CHECK(smbios_index_find(&index, table.bytes, 1, 4) == NULL);
+}
+
+TEST(smbios_index_strings)
+{
+    smbios_index_t index;
+    table_t table;
+
+    // One character strings put a nul at every other byte, never two in a row
+    table.length = 0;
+    TABLE_ADD(&table, 0, 4, "a\0b\0c\0d\0e\0");
+    TABLE_ADD(&table, 1, 5, "");
+    TABLE_ADD(&table, 2, 4, "ab\0" "c\0");
+    TABLE_ADD(&table, 3, 4, "");
+    CHECK_INT(build(&index, &table, table.length), 4);
+    CHECK_INT(index.offset[1], 4 + 10 + 1);
+    CHECK_INT(index.offset[2], 4 + 10 + 1 + 5 + 2);
+    CHECK_INT(index.offset[3], 4 + 10 + 1 + 5 + 2 + 4 + 5 + 1);
+}
+
+TEST(smbios_index_stops)
+{
+    smbios_index_t index;
+    table_t table;
+    uint32_t offsets[IMAC_STRUCTURES];
+    uint32_t length;
+
+    // Anything after the end of table structure
+    table_imac(&table, offsets);
+    TABLE_ADD(&table, 5, 4, "");
+    CHECK_INT(build(&index, &table, table.length), IMAC_STRUCTURES);
+    CHECK_INT(index.offset[5], SMBIOS_INDEX_NONE);
+
+    // Cut anywhere, the structures before the cut are still indexed and nothing is read past it
+    for(length = 0; length < offsets[IMAC_STRUCTURES - 1]; length++)
+    {
+        uint32_t expected = 0;
+
+        while(expected < IMAC_STRUCTURES - 1 && offsets[expected + 1] <= length) expected++;
+        if(build(&index, &table, length) != expected)
+        {
+            test_fail(__FILE__, __LINE__, "wrong count for a truncated table");
+            break;
+        }
+    }
+
+    // A formatted area shorter than the header or past the end
+    table_imac(&table, offsets);
+    table.bytes[offsets[3] + 1] = 3;
+    CHECK_INT(build(&index, &table, table.length), 3);
+    CHECK_INT(index.offset[3], SMBIOS_INDEX_NONE);
+
+    table_imac(&table, offsets);
+    table.bytes[offsets[13] + 1] = 0xFF;
+    CHECK_INT(build(&index, &table, table.length), IMAC_STRUCTURES - 1);
+}
+
+TEST(smbios_index_matches_reference)
+{
+    uint32_t state = 49;
+    int round;
+
+    // Random structures with sparse strings, cut at random
+    for(round = 0; round < 500; round++)
+    {
+        smbios_index_t index;
+        table_t table;
+        uint32_t expected[TABLE_SIZE / 4];
+        uint32_t count, length, i;
+
+        table.length = 0;
+        while(table.length < TABLE_SIZE - 256)
+        {
+            char strings[64];
+            uint32_t stringsLength = harness_random(&state) % 24;
+
+            for(i = 0; i < stringsLength; i++) strings[i] = (harness_random(&state) % 3) ? 'a' + i % 26 : 0;
+            if(stringsLength) strings[stringsLength - 1] = 0;
+            for(i = 1; i < stringsLength; i++) if(!strings[i] && !strings[i - 1]) strings[i] = 'z';
+
+            table_add(&table, (uint8_t)(harness_random(&state) % 140), 4 + harness_random(&state) % 40, strings, stringsLength);
+        }
+
+        length = harness_random(&state) % (table.length + 1);
+        count = reference_walk(table.bytes, length, expected);
+        if(build(&index, &table, length) != count)
+        {
+            test_fail(__FILE__, __LINE__, "count differs from the byte walk");
+            break;
+        }
+
+        for(i = 0; i < count; i++)
+        {
+            uint8_t type = table.bytes[expected[i]];
+            if(type < SMBIOS_INDEX_TYPES && index.offset[type] > expected[i]) test_fail(__FILE__, __LINE__, "structure missed");
+        }
+    }
+}
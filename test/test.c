@@ -0,0 +1,110 @@
+/*
+ *  test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TEST_MAX    512
+
+typedef struct
+{
+    const char* name;
+    const char* file;
+    void        (*fn)(void);
+    int         order;
+} test_t;
+
+static test_t   gTests[TEST_MAX];
+static int      gTestCount;
+static int      gFailures;
+
+void test_register(const char* name, const char* file, void (*fn)(void))
+{
+    if(gTestCount >= TEST_MAX)
+    {
+        fprintf(stderr, "too many tests, raise TEST_MAX\n");
+        exit(1);
+    }
+
+    gTests[gTestCount].name = name;
+    gTests[gTestCount].file = file;
+    gTests[gTestCount].fn = fn;
+    gTests[gTestCount].order = gTestCount;
+    gTestCount++;
+}
+
+void test_fail(const char* file, int line, const char* expression)
+{
+    fprintf(stderr, "    %s:%d: %s\n", file, line, expression);
+    gFailures++;
+}
+
+int test_failures(void)
+{
+    return gFailures;
+}
+
+static void run_test(void* arg)
+{
+    const test_t* test = arg;
+
+    // The module and the kext print to stdout as they go, only failures are of interest
+    if(!getenv("TEST_VERBOSE")) freopen("/dev/null", "w", stdout);
+
+    test->fn();
+    fflush(stderr);
+    _exit(gFailures ? 1 : 0);
+}
+
+/** Registration order follows link order, run the files alphabetically and each file's tests in order **/
+static int compare_tests(const void* a, const void* b)
+{
+    const test_t* ta = a;
+    const test_t* tb = b;
+    int order = strcmp(ta->file, tb->file);
+
+    return order ? order : ta->order - tb->order;
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = (argc > 1) ? argv[1] : NULL;
+    int i, ran = 0, failed = 0;
+
+    qsort(gTests, gTestCount, sizeof(test_t), compare_tests);
+
+    for(i = 0; i < gTestCount; i++)
+    {
+        int status;
+
+        if(filter && !strstr(gTests[i].name, filter) && !strstr(gTests[i].file, filter)) continue;
+
+        status = harness_run(run_test, &gTests[i]);
+        ran++;
+
+        if(status)
+        {
+            failed++;
+            printf("FAIL %s (%s", gTests[i].name, gTests[i].file);
+            if(status > 128) printf(", signal %d", status - 128);
+            printf(")\n");
+        }
+        else
+        {
+            printf("ok   %s\n", gTests[i].name);
+        }
+    }
+
+    printf("%d of %d tests passed\n", ran - failed, ran);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+/*
+ *  test.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_TEST_H
+#define __TEST_TEST_H
+
+/**
+ ** TEST(name) { ... } registers a test case, run in a process of its own by test.c:
+ **
+ **     ./unittest [substring]
+ **
+ ** CHECK records a failure and carries on, REQUIRE ends the test. Set TEST_VERBOSE to see what the module
+ ** and the kext print while a test runs.
+ **/
+#include "harness.h"
+#include "host.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void    test_register(const char* name, const char* file, void (*fn)(void));
+void    test_fail(const char* file, int line, const char* expression);
+int     test_failures(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define TEST(name)                                                                  \
+    static void test_ ## name(void);                                                \
+    static void __attribute__((constructor)) register_ ## name(void)                \
+    {                                                                               \
+        test_register(#name, __FILE__, test_ ## name);                              \
+    }                                                                               \
+    static void test_ ## name(void)
+
+#define CHECK(expr)                                                                 \
+    do { if(!(expr)) test_fail(__FILE__, __LINE__, #expr); } while(0)
+
+#define REQUIRE(expr)                                                               \
+    do { if(!(expr)) { test_fail(__FILE__, __LINE__, #expr); return; } } while(0)
+
+#define CHECK_INT(a, b)                                                             \
+    do {                                                                            \
+        long long _a = (long long)(a), _b = (long long)(b);                         \
+        if(_a != _b)                                                                \
+        {                                                                           \
+            char _m[256];                                                           \
+            snprintf(_m, sizeof(_m), "%s == %s (%lld != %lld)", #a, #b, _a, _b);    \
+            test_fail(__FILE__, __LINE__, _m);                                      \
+        }                                                                           \
+    } while(0)
+
+#define CHECK_STR(a, b)                                                             \
+    do {                                                                            \
+        const char *_a = (a), *_b = (b);                                            \
+        if(!_a || !_b || strcmp(_a, _b))                                            \
+        {                                                                           \
+            char _m[512];                                                           \
+            snprintf(_m, sizeof(_m), "%s == %s (\"%.200s\" != \"%.200s\")", #a, #b, \
+                     _a ? _a : "(null)", _b ? _b : "(null)");                       \
+            test_fail(__FILE__, __LINE__, _m);                                      \
+        }                                                                           \
+    } while(0)
+
+#endif /* !__TEST_TEST_H */
@@ -0,0 +1,173 @@
+/*
+ *  x86_insn_test.c
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "test.h"
+#include "x86_insn.h"
+
+typedef struct
+{
+    const char* bytes;
+    UInt32      length;         /* expected, 0 if it can't be decoded */
+    const char* what;
+} insn_t;
+
+/** Instructions followed by NOPs, so the decoder never runs out. Invalid ones are spelled without nul bytes. **/
+static const insn_t gInsns32[] =
+{
+    { "\x90",                               1,  "nop" },
+    { "\x55",                               1,  "push %ebp" },
+    { "\x89\xE5",                           2,  "mov %esp,%ebp" },
+    { "\x83\xEC\x18",                       3,  "sub $0x18,%esp" },
+    { "\x8B\x45\x08",                       3,  "mov 8(%ebp),%eax" },
+    { "\x8B\x04\x85\x00\x10\x00\x00",       7,  "mov 0x1000(,%eax,4),%eax" },
+    { "\x8B\x84\x24\x00\x01\x00\x00",       7,  "mov 0x100(%esp),%eax" },
+    { "\x89\x34\x24",                       3,  "mov %esi,(%esp)" },
+    { "\xC7\x44\x24\x08\x08\x75\x88\x00",   8,  "movl $imm,8(%esp)" },
+    { "\xC7\x04\x24\x00\x00\x00\x00",       7,  "movl $0,(%esp)" },
+    { "\x66\xC7\x04\x24\x01\x00",           6,  "movw $1,(%esp)" },
+    { "\x67\x8B\x06\x34\x12",               5,  "mov 0x1234,%eax, 16 bit addressing" },
+    { "\x67\x8B\x40\x02",                   4,  "mov 2(%bx,%si),%eax" },
+    { "\xA1\x00\x10\x00\x00",               5,  "mov 0x1000,%eax" },
+    { "\x67\xA1\x00\x10",                   4,  "mov 0x1000,%eax, 16 bit offset" },
+    { "\xE8\x00\x00\x00\x00",               5,  "call rel32" },
+    { "\x66\xE8\x00\x00",                   4,  "call rel16" },
+    { "\xEB\xFE",                           2,  "jmp rel8" },
+    { "\x0F\x84\x00\x01\x00\x00",           6,  "je rel32" },
+    { "\xF6\xC0\x01",                       3,  "test $1,%al" },
+    { "\xF6\xD0",                           2,  "not %al" },
+    { "\xF7\xC0\x01\x00\x00\x00",           6,  "test $1,%eax" },
+    { "\x66\xF7\xC0\x01\x00",               5,  "test $1,%ax" },
+    { "\xF7\xD8",                           2,  "neg %eax" },
+    { "\xC8\x10\x00\x00",                   4,  "enter $16,$0" },
+    { "\xC2\x04\x00",                       3,  "ret $4" },
+    { "\x9A\x00\x00\x00\x00\x08\x00",       7,  "lcall ptr16:32" },
+    { "\xC5\x06",                           2,  "lds (%esi),%eax" },
+    { "\xF3\xA5",                           2,  "rep movsl" },
+    { "\x0F\x1F\x44\x00\x00",               5,  "nopl 0(%eax,%eax)" },
+    { "\x0F\x0B",                           2,  "ud2" },
+    { "\x0F\x38\x00\xC1",                   4,  "pshufb %mm1,%mm0" },
+    { "\x66\x0F\x3A\x0F\xC1\x08",           6,  "palignr $8,%xmm1,%xmm0" },
+    { "\x0F\xBA\xE0\x03",                   4,  "bt $3,%eax" },
+    { "\xD9\xEE",                           2,  "fldz" },
+    { "\xC5\xF8\x77",                       0,  "vzeroupper, VEX" },
+    { "\x0F\x0F\xC1\xB4",                   0,  "3DNow!" },
+    { "\xF0\xF0\xF0\xF0\xF0\xF0\xF0\xF0\xF0\xF0\xF0\xF0\xF0\xF0\xF0\x90", 0, "longer than 15 bytes" },
+};
+
+static const insn_t gInsns64[] =
+{
+    { "\x48\x8D\x15\x10\x20\x00\x00",       7,  "lea msg(%rip),%rdx" },
+    { "\x48\x89\xDF",                       3,  "mov %rbx,%rdi" },
+    { "\xBE\x84\x00\x01\x00",               5,  "mov $imm,%esi" },
+    { "\x66\xB8\x01\x00",                   4,  "mov $1,%ax" },
+    { "\x48\xB8\x01\x02\x03\x04\x05\x06\x07\x08", 10, "movabs $imm64,%rax" },
+    { "\x48\xC7\xC0\xFF\xFF\xFF\xFF",       7,  "mov $-1,%rax" },
+    { "\x48\x8B\x04\x25\x00\x10\x00\x00",   8,  "mov 0x1000,%rax" },
+    { "\x48\xA1\x01\x02\x03\x04\x05\x06\x07\x08", 10, "movabs 0x...,%rax" },
+    { "\x67\xA1\x00\x10\x00\x00",           6,  "mov 0x1000,%eax, 32 bit offset" },
+    { "\x41\xFF\xD3",                       3,  "call *%r11" },
+    { "\x40\x90",                           2,  "rex nop" },
+    { "\xE8\x00\x00\x00\x00",               5,  "call rel32" },
+    { "\x66\xE8\x00\x00\x00\x00",           6,  "call rel32, 66 ignored" },
+    { "\x66\x0F\x84\x00\x01\x00\x00",       7,  "je rel32, 66 ignored" },
+    { "\x31\xFF",                           2,  "xor %edi,%edi" },
+    { "\x66\x0F\x1F\x84\x00\x00\x00\x00\x00", 9, "nopw 0(%rax,%rax)" },
+    { "\x06",                               0,  "push %es" },
+    { "\xEA\x00\x00\x00\x00\x08\x00",       0,  "ljmp ptr16:32" },
+    { "\xC4\xE2\x79\x00\xC1",               0,  "vpshufb, VEX" },
+    { "\x62\xF1\x7C\x48\x28\xC1",           0,  "vmovaps, EVEX" },
+};
+
+static void check_insns(const insn_t* insns, size_t count, bool is64)
+{
+    size_t i;
+
+    for(i = 0; i < count; i++)
+    {
+        UInt8 code[32];
+        UInt32 length;
+
+        memset(code, 0x90, sizeof(code));
+        memcpy(code, insns[i].bytes, insns[i].length ? insns[i].length : strlen(insns[i].bytes));
+
+        length = x86_insn_length(code, sizeof(code), is64);
+        if(length != insns[i].length)
+        {
+            char message[128];
+            snprintf(message, sizeof(message), "%s: %u bytes, expected %u", insns[i].what, length, insns[i].length);
+            test_fail(__FILE__, __LINE__, message);
+        }
+    }
+}
+
+TEST(x86_insn_corpus_32)
+{
+    check_insns(gInsns32, sizeof(gInsns32) / sizeof(gInsns32[0]), false);
+}
+
+TEST(x86_insn_corpus_64)
+{
+    check_insns(gInsns64, sizeof(gInsns64) / sizeof(gInsns64[0]), true);
+}
+
+TEST(x86_insn_truncated)
+{
+    size_t i;
+
+    // Any instruction cut short is rejected rather than read past the bytes available
+    for(i = 0; i < sizeof(gInsns64) / sizeof(gInsns64[0]); i++)
+    {
+        UInt32 length = gInsns64[i].length;
+        UInt32 available;
+
+        for(available = 0; available < length; available++)
+        {
+            UInt8* code = malloc(available ? available : 1);
+
+            memcpy(code, gInsns64[i].bytes, available);
+            if(x86_insn_length(code, available, true)) test_fail(__FILE__, __LINE__, gInsns64[i].what);
+            free(code);
+        }
+    }
+}
+
+TEST(x86_nop_fill_lengths)
+{
+    UInt32 length;
+
+    for(length = 1; length <= 40; length++)
+    {
+        UInt8* code = malloc(length);
+        UInt32 pos = 0;
+        int count = 0;
+
+        x86_nop_fill(code, length);
+
+        // Whole NOP instructions in both modes, as few as the 9 byte form allows
+        while(pos < length)
+        {
+            UInt32 size = x86_insn_length(&code[pos], length - pos, true);
+
+            if(!size || size != x86_insn_length(&code[pos], length - pos, false)) break;
+            if(code[pos] != 0x90 && !(code[pos] == 0x66 && code[pos + 1] == 0x90) &&
+               memcmp(&code[pos + (code[pos] == 0x66)], "\x0F\x1F", 2)) break;
+
+            pos += size;
+            count++;
+        }
+
+        CHECK_INT(pos, length);
+        CHECK_INT(count, (length + 8) / 9);
+
+        free(code);
+    }
+}
@@ -0,0 +1,2 @@
+/* IOCommandGate.h comes from the host shim */
+#include "../xnu.h"
@@ -0,0 +1,2 @@
+/* IONVRAM.h comes from the host shim */
+#include "../xnu.h"
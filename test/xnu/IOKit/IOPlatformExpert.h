@@ -0,0 +1,2 @@
+/* IOPlatformExpert.h comes from the host shim */
+#include "../xnu.h"
@@ -0,0 +1,2 @@
+/* IOService.h comes from the host shim */
+#include "../xnu.h"
@@ -0,0 +1,2 @@
+/* IOTimerEventSource.h comes from the host shim */
+#include "../xnu.h"
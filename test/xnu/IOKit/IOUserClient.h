@@ -0,0 +1,2 @@
+/* IOUserClient.h comes from the host shim */
+#include "../xnu.h"
@@ -0,0 +1,2 @@
+/* clock.h comes from the host shim */
+#include "../xnu.h"
@@ -0,0 +1,2 @@
+/* OSAtomic.h comes from the host shim */
+#include "../xnu.h"
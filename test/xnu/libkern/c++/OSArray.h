@@ -0,0 +1,2 @@
+/* OSArray.h comes from the host shim */
+#include "../../xnu.h"
@@ -0,0 +1,2 @@
+/* OSBoolean.h comes from the host shim */
+#include "../../xnu.h"
@@ -0,0 +1,2 @@
+/* OSCollectionIterator.h comes from the host shim */
+#include "../../xnu.h"
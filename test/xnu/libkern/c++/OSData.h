@@ -0,0 +1,2 @@
+/* OSData.h comes from the host shim */
+#include "../../xnu.h"
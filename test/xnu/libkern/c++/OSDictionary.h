@@ -0,0 +1,2 @@
+/* OSDictionary.h comes from the host shim */
+#include "../../xnu.h"
@@ -0,0 +1,2 @@
+/* OSNumber.h comes from the host shim */
+#include "../../xnu.h"
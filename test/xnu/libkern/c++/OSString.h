@@ -0,0 +1,2 @@
+/* OSString.h comes from the host shim */
+#include "../../xnu.h"
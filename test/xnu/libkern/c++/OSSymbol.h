@@ -0,0 +1,2 @@
+/* OSSymbol.h comes from the host shim */
+#include "../../xnu.h"
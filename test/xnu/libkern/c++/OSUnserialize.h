@@ -0,0 +1,2 @@
+/* OSUnserialize.h comes from the host shim */
+#include "../../xnu.h"
@@ -0,0 +1,2 @@
+/* libkern.h comes from the host shim */
+#include "../xnu.h"
@@ -0,0 +1,2 @@
+/* zlib.h comes from the host shim */
+#include "../xnu.h"
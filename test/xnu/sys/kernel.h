@@ -0,0 +1,2 @@
+/* kernel.h comes from the host shim */
+#include "../xnu.h"
@@ -0,0 +1,2 @@
+/* proc.h comes from the host shim */
+#include "../xnu.h"
@@ -0,0 +1,2 @@
+/* vnode.h comes from the host shim */
+#include "../xnu.h"
@@ -0,0 +1,758 @@
+/*
+ *  xnu.h
+ *  FileNVRAM tests
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TEST_XNU_H
+#define __TEST_XNU_H
+
+/**
+ ** Just enough of libkern, IOKit and the BSD KPIs for FileNVRAM.kext to build and run on the host, see host/xnu.cpp.
+ ** Every header the kext includes forwards here. FileNVRAM.h defines private as public, so everything the shim
+ ** needs from the host is included up front, and the STL is never used.
+ **
+ ** Behaviour follows xnu where the kext depends on it: objects are zero filled and reference counted, symbols are
+ ** interned, dictionaries are unsorted arrays grown by their initial capacity, OSSerialize writes xnu's XML with
+ ** ID/IDREF and each registry entry's properties are guarded by its own lock. Work loops are a recursive mutex,
+ ** timers only fire when a test fires them.
+ **/
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <new>
+#include <libkern/OSTypes.h>
+
+/********************************************************************/
+/**                     Mach and BSD                               **/
+/********************************************************************/
+
+typedef int             IOReturn;
+typedef int             boolean_t;
+typedef unsigned long   IOByteCount;
+typedef UInt32          IOOptionBits;
+typedef struct task*    task_t;
+typedef struct proc*    proc_t;
+typedef struct ucred*   kauth_cred_t;
+typedef struct vfs_context* vfs_context_t;
+typedef struct vnode*   vnode_t;
+
+#define kIOReturnSuccess        0
+#define kIOReturnError          ((IOReturn)0xe00002bc)
+#define kIOReturnNoMemory       ((IOReturn)0xe00002bd)
+#define kIOReturnBadArgument    ((IOReturn)0xe00002c2)
+#define kIOReturnNotPrivileged  ((IOReturn)0xe00002c1)
+#define kIOReturnUnsupported    ((IOReturn)0xe00002c7)
+#define kIOReturnNotReady       ((IOReturn)0xe00002d8)
+#define kIOReturnNotFound       ((IOReturn)0xe00002f0)
+
+/* Not BSD's values, those are O_WRONLY and O_RDWR on Linux. Stripped before the host's open. */
+#define FREAD                   0x40000000
+#define FWRITE                  0x20000000
+#define FWASWRITTEN             0x00010000
+
+#define VNODE_LOOKUP_NOFOLLOW   0x01
+
+enum vtype { VNON, VREG, VDIR };
+enum uio_rw { UIO_READ, UIO_WRITE };
+enum uio_seg { UIO_USERSPACE, UIO_SYSSPACE };
+
+#define IO_UNIT                 0x0001
+#define IO_NODELOCKED           0x0008
+#define IO_NOCACHE              0x0040
+
+#define VNODE_ATTR_va_data_size     (1ULL << 4)
+#define VNODE_ATTR_va_modify_time   (1ULL << 14)
+
+struct vnode_attr
+{
+    uint64_t        va_supported;
+    uint64_t        va_active;
+    off_t           va_data_size;
+    struct timespec va_modify_time;
+};
+
+#define VATTR_INIT(v)               do { (v)->va_supported = (v)->va_active = 0; } while(0)
+#define VATTR_WANTED(v, a)          ((v)->va_active |= VNODE_ATTR_ ## a)
+#define VATTR_IS_SUPPORTED(v, a)    (((v)->va_supported & VNODE_ATTR_ ## a) != 0)
+
+extern "C" {
+
+/** Paths are mapped onto the test's directory with host_path, see host/host.h **/
+int             vnode_open(const char* path, int fmode, int cmode, int flags, vnode_t* vpp, vfs_context_t ctx);
+int             vnode_close(vnode_t vp, int flags, vfs_context_t ctx);
+int             vnode_lookup(const char* path, int flags, vnode_t* vpp, vfs_context_t ctx);
+int             vnode_put(vnode_t vp);
+int             vnode_isreg(vnode_t vp);
+int             vnode_getattr(vnode_t vp, struct vnode_attr* vap, vfs_context_t ctx);
+int             vn_rdwr(enum uio_rw rw, vnode_t vp, caddr_t base, int len, off_t offset, enum uio_seg segflg,
+                        int ioflg, kauth_cred_t cred, int* aresid, proc_t p);
+
+vfs_context_t   vfs_context_current(void);
+proc_t          vfs_context_proc(vfs_context_t ctx);
+kauth_cred_t    vfs_context_ucred(vfs_context_t ctx);
+int             proc_pid(proc_t p);
+void            proc_name(int pid, char* buf, int size);
+task_t          current_task(void);
+
+/** Boot arguments come from xnu_set_boot_args **/
+bool            PE_parse_boot_argn(const char* arg_string, void* arg_ptr, int max_arg);
+
+void            IOLog(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void*           IOMalloc(size_t size);
+void            IOFree(void* address, size_t size);
+
+/* glibc before 2.38 has no strlcpy */
+size_t          xnu_strlcpy(char* dst, const char* src, size_t size);
+#define strlcpy xnu_strlcpy
+
+/** Uptime is in ns, so absolute time needs no conversion **/
+void            clock_get_uptime(uint64_t* result);
+void            absolutetime_to_nanoseconds(uint64_t abstime, uint64_t* result);
+
+}
+
+static inline SInt64 OSIncrementAtomic64(volatile SInt64* address)
+{
+    return __sync_fetch_and_add(address, 1);
+}
+
+static inline SInt64 OSAddAtomic64(SInt64 amount, volatile SInt64* address)
+{
+    return __sync_fetch_and_add(address, amount);
+}
+
+static inline bool OSCompareAndSwap64(UInt64 oldValue, UInt64 newValue, volatile UInt64* address)
+{
+    return __sync_bool_compare_and_swap(address, oldValue, newValue);
+}
+
+typedef struct kmod_info
+{
+    char    name[64];
+    char    version[64];
+} kmod_info_t;
+
+/********************************************************************/
+/**                     libkern C++                                **/
+/********************************************************************/
+
+class OSMetaClassBase;
+class OSObject;
+class OSString;
+class OSSymbol;
+class OSSerialize;
+
+/** Class name and superclass, enough for OSDynamicCast without RTTI **/
+class OSMetaClass
+{
+public:
+    constexpr OSMetaClass(const char* name, const OSMetaClass* superClass) : className(name), superClassLink(superClass) { }
+
+    const char*         getClassName() const { return className; }
+    const OSMetaClass*  getSuperClass() const { return superClassLink; }
+
+    const char*         className;
+    const OSMetaClass*  superClassLink;
+};
+
+#define OSDeclareCommonStructors(className)                         \
+    public:                                                         \
+        static OSMetaClass gMetaClass;                              \
+        static const OSMetaClass* const metaClass;                  \
+        virtual const OSMetaClass* getMetaClass() const;            \
+        className();                                                \
+        virtual ~className()
+
+#define OSDeclareDefaultStructors(className)    OSDeclareCommonStructors(className)
+#define OSDeclareAbstractStructors(className)   OSDeclareCommonStructors(className)
+
+#define OSDefineMetaClassAndStructors(className, superclassName)                    \
+    OSMetaClass className::gMetaClass(#className, &superclassName::gMetaClass);     \
+    const OSMetaClass* const className::metaClass = &className::gMetaClass;         \
+    const OSMetaClass* className::getMetaClass() const { return &gMetaClass; }     \
+    className::className() { }                                                      \
+    className::~className() { }
+
+#define OSDefineMetaClassAndAbstractStructors(className, superclassName)   \
+    OSDefineMetaClassAndStructors(className, superclassName)
+
+#define OSTypeID(type)              (&type::gMetaClass)
+#define OSDynamicCast(type, inst)   ((type*)OSMetaClassBase::safeMetaCast((const OSMetaClassBase*)(inst), OSTypeID(type)))
+#define OSSafeReleaseNULL(inst)     do { if(inst) (inst)->release(); (inst) = NULL; } while(0)
+
+class OSMetaClassBase
+{
+public:
+    static const OSMetaClassBase* safeMetaCast(const OSMetaClassBase* anObject, const OSMetaClass* toMeta);
+
+    const OSMetaClassBase*  metaCast(const OSMetaClass* toMeta) const;
+    const OSMetaClassBase*  metaCast(const char* toMeta) const;
+
+    virtual const OSMetaClass* getMetaClass() const = 0;
+    virtual void    retain() const = 0;
+    virtual void    release() const = 0;
+    virtual int     getRetainCount() const = 0;
+    virtual bool    serialize(OSSerialize* s) const = 0;
+    virtual bool    isEqualTo(const OSMetaClassBase* anObject) const;
+
+    virtual ~OSMetaClassBase() { }
+};
+
+/** Memory comes zero filled from operator new, like kalloc's for OSObjects **/
+class OSObject : public OSMetaClassBase
+{
+    OSDeclareDefaultStructors(OSObject);
+
+public:
+    static void*    operator new(size_t size) noexcept;
+    static void     operator delete(void* mem, size_t size);
+
+    virtual bool    init();
+    virtual void    free();
+
+    virtual void    retain() const override;
+    virtual void    release() const override;
+    virtual int     getRetainCount() const override;
+    virtual bool    serialize(OSSerialize* s) const override;
+
+    mutable volatile SInt32 retainCount;    /* references beyond the first */
+};
+
+class OSIterator : public OSObject
+{
+    OSDeclareAbstractStructors(OSIterator);
+
+public:
+    virtual void        reset() = 0;
+    virtual bool        isValid() = 0;
+    virtual OSObject*   getNextObject() = 0;
+};
+
+class OSCollection : public OSObject
+{
+    OSDeclareAbstractStructors(OSCollection);
+
+public:
+    virtual unsigned int    getCount() const = 0;
+    virtual unsigned int    getCapacity() const = 0;
+    virtual unsigned int    ensureCapacity(unsigned int newCapacity) = 0;
+
+    /** Iteration state is a single index, see OSCollectionIterator **/
+    virtual bool            initIterator(void* iterator) const;
+    virtual bool            getNextObjectForIterator(void* iterator, OSObject** ret) const = 0;
+
+    void                    haveUpdated() { updateStamp++; }
+
+    unsigned int            updateStamp;
+    unsigned int            capacityIncrement;
+};
+
+class OSString : public OSObject
+{
+    OSDeclareDefaultStructors(OSString);
+
+public:
+    static OSString*    withCString(const char* cString);
+    static OSString*    withString(const OSString* aString);
+
+    virtual bool        initWithCString(const char* cString);
+    virtual void        free() override;
+
+    virtual unsigned int getLength() const { return length; }
+    virtual const char* getCStringNoCopy() const { return string; }
+
+    virtual bool        isEqualTo(const char* aCString) const;
+    virtual bool        isEqualTo(const OSString* aString) const;
+    virtual bool        isEqualTo(const OSMetaClassBase* anObject) const override;
+    virtual bool        serialize(OSSerialize* s) const override;
+
+    char*               string;
+    unsigned int        length;
+};
+
+/** Interned, one instance per string for as long as it is referenced **/
+class OSSymbol : public OSString
+{
+    OSDeclareDefaultStructors(OSSymbol);
+
+public:
+    static const OSSymbol*  withCString(const char* cString);
+    static const OSSymbol*  withCStringNoCopy(const char* cString);
+    static const OSSymbol*  withString(const OSString* aString);
+
+    virtual void        release() const override;
+
+    UInt32              hash;
+    OSSymbol*           poolNext;
+};
+
+class OSData : public OSObject
+{
+    OSDeclareDefaultStructors(OSData);
+
+public:
+    static OSData*      withCapacity(unsigned int capacity);
+    static OSData*      withBytes(const void* bytes, unsigned int numBytes);
+    static OSData*      withData(const OSData* other);
+
+    virtual bool        initWithCapacity(unsigned int capacity);
+    virtual void        free() override;
+
+    virtual unsigned int getLength() const { return length; }
+    virtual unsigned int getCapacity() const { return capacity; }
+    virtual unsigned int ensureCapacity(unsigned int newCapacity);
+    virtual const void* getBytesNoCopy() const { return data; }
+    virtual const void* getBytesNoCopy(unsigned int start, unsigned int numBytes) const;
+
+    virtual bool        appendBytes(const void* bytes, unsigned int numBytes);
+    virtual bool        appendBytes(const OSData* other);
+    virtual bool        appendByte(unsigned char byte, unsigned int numBytes);
+
+    virtual bool        isEqualTo(const void* bytes, unsigned int numBytes) const;
+    virtual bool        isEqualTo(const OSData* aData) const;
+    virtual bool        isEqualTo(const OSMetaClassBase* anObject) const override;
+    virtual bool        serialize(OSSerialize* s) const override;
+
+    void*               data;
+    unsigned int        length;
+    unsigned int        capacity;
+    unsigned int        capacityIncrement;
+};
+
+class OSNumber : public OSObject
+{
+    OSDeclareDefaultStructors(OSNumber);
+
+public:
+    static OSNumber*    withNumber(unsigned long long value, unsigned int numberOfBits);
+
+    virtual unsigned int        numberOfBits() const { return size; }
+    virtual unsigned char       unsigned8BitValue() const { return (unsigned char)value; }
+    virtual unsigned short      unsigned16BitValue() const { return (unsigned short)value; }
+    virtual unsigned int        unsigned32BitValue() const { return (unsigned int)value; }
+    virtual unsigned long long  unsigned64BitValue() const { return value; }
+
+    virtual bool        isEqualTo(const OSMetaClassBase* anObject) const override;
+    virtual bool        serialize(OSSerialize* s) const override;
+
+    unsigned long long  value;
+    unsigned int        size;
+};
+
+/** Two shared instances that are never freed **/
+class OSBoolean : public OSObject
+{
+    OSDeclareDefaultStructors(OSBoolean);
+
+public:
+    static OSBoolean*   withBoolean(bool value);
+
+    virtual void        retain() const override { }
+    virtual void        release() const override { }
+
+    virtual bool        isTrue() const { return value; }
+    virtual bool        isFalse() const { return !value; }
+    virtual bool        getValue() const { return value; }
+
+    virtual bool        serialize(OSSerialize* s) const override;
+
+    bool                value;
+};
+
+extern OSBoolean* const kOSBooleanTrue;
+extern OSBoolean* const kOSBooleanFalse;
+
+class OSArray : public OSCollection
+{
+    OSDeclareDefaultStructors(OSArray);
+
+public:
+    static OSArray*     withCapacity(unsigned int capacity);
+
+    virtual bool        initWithCapacity(unsigned int capacity);
+    virtual void        free() override;
+
+    virtual unsigned int getCount() const override { return count; }
+    virtual unsigned int getCapacity() const override { return capacity; }
+    virtual unsigned int ensureCapacity(unsigned int newCapacity) override;
+
+    virtual bool        setObject(const OSMetaClassBase* anObject);
+    virtual OSObject*   getObject(unsigned int index) const;
+    virtual void        removeObject(unsigned int index);
+
+    virtual bool        getNextObjectForIterator(void* iterator, OSObject** ret) const override;
+    virtual bool        serialize(OSSerialize* s) const override;
+
+    const OSMetaClassBase** array;
+    unsigned int        count;
+    unsigned int        capacity;
+};
+
+/** Unsorted key/value array, lookups are a linear scan comparing interned keys **/
+class OSDictionary : public OSCollection
+{
+    OSDeclareDefaultStructors(OSDictionary);
+
+public:
+    static OSDictionary* withCapacity(unsigned int capacity);
+    static OSDictionary* withDictionary(const OSDictionary* dict, unsigned int capacity = 0);
+
+    virtual bool        initWithCapacity(unsigned int capacity);
+    virtual void        free() override;
+
+    virtual unsigned int getCount() const override { return count; }
+    virtual unsigned int getCapacity() const override { return capacity; }
+    virtual unsigned int ensureCapacity(unsigned int newCapacity) override;
+
+    virtual bool        setObject(const OSSymbol* aKey, const OSMetaClassBase* anObject);
+    virtual bool        setObject(const OSString* aKey, const OSMetaClassBase* anObject);
+    virtual bool        setObject(const char* aKey, const OSMetaClassBase* anObject);
+
+    virtual OSObject*   getObject(const OSSymbol* aKey) const;
+    virtual OSObject*   getObject(const OSString* aKey) const;
+    virtual OSObject*   getObject(const char* aKey) const;
+
+    virtual void        removeObject(const OSSymbol* aKey);
+    virtual void        removeObject(const OSString* aKey);
+    virtual void        removeObject(const char* aKey);
+
+    virtual bool        getNextObjectForIterator(void* iterator, OSObject** ret) const override;
+    virtual bool        serialize(OSSerialize* s) const override;
+
+    struct dictEntry
+    {
+        const OSSymbol*         key;
+        const OSMetaClassBase*  value;
+    };
+
+    dictEntry*          dictionary;
+    unsigned int        count;
+    unsigned int        capacity;
+};
+
+/** Fails once the collection changes, like xnu's **/
+class OSCollectionIterator : public OSIterator
+{
+    OSDeclareDefaultStructors(OSCollectionIterator);
+
+public:
+    static OSCollectionIterator* withCollection(const OSCollection* inColl);
+
+    virtual void        free() override;
+    virtual void        reset() override;
+    virtual bool        isValid() override;
+    virtual OSObject*   getNextObject() override;
+
+    const OSCollection* collection;
+    unsigned int        collIterator;
+    unsigned int        initialUpdateStamp;
+    bool                valid;
+};
+
+/** XML in xnu's flavour: start tags carry ID="n", objects seen before become <reference IDREF="n"/> **/
+class OSSerialize : public OSObject
+{
+    OSDeclareDefaultStructors(OSSerialize);
+
+public:
+    static OSSerialize* withCapacity(unsigned int capacity);
+
+    virtual void        free() override;
+
+    virtual char*       text() const { return data; }
+    virtual unsigned int getLength() const { return length; }
+
+    virtual bool        addChar(const char aChar);
+    virtual bool        addString(const char* aString);
+    virtual bool        addXMLStartTag(const OSMetaClassBase* o, const char* tagString);
+    virtual bool        addXMLEndTag(const char* tagString);
+    virtual bool        previouslySerialized(const OSMetaClassBase* o);
+
+    bool                ensureLength(unsigned int needed);
+
+    char*               data;
+    unsigned int        length;
+    unsigned int        capacity;
+    unsigned int        capacityIncrement;
+
+    struct tagEntry
+    {
+        const OSMetaClassBase*  object;
+        unsigned int            tag;
+    };
+
+    tagEntry*           tags;           /* open addressing, keyed by object */
+    unsigned int        tagCapacity;
+    unsigned int        tagCount;
+};
+
+/** Parses xnu's XML, dictionary keys are symbols. On failure returns NULL and, if asked, an error message. **/
+OSObject* OSUnserializeXML(const char* buffer, OSString** errorString = 0);
+
+/********************************************************************/
+/**                     IOKit                                      **/
+/********************************************************************/
+
+class IOService;
+class IOWorkLoop;
+class IONVRAMController;
+
+typedef struct IORegistryPlane
+{
+    const char* name;
+} IORegistryPlane;
+
+extern const IORegistryPlane* gIODTPlane;
+extern const IORegistryPlane* gIOServicePlane;
+extern const OSSymbol* gIOProviderClassKey;
+
+#define kIOPMPowerOn            0x00000002
+#define kIOPMAckImplied         0
+#define kIOPMPowerStateVersion1 1
+
+typedef unsigned long IOPMPowerFlags;
+
+typedef struct
+{
+    unsigned long   version;
+    IOPMPowerFlags  capabilityFlags;
+    IOPMPowerFlags  outputPowerCharacter;
+    IOPMPowerFlags  inputPowerRequirement;
+    unsigned long   staticPower;
+    unsigned long   unbudgetedPower;
+    unsigned long   powerToAttain;
+    unsigned long   timeToAttain;
+    unsigned long   settleUpTime;
+    unsigned long   timeToLower;
+    unsigned long   settleDownTime;
+    unsigned long   powerDomainBudget;
+} IOPMPowerState;
+
+#define kIOClientPrivilegeAdministrator "root"
+
+/**
+ ** Properties live in a table guarded by the entry's lock. Only the device tree plane has any structure:
+ ** an entry has at most one parent, and an entry's name in that plane may differ from its own.
+ **/
+class IORegistryEntry : public OSObject
+{
+    OSDeclareDefaultStructors(IORegistryEntry);
+
+public:
+    static IORegistryEntry* fromPath(const char* path, const IORegistryPlane* plane = 0, char* residualPath = 0,
+                                     int* residualLength = 0, IORegistryEntry* fromEntry = 0);
+
+    virtual bool        init(OSDictionary* dictionary = 0);
+    virtual bool        init(IORegistryEntry* old, const IORegistryPlane* plane);
+    virtual void        free() override;
+
+    virtual const char* getName(const IORegistryPlane* plane = 0) const;
+    virtual void        setName(const char* name, const IORegistryPlane* plane = 0);
+
+    virtual OSIterator* getChildIterator(const IORegistryPlane* plane) const;
+    virtual IORegistryEntry* getParentEntry(const IORegistryPlane* plane) const;
+    virtual bool        attachToParent(IORegistryEntry* parent, const IORegistryPlane* plane);
+    virtual void        detachFromParent(IORegistryEntry* parent, const IORegistryPlane* plane);
+
+    virtual OSDictionary* dictionaryWithProperties() const;
+    virtual OSDictionary* getPropertyTable() const;
+    virtual void        setPropertyTable(OSDictionary* dict);
+    virtual bool        serializeProperties(OSSerialize* s) const;
+    virtual IOReturn    setProperties(OSObject* properties);
+
+    virtual OSObject*   getProperty(const OSSymbol* aKey) const;
+    virtual OSObject*   getProperty(const OSString* aKey) const;
+    virtual OSObject*   getProperty(const char* aKey) const;
+    virtual OSObject*   copyProperty(const OSSymbol* aKey) const;
+    virtual OSObject*   copyProperty(const OSString* aKey) const;
+    virtual OSObject*   copyProperty(const char* aKey) const;
+
+    virtual bool        setProperty(const OSSymbol* aKey, OSObject* anObject);
+    virtual bool        setProperty(const OSString* aKey, OSObject* anObject);
+    virtual bool        setProperty(const char* aKey, OSObject* anObject);
+    virtual bool        setProperty(const char* aKey, const char* aString);
+    virtual bool        setProperty(const char* aKey, bool aBoolean);
+    virtual bool        setProperty(const char* aKey, unsigned long long aValue, unsigned int aNumberOfBits);
+    virtual bool        setProperty(const char* aKey, void* bytes, unsigned int length);
+
+    virtual void        removeProperty(const OSSymbol* aKey);
+    virtual void        removeProperty(const OSString* aKey);
+    virtual void        removeProperty(const char* aKey);
+
+    mutable pthread_mutex_t fLock;
+    OSDictionary*       fPropertyTable;
+    const OSSymbol*     fName;
+    const OSSymbol*     fPlaneName;     /* name in the device tree plane, if set */
+    IORegistryEntry*    fParent;
+    OSArray*            fChildren;
+};
+
+class IOService : public IORegistryEntry
+{
+    OSDeclareDefaultStructors(IOService);
+
+public:
+    static OSDictionary* resourceMatching(const char* name, OSDictionary* table = 0);
+    static IOService*   waitForMatchingService(OSDictionary* matching, uint64_t timeout = UINT64_MAX);
+
+    virtual bool        start(IOService* provider);
+    virtual void        stop(IOService* provider);
+    virtual bool        passiveMatch(OSDictionary* matching, bool changesOK = false);
+    virtual IOWorkLoop* getWorkLoop() const;
+    virtual void        registerService(IOOptionBits options = 0);
+    virtual IOReturn    callPlatformFunction(const OSSymbol* functionName, bool waitForFunction,
+                                             void* param1, void* param2, void* param3, void* param4);
+    virtual IOReturn    setPowerState(unsigned long powerStateOrdinal, IOService* whatDevice);
+
+    void                PMinit();
+    void                PMstop();
+    IOReturn            registerPowerDriver(IOService* controllingDriver, IOPMPowerState* powerStates, unsigned long numberOfStates);
+    IOReturn            joinPMtree(IOService* driver);
+
+    bool                fRegistered;
+};
+
+class IODTNVRAM : public IOService
+{
+    OSDeclareDefaultStructors(IODTNVRAM);
+
+public:
+    virtual bool        init(IORegistryEntry* old, const IORegistryPlane* plane) override;
+
+    virtual void        registerNVRAMController(IONVRAMController* nvram);
+    virtual void        sync(void);
+    virtual IOReturn    syncOFVariables(void);
+
+    virtual IOReturn    readXPRAM(IOByteCount offset, UInt8* buffer, IOByteCount length);
+    virtual IOReturn    writeXPRAM(IOByteCount offset, UInt8* buffer, IOByteCount length);
+    virtual IOReturn    readNVRAMProperty(IORegistryEntry* entry, const OSSymbol** name, OSData** value);
+    virtual IOReturn    writeNVRAMProperty(IORegistryEntry* entry, const OSSymbol* name, OSData* value);
+
+    virtual OSDictionary* getNVRAMPartitions(void);
+    virtual IOReturn    readNVRAMPartition(const OSSymbol* partitionID, IOByteCount offset, UInt8* buffer, IOByteCount length);
+    virtual IOReturn    writeNVRAMPartition(const OSSymbol* partitionID, IOByteCount offset, UInt8* buffer, IOByteCount length);
+
+    virtual IOByteCount savePanicInfo(UInt8* buffer, IOByteCount length);
+    virtual bool        safeToSync(void);
+};
+
+class IOEventSource : public OSObject
+{
+    OSDeclareAbstractStructors(IOEventSource);
+
+public:
+    virtual bool        init(OSObject* owner);
+
+    virtual IOWorkLoop* getWorkLoop() const { return workLoop; }
+
+    OSObject*           owner;
+    IOWorkLoop*         workLoop;
+};
+
+/** A recursive lock, event sources only run when called or fired from the test **/
+class IOWorkLoop : public OSObject
+{
+    OSDeclareDefaultStructors(IOWorkLoop);
+
+public:
+    static IOWorkLoop*  workLoop();
+
+    virtual void        free() override;
+
+    virtual IOReturn    addEventSource(IOEventSource* newEvent);
+    virtual IOReturn    removeEventSource(IOEventSource* toRemove);
+
+    virtual void        closeGate();
+    virtual void        openGate();
+
+    pthread_mutex_t     gateLock;
+    OSArray*            eventSources;
+};
+
+class IOCommandGate : public IOEventSource
+{
+    OSDeclareDefaultStructors(IOCommandGate);
+
+public:
+    typedef IOReturn (*Action)(OSObject* owner, void* arg0, void* arg1, void* arg2, void* arg3);
+
+    static IOCommandGate* commandGate(OSObject* owner, Action action = 0);
+
+    virtual IOReturn    runCommand(void* arg0 = 0, void* arg1 = 0, void* arg2 = 0, void* arg3 = 0);
+
+    Action              action;
+};
+
+class IOTimerEventSource : public IOEventSource
+{
+    OSDeclareDefaultStructors(IOTimerEventSource);
+
+public:
+    typedef void (*Action)(OSObject* owner, IOTimerEventSource* sender);
+
+    static IOTimerEventSource* timerEventSource(OSObject* owner, Action action = 0);
+
+    virtual IOReturn    setTimeoutMS(UInt32 ms);
+    virtual void        cancelTimeout();
+
+    /** Host only: run the action on the work loop if the timer is armed, returns false if it wasn't **/
+    bool                fire();
+    bool                isArmed() const { return armed; }
+    UInt32              getTimeoutMS() const { return timeoutMS; }
+
+    Action              action;
+    UInt32              timeoutMS;
+    bool                armed;
+};
+
+class IOUserClient : public IOService
+{
+    OSDeclareAbstractStructors(IOUserClient);
+
+public:
+    /** Answers with xnu_set_client_privilege's result **/
+    static IOReturn     clientHasPrivilege(void* securityToken, const char* privilegeName);
+};
+
+/********************************************************************/
+/**                     Host only                                  **/
+/********************************************************************/
+
+/** Boot arguments for PE_parse_boot_argn: space separated -flags and key=value pairs **/
+void                xnu_set_boot_args(const char* args);
+
+void                xnu_set_client_privilege(IOReturn result);
+
+/** Let waitForMatchingService find resource name **/
+void                xnu_publish_resource(const char* name);
+
+/** New device tree entry below parent (the root if NULL), named like Open Firmware nodes with a "name" property **/
+IORegistryEntry*    xnu_dt_add_entry(IORegistryEntry* parent, const char* name);
+
+/** Last function name passed to callPlatformFunction, NULL if none **/
+const char*         xnu_platform_function(void);
+
+/** Times any OSDictionary had to grow past its capacity **/
+extern unsigned long gOSDictionaryGrows;
+
+#endif /* !__TEST_XNU_H */
@@ -0,0 +1,47 @@
+/*
+ *  libsaio.h
+ *  FileNVRAM tools
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TOOLS_LIBSAIO_H
+#define __TOOLS_LIBSAIO_H
+
+/**
+ ** Just enough of Chameleon's libsaio for the module's portable sources to build into host tools.
+ ** File access goes straight to the host's open/read/close, verbose and file_size are up to each tool.
+ **/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libkern/OSTypes.h>
+
+typedef struct BootVolume* BVRef;
+
+/** Only the fields the module reads, in no particular order **/
+struct BootVolume
+{
+    BVRef next;
+    int biosdev;
+    int part_no;
+    bool OSisInstaller;
+    void (*description)(BVRef bvr, char* str, long strMaxLen);
+};
+
+#define BIOS_DEV_UNIT(bvr)  ((bvr)->biosdev - 0x80)
+
+int     file_size(int fdesc);
+int     verbose(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif /* !__TOOLS_LIBSAIO_H */
@@ -0,0 +1 @@
+/* nothing from bootstruct.h is needed by the kernel patcher */
@@ -0,0 +1,39 @@
+/*
+ *  fat.h
+ *  FileNVRAM tools
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TOOLS_MACHO_FAT_H
+#define __TOOLS_MACHO_FAT_H
+
+#include <stdint.h>
+
+/** Universal binary header, all fields are big endian **/
+#define FAT_MAGIC           0xcafebabe
+
+#define CPU_TYPE_X86        7
+#define CPU_TYPE_X86_64     (CPU_TYPE_X86 | 0x01000000)
+
+struct fat_header
+{
+    uint32_t    magic;
+    uint32_t    nfat_arch;
+};
+
+struct fat_arch
+{
+    int32_t     cputype;
+    int32_t     cpusubtype;
+    uint32_t    offset;
+    uint32_t    size;
+    uint32_t    align;
+};
+
+#endif /* !__TOOLS_MACHO_FAT_H */
@@ -0,0 +1,126 @@
+/*
+ *  loader.h
+ *  FileNVRAM tools
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TOOLS_MACHO_LOADER_H
+#define __TOOLS_MACHO_LOADER_H
+
+#include <stdint.h>
+
+/** Mach-O layouts used by the kernel patcher and kpatch's parse_mach, as found in xnu's EXTERNAL_HEADERS **/
+#define MH_MAGIC        0xfeedface
+#define MH_MAGIC_64     0xfeedfacf
+
+#define LC_SEGMENT      0x1
+#define LC_SYMTAB       0x2
+#define LC_SEGMENT_64   0x19
+
+struct mach_header
+{
+    uint32_t    magic;
+    int32_t     cputype;
+    int32_t     cpusubtype;
+    uint32_t    filetype;
+    uint32_t    ncmds;
+    uint32_t    sizeofcmds;
+    uint32_t    flags;
+};
+
+struct mach_header_64
+{
+    uint32_t    magic;
+    int32_t     cputype;
+    int32_t     cpusubtype;
+    uint32_t    filetype;
+    uint32_t    ncmds;
+    uint32_t    sizeofcmds;
+    uint32_t    flags;
+    uint32_t    reserved;
+};
+
+struct load_command
+{
+    uint32_t    cmd;
+    uint32_t    cmdsize;
+};
+
+struct segment_command
+{
+    uint32_t    cmd;
+    uint32_t    cmdsize;
+    char        segname[16];
+    uint32_t    vmaddr;
+    uint32_t    vmsize;
+    uint32_t    fileoff;
+    uint32_t    filesize;
+    int32_t     maxprot;
+    int32_t     initprot;
+    uint32_t    nsects;
+    uint32_t    flags;
+};
+
+struct segment_command_64
+{
+    uint32_t    cmd;
+    uint32_t    cmdsize;
+    char        segname[16];
+    uint64_t    vmaddr;
+    uint64_t    vmsize;
+    uint64_t    fileoff;
+    uint64_t    filesize;
+    int32_t     maxprot;
+    int32_t     initprot;
+    uint32_t    nsects;
+    uint32_t    flags;
+};
+
+struct section
+{
+    char        sectname[16];
+    char        segname[16];
+    uint32_t    addr;
+    uint32_t    size;
+    uint32_t    offset;
+    uint32_t    align;
+    uint32_t    reloff;
+    uint32_t    nreloc;
+    uint32_t    flags;
+    uint32_t    reserved1;
+    uint32_t    reserved2;
+};
+
+struct section_64
+{
+    char        sectname[16];
+    char        segname[16];
+    uint64_t    addr;
+    uint64_t    size;
+    uint32_t    offset;
+    uint32_t    align;
+    uint32_t    reloff;
+    uint32_t    nreloc;
+    uint32_t    flags;
+    uint32_t    reserved1;
+    uint32_t    reserved2;
+    uint32_t    reserved3;
+};
+
+struct symtab_command
+{
+    uint32_t    cmd;
+    uint32_t    cmdsize;
+    uint32_t    symoff;
+    uint32_t    nsyms;
+    uint32_t    stroff;
+    uint32_t    strsize;
+};
+
+#endif /* !__TOOLS_MACHO_LOADER_H */
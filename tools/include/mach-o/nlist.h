@@ -0,0 +1,46 @@
+/*
+ *  nlist.h
+ *  FileNVRAM tools
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TOOLS_MACHO_NLIST_H
+#define __TOOLS_MACHO_NLIST_H
+
+#include <stdint.h>
+
+#define N_STAB  0xe0
+#define N_TYPE  0x0e
+#define N_SECT  0xe
+
+struct nlist
+{
+    union
+    {
+        uint32_t    n_strx;
+    } n_un;
+    uint8_t     n_type;
+    uint8_t     n_sect;
+    int16_t     n_desc;
+    uint32_t    n_value;
+};
+
+struct nlist_64
+{
+    union
+    {
+        uint32_t    n_strx;
+    } n_un;
+    uint8_t     n_type;
+    uint8_t     n_sect;
+    uint16_t    n_desc;
+    uint64_t    n_value;
+};
+
+#endif /* !__TOOLS_MACHO_NLIST_H */
@@ -0,0 +1 @@
+/* relocations are not used by the kernel patcher */
@@ -0,0 +1,24 @@
+/*
+ *  modules.h
+ *  FileNVRAM tools
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __TOOLS_MODULES_H
+#define __TOOLS_MODULES_H
+
+#include <libkern/OSTypes.h>
+
+/** Same callbacks as Chameleon's parse_mach. Only sections and symbols are reported, nothing is loaded. **/
+void* parse_mach(void* binary, void* new_base,
+                 int (*dylib_loader)(char*),
+                 long long (*symbol_handler)(char*, long long, char),
+                 void (*section_handler)(char* base, char* new_base, char* section, char* segment, void* cmd, UInt64 offset, UInt64 address));
+
+#endif /* !__TOOLS_MODULES_H */
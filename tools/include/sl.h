@@ -0,0 +1 @@
+/* nothing from sl.h is needed by the kernel patcher */
@@ -0,0 +1,450 @@
+/*
+ *  kpatch.c
+ *  kpatch
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+/**
+ ** Runs the module's kernel patcher against kernel files on the build host, to check a new kernel can be
+ ** patched without booting it. Each kernel is patched in its own process, since the patcher keeps its state
+ ** in statics, and up to one process per core runs at once.
+ **/
+
+#include "kpatch.h"
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <mach-o/loader.h>
+#include <mach-o/fat.h>
+#include "kernel_patcher.h"
+
+#define KPATCH_PATCHED      0
+#define KPATCH_UNPATCHED    1
+#define KPATCH_FAILED       2       /* unreadable, or not an x86 kernel */
+
+#define KPATCH_REGION_GAP   8       /* changed bytes this close together are reported as one region */
+#define KPATCH_HEX_MAX      32
+
+typedef struct
+{
+    int     runs;
+    bool    tabular;
+} kpatch_options_t;
+
+typedef struct
+{
+    char**  paths;
+    size_t  count;
+    size_t  capacity;
+} path_list_t;
+
+static double ms(uint64_t ns)
+{
+    return ns / 1000000.0;
+}
+
+static void print_hex(FILE* out, const UInt8* bytes, size_t length)
+{
+    size_t i;
+    for(i = 0; i < length && i < KPATCH_HEX_MAX; i++) fprintf(out, "%s%02x", i ? " " : "", bytes[i]);
+    if(length > KPATCH_HEX_MAX) fprintf(out, " ...");
+}
+
+/** Report each run of changed bytes, returns the number of regions. **/
+static size_t report_changes(FILE* out, const UInt8* original, const UInt8* patched, size_t length, size_t* changed)
+{
+    size_t regions = 0;
+    size_t i = 0;
+
+    *changed = 0;
+
+    while(i < length)
+    {
+        size_t start, end, gap;
+
+        if(original[i] == patched[i])
+        {
+            i++;
+            continue;
+        }
+
+        start = end = i;
+        for(gap = 0; i < length && gap < KPATCH_REGION_GAP; i++)
+        {
+            if(original[i] != patched[i])
+            {
+                end = i + 1;
+                gap = 0;
+                (*changed)++;
+            }
+            else
+            {
+                gap++;
+            }
+        }
+
+        regions++;
+        if(out)
+        {
+            fprintf(out, "    0x%08zx %3zu bytes: ", start, end - start);
+            print_hex(out, original + start, end - start);
+            fprintf(out, "\n                    -> ");
+            print_hex(out, patched + start, end - start);
+            fprintf(out, "\n");
+        }
+    }
+
+    return regions;
+}
+
+/** Patch one Mach-O image options->runs times, each time on a fresh copy. **/
+static int patch_image(FILE* out, const char* path, const UInt8* image, size_t length, uint64_t loadTime, const kpatch_options_t* options)
+{
+    const struct mach_header* header = (const struct mach_header*)image;
+    const char* arch;
+    UInt8* patched = NULL;
+    char* log = NULL;
+    size_t logLength = 0;
+    uint64_t parseBest = UINT64_MAX, patchBest = UINT64_MAX, parseTotal = 0, patchTotal = 0;
+    size_t regions, changed, symbols = 0, sections = 0;
+    int run, status;
+
+    if(length < sizeof(*header))                                                  arch = NULL;
+    else if(header->magic == MH_MAGIC && header->cputype == CPU_TYPE_X86)         arch = "i386";
+    else if(header->magic == MH_MAGIC_64 && header->cputype == CPU_TYPE_X86_64)   arch = "x86_64";
+    else                                                                          arch = NULL;
+
+    if(!arch)
+    {
+        fprintf(out, options->tabular ? "%s\t-\tunsupported\n" : "%s: not an x86 Mach-O kernel\n", path);
+        return KPATCH_FAILED;
+    }
+
+    for(run = 0; run < options->runs; run++)
+    {
+        UInt8* copy = malloc(length);
+        uint64_t start, elapsed;
+
+        if(!copy)
+        {
+            fprintf(out, "%s (%s): out of memory\n", path, arch);
+            free(patched);
+            return KPATCH_FAILED;
+        }
+        memcpy(copy, image, length);
+
+        // Only the first run's log is kept, the others are for timing.
+        gReport = (run == 0) ? open_memstream(&log, &logLength) : fopen("/dev/null", "w");
+        gMachLength = length;
+        gParseTime = 0;
+        gSymbolCount = gSectionCount = 0;
+
+        start = kpatch_now();
+        patch_kernel(copy, NULL, NULL, NULL);
+        elapsed = kpatch_now() - start;
+
+        if(gReport) fclose(gReport);
+        gReport = NULL;
+
+        parseTotal += gParseTime;
+        patchTotal += elapsed - gParseTime;
+        if(gParseTime < parseBest) parseBest = gParseTime;
+        if(elapsed - gParseTime < patchBest) patchBest = elapsed - gParseTime;
+
+        if(run == 0)
+        {
+            patched = copy;
+            symbols = gSymbolCount;
+            sections = gSectionCount;
+        }
+        else
+        {
+            free(copy);
+        }
+    }
+
+    regions = report_changes(NULL, image, patched, length, &changed);
+    status = regions ? KPATCH_PATCHED : KPATCH_UNPATCHED;
+
+    if(options->tabular)
+    {
+        fprintf(out, "%s\t%s\t%s\t%zu\t%zu\t%.3f\t%.3f\t%.3f\n", path, arch, regions ? "patched" : "unpatched",
+                regions, changed, ms(loadTime), ms(parseBest), ms(patchBest));
+    }
+    else
+    {
+        fprintf(out, "%s (%s): %s, %zu bytes in %zu regions\n", path, arch, regions ? "patched" : "not patched", changed, regions);
+
+        // Indent the patcher's own status lines under the kernel.
+        char* line = log;
+        while(line && *line)
+        {
+            char* next = strchr(line, '\n');
+            int lineLength = next ? (int)(next - line) : (int)strlen(line);
+            fprintf(out, "    %.*s\n", lineLength, line);
+            line = next ? next + 1 : NULL;
+        }
+
+        report_changes(out, image, patched, length, &changed);
+        fprintf(out, "    %zu symbols, %zu sections\n", symbols, sections);
+        fprintf(out, "    load %.3f ms, parse %.3f ms, patch %.3f ms", ms(loadTime), ms(parseBest), ms(patchBest));
+        if(options->runs > 1)
+        {
+            fprintf(out, " (best of %d, mean parse %.3f ms, patch %.3f ms)",
+                    options->runs, ms(parseTotal / options->runs), ms(patchTotal / options->runs));
+        }
+        fprintf(out, "\n");
+    }
+
+    free(log);
+    free(patched);
+    return status;
+}
+
+static UInt8* read_kernel(const char* path, size_t* length)
+{
+    struct stat st;
+    UInt8* data = NULL;
+    size_t done = 0;
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0) return NULL;
+
+    if(fstat(fd, &st) == 0 && st.st_size > 0 && (data = malloc(st.st_size)))
+    {
+        while(done < (size_t)st.st_size)
+        {
+            ssize_t got = read(fd, data + done, st.st_size - done);
+            if(got <= 0) break;
+            done += got;
+        }
+
+        if(done != (size_t)st.st_size)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    close(fd);
+    *length = done;
+    return data;
+}
+
+/** Patch every x86 image in a kernel file, thin or universal. Returns the worst status. **/
+static int check_kernel(FILE* out, const char* path, const kpatch_options_t* options)
+{
+    uint64_t start = kpatch_now();
+    size_t length;
+    UInt8* data = read_kernel(path, &length);
+    uint64_t loadTime = kpatch_now() - start;
+    int status = KPATCH_PATCHED;
+
+    if(!data)
+    {
+        fprintf(out, options->tabular ? "%s\t-\tunreadable\n" : "%s: %s\n", path, strerror(errno));
+        return KPATCH_FAILED;
+    }
+
+    if(length >= sizeof(struct fat_header) && __builtin_bswap32(((struct fat_header*)data)->magic) == FAT_MAGIC)
+    {
+        uint32_t count = __builtin_bswap32(((struct fat_header*)data)->nfat_arch);
+        struct fat_arch* archs = (struct fat_arch*)(data + sizeof(struct fat_header));
+        bool found = false;
+        uint32_t i;
+
+        for(i = 0; i < count && (UInt8*)&archs[i + 1] <= data + length; i++)
+        {
+            int32_t cputype = __builtin_bswap32(archs[i].cputype);
+            uint32_t offset = __builtin_bswap32(archs[i].offset);
+            uint32_t size = __builtin_bswap32(archs[i].size);
+            int result;
+
+            if(cputype != CPU_TYPE_X86 && cputype != CPU_TYPE_X86_64) continue;
+            if(offset > length || size > length - offset) continue;
+
+            found = true;
+            result = patch_image(out, path, data + offset, size, loadTime, options);
+            if(result > status) status = result;
+        }
+
+        if(!found)
+        {
+            fprintf(out, options->tabular ? "%s\t-\tunsupported\n" : "%s: no x86 slice\n", path);
+            status = KPATCH_FAILED;
+        }
+    }
+    else
+    {
+        status = patch_image(out, path, data, length, loadTime, options);
+    }
+
+    free(data);
+    return status;
+}
+
+static void add_path(path_list_t* list, const char* path)
+{
+    if(list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->paths = realloc(list->paths, list->capacity * sizeof(char*));
+        if(!list->paths)
+        {
+            perror("kpatch");
+            exit(KPATCH_FAILED);
+        }
+    }
+
+    list->paths[list->count++] = strdup(path);
+}
+
+static int skip_hidden(const struct dirent* entry)
+{
+    return entry->d_name[0] != '.';
+}
+
+/** Directories are expanded to the files they contain, one level deep, in name order. **/
+static void expand_path(path_list_t* list, const char* path)
+{
+    struct dirent** entries;
+    struct stat st;
+    int count, i;
+
+    if(stat(path, &st) || !S_ISDIR(st.st_mode))
+    {
+        add_path(list, path);
+        return;
+    }
+
+    count = scandir(path, &entries, skip_hidden, alphasort);
+    for(i = 0; i < count; i++)
+    {
+        char child[PATH_MAX];
+        snprintf(child, sizeof(child), "%s/%s", path, entries[i]->d_name);
+        if(stat(child, &st) == 0 && S_ISREG(st.st_mode)) add_path(list, child);
+        free(entries[i]);
+    }
+    if(count >= 0) free(entries);
+}
+
+/** Child process: patch one kernel and write its whole report at once, so parallel reports don't interleave. **/
+static int run_child(const char* path, const kpatch_options_t* options)
+{
+    char* report = NULL;
+    size_t length = 0, done = 0;
+    FILE* out = open_memstream(&report, &length);
+    int status;
+
+    if(!out) return KPATCH_FAILED;
+
+    status = check_kernel(out, path, options);
+    fclose(out);
+
+    while(done < length)
+    {
+        ssize_t wrote = write(STDOUT_FILENO, report + done, length - done);
+        if(wrote <= 0) break;
+        done += wrote;
+    }
+
+    free(report);
+    return status;
+}
+
+static void tally(int waitStatus, size_t counts[3])
+{
+    int status = WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus) : KPATCH_FAILED;
+    counts[status <= KPATCH_FAILED ? status : KPATCH_FAILED]++;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: kpatch [-j jobs] [-r runs] [-t] kernel|directory ...\n"
+            "  -j jobs  kernels patched in parallel, defaults to the number of cores\n"
+            "  -r runs  patch each kernel this many times, reporting the best time\n"
+            "  -t       one tab separated line per kernel: path, arch, status, regions, bytes, load/parse/patch ms\n");
+    exit(KPATCH_FAILED);
+}
+
+int main(int argc, char** argv)
+{
+    kpatch_options_t options = { 1, false };
+    path_list_t list = { NULL, 0, 0 };
+    size_t counts[3] = { 0, 0, 0 };
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    long running = 0;
+    size_t i;
+    int opt;
+
+    while((opt = getopt(argc, argv, "j:r:t")) != -1)
+    {
+        switch(opt)
+        {
+            case 'j': jobs = strtol(optarg, NULL, 10); break;
+            case 'r': options.runs = (int)strtol(optarg, NULL, 10); break;
+            case 't': options.tabular = true; break;
+            default:  usage();
+        }
+    }
+
+    if(optind >= argc || jobs < 1 || options.runs < 1) usage();
+
+    for(; optind < argc; optind++) expand_path(&list, argv[optind]);
+
+    fflush(stdout);
+
+    for(i = 0; i < list.count; i++)
+    {
+        int waitStatus;
+        pid_t pid;
+
+        if(running >= jobs && wait(&waitStatus) > 0)
+        {
+            tally(waitStatus, counts);
+            running--;
+        }
+
+        pid = fork();
+        if(pid == 0) _exit(run_child(list.paths[i], &options));
+
+        if(pid < 0)
+        {
+            // Out of processes, patch this one here instead.
+            counts[check_kernel(stdout, list.paths[i], &options)]++;
+            fflush(stdout);
+            continue;
+        }
+
+        running++;
+    }
+
+    while(running > 0)
+    {
+        int waitStatus;
+        if(wait(&waitStatus) <= 0) break;
+        tally(waitStatus, counts);
+        running--;
+    }
+
+    if(!options.tabular && list.count > 1)
+    {
+        printf("%zu kernels: %zu patched, %zu not patched, %zu failed\n",
+               list.count, counts[KPATCH_PATCHED], counts[KPATCH_UNPATCHED], counts[KPATCH_FAILED]);
+    }
+
+    for(i = 0; i < list.count; i++) free(list.paths[i]);
+    free(list.paths);
+
+    if(counts[KPATCH_FAILED]) return KPATCH_FAILED;
+    return counts[KPATCH_UNPATCHED] ? KPATCH_UNPATCHED : KPATCH_PATCHED;
+}
@@ -0,0 +1,27 @@
+/*
+ *  kpatch.h
+ *  kpatch
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __KPATCH_H
+#define __KPATCH_H
+
+#include "libsaio.h"
+
+extern FILE*    gReport;            /** verbose() output, the current kernel's report **/
+extern size_t   gMachLength;        /** Bytes available at the binary handed to parse_mach **/
+extern uint64_t gParseTime;         /** ns spent in parse_mach, symbol capture included **/
+extern size_t   gSymbolCount;
+extern size_t   gSectionCount;
+
+/** Monotonic clock, in ns **/
+uint64_t        kpatch_now(void);
+
+#endif /* !__KPATCH_H */
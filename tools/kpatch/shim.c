@@ -0,0 +1,201 @@
+/*
+ *  shim.c
+ *  kpatch
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "kpatch.h"
+#include <stdarg.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+#include "modules.h"
+
+FILE*       gReport;
+size_t      gMachLength;
+uint64_t    gParseTime;
+size_t      gSymbolCount;
+size_t      gSectionCount;
+
+uint64_t kpatch_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+int verbose(const char* format, ...)
+{
+    va_list args;
+    int written;
+
+    va_start(args, format);
+    written = vfprintf(gReport ? gReport : stdout, format, args);
+    va_end(args);
+
+    return written;
+}
+
+int file_size(int fdesc)
+{
+    struct stat st;
+    return fstat(fdesc, &st) ? 0 : (int)st.st_size;
+}
+
+static bool in_range(size_t offset, size_t length)
+{
+    return offset <= gMachLength && length <= gMachLength - offset;
+}
+
+static void report_sections(char* binary, char* new_base, struct load_command* cmd, bool is64,
+                            void (*section_handler)(char*, char*, char*, char*, void*, UInt64, UInt64))
+{
+    char segname[17], sectname[17];
+    uint32_t nsects, i;
+    char* sect;
+
+    if(is64)
+    {
+        struct segment_command_64* segment = (struct segment_command_64*)cmd;
+        nsects = segment->nsects;
+        sect = (char*)(segment + 1);
+        if(cmd->cmdsize < sizeof(*segment) || (cmd->cmdsize - sizeof(*segment)) / sizeof(struct section_64) < nsects) return;
+    }
+    else
+    {
+        struct segment_command* segment = (struct segment_command*)cmd;
+        nsects = segment->nsects;
+        sect = (char*)(segment + 1);
+        if(cmd->cmdsize < sizeof(*segment) || (cmd->cmdsize - sizeof(*segment)) / sizeof(struct section) < nsects) return;
+    }
+
+    segname[16] = sectname[16] = 0;
+
+    for(i = 0; i < nsects; i++)
+    {
+        void* section = sect;
+        UInt64 offset, address;
+
+        if(is64)
+        {
+            struct section_64* sect64 = section;
+            memcpy(sectname, sect64->sectname, 16);
+            memcpy(segname, sect64->segname, 16);
+            offset = sect64->offset;
+            address = sect64->addr;
+            sect += sizeof(*sect64);
+        }
+        else
+        {
+            struct section* sect32 = section;
+            memcpy(sectname, sect32->sectname, 16);
+            memcpy(segname, sect32->segname, 16);
+            offset = sect32->offset;
+            address = sect32->addr;
+            sect += sizeof(*sect32);
+        }
+
+        gSectionCount++;
+        if(section_handler) section_handler(binary, new_base, sectname, segname, section, offset, address);
+    }
+}
+
+static void report_symbols(char* binary, struct symtab_command* symtab, bool is64,
+                           long long (*symbol_handler)(char*, long long, char))
+{
+    size_t entrySize = is64 ? sizeof(struct nlist_64) : sizeof(struct nlist);
+    char* strings = binary + symtab->stroff;
+    uint32_t i;
+
+    if(!in_range(symtab->symoff, (size_t)symtab->nsyms * entrySize) || !in_range(symtab->stroff, symtab->strsize)) return;
+
+    for(i = 0; i < symtab->nsyms; i++)
+    {
+        char* entry = binary + symtab->symoff + i * entrySize;
+        uint32_t strx;
+        uint8_t type;
+        uint64_t value;
+
+        if(is64)
+        {
+            struct nlist_64* symbol = (struct nlist_64*)entry;
+            strx = symbol->n_un.n_strx;
+            type = symbol->n_type;
+            value = symbol->n_value;
+        }
+        else
+        {
+            struct nlist* symbol = (struct nlist*)entry;
+            strx = symbol->n_un.n_strx;
+            type = symbol->n_type;
+            value = symbol->n_value;
+        }
+
+        // Defined symbols only, with a name that ends inside of the string table.
+        if((type & N_STAB) || (type & N_TYPE) != N_SECT) continue;
+        if(strx >= symtab->strsize || !memchr(strings + strx, 0, symtab->strsize - strx)) continue;
+
+        gSymbolCount++;
+        // Like Chameleon, addresses are reported relative to the binary's location in memory.
+        if(symbol_handler) symbol_handler(strings + strx, (long long)(uintptr_t)binary + (long long)value, is64);
+    }
+}
+
+/**
+ ** Walk the load commands, reporting every section and defined symbol. Unlike Chameleon's version nothing
+ ** is loaded or bound, which is all the kernel patcher needs. The binary's length comes from gMachLength.
+ **/
+void* parse_mach(void* binary, void* new_base,
+                 int (*dylib_loader)(char*),
+                 long long (*symbol_handler)(char*, long long, char),
+                 void (*section_handler)(char* base, char* new_base, char* section, char* segment, void* cmd, UInt64 offset, UInt64 address))
+{
+    uint64_t start = kpatch_now();
+    char* base = binary;
+    uint32_t magic, ncmds, i;
+    size_t offset;
+    bool is64;
+
+    if(gMachLength < sizeof(struct mach_header)) return NULL;
+
+    magic = ((struct mach_header*)base)->magic;
+    if(magic != MH_MAGIC && magic != MH_MAGIC_64) return NULL;
+
+    is64 = (magic == MH_MAGIC_64);
+    ncmds = ((struct mach_header*)base)->ncmds;
+    offset = is64 ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+
+    for(i = 0; i < ncmds; i++)
+    {
+        struct load_command* cmd = (struct load_command*)(base + offset);
+
+        if(!in_range(offset, sizeof(*cmd)) || cmd->cmdsize < sizeof(*cmd) || !in_range(offset, cmd->cmdsize)) break;
+
+        switch(cmd->cmd)
+        {
+            case LC_SEGMENT:
+            case LC_SEGMENT_64:
+                if((cmd->cmd == LC_SEGMENT_64) == is64) report_sections(base, new_base, cmd, is64, section_handler);
+                break;
+
+            case LC_SYMTAB:
+                if(cmd->cmdsize >= sizeof(struct symtab_command)) report_symbols(base, (struct symtab_command*)cmd, is64, symbol_handler);
+                break;
+
+            default:
+                break;
+        }
+
+        offset += cmd->cmdsize;
+    }
+
+    gParseTime += kpatch_now() - start;
+    return NULL;
+}
@@ -0,0 +1,280 @@
+/*
+ *  nvcheck.c
+ *  nvcheck
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+/**
+ ** Validates archived nvram plists against the format FileNVRAM.kext writes and the module reads, and reports
+ ** statistics over the whole corpus. Files are memory mapped and spread over a work stealing thread pool.
+ **/
+
+#include "nvcheck.h"
+#include "base64.h"
+#include <errno.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct
+{
+    char**  paths;
+    size_t  count;
+    size_t  capacity;
+} path_list_t;
+
+typedef struct
+{
+    nvcheck_stats_t     stats;
+    nvcheck_scratch_t   scratch;
+    nvcheck_report_t    report;
+} thread_state_t;
+
+typedef struct
+{
+    path_list_t*        list;
+    thread_state_t*     threads;
+    pthread_mutex_t     outputLock;
+    bool                quiet;
+    bool                verbose;
+} run_t;
+
+static path_list_t gList;
+
+static uint64_t now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void add_path(path_list_t* list, const char* path)
+{
+    if(list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->paths = realloc(list->paths, list->capacity * sizeof(char*));
+        if(!list->paths)
+        {
+            perror("nvcheck");
+            exit(2);
+        }
+    }
+
+    list->paths[list->count++] = strdup(path);
+}
+
+static int add_plist(const char* path, const struct stat* st, int type, struct FTW* ftw)
+{
+    size_t length = strlen(path);
+    if(type == FTW_F && length > 6 && !strcmp(path + length - 6, ".plist")) add_path(&gList, path);
+    return 0;
+}
+
+static void check_path(void* context, int thread, size_t item)
+{
+    run_t* run = context;
+    thread_state_t* state = &run->threads[thread];
+    const char* path = run->list->paths[item];
+    const char* data = "";
+    void* mapped = NULL;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0 || fstat(fd, &st))
+    {
+        int error = errno;
+        if(fd >= 0) close(fd);
+
+        state->stats.files++;
+        state->stats.failed++;
+        pthread_mutex_lock(&run->outputLock);
+        printf("%s: %s\n", path, strerror(error));
+        pthread_mutex_unlock(&run->outputLock);
+        return;
+    }
+
+    if(st.st_size > 0)
+    {
+        mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped == MAP_FAILED)
+        {
+            int error = errno;
+            close(fd);
+
+            state->stats.files++;
+            state->stats.failed++;
+            pthread_mutex_lock(&run->outputLock);
+            printf("%s: %s\n", path, strerror(error));
+            pthread_mutex_unlock(&run->outputLock);
+            return;
+        }
+
+        madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+        data = mapped;
+    }
+    close(fd);
+
+    nvcheck_file(data, st.st_size, item, &state->stats, &state->report, &state->scratch);
+
+    if(mapped) munmap(mapped, st.st_size);
+
+    if(!run->quiet && (run->verbose || state->report.errors || state->report.warnings))
+    {
+        pthread_mutex_lock(&run->outputLock);
+        printf("%s: %s, %d errors, %d warnings\n%s", path,
+               state->report.errors ? "invalid" : "ok", state->report.errors, state->report.warnings, state->report.text);
+        pthread_mutex_unlock(&run->outputLock);
+    }
+}
+
+static int compare_guids(const void* a, const void* b)
+{
+    const nvcheck_guid_t* first = *(const nvcheck_guid_t* const*)a;
+    const nvcheck_guid_t* second = *(const nvcheck_guid_t* const*)b;
+
+    if(first->bytes != second->bytes) return first->bytes < second->bytes ? 1 : -1;
+    return strcmp(first->guid, second->guid);
+}
+
+static void print_summary(const nvcheck_stats_t* stats, double seconds, int topGuids)
+{
+    const nvcheck_guid_t** guids;
+    uint32_t i, count = 0;
+    int bucket, last = 0;
+
+    printf("%llu files, %.1f MB in %.3f s: %.0f files/s, %.1f MB/s\n",
+           (unsigned long long)stats->files, stats->bytes / 1048576.0, seconds,
+           seconds > 0 ? stats->files / seconds : 0.0, seconds > 0 ? stats->bytes / 1048576.0 / seconds : 0.0);
+    printf("  %llu valid, %llu with warnings, %llu with errors\n",
+           (unsigned long long)stats->valid, (unsigned long long)stats->warned, (unsigned long long)stats->failed);
+    printf("  %llu values (%.1f per file), %llu bytes, %llu under %s\n",
+           (unsigned long long)stats->keys, stats->files ? (double)stats->keys / stats->files : 0.0,
+           (unsigned long long)stats->valueBytes, (unsigned long long)stats->missKeys, NVRAM_MISS_KEY);
+
+    for(bucket = 0; bucket < NVCHECK_SIZE_BUCKETS; bucket++) if(stats->sizes[bucket]) last = bucket;
+
+    printf("  value sizes, bytes:\n");
+    for(bucket = 0; bucket <= last; bucket++)
+    {
+        char range[48];
+
+        if(bucket == 0)                             snprintf(range, sizeof(range), "0");
+        else if(bucket == 1)                        snprintf(range, sizeof(range), "1");
+        else if(bucket == NVCHECK_SIZE_BUCKETS - 1) snprintf(range, sizeof(range), "%llu+", 1ULL << (bucket - 1));
+        else                                        snprintf(range, sizeof(range), "%llu-%llu", 1ULL << (bucket - 1), (1ULL << bucket) - 1);
+
+        printf("    %-16s %llu\n", range, (unsigned long long)stats->sizes[bucket]);
+    }
+
+    guids = malloc((stats->guids.count + 1) * sizeof(*guids));
+    if(!guids) return;
+
+    for(i = 0; i < stats->guids.capacity; i++)
+    {
+        if(stats->guids.entries[i].guid[0]) guids[count++] = &stats->guids.entries[i];
+    }
+    qsort(guids, count, sizeof(*guids), compare_guids);
+
+    printf("  GUIDs by bytes (%u total, %s = no GUID):\n", count, NVCHECK_NO_GUID);
+    printf("    %-38s %10s %10s %12s\n", "GUID", "files", "values", "bytes");
+    for(i = 0; i < count && (topGuids < 0 || i < (uint32_t)topGuids); i++)
+    {
+        printf("    %-38s %10llu %10llu %12llu\n", guids[i]->guid,
+               (unsigned long long)guids[i]->files, (unsigned long long)guids[i]->keys, (unsigned long long)guids[i]->bytes);
+    }
+
+    free(guids);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: nvcheck [-j threads] [-g count] [-q | -v] file|directory ...\n"
+            "  -j threads  defaults to the number of cores\n"
+            "  -g count    GUIDs listed in the summary, -1 for all, defaults to 20\n"
+            "  -q          summary only\n"
+            "  -v          report every file, not just those with problems\n"
+            "Directories are searched recursively for *.plist files.\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    run_t run;
+    nvcheck_stats_t total;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int topGuids = 20;
+    uint64_t start;
+    double seconds;
+    size_t i;
+    int opt;
+
+    bzero(&run, sizeof(run));
+    bzero(&total, sizeof(total));
+
+    while((opt = getopt(argc, argv, "j:g:qv")) != -1)
+    {
+        switch(opt)
+        {
+            case 'j': threads = strtol(optarg, NULL, 10); break;
+            case 'g': topGuids = (int)strtol(optarg, NULL, 10); break;
+            case 'q': run.quiet = true; break;
+            case 'v': run.verbose = true; break;
+            default:  usage();
+        }
+    }
+
+    if(optind >= argc || threads < 1) usage();
+
+    for(; optind < argc; optind++)
+    {
+        struct stat st;
+        if(!stat(argv[optind], &st) && S_ISDIR(st.st_mode)) nftw(argv[optind], add_plist, 64, FTW_PHYS);
+        else add_path(&gList, argv[optind]);
+    }
+
+    if((size_t)threads > gList.count && gList.count) threads = gList.count;
+
+    run.list = &gList;
+    run.threads = calloc(threads, sizeof(thread_state_t));
+    if(!run.threads)
+    {
+        perror("nvcheck");
+        return 2;
+    }
+    pthread_mutex_init(&run.outputLock, NULL);
+
+    // base64_decode builds its table on first use, which is fine in the single threaded booter but not here.
+    uint8_t warmup[3];
+    base64_decode("AAAA", 4, warmup);
+
+    start = now();
+    nvcheck_pool_run((int)threads, gList.count, check_path, &run);
+    seconds = (now() - start) / 1e9;
+
+    for(i = 0; i < (size_t)threads; i++)
+    {
+        nvcheck_stats_merge(&total, &run.threads[i].stats);
+        nvcheck_stats_free(&run.threads[i].stats);
+        free(run.threads[i].scratch.decoded);
+    }
+
+    print_summary(&total, seconds, topGuids);
+
+    nvcheck_stats_free(&total);
+    pthread_mutex_destroy(&run.outputLock);
+    free(run.threads);
+    for(i = 0; i < gList.count; i++) free(gList.paths[i]);
+    free(gList.paths);
+
+    return total.failed ? 1 : 0;
+}
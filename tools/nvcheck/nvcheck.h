@@ -0,0 +1,92 @@
+/*
+ *  nvcheck.h
+ *  nvcheck
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#ifndef __NVCHECK_H
+#define __NVCHECK_H
+
+#include "libsaio.h"
+#include <pthread.h>
+
+/** On-disk format, as written by FileNVRAM::doSync. These must match kext/FileNVRAM/FileNVRAM.h. **/
+#define NVRAM_FILE_HEADER		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" \
+                                "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"\
+                                "\t<plist version=\"1.0\">\n<dict>\n<key>NVRAM</key>\n"
+#define NVRAM_FILE_FOOTER       "</dict></plist>\n"
+#define NVRAM_KEY_BUFFER_SIZE   512
+#define NVRAM_MISS_KEY			"NVRAM_MISS"
+#define NVRAM_SEPERATOR         ":"
+
+#define NVCHECK_SIZE_BUCKETS    24      /* bucket 0 is empty values, bucket n holds [2^(n-1), 2^n) bytes */
+#define NVCHECK_REPORT_SIZE     2048    /* messages kept per file, the rest are counted but dropped */
+#define NVCHECK_NO_GUID         "-"     /* values stored in the NVRAM dictionary itself */
+
+typedef struct
+{
+    char        guid[40];
+    uint64_t    keys;
+    uint64_t    bytes;
+    uint64_t    files;
+    uint64_t    lastFile;       /* file number + 1 of the last file counted in files */
+} nvcheck_guid_t;
+
+typedef struct
+{
+    nvcheck_guid_t* entries;
+    uint32_t        capacity;   /* power of two */
+    uint32_t        count;
+} nvcheck_guid_table_t;
+
+typedef struct
+{
+    uint64_t                files;
+    uint64_t                bytes;
+    uint64_t                valid;      /* no errors or warnings */
+    uint64_t                warned;     /* warnings only */
+    uint64_t                failed;     /* at least one error */
+    uint64_t                keys;
+    uint64_t                missKeys;   /* values under NVRAM_MISS */
+    uint64_t                valueBytes;
+    uint64_t                sizes[NVCHECK_SIZE_BUCKETS];
+    nvcheck_guid_table_t    guids;
+} nvcheck_stats_t;
+
+typedef struct
+{
+    int     errors;
+    int     warnings;
+    size_t  used;
+    char    text[NVCHECK_REPORT_SIZE];
+} nvcheck_report_t;
+
+/** Per thread scratch memory, reused from file to file **/
+typedef struct
+{
+    uint8_t*    decoded;
+    size_t      capacity;
+} nvcheck_scratch_t;
+
+/** Parse and validate one nvram file, adding it to stats. fileNumber is unique per file, counting from 0. **/
+void    nvcheck_file(const char* data, size_t length, uint64_t fileNumber, nvcheck_stats_t* stats,
+                     nvcheck_report_t* report, nvcheck_scratch_t* scratch);
+
+void    nvcheck_stats_merge(nvcheck_stats_t* into, const nvcheck_stats_t* from);
+void    nvcheck_stats_free(nvcheck_stats_t* stats);
+
+/**
+ ** Work stealing pool: items 0..count-1 are split evenly between threads, each takes its own from the back and
+ ** an idle thread steals half of the remaining items of another from the front.
+ **/
+typedef void (*nvcheck_work_t)(void* context, int thread, size_t item);
+
+void    nvcheck_pool_run(int threads, size_t count, nvcheck_work_t work, void* context);
+
+#endif /* !__NVCHECK_H */
@@ -0,0 +1,150 @@
+/*
+ *  pool.c
+ *  nvcheck
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "nvcheck.h"
+
+/** The items are known up front, so each thread's deque is just the range [head, tail) **/
+typedef struct
+{
+    pthread_mutex_t lock;
+    size_t          head;
+    size_t          tail;
+} pool_deque_t;
+
+typedef struct
+{
+    pool_deque_t*   deques;
+    int             threads;
+    nvcheck_work_t  work;
+    void*           context;
+} pool_t;
+
+typedef struct
+{
+    pool_t*         pool;
+    int             thread;
+} pool_worker_t;
+
+static bool pop_own(pool_deque_t* deque, size_t* item)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if(deque->head < deque->tail)
+    {
+        *item = --deque->tail;
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+/** Move the front half of a victim's remaining items to thief, false if every other deque is empty **/
+static bool steal(pool_t* pool, int thief)
+{
+    int i;
+
+    for(i = 1; i < pool->threads; i++)
+    {
+        pool_deque_t* victim = &pool->deques[(thief + i) % pool->threads];
+        size_t head = 0, tail = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if(victim->head < victim->tail)
+        {
+            size_t half = (victim->tail - victim->head + 1) / 2;
+            head = victim->head;
+            tail = victim->head = head + half;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if(head < tail)
+        {
+            pool_deque_t* own = &pool->deques[thief];
+            pthread_mutex_lock(&own->lock);
+            own->head = head;
+            own->tail = tail;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void* pool_worker(void* argument)
+{
+    pool_worker_t* worker = argument;
+    pool_t* pool = worker->pool;
+    size_t item;
+
+    for(;;)
+    {
+        while(pop_own(&pool->deques[worker->thread], &item)) pool->work(pool->context, worker->thread, item);
+
+        // Items are never added, so once nothing is left to steal the work is done.
+        if(!steal(pool, worker->thread)) break;
+    }
+
+    return NULL;
+}
+
+void nvcheck_pool_run(int threads, size_t count, nvcheck_work_t work, void* context)
+{
+    pool_t pool = { NULL, threads, work, context };
+    pool_worker_t* workers;
+    pthread_t* ids;
+    bool* started;
+    int i;
+
+    if(threads < 1) threads = pool.threads = 1;
+
+    pool.deques = calloc(threads, sizeof(pool_deque_t));
+    workers = calloc(threads, sizeof(pool_worker_t));
+    ids = calloc(threads, sizeof(pthread_t));
+    started = calloc(threads, sizeof(bool));
+    if(!pool.deques || !workers || !ids || !started)
+    {
+        perror("nvcheck");
+        exit(2);
+    }
+
+    for(i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].head = count * i / threads;
+        pool.deques[i].tail = count * (i + 1) / threads;
+        workers[i].pool = &pool;
+        workers[i].thread = i;
+    }
+
+    // The calling thread works too, as thread 0.
+    for(i = 1; i < threads; i++)
+    {
+        // If the thread can't be started its items get stolen by the others.
+        started[i] = !pthread_create(&ids[i], NULL, pool_worker, &workers[i]);
+    }
+
+    pool_worker(&workers[0]);
+
+    for(i = 1; i < threads; i++)
+    {
+        if(started[i]) pthread_join(ids[i], NULL);
+    }
+
+    for(i = 0; i < threads; i++) pthread_mutex_destroy(&pool.deques[i].lock);
+    free(started);
+    free(ids);
+    free(workers);
+    free(pool.deques);
+}
@@ -0,0 +1,391 @@
+/*
+ *  validate.c
+ *  nvcheck
+ *
+ *  Copyright (c) 2013-2017 xZenue LLC. All rights reserved.
+ *
+ *
+ * This work is licensed under the
+ *  Creative Commons Attribution-NonCommercial 3.0 Unported License.
+ *  To view a copy of this license, visit http://creativecommons.org/licenses/by-nc/3.0/.
+ */
+
+#include "nvcheck.h"
+#include <stdarg.h>
+#include "plist_stream.h"
+#include "base64.h"
+#include "hash.h"
+
+#define NVCHECK_MAX_DEPTH       16
+
+typedef struct
+{
+    nvcheck_stats_t*    stats;
+    nvcheck_report_t*   report;
+    nvcheck_scratch_t*  scratch;
+    uint64_t            fileNumber;
+    plist_stream_t      stream;
+    bool                miss;           /* inside of NVRAM_MISS */
+    char                path[NVRAM_KEY_BUFFER_SIZE];
+} nvcheck_walk_t;
+
+static void report(nvcheck_report_t* report, bool error, const char* format, ...)
+{
+    va_list args;
+    int written;
+
+    if(error) report->errors++;
+    else report->warnings++;
+
+    if(report->used >= sizeof(report->text)) return;
+
+    written = snprintf(report->text + report->used, sizeof(report->text) - report->used, "    %s: ", error ? "error" : "warning");
+    if(written > 0) report->used += written;
+    if(report->used >= sizeof(report->text)) return;
+
+    va_start(args, format);
+    written = vsnprintf(report->text + report->used, sizeof(report->text) - report->used, format, args);
+    va_end(args);
+    if(written > 0) report->used += written;
+
+    if(report->used + 1 < sizeof(report->text))
+    {
+        report->text[report->used++] = '\n';
+        report->text[report->used] = 0;
+    }
+    else
+    {
+        report->used = sizeof(report->text);
+    }
+}
+
+static bool is_guid(const plist_token_t* key)
+{
+    int i;
+
+    if(key->length != 36) return false;
+
+    for(i = 0; i < 36; i++)
+    {
+        char c = key->text[i];
+        if(i == 8 || i == 13 || i == 18 || i == 23)
+        {
+            if(c != '-') return false;
+        }
+        else if(!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static nvcheck_guid_t* find_guid(nvcheck_guid_table_t* table, const char* guid)
+{
+    uint32_t hash = fnv1a(guid);
+    uint32_t i;
+
+    if(table->count * 2 >= table->capacity)
+    {
+        nvcheck_guid_table_t grown = { NULL, table->capacity ? table->capacity * 2 : 64, 0 };
+
+        grown.entries = calloc(grown.capacity, sizeof(nvcheck_guid_t));
+        if(!grown.entries) return NULL;
+
+        for(i = 0; i < table->capacity; i++)
+        {
+            if(!table->entries[i].guid[0]) continue;
+            *find_guid(&grown, table->entries[i].guid) = table->entries[i];
+            grown.count++;
+        }
+
+        free(table->entries);
+        *table = grown;
+    }
+
+    for(i = hash & (table->capacity - 1); table->entries[i].guid[0]; i = (i + 1) & (table->capacity - 1))
+    {
+        if(!strcmp(table->entries[i].guid, guid)) return &table->entries[i];
+    }
+
+    // New entries are claimed by the caller filling in guid.
+    return &table->entries[i];
+}
+
+static void count_guid(nvcheck_walk_t* walk, const char* guid, size_t bytes)
+{
+    nvcheck_guid_table_t* table = &walk->stats->guids;
+    nvcheck_guid_t* entry = find_guid(table, guid);
+
+    if(!entry) return;
+
+    if(!entry->guid[0])
+    {
+        strncpy(entry->guid, guid, sizeof(entry->guid) - 1);
+        table->count++;
+    }
+
+    entry->keys++;
+    entry->bytes += bytes;
+    if(entry->lastFile != walk->fileNumber + 1)
+    {
+        entry->lastFile = walk->fileNumber + 1;
+        entry->files++;
+    }
+}
+
+static void count_value(nvcheck_walk_t* walk, const char* guid, size_t bytes)
+{
+    int bucket = bytes ? 64 - __builtin_clzll(bytes) : 0;
+    if(bucket >= NVCHECK_SIZE_BUCKETS) bucket = NVCHECK_SIZE_BUCKETS - 1;
+
+    walk->stats->keys++;
+    walk->stats->valueBytes += bytes;
+    walk->stats->sizes[bucket]++;
+    if(walk->miss) walk->stats->missKeys++;
+
+    count_guid(walk, guid, bytes);
+}
+
+/** Decoded size of a <data> value, warning about characters base64_decode would silently skip **/
+static size_t data_size(nvcheck_walk_t* walk, const plist_token_t* value)
+{
+    size_t needed = (value->length * 3) / 4 + 16;
+    nvcheck_scratch_t* scratch = walk->scratch;
+    int i;
+
+    for(i = 0; i < value->length; i++)
+    {
+        char c = value->text[i];
+        if((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+           c == '+' || c == '/' || c == '=' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            continue;
+        }
+
+        report(walk->report, false, "%s: data has characters outside of base64", walk->path);
+        break;
+    }
+
+    if(scratch->capacity < needed)
+    {
+        uint8_t* grown = realloc(scratch->decoded, needed);
+        if(!grown) return 0;
+        scratch->decoded = grown;
+        scratch->capacity = needed;
+    }
+
+    return plist_decode_data(value, (char*)scratch->decoded);
+}
+
+/**
+ ** Walk a dictionary below NVRAM or NVRAM_MISS, walk->path is the kext's "GUID:key" name built so far.
+ ** Sizes are those of the device tree properties the module would inject. Returns false on malformed input.
+ **/
+static bool walk_dict(nvcheck_walk_t* walk, const char* guid, int depth)
+{
+    size_t pathLength = strlen(walk->path);
+    plist_token_t key, value;
+
+    while(plist_stream_next(&walk->stream, &key) == kPlistTokenKey)
+    {
+        const char* keyGuid = guid;
+        char guidName[40];
+
+        // The kext joins nested keys with ':' into a fixed size buffer.
+        if(pathLength + (pathLength ? 1 : 0) + key.length >= NVRAM_KEY_BUFFER_SIZE)
+        {
+            report(walk->report, true, "%.64s...: name is longer than the kext's %d byte key buffer", walk->path, NVRAM_KEY_BUFFER_SIZE);
+            walk->path[pathLength] = 0;
+            plist_stream_next(&walk->stream, &value);
+            if(!plist_stream_skip(&walk->stream, &value)) return false;
+            continue;
+        }
+
+        snprintf(walk->path + pathLength, sizeof(walk->path) - pathLength, "%s%.*s",
+                 pathLength ? NVRAM_SEPERATOR : "", key.length, key.text);
+
+        plist_stream_next(&walk->stream, &value);
+
+        switch(value.type)
+        {
+            case kPlistTokenData:
+                count_value(walk, guid, data_size(walk, &value));
+                break;
+
+            case kPlistTokenString:
+                count_value(walk, guid, value.length);
+                break;
+
+            case kPlistTokenInteger:
+            case kPlistTokenTrue:
+            case kPlistTokenFalse:
+                count_value(walk, guid, sizeof(int));
+                break;
+
+            case kPlistTokenDict:
+                if(depth == 0)
+                {
+                    // First level dictionaries group a GUID's variables.
+                    if(!is_guid(&key)) report(walk->report, false, "%s: dictionary name isn't a GUID", walk->path);
+                    snprintf(guidName, sizeof(guidName), "%.*s", key.length < 39 ? key.length : 39, key.text);
+                    keyGuid = guidName;
+                }
+                else if(depth + 1 >= NVCHECK_MAX_DEPTH)
+                {
+                    report(walk->report, true, "%s: nested too deeply", walk->path);
+                    return false;
+                }
+
+                if(!walk_dict(walk, keyGuid, depth + 1)) return false;
+                break;
+
+            case kPlistTokenArray:
+            case kPlistTokenOther:
+                report(walk->report, false, "%s: %s values aren't injected by the module", walk->path,
+                       value.type == kPlistTokenArray ? "array" : "date and real");
+                if(!plist_stream_skip(&walk->stream, &value)) return false;
+                break;
+
+            default:
+                walk->path[pathLength] = 0;
+                return false;
+        }
+
+        walk->path[pathLength] = 0;
+    }
+
+    walk->path[pathLength] = 0;
+    return key.type == kPlistTokenDictEnd;
+}
+
+void nvcheck_file(const char* data, size_t length, uint64_t fileNumber, nvcheck_stats_t* stats,
+                  nvcheck_report_t* out, nvcheck_scratch_t* scratch)
+{
+    nvcheck_walk_t walk;
+    plist_token_t key, value;
+    bool nvramFound = false;
+    size_t headerLength = strlen(NVRAM_FILE_HEADER);
+    size_t footerLength = strlen(NVRAM_FILE_FOOTER);
+
+    bzero(out, sizeof(*out));
+
+    walk.stats = stats;
+    walk.report = out;
+    walk.scratch = scratch;
+    walk.fileNumber = fileNumber;
+    walk.miss = false;
+    walk.path[0] = 0;
+
+    stats->files++;
+    stats->bytes += length;
+
+    if(length > INT32_MAX)
+    {
+        report(out, true, "file is too large");
+        stats->failed++;
+        return;
+    }
+
+    // FileNVRAM.kext cuts a fixed size header and footer off before unserializing the rest.
+    if(length < headerLength + footerLength + 1 || memcmp(data, NVRAM_FILE_HEADER, headerLength))
+    {
+        report(out, true, "header isn't the one FileNVRAM.kext writes, the kext can't read this file");
+    }
+    else if(memcmp(data + length - footerLength, NVRAM_FILE_FOOTER, footerLength))
+    {
+        report(out, true, "footer isn't the one FileNVRAM.kext writes, the kext can't read this file");
+    }
+
+    // The same tokenizer the module streams the file with at boot.
+    plist_stream_init(&walk.stream, data, (int)length);
+
+    if(plist_stream_next(&walk.stream, &value) != kPlistTokenDict)
+    {
+        report(out, true, "not a plist dictionary");
+    }
+    else
+    {
+        bool wellFormed = true;
+
+        while(wellFormed && plist_stream_next(&walk.stream, &key) == kPlistTokenKey)
+        {
+            bool nvram = plist_token_equals(&key, "NVRAM");
+            bool miss = plist_token_equals(&key, NVRAM_MISS_KEY);
+
+            plist_stream_next(&walk.stream, &value);
+
+            if((nvram || miss) && value.type == kPlistTokenDict)
+            {
+                if(nvram && nvramFound) report(out, false, "more than one NVRAM dictionary, the module only reads the first");
+                if(nvram) nvramFound = true;
+
+                walk.miss = miss;
+                wellFormed = walk_dict(&walk, NVCHECK_NO_GUID, 0);
+                walk.miss = false;
+            }
+            else
+            {
+                report(out, false, "unknown top level key %.*s", key.length < 64 ? key.length : 64, key.text);
+                wellFormed = plist_stream_skip(&walk.stream, &value);
+            }
+        }
+
+        if(!wellFormed || key.type != kPlistTokenDictEnd)
+        {
+            report(out, true, "malformed plist near byte %ld", (long)(walk.stream.pos - data));
+        }
+        else
+        {
+            if(!nvramFound) report(out, true, "no NVRAM dictionary");
+            if(walk.stream.refs) report(out, false, "IDREF values, the module falls back to the full XML parser");
+        }
+    }
+
+    if(out->errors) stats->failed++;
+    else if(out->warnings) stats->warned++;
+    else stats->valid++;
+}
+
+void nvcheck_stats_merge(nvcheck_stats_t* into, const nvcheck_stats_t* from)
+{
+    uint32_t i;
+
+    into->files         += from->files;
+    into->bytes         += from->bytes;
+    into->valid         += from->valid;
+    into->warned        += from->warned;
+    into->failed        += from->failed;
+    into->keys          += from->keys;
+    into->missKeys      += from->missKeys;
+    into->valueBytes    += from->valueBytes;
+
+    for(i = 0; i < NVCHECK_SIZE_BUCKETS; i++) into->sizes[i] += from->sizes[i];
+
+    // File numbers are unique across threads, so per GUID file counts just add up.
+    for(i = 0; i < from->guids.capacity; i++)
+    {
+        const nvcheck_guid_t* source = &from->guids.entries[i];
+        nvcheck_guid_t* entry;
+
+        if(!source->guid[0] || !(entry = find_guid(&into->guids, source->guid))) continue;
+
+        if(!entry->guid[0])
+        {
+            memcpy(entry->guid, source->guid, sizeof(entry->guid));
+            into->guids.count++;
+        }
+
+        entry->keys += source->keys;
+        entry->bytes += source->bytes;
+        entry->files += source->files;
+    }
+}
+
+void nvcheck_stats_free(nvcheck_stats_t* stats)
+{
+    free(stats->guids.entries);
+    stats->guids.entries = NULL;
+    stats->guids.capacity = stats->guids.count = 0;
+}